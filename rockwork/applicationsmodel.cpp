@@ -2,6 +2,8 @@
 
 #include <QDebug>
 
+#include <algorithm>
+
 
 ApplicationsModel::ApplicationsModel(QObject *parent):
     QAbstractListModel(parent)
@@ -108,6 +110,46 @@ void ApplicationsModel::insert(AppItem *item)
     emit changed();
 }
 
+void ApplicationsModel::replace(AppItem *oldItem, AppItem *item)
+{
+    int row = m_apps.indexOf(oldItem);
+    if (row < 0) {
+        return;
+    }
+    item->setParent(this);
+    m_apps[row] = item;
+    oldItem->deleteLater();
+    emit dataChanged(index(row), index(row));
+    emit changed();
+}
+
+void ApplicationsModel::remove(AppItem *item)
+{
+    int row = m_apps.indexOf(item);
+    if (row < 0) {
+        return;
+    }
+    beginRemoveRows(QModelIndex(), row, row);
+    m_apps.removeAt(row);
+    endRemoveRows();
+    item->deleteLater();
+    emit changed();
+}
+
+void ApplicationsModel::sortByUuid(const QStringList &uuids)
+{
+    emit layoutAboutToBeChanged();
+    QModelIndexList from = persistentIndexList();
+    QList<AppItem*> items = from.isEmpty() ? QList<AppItem*>() : m_apps;
+    std::stable_sort(m_apps.begin(), m_apps.end(), [&uuids](AppItem *a, AppItem *b) {
+        return (uint)uuids.indexOf(a->uuid()) < (uint)uuids.indexOf(b->uuid());
+    });
+    foreach (const QModelIndex &idx, from) {
+        changePersistentIndex(idx, index(m_apps.indexOf(items.at(idx.row()))));
+    }
+    emit layoutChanged();
+}
+
 void ApplicationsModel::insertGroup(const QString &id, const QString &name, const QString &link, const QString &icon)
 {
     m_groupNames[id] = name;
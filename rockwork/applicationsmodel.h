@@ -163,6 +163,11 @@ public:
 
     void clear();
     void insert(AppItem *item);
+    // Swaps the item at the same row, the old one is deleted
+    void replace(AppItem *oldItem, AppItem *item);
+    void remove(AppItem *item);
+    // Sorts the apps along the given uuids, unlisted ones go last
+    void sortByUuid(const QStringList &uuids);
     void insertGroup(const QString &id, const QString &name, const QString &link, const QString &icon = "");
 
     Q_INVOKABLE AppItem* get(int index) const;
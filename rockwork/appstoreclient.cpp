@@ -1,5 +1,6 @@
 #include "appstoreclient.h"
 #include "applicationsmodel.h"
+#include "shareddiskcache.h"
 
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
@@ -21,11 +22,20 @@
     query.addQueryItem("platform", "all");
 */
 
+// Pages younger than this are shown without asking the store again
+static const int STORE_PAGE_TTL = 300;
+// Bytes of raw JSON kept in memory
+static const int STORE_MEMORY_CACHE = 4 * 1024 * 1024;
+static const qint64 STORE_DISK_CACHE = 20 * 1024 * 1024;
+
 AppStoreClient::AppStoreClient(QObject *parent):
     QObject(parent),
     m_nam(new QNetworkAccessManager(this)),
+    m_replies(STORE_MEMORY_CACHE),
     m_model(new ApplicationsModel(this))
 {
+    // Several pages each have their own client, they share the store's disk cache
+    m_nam->setCache(new SharedDiskCache("appstore", STORE_DISK_CACHE, m_nam));
 }
 
 ApplicationsModel *AppStoreClient::model() const
@@ -80,6 +90,7 @@ void AppStoreClient::fetchHome(Type type)
 {
     m_model->clear();
     setBusy(true);
+    int generation = ++m_generation;
 
     QUrlQuery query;
     query.addQueryItem("firmware_version", "3");
@@ -96,14 +107,12 @@ void AppStoreClient::fetchHome(Type type)
     }
     QUrl storeUrl(url);
     storeUrl.setQuery(query);
-    QNetworkRequest request(storeUrl);
 
     qDebug() << "fetching home" << storeUrl.toString();
-    QNetworkReply *reply = m_nam->get(request);
-    connect(reply, &QNetworkReply::finished, [this, reply]() {
-        QByteArray data = reply->readAll();
-        reply->deleteLater();
-
+    fetch(storeUrl, QByteArray(), [this, generation](const QByteArray &data) {
+        if (generation != m_generation) {
+            return;
+        }
         QJsonDocument jsonDoc = QJsonDocument::fromJson(data);
         QVariantMap resultMap = jsonDoc.toVariant().toMap();
 
@@ -161,35 +170,21 @@ void AppStoreClient::fetchHome(Type type)
         }
         setBusy(false);
     });
-
-
 }
 
 void AppStoreClient::fetchLink(const QString &link)
 {
     m_model->clear();
     setBusy(true);
+    int generation = ++m_generation;
 
-    QUrl storeUrl(link);
-    QUrlQuery query(storeUrl);
-    // Navigation buttons are supplied based on actual navigation availability
-    // Limit is preserved in links as long as it differs from default(20).
-    query.removeQueryItem("limit");
-    query.addQueryItem("limit", QString::number(m_limit));
-    if (!query.hasQueryItem("hardware")) {
-        query.addQueryItem("hardware", m_hardwarePlatform);
-        query.addQueryItem("filter_hardware", "true");
-    }
-    storeUrl.setQuery(query);
-    QNetworkRequest request(storeUrl);
-    qDebug() << "fetching link" << request.url();
-
-    QNetworkReply *reply = m_nam->get(request);
-    connect(reply, &QNetworkReply::finished, [this, reply, storeUrl]() {
-        qDebug() << "fetch reply";
-        QByteArray data = reply->readAll();
-        reply->deleteLater();
+    QUrl storeUrl = linkUrl(link);
+    qDebug() << "fetching link" << storeUrl;
 
+    fetch(storeUrl, QByteArray(), [this, generation, storeUrl](const QByteArray &data) {
+        if (generation != m_generation) {
+            return;
+        }
         QJsonDocument jsonDoc = QJsonDocument::fromJson(data);
         QVariantMap resultMap = jsonDoc.toVariant().toMap();
 
@@ -215,10 +210,11 @@ void AppStoreClient::fetchLink(const QString &link)
                 !resultMap.value("links").toMap().value("nextPage").isNull()) {
             QString nextLink = resultMap.value("links").toMap().value("nextPage").toString();
             m_model->addLink(nextLink, gettext("Next"));
+            // Paging forward is the likely next step
+            prefetch(linkUrl(nextLink));
         }
         setBusy(false);
     });
-
 }
 
 void AppStoreClient::fetchAppDetails(const QString &appId)
@@ -230,18 +226,15 @@ void AppStoreClient::fetchAppDetails(const QString &appId)
     }
     url.setQuery(query);
 
-    QNetworkRequest request(url);
-    QNetworkReply * reply = m_nam->get(request);
-    connect(reply, &QNetworkReply::finished, [this, reply, appId]() {
-        reply->deleteLater();
+    fetch(url, QByteArray(), [this, appId](const QByteArray &data) {
         AppItem *item = model()->findByStoreId(appId);
         if (!item) {
             qWarning() << "Can't find item with id" << appId;
             return;
         }
-        QJsonDocument jsonDoc = QJsonDocument::fromJson(reply->readAll());
+        QJsonDocument jsonDoc = QJsonDocument::fromJson(data);
         if(jsonDoc.isEmpty()) {
-            qDebug() << "Not a store app" << appId << "or problem with store connection" << reply->errorString();
+            qDebug() << "Not a store app" << appId << "or problem with store connection";
             return;
         } else
             qDebug() << "Attempting to parse for" << appId << item->category() << "cat";
@@ -285,6 +278,7 @@ void AppStoreClient::search(const QString &searchString, Type type, int page)
 {
     m_model->clear();
     setBusy(true);
+    int generation = ++m_generation;
 
     QUrl url("https://7683ow76eq-dsn.algolia.net/1/indexes/rebble-appstore-production/query");
     QUrlQuery query;
@@ -292,29 +286,15 @@ void AppStoreClient::search(const QString &searchString, Type type, int page)
     query.addQueryItem("x-algolia-application-id", "7683OW76EQ");
     url.setQuery(query);
 
-    QString filter = "watchapp";
-    if (type == TypeWatchface) {
-        filter = "watchface";
-    }
-
-    QString pluralFilter = filter + "s";
-    QString params = QString("query=%1&hitsPerPage=30&page=%5&tagFilters=(%2)&analyticsTags=product-variant-time,%3,%4,appstore-search")
-        .arg(searchString).arg(filter).arg(m_hardwarePlatform).arg(pluralFilter).arg(page);
-    QJsonObject json;
-    json.insert("params", params);
-    QJsonDocument doc;
-    doc.setObject(json);
-    QByteArray body = doc.toJson();
-
-    QNetworkRequest request(url);
-    qDebug() << "Search query:" << url << params;
-    QNetworkReply *reply = m_nam->post(request, body);
-    connect(reply, &QNetworkReply::finished, [this, reply]() {
+    qDebug() << "Search query:" << url << searchString << page;
+    fetch(url, searchBody(searchString, type, page), [this, generation, url, searchString, type](const QByteArray &data) {
+        if (generation != m_generation) {
+            return;
+        }
         m_model->clear();
         setBusy(false);
 
-        reply->deleteLater();
-        QJsonDocument jsonDoc = QJsonDocument::fromJson(reply->readAll());
+        QJsonDocument jsonDoc = QJsonDocument::fromJson(data);
 
         QVariantMap resultMap = jsonDoc.toVariant().toMap();
         foreach (const QVariant &entry, resultMap.value("hits").toList()) {
@@ -328,11 +308,88 @@ void AppStoreClient::search(const QString &searchString, Type type, int page)
         }
         if (resultMap.value("page").toInt() < resultMap.value("nbPages").toInt() - 1) {
             m_model->addLink("next", gettext("Next"), resultMap.value("query").toString(), resultMap.value("page").toInt() + 1);
+            prefetch(url, searchBody(searchString, type, resultMap.value("page").toInt() + 1));
         }
         qDebug() << "Found" << m_model->rowCount() << "items";
     });
 }
 
+QByteArray AppStoreClient::searchBody(const QString &searchString, Type type, int page) const
+{
+    QString filter = "watchapp";
+    if (type == TypeWatchface) {
+        filter = "watchface";
+    }
+
+    QString pluralFilter = filter + "s";
+    QString params = QString("query=%1&hitsPerPage=30&page=%5&tagFilters=(%2)&analyticsTags=product-variant-time,%3,%4,appstore-search")
+        .arg(searchString).arg(filter).arg(m_hardwarePlatform).arg(pluralFilter).arg(page);
+    QJsonObject json;
+    json.insert("params", params);
+    QJsonDocument doc;
+    doc.setObject(json);
+    return doc.toJson();
+}
+
+QUrl AppStoreClient::linkUrl(const QString &link) const
+{
+    QUrl storeUrl(link);
+    QUrlQuery query(storeUrl);
+    // Navigation buttons are supplied based on actual navigation availability
+    // Limit is preserved in links as long as it differs from default(20).
+    query.removeQueryItem("limit");
+    query.addQueryItem("limit", QString::number(m_limit));
+    if (!query.hasQueryItem("hardware")) {
+        query.addQueryItem("hardware", m_hardwarePlatform);
+        query.addQueryItem("filter_hardware", "true");
+    }
+    storeUrl.setQuery(query);
+    return storeUrl;
+}
+
+void AppStoreClient::fetch(const QUrl &url, const QByteArray &body, ReplyHandler handler)
+{
+    QString key = url.toString() + QString::fromUtf8(body);
+    CachedReply *cached = m_replies.object(key);
+    if (cached && cached->fetched.secsTo(QDateTime::currentDateTimeUtc()) < STORE_PAGE_TTL) {
+        if (handler) {
+            handler(cached->data);
+        }
+        return;
+    }
+    // Already on its way, most likely prefetched
+    if (m_pending.contains(key)) {
+        if (handler) {
+            m_pending[key].append(handler);
+        }
+        return;
+    }
+    m_pending[key] = QList<ReplyHandler>();
+    if (handler) {
+        m_pending[key].append(handler);
+    }
+
+    QNetworkRequest request(url);
+    QNetworkReply *reply = body.isEmpty() ? m_nam->get(request) : m_nam->post(request, body);
+    connect(reply, &QNetworkReply::finished, this, [this, reply, key]() {
+        reply->deleteLater();
+        QByteArray data = reply->readAll();
+        if (reply->error() == QNetworkReply::NoError) {
+            m_replies.insert(key, new CachedReply{QDateTime::currentDateTimeUtc(), data}, data.size());
+        } else {
+            qWarning() << "Store request failed" << reply->url() << reply->errorString();
+        }
+        foreach (const ReplyHandler &handler, m_pending.take(key)) {
+            handler(data);
+        }
+    });
+}
+
+void AppStoreClient::prefetch(const QUrl &url, const QByteArray &body)
+{
+    fetch(url, body, nullptr);
+}
+
 AppItem* AppStoreClient::parseAppItem(const QVariantMap &map)
 {
     AppItem *item = new AppItem();
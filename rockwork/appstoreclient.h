@@ -2,6 +2,12 @@
 #define APPSTORECLIENT_H
 
 #include <QObject>
+#include <QCache>
+#include <QDateTime>
+#include <QHash>
+#include <QUrl>
+
+#include <functional>
 
 class QNetworkAccessManager;
 class ApplicationsModel;
@@ -59,8 +65,26 @@ private:
     AppItem *parseAppItem(const QVariantMap &map);
     void setBusy(bool busy);
 
+    // Pages are served from memory while fresh, otherwise from the network through
+    // the disk cache, which revalidates. A POST is identified by its body.
+    // A prefetch only warms the cache.
+    typedef std::function<void(const QByteArray &data)> ReplyHandler;
+    void fetch(const QUrl &url, const QByteArray &body, ReplyHandler handler);
+    void prefetch(const QUrl &url, const QByteArray &body = QByteArray());
+    QUrl linkUrl(const QString &link) const;
+    QByteArray searchBody(const QString &searchString, Type type, int page) const;
+
+    struct CachedReply {
+        QDateTime fetched;
+        QByteArray data;
+    };
+
 private:
     QNetworkAccessManager *m_nam;
+    QCache<QString, CachedReply> m_replies;
+    QHash<QString, QList<ReplyHandler> > m_pending;
+    // Bumped on every navigation so a late reply can't overwrite a newer page
+    int m_generation = 0;
     ApplicationsModel *m_model;
     ApplicationsModel *f_model = 0;
     int m_limit = 20;
@@ -0,0 +1,39 @@
+#include "imagecache.h"
+#include "shareddiskcache.h"
+
+#include <QNetworkRequest>
+#include <QStringList>
+
+static const qint64 IMAGE_DISK_CACHE = 50 * 1024 * 1024;
+
+ImageCacheNetworkAccessManager::ImageCacheNetworkAccessManager(QObject *parent):
+    QNetworkAccessManager(parent)
+{
+    // create() is called once per loader thread, they all share the one disk cache
+    setCache(new SharedDiskCache("images", IMAGE_DISK_CACHE, this));
+}
+
+QNetworkReply *ImageCacheNetworkAccessManager::createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData)
+{
+    static const QStringList imageSuffixes({".png", ".jpg", ".jpeg", ".gif", ".webp"});
+    QString path = request.url().path().toLower();
+    bool isImage = false;
+    foreach (const QString &suffix, imageSuffixes) {
+        if (path.endsWith(suffix)) {
+            isImage = true;
+            break;
+        }
+    }
+    // Anything else, like the XMLHttpRequests of the pages, keeps the default revalidation
+    if (op != GetOperation || !isImage) {
+        return QNetworkAccessManager::createRequest(op, request, outgoingData);
+    }
+    QNetworkRequest cachedRequest(request);
+    cachedRequest.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache);
+    return QNetworkAccessManager::createRequest(op, cachedRequest, outgoingData);
+}
+
+QNetworkAccessManager *ImageCacheFactory::create(QObject *parent)
+{
+    return new ImageCacheNetworkAccessManager(parent);
+}
@@ -0,0 +1,25 @@
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <QQmlNetworkAccessManagerFactory>
+#include <QNetworkAccessManager>
+
+// Network access of the QML engine. Store icons, thumbnails and screenshots never
+// change under the same URL, so they are taken from disk without revalidation.
+class ImageCacheNetworkAccessManager : public QNetworkAccessManager
+{
+    Q_OBJECT
+public:
+    explicit ImageCacheNetworkAccessManager(QObject *parent = 0);
+
+protected:
+    QNetworkReply *createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData) override;
+};
+
+class ImageCacheFactory : public QQmlNetworkAccessManagerFactory
+{
+public:
+    QNetworkAccessManager *create(QObject *parent) override;
+};
+
+#endif // IMAGECACHE_H
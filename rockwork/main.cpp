@@ -14,6 +14,7 @@
 #include "applicationsfiltermodel.h"
 #include "appstoreclient.h"
 #include "screenshotmodel.h"
+#include "imagecache.h"
 
 #include <QTimer>
 
@@ -43,7 +44,9 @@ int main(int argc, char *argv[])
     qmlRegisterType<AppStoreClient>("RockPool", 1, 0, "AppStoreClient");
     qmlRegisterType<ScreenshotModel>("RockPool", 1, 0, "ScreenshotModel");
 
+    ImageCacheFactory imageCache;
     QScopedPointer<QQuickView> view(SailfishApp::createView());
+    view->engine()->setNetworkAccessManagerFactory(&imageCache);
     view->rootContext()->setContextProperty("version", QStringLiteral(VERSION));
     view->rootContext()->setContextProperty("locale", locale);
     view->rootContext()->setContextProperty("appFilePath",QCoreApplication::applicationFilePath());
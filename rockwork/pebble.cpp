@@ -4,6 +4,8 @@
 #include "screenshotmodel.h"
 
 #include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusPendingCallWatcher>
 #include <QDebug>
 
 // TODO: Bootstrapping config from
@@ -12,7 +14,8 @@ Pebble::Pebble(const QDBusObjectPath &path, QObject *parent):
     QObject(parent),
     m_path(path)
 {
-    m_iface = new QDBusInterface("org.rockwork", path.path(), "org.rockwork.Pebble", QDBusConnection::sessionBus(), this);
+    // The object path carries the address, no need to ask for it
+    m_address = path.path().section('/', -1).replace('_', ':');
     m_notifications = new NotificationSourceModel(this);
     m_installedApps = new ApplicationsModel(this);
     connect(m_installedApps, &ApplicationsModel::appsSorted, this, &Pebble::appsSorted);
@@ -22,23 +25,24 @@ Pebble::Pebble(const QDBusObjectPath &path, QObject *parent):
 
     QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "Connected", this, SLOT(pebbleConnected()));
     QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "Disconnected", this, SLOT(pebbleDisconnected()));
-    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "InstalledAppsChanged", this, SLOT(refreshApps()));
+    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "AppCatalogChanged", this, SLOT(appCatalogChanged(quint32)));
     QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "OpenURL", this, SIGNAL(openURL(const QString&, const QString&)));
     QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "NotificationFilterChanged", this, SLOT(notificationFilterChanged(const QString &, const QString &, const QString &, const int )));
     QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "ScreenshotAdded", this, SLOT(screenshotAdded(const QString &)));
     QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "ScreenshotRemoved", this, SLOT(screenshotRemoved(const QString &)));
     QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "FirmwareUpgradeAvailableChanged", this, SLOT(refreshFirmwareUpdateInfo()));
-    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "LanguageVersionChanged", this, SIGNAL(languageVersionChanged()));
-    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "UpgradingFirmwareChanged", this, SIGNAL(refreshFirmwareUpdateInfo()));
+    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "LanguageVersionChanged", this, SLOT(onLanguageVersionChanged()));
+    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "UpgradingFirmwareChanged", this, SLOT(refreshFirmwareUpdateInfo()));
     QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "LogsDumped", this, SIGNAL(logsDumped(bool)));
-    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "HealthParamsChanged", this, SIGNAL(healthParamsChanged()));
-    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "ImperialUnitsChanged", this, SIGNAL(imperialUnitsChanged()));
-    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "ProfileWhenConnectedChanged", this, SIGNAL(profileWhenConnectedChanged()));
-    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "ProfileWhenDisconnectedChanged", this, SIGNAL(profileWhenDisconnectedChanged()));
-    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "CalendarSyncEnabledChanged", this, SIGNAL(calendarSyncEnabledChanged()));
+    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "HealthParamsChanged", this, SLOT(onHealthParamsChanged(QVariantMap)));
+    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "ImperialUnitsChanged", this, SLOT(onImperialUnitsChanged(bool)));
+    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "ProfileWhenConnectedChanged", this, SLOT(onProfileWhenConnectedChanged(QString)));
+    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "ProfileWhenDisconnectedChanged", this, SLOT(onProfileWhenDisconnectedChanged(QString)));
+    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "CalendarSyncEnabledChanged", this, SLOT(onCalendarSyncEnabledChanged(bool)));
+    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "WeatherLocationsChanged", this, SLOT(onWeatherLocationsChanged(QVariantList)));
     QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "DevConnectionChanged", this, SLOT(devConStateChanged(bool)));
     QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "DevConnCloudChanged", this, SLOT(devConCloudChanged(bool)));
-    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "oauthTokenChanged", this, SLOT(setOAuthToken(QString)));
+    QDBusConnection::sessionBus().connect("org.rockwork", path.path(), "org.rockwork.Pebble", "oauthTokenChanged", this, SLOT(onOAuthTokenChanged(QString)));
 
     dataChanged();
     refreshApps();
@@ -69,7 +73,7 @@ QString Pebble::name() const
 
 QString Pebble::platformString() const
 {
-    return fetchProperty("PlatformString").toString();
+    return cachedProperty("PlatformString", &Pebble::platformStringChanged).toString();
 }
 
 QString Pebble::hardwarePlatform() const
@@ -89,13 +93,18 @@ QString Pebble::softwareVersion() const
 
 QString Pebble::languageVersion() const
 {
-    return fetchProperty("LanguageVersion").toString();
+    return cachedProperty("LanguageVersion", &Pebble::languageVersionChanged).toString();
+}
+
+void Pebble::onLanguageVersionChanged()
+{
+    refreshProperty("LanguageVersion", &Pebble::languageVersionChanged);
 }
 
 void Pebble::loadLanguagePack(const QString &pblFile)
 {
     qDebug() << "Requesting to load language from" << pblFile;
-    m_iface->call("LoadLanguagePack", pblFile);
+    callAsync("LoadLanguagePack", {pblFile});
 }
 
 int Pebble::model() const
@@ -149,21 +158,99 @@ QString Pebble::candidateVersion() const
     return m_candidateVersion;
 }
 
-QVariantMap Pebble::fetchVarMap(const QString &propertyName, const QStringList *keys) const
+QDBusMessage Pebble::methodCall(const QString &method, const QVariantList &args) const
 {
-    QDBusMessage m = ((keys) ? m_iface->call(propertyName, *keys) : m_iface->call(propertyName));
+    // Plain messages rather than a QDBusInterface, which introspects the daemon synchronously
+    QDBusMessage m = QDBusMessage::createMethodCall("org.rockwork", m_path.path(), "org.rockwork.Pebble", method);
+    m.setArguments(args);
+    return m;
+}
+
+QVariant Pebble::call(const QString &method, const QVariantList &args) const
+{
+    QDBusMessage m = QDBusConnection::sessionBus().call(methodCall(method, args));
     if (m.type() == QDBusMessage::ErrorMessage || m.arguments().count() == 0) {
-        qWarning() << "Could not fetch" << propertyName << m.errorMessage();
-        return QVariantMap();
+        qWarning() << "Could not call" << method << m.errorMessage();
+        return QVariant();
     }
+    return demarshal(m.arguments().first());
+}
 
-    const QDBusArgument &arg = m.arguments().first().value<QDBusArgument>();
+void Pebble::callAsync(const QString &method, const QVariantList &args) const
+{
+    QDBusConnection::sessionBus().asyncCall(methodCall(method, args));
+}
 
-    QVariantMap mapEntryVariant;
-    arg >> mapEntryVariant;
+void Pebble::fetchAsync(const QString &method, std::function<void(const QVariant &)> handler) const
+{
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(methodCall(method, QVariantList())), const_cast<Pebble*>(this));
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [method, handler](QDBusPendingCallWatcher *watcher) {
+        watcher->deleteLater();
+        QDBusMessage m = watcher->reply();
+        if (m.type() == QDBusMessage::ErrorMessage || m.arguments().count() == 0) {
+            qWarning() << "Could not fetch" << method << m.errorMessage();
+            return;
+        }
+        handler(demarshal(m.arguments().first()));
+    });
+}
 
-    qDebug() << "have" << propertyName << mapEntryVariant;
-    return mapEntryVariant;
+QVariant Pebble::cachedProperty(const QString &method, NotifySignal notify) const
+{
+    if (!m_cache.contains(method)) {
+        // Placeholder, so the property is only fetched once
+        m_cache.insert(method, QVariant());
+        refreshProperty(method, notify);
+    }
+    return m_cache.value(method);
+}
+
+void Pebble::refreshProperty(const QString &method, NotifySignal notify) const
+{
+    fetchAsync(method, [this, method, notify](const QVariant &value) {
+        updateProperty(method, value, notify);
+    });
+}
+
+void Pebble::updateProperty(const QString &method, const QVariant &value, NotifySignal notify) const
+{
+    if (m_cache.contains(method) && m_cache.value(method) == value) {
+        return;
+    }
+    m_cache.insert(method, value);
+    emit (const_cast<Pebble*>(this)->*notify)();
+}
+
+QVariant Pebble::demarshal(const QVariant &value)
+{
+    if (value.userType() != qMetaTypeId<QDBusArgument>()) {
+        return value;
+    }
+    const QDBusArgument &arg = value.value<QDBusArgument>();
+    switch (arg.currentType()) {
+    case QDBusArgument::MapType: {
+        QVariantMap map;
+        arg >> map;
+        for (QVariantMap::iterator it = map.begin(); it != map.end(); ++it) {
+            it.value() = demarshal(it.value());
+        }
+        return map;
+    }
+    case QDBusArgument::ArrayType: {
+        QVariantList list;
+        arg.beginArray();
+        while (!arg.atEnd()) {
+            QVariant entry;
+            arg >> entry;
+            list.append(demarshal(entry));
+        }
+        arg.endArray();
+        return list;
+    }
+    default:
+        qWarning() << "Unexpected D-Bus argument" << arg.currentSignature();
+        return QVariant();
+    }
 }
 
 void Pebble::sendVarMap(const QString &property, const QVariantMap &values)
@@ -187,21 +274,22 @@ void Pebble::sendVarMap(const QString &property, const QVariantMap &values)
             vals.insert(key,msgs);
     }
     qDebug() << "Setting Map of StringLists" << vals;
-    m_iface->call(property, vals);
+    callAsync(property, {vals});
 }
 
 QVariantMap Pebble::cannedResponses() const
 {
-    return fetchVarMap("cannedResponses");
+    return cachedProperty("cannedResponses", &Pebble::cannedResponsesChanged).toMap();
 }
 void Pebble::setCannedResponses(const QVariantMap &cans)
 {
     sendVarMap("setCannedResponses",cans);
-    emit cannedResponsesChanged();
+    // The daemon filters what it keeps, take its word for it
+    refreshProperty("cannedResponses", &Pebble::cannedResponsesChanged);
 }
 QVariantMap Pebble::getCannedResponses(const QStringList &keys)
 {
-    return fetchVarMap("getCannedResponses",&keys);
+    return call("getCannedResponses", {keys}).toMap();
 }
 void Pebble::setCannedContacts(const QVariantMap &cans)
 {
@@ -209,27 +297,16 @@ void Pebble::setCannedContacts(const QVariantMap &cans)
 }
 QVariantMap Pebble::getCannedContacts(const QStringList &keys)
 {
-    return fetchVarMap("getFavoriteContacts",&keys);
+    return call("getFavoriteContacts", {keys}).toMap();
 }
 
 QVariantList Pebble::weatherLocations() const
 {
-    QVariantList retList;
-    QDBusMessage m = m_iface->call("WeatherLocations");
-    if (m.type() == QDBusMessage::ErrorMessage || m.arguments().count() == 0) {
-        qWarning() << "Could not fetch installed apps" << m.errorMessage();
-        return retList;
-    }
-    const QDBusArgument &arg = m.arguments().first().value<QDBusArgument>();
-    arg.beginArray();
-    while (!arg.atEnd()) {
-        QVariant entryVariant;
-        arg >> entryVariant;
-        retList.append(entryVariant);
-    }
-    arg.endArray();
-    qDebug() << retList;
-    return retList;
+    return cachedProperty("WeatherLocations", &Pebble::weatherLocationsChanged).toList();
+}
+void Pebble::onWeatherLocationsChanged(const QVariantList &locations)
+{
+    updateProperty("WeatherLocations", locations, &Pebble::weatherLocationsChanged);
 }
 void Pebble::setWeatherLocations(const QVariantList &in)
 {
@@ -247,286 +324,342 @@ void Pebble::setWeatherLocations(const QVariantList &in)
         }
     }
     qDebug() << out;
-    m_iface->call("SetWeatherLocations",out);
-    emit weatherLocationsChanged();
+    callAsync("SetWeatherLocations", {QVariant(out)});
+    updateProperty("WeatherLocations", out, &Pebble::weatherLocationsChanged);
 }
 
 QString Pebble::weatherUnits() const
 {
-    return fetchProperty("WeatherUnits").toString();
+    return cachedProperty("WeatherUnits", &Pebble::weatherUnitsChanged).toString();
 }
 void Pebble::setWeatherUnits(const QString &u)
 {
-    m_iface->call("setWeatherUnits",u);
-    emit weatherUnitsChanged();
+    callAsync("setWeatherUnits", {u});
+    updateProperty("WeatherUnits", u, &Pebble::weatherUnitsChanged);
 }
 
 QString Pebble::weatherLanguage() const
 {
-    return fetchProperty("WeatherLanguage").toString();
+    return cachedProperty("WeatherLanguage", &Pebble::weatherLanguageChanged).toString();
 }
 void Pebble::setWeatherLanguage(const QString &l)
 {
-    m_iface->call("setWeatherLanguage",l);
-    emit weatherLanguageChanged();
+    callAsync("setWeatherLanguage", {l});
+    updateProperty("WeatherLanguage", l, &Pebble::weatherLanguageChanged);
 }
 
 QString Pebble::weatherAltKey() const
 {
-    return fetchProperty("WeatherAltKey").toString();
+    return cachedProperty("WeatherAltKey", &Pebble::weatherAltKeyChanged).toString();
 }
 void Pebble::setWeatherAltKey(const QString &key)
 {
-    m_iface->call("setWeatherAltKey",key);
-    emit weatherAltKeyChanged();
+    callAsync("setWeatherAltKey", {key});
+    updateProperty("WeatherAltKey", key, &Pebble::weatherAltKeyChanged);
 }
 
 QVariantMap Pebble::healthParams() const
 {
-    return fetchVarMap("HealthParams");
+    return cachedProperty("HealthParams", &Pebble::healthParamsChanged).toMap();
 }
 
 void Pebble::setHealthParams(const QVariantMap &healthParams)
 {
-    m_iface->call("SetHealthParams", healthParams);
+    // HealthParamsChanged comes back with the normalized values
+    callAsync("SetHealthParams", {healthParams});
+}
+
+void Pebble::onHealthParamsChanged(const QVariantMap &healthParams)
+{
+    updateProperty("HealthParams", healthParams, &Pebble::healthParamsChanged);
 }
 
 bool Pebble::imperialUnits() const
 {
-    return fetchProperty("ImperialUnits").toBool();
+    return cachedProperty("ImperialUnits", &Pebble::imperialUnitsChanged).toBool();
 }
 
 void Pebble::setImperialUnits(bool imperialUnits)
 {
     qDebug() << "setting im units" << imperialUnits;
-    m_iface->call("SetImperialUnits", imperialUnits);
+    callAsync("SetImperialUnits", {imperialUnits});
+    updateProperty("ImperialUnits", imperialUnits, &Pebble::imperialUnitsChanged);
+}
+
+void Pebble::onImperialUnitsChanged(bool imperialUnits)
+{
+    updateProperty("ImperialUnits", imperialUnits, &Pebble::imperialUnitsChanged);
 }
 
 QString Pebble::profileWhenConnected()
 {
-    return fetchProperty("ProfileWhenConnected").toString();
+    return cachedProperty("ProfileWhenConnected", &Pebble::profileWhenConnectedChanged).toString();
 }
 
 QString Pebble::profileWhenDisconnected()
 {
-    return fetchProperty("ProfileWhenDisconnected").toString();
+    return cachedProperty("ProfileWhenDisconnected", &Pebble::profileWhenDisconnectedChanged).toString();
 }
 
 void Pebble::setProfileWhenConnected(const QString &profile)
 {
     qDebug() << "setting profile when connected: " << profile;
-    m_iface->call("SetProfileWhenConnected", profile);
+    callAsync("SetProfileWhenConnected", {profile});
+    updateProperty("ProfileWhenConnected", profile, &Pebble::profileWhenConnectedChanged);
 }
 
 void Pebble::setProfileWhenDisconnected(const QString &profile)
 {
     qDebug() << "setting profile when disconnected: " << profile;
-    m_iface->call("SetProfileWhenDisconnected", profile);
+    callAsync("SetProfileWhenDisconnected", {profile});
+    updateProperty("ProfileWhenDisconnected", profile, &Pebble::profileWhenDisconnectedChanged);
+}
+
+void Pebble::onProfileWhenConnectedChanged(const QString &profile)
+{
+    updateProperty("ProfileWhenConnected", profile, &Pebble::profileWhenConnectedChanged);
+}
+
+void Pebble::onProfileWhenDisconnectedChanged(const QString &profile)
+{
+    updateProperty("ProfileWhenDisconnected", profile, &Pebble::profileWhenDisconnectedChanged);
 }
 
 bool Pebble::calendarSyncEnabled() const
 {
-    return fetchProperty("CalendarSyncEnabled").toBool();
+    return cachedProperty("CalendarSyncEnabled", &Pebble::calendarSyncEnabledChanged).toBool();
 }
 
 void Pebble::setCalendarSyncEnabled(bool enabled)
 {
-    m_iface->call("SetCalendarSyncEnabled", enabled);
+    callAsync("SetCalendarSyncEnabled", {enabled});
+    updateProperty("CalendarSyncEnabled", enabled, &Pebble::calendarSyncEnabledChanged);
+}
+
+void Pebble::onCalendarSyncEnabledChanged(bool enabled)
+{
+    updateProperty("CalendarSyncEnabled", enabled, &Pebble::calendarSyncEnabledChanged);
 }
 
 bool Pebble::devConnEnabled() const
 {
-    return fetchProperty("DevConnectionEnabled").toBool();
+    return cachedProperty("DevConnectionEnabled", &Pebble::devConnEnabledChanged).toBool();
 }
 void Pebble::setDevConnEnabled(bool enabled)
 {
-    m_iface->call("SetDevConnEnabled", enabled);
+    callAsync("SetDevConnEnabled", {enabled});
+    updateProperty("DevConnectionEnabled", enabled, &Pebble::devConnEnabledChanged);
 }
 
 bool Pebble::devConnCloudEnabled() const
 {
-    return fetchProperty("DevConnCloudEnabled").toBool();
+    return cachedProperty("DevConnCloudEnabled", &Pebble::devConnCloudEnabledChanged).toBool();
 }
 void Pebble::setDevConnCloudEnabled(bool enabled)
 {
-    m_iface->call("SetDevConnCloudEnabled",enabled);
+    callAsync("SetDevConnCloudEnabled", {enabled});
+    updateProperty("DevConnCloudEnabled", enabled, &Pebble::devConnCloudEnabledChanged);
 }
 
 quint16 Pebble::devConListenPort() const
 {
-    return (quint16)fetchProperty("DevConnListenPort").toInt();
+    return (quint16)cachedProperty("DevConnListenPort", &Pebble::devConListenPortChanged).toInt();
 }
 void Pebble::setDevConListenPort(quint16 port)
 {
-    m_iface->call("SetDevConnListenPort",port);
+    callAsync("SetDevConnListenPort", {QVariant::fromValue(port)});
+    updateProperty("DevConnListenPort", QVariant::fromValue(port), &Pebble::devConListenPortChanged);
 }
 
 bool Pebble::devConnServerRunning() const
 {
-    return fetchProperty("DevConnectionState").toBool();
+    return cachedProperty("DevConnectionState", &Pebble::devConnServerRunningChanged).toBool();
 }
 
 bool Pebble::devConCloudConnected() const
 {
-    return fetchProperty("DevConnCloudState").toBool();
+    return cachedProperty("DevConnCloudState", &Pebble::devConCloudConnectedChanged).toBool();
 }
 
 void Pebble::devConStateChanged(bool state)
 {
     qDebug() << "DevCon state hase changed:" << (state?"running":"stopped");
-    emit devConnServerRunningChanged();
+    updateProperty("DevConnectionState", state, &Pebble::devConnServerRunningChanged);
 }
 
 void Pebble::devConCloudChanged(bool state)
 {
     qDebug() << "DevConCloud state changed:" << (state?"connected":"disconnected");
-    emit devConCloudConnectedChanged();
+    updateProperty("DevConnCloudState", state, &Pebble::devConCloudConnectedChanged);
 }
 
 void Pebble::setLogLevel(int level)
 {
-    m_iface->call("setLogLevel",level);
-    emit logLevelChanged();
+    callAsync("setLogLevel", {level});
+    updateProperty("getLogLevel", level, &Pebble::logLevelChanged);
 }
 int Pebble::getLogLevel() const
 {
-    return fetchProperty("getLogLevel").toInt();
+    return cachedProperty("getLogLevel", &Pebble::logLevelChanged).toInt();
 }
 
-QString Pebble::getLogDump()
+QString Pebble::getLogDump() const
 {
-    return fetchProperty("getLogDump").toString();
+    return cachedProperty("getLogDump", &Pebble::logDumpChanged).toString();
 }
 QString Pebble::startLogDump()
 {
-    QString ret = fetchProperty("startLogDump").toString();
-    emit logDumpChanged();
+    QString ret = call("startLogDump").toString();
+    refreshProperty("getLogDump", &Pebble::logDumpChanged);
+    refreshProperty("isLogDumping", &Pebble::logDumpChanged);
     return ret;
 }
 QString Pebble::stopLogDump()
 {
-    QString ret = fetchProperty("stopLogDump").toString();
-    emit logDumpChanged();
+    QString ret = call("stopLogDump").toString();
+    refreshProperty("getLogDump", &Pebble::logDumpChanged);
+    refreshProperty("isLogDumping", &Pebble::logDumpChanged);
     return ret;
 }
-bool Pebble::isLogDumping()
+bool Pebble::isLogDumping() const
 {
-    return fetchProperty("isLogDumping").toBool();
+    return cachedProperty("isLogDumping", &Pebble::logDumpChanged).toBool();
 }
 
 QString Pebble::oauthToken() const
 {
-    return fetchProperty("oauthToken").toString();
+    return cachedProperty("oauthToken", &Pebble::oauthTokenChanged).toString();
 }
 
 void Pebble::setOAuthToken(const QString &token)
 {
-    m_iface->call("setOAuthToken",token);
-    emit oauthTokenChanged();
-    emit accountNameChanged();
-    emit accountEmailChanged();
+    callAsync("setOAuthToken", {token});
+    onOAuthTokenChanged(token);
+}
+
+void Pebble::onOAuthTokenChanged(const QString &token)
+{
+    if (m_cache.contains("oauthToken") && m_cache.value("oauthToken").toString() == token) {
+        return;
+    }
+    updateProperty("oauthToken", token, &Pebble::oauthTokenChanged);
+    // The account is resolved by the daemon once it sees the token
+    refreshProperty("accountName", &Pebble::accountNameChanged);
+    refreshProperty("accountEmail", &Pebble::accountEmailChanged);
 }
 
 QString Pebble::accountName() const
 {
-    return fetchProperty("accountName").toString();
+    return cachedProperty("accountName", &Pebble::accountNameChanged).toString();
 }
 
 QString Pebble::accountEmail() const
 {
-    return fetchProperty("accountEmail").toString();
+    return cachedProperty("accountEmail", &Pebble::accountEmailChanged).toString();
 }
 
 bool Pebble::syncAppsFromCloud() const
 {
-    return fetchProperty("syncAppsFromCloud").toBool();
+    return cachedProperty("syncAppsFromCloud", &Pebble::syncAppsFromCloudChanged).toBool();
 }
 void Pebble::setSyncAppsFromCloud(bool enable)
 {
-    m_iface->call("setSyncAppsFromCloud",enable);
-    emit syncAppsFromCloudChanged();
+    callAsync("setSyncAppsFromCloud", {enable});
+    updateProperty("syncAppsFromCloud", enable, &Pebble::syncAppsFromCloudChanged);
 }
 
 void Pebble::resetTimeline()
 {
-    m_iface->call("resetTimeline");
+    callAsync("resetTimeline");
 }
 
 void Pebble::setTimelineWindow()
 {
-    m_iface->call("setTimelineWindow",-m_timelienWindowStart,-m_timelienWindowFade,m_timelienWindowEnd);
+    callAsync("setTimelineWindow", {-m_timelienWindowStart, -m_timelienWindowFade, m_timelienWindowEnd});
 }
 
 void Pebble::configurationClosed(const QString &uuid, const QString &url)
 {
-    m_iface->call("ConfigurationClosed", uuid, url.mid(17));
+    callAsync("ConfigurationClosed", {uuid, url.mid(17)});
 }
 
 void Pebble::launchApp(const QString &uuid)
 {
-    m_iface->call("LaunchApp", uuid);
+    callAsync("LaunchApp", {uuid});
 }
 
 void Pebble::requestConfigurationURL(const QString &uuid)
 {
-    m_iface->call("ConfigurationURL", uuid);
+    callAsync("ConfigurationURL", {uuid});
 }
 
 void Pebble::removeApp(const QString &uuid)
 {
     qDebug() << "should remove app" << uuid;
-    m_iface->call("RemoveApp", uuid);
+    callAsync("RemoveApp", {uuid});
 }
 
 void Pebble::installApp(const QString &storeId)
 {
     qDebug() << "should install app" << storeId;
-    m_iface->call("InstallApp", storeId);
+    callAsync("InstallApp", {storeId});
 }
 
 void Pebble::sideloadApp(const QString &packageFile)
 {
-    m_iface->call("SideloadApp", packageFile);
-}
-
-QVariant Pebble::fetchProperty(const QString &propertyName) const
-{
-    QDBusMessage m = m_iface->call(propertyName);
-    if (m.type() != QDBusMessage::ErrorMessage && m.arguments().count() == 1) {
-        qDebug() << "property" << propertyName << m.arguments().first();
-        return m.arguments().first();
-
-    }
-    qDebug() << "error getting property:" << propertyName << m.errorMessage();
-    return QVariant();
+    callAsync("SideloadApp", {packageFile});
 }
 
 void Pebble::dataChanged()
 {
     qDebug() << "data changed";
-    m_name = fetchProperty("Name").toString();
-    m_address = fetchProperty("Address").toString();
-    m_serialNumber = fetchProperty("SerialNumber").toString();
-    m_serialNumber = fetchProperty("SerialNumber").toString();
-    QString hardwarePlatform = fetchProperty("HardwarePlatform").toString();
-    if (hardwarePlatform != m_hardwarePlatform) {
-        m_hardwarePlatform = hardwarePlatform;
-        emit hardwarePlatformChanged();
-    }
-    m_softwareVersion = fetchProperty("SoftwareVersion").toString();
-    m_model = fetchProperty("Model").toInt();
-    m_recovery = fetchProperty("Recovery").toBool();
-    qDebug() << "model is" << m_model;
-    emit modelChanged();
-
-    bool connected = fetchProperty("IsConnected").toBool();
-    if (connected != m_connected) {
-        m_connected = connected;
+    // All in flight at once, each one updates the UI as it comes in
+    fetchAsync("Name", [this](const QVariant &value) {
+        if (m_name != value.toString()) {
+            m_name = value.toString();
+            emit nameChanged();
+        }
+    });
+    fetchAsync("SerialNumber", [this](const QVariant &value) {
+        m_serialNumber = value.toString();
+    });
+    fetchAsync("HardwarePlatform", [this](const QVariant &value) {
+        if (value.toString() != m_hardwarePlatform) {
+            m_hardwarePlatform = value.toString();
+            emit hardwarePlatformChanged();
+        }
+    });
+    fetchAsync("SoftwareVersion", [this](const QVariant &value) {
+        m_softwareVersion = value.toString();
         emit connectedChanged();
-    }
-    m_timelienWindowStart = -fetchProperty("timelineWindowStart").toInt();
-    m_timelienWindowFade = -fetchProperty("timelineWindowFade").toInt();
-    m_timelienWindowEnd = fetchProperty("timelineWindowEnd").toInt();
+    });
+    fetchAsync("Model", [this](const QVariant &value) {
+        m_model = value.toInt();
+        qDebug() << "model is" << m_model;
+        emit modelChanged();
+    });
+    fetchAsync("Recovery", [this](const QVariant &value) {
+        m_recovery = value.toBool();
+        emit connectedChanged();
+    });
+    fetchAsync("IsConnected", [this](const QVariant &value) {
+        if (value.toBool() != m_connected) {
+            m_connected = value.toBool();
+            emit connectedChanged();
+        }
+    });
+    fetchAsync("timelineWindowStart", [this](const QVariant &value) {
+        m_timelienWindowStart = -value.toInt();
+        emit timelineWindowChanged();
+    });
+    fetchAsync("timelineWindowFade", [this](const QVariant &value) {
+        m_timelienWindowFade = -value.toInt();
+        emit timelineWindowChanged();
+    });
+    fetchAsync("timelineWindowEnd", [this](const QVariant &value) {
+        m_timelienWindowEnd = value.toInt();
+        emit timelineWindowChanged();
+    });
 }
 
 void Pebble::pebbleConnected()
@@ -536,6 +669,13 @@ void Pebble::pebbleConnected()
     m_connected = true;
     emit connectedChanged();
 
+    // Whatever was cached may have changed with the watch
+    foreach (const QString &method, QStringList({"PlatformString", "LanguageVersion"})) {
+        m_cache.remove(method);
+    }
+    emit platformStringChanged();
+    emit languageVersionChanged();
+
     refreshApps();
     refreshNotifications();
     refreshScreenshots();
@@ -549,96 +689,138 @@ void Pebble::pebbleDisconnected()
 
 void Pebble::notificationFilterChanged(const QString &sourceId, const QString &name, const QString &icon, const int enabled)
 {
+    // The signal carries the whole entry, no need to go back for the list
     m_notifications->insert(sourceId, name, icon, enabled);
-    emit notificationsFilterChanged();
+    QVariantMap filter = m_cache.value("NotificationsFilter").toMap();
+    if (enabled < 0) {
+        filter.remove(sourceId);
+    } else {
+        QVariantMap notif;
+        notif.insert("enabled", enabled);
+        notif.insert("icon", icon);
+        notif.insert("name", name);
+        filter.insert(sourceId, notif);
+    }
+    updateProperty("NotificationsFilter", filter, &Pebble::notificationsFilterChanged);
 }
 
 QVariantMap Pebble::notificationsFilter() const
 {
-    QVariantMap mapEntryVariant = fetchVarMap("NotificationsFilter");
-    QVariantMap ret;
-
-    foreach (const QString &sourceId, mapEntryVariant.keys()) {
-        const QDBusArgument &arg2 = qvariant_cast<QDBusArgument>(mapEntryVariant.value(sourceId));
-        QVariantMap notifEntry;
-        arg2 >> notifEntry;
-        ret.insert(sourceId, notifEntry);
-    }
-    return ret;
+    return cachedProperty("NotificationsFilter", &Pebble::notificationsFilterChanged).toMap();
 }
 
 void Pebble::refreshNotifications()
 {
-    QVariantMap mapEntryVariant = fetchVarMap("NotificationsFilter");
-
-    foreach (const QString &sourceId, mapEntryVariant.keys()) {
-        const QDBusArgument &arg2 = qvariant_cast<QDBusArgument>(mapEntryVariant.value(sourceId));
-        QVariantMap notifEntry;
-        arg2 >> notifEntry;
-        m_notifications->insert(sourceId, notifEntry.value("name").toString(), notifEntry.value("icon").toString(), notifEntry.value("enabled").toInt());
+    if (!m_cache.contains("NotificationsFilter")) {
+        m_cache.insert("NotificationsFilter", QVariant());
     }
+    fetchAsync("NotificationsFilter", [this](const QVariant &value) {
+        QVariantMap filter = value.toMap();
+        foreach (const QString &sourceId, filter.keys()) {
+            QVariantMap notifEntry = filter.value(sourceId).toMap();
+            m_notifications->insert(sourceId, notifEntry.value("name").toString(), notifEntry.value("icon").toString(), notifEntry.value("enabled").toInt());
+        }
+        updateProperty("NotificationsFilter", filter, &Pebble::notificationsFilterChanged);
+    });
 }
 
 void Pebble::setNotificationFilter(const QString &sourceId, int enabled)
 {
-    m_iface->call("SetNotificationFilter", sourceId, enabled);
-    emit notificationsFilterChanged();
+    // NotificationFilterChanged comes back if anything changed
+    callAsync("SetNotificationFilter", {sourceId, enabled});
 }
 
 void Pebble::forgetNotificationFilter(const QString &sourceId)
 {
-    m_iface->call("ForgetNotificationFilter", sourceId);
-    emit notificationsFilterChanged();
+    callAsync("ForgetNotificationFilter", {sourceId});
 }
 
 void Pebble::refreshApps()
 {
-    QDBusMessage m = m_iface->call("InstalledApps");
-    if (m.type() == QDBusMessage::ErrorMessage || m.arguments().count() == 0) {
-        qWarning() << "Could not fetch installed apps" << m.errorMessage();
+    // One request in flight at a time, so deltas are applied in order
+    if (m_fetchingApps) {
+        m_appsOutdated = true;
         return;
     }
+    m_fetchingApps = true;
+    m_appsOutdated = false;
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(methodCall("AppCatalog", {m_appCatalogVersion})), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this](QDBusPendingCallWatcher *watcher) {
+        watcher->deleteLater();
+        m_fetchingApps = false;
+        applyAppCatalog(watcher->reply());
+        if (m_appsOutdated) {
+            refreshApps();
+        }
+    });
+}
 
-    m_installedApps->clear();
-    m_installedWatchfaces->clear();
-
-    const QDBusArgument &arg = m.arguments().first().value<QDBusArgument>();
-
-    QVariantList appList;
-
-    arg.beginArray();
-    while (!arg.atEnd()) {
-        QVariant mapEntryVariant;
-        arg >> mapEntryVariant;
-
-        QDBusArgument mapEntry = mapEntryVariant.value<QDBusArgument>();
-        QVariantMap appMap;
-        mapEntry >> appMap;
-        appList.append(appMap);
-
+void Pebble::appCatalogChanged(quint32 version)
+{
+    if (version != m_appCatalogVersion) {
+        refreshApps();
     }
-    arg.endArray();
+}
 
+void Pebble::applyAppCatalog(const QDBusMessage &reply)
+{
+    if (reply.type() == QDBusMessage::ErrorMessage || reply.arguments().count() < 5) {
+        qWarning() << "Could not fetch AppCatalog" << reply.errorMessage();
+        return;
+    }
+    quint32 version = reply.arguments().at(0).toUInt();
+    bool full = reply.arguments().at(1).toBool();
+    QStringList removed = reply.arguments().at(3).toStringList();
+    QStringList order = reply.arguments().at(4).toStringList();
+
+    if (full) {
+        m_installedApps->clear();
+        m_installedWatchfaces->clear();
+    }
 
-    qDebug() << "have apps" << appList;
-    foreach (const QVariant &v, appList) {
+    int count = 0;
+    const QDBusArgument &changed = reply.arguments().at(2).value<QDBusArgument>();
+    changed.beginArray();
+    while (!changed.atEnd()) {
         AppItem *app = new AppItem(this);
-        app->setStoreId(v.toMap().value("storeId").toString());
-        app->setUuid(v.toMap().value("uuid").toString());
-        app->setName(v.toMap().value("name").toString());
-        app->setIcon(v.toMap().value("icon").toString());
-        app->setVendor(v.toMap().value("vendor").toString());
-        app->setVersion(v.toMap().value("version").toString());
-        app->setIsWatchFace(v.toMap().value("watchface").toBool());
-        app->setHasSettings(v.toMap().value("hasSettings").toBool());
-        app->setIsSystemApp(v.toMap().value("systemApp").toBool());
-
-        if (app->isWatchFace()) {
-            m_installedWatchfaces->insert(app);
+        QString storeId, uuid, name, vendor, appVersion, icon;
+        bool watchface, hasSettings, systemApp;
+        changed.beginStructure();
+        changed >> uuid >> storeId >> name >> vendor >> appVersion >> icon >> watchface >> hasSettings >> systemApp;
+        changed.endStructure();
+        app->setStoreId(storeId);
+        app->setUuid(uuid);
+        app->setName(name);
+        app->setIcon(icon);
+        app->setVendor(vendor);
+        app->setVersion(appVersion);
+        app->setIsWatchFace(watchface);
+        app->setHasSettings(hasSettings);
+        app->setIsSystemApp(systemApp);
+        count++;
+
+        ApplicationsModel *model = watchface ? m_installedWatchfaces : m_installedApps;
+        ApplicationsModel *other = watchface ? m_installedApps : m_installedWatchfaces;
+        other->remove(other->findByUuid(uuid));
+        AppItem *existing = model->findByUuid(uuid);
+        if (existing) {
+            model->replace(existing, app);
         } else {
-            m_installedApps->insert(app);
+            model->insert(app);
         }
     }
+    changed.endArray();
+
+    foreach (const QString &uuid, removed) {
+        m_installedApps->remove(m_installedApps->findByUuid(uuid));
+        m_installedWatchfaces->remove(m_installedWatchfaces->findByUuid(uuid));
+    }
+    if (!full && !order.isEmpty()) {
+        m_installedApps->sortByUuid(order);
+        m_installedWatchfaces->sortByUuid(order);
+    }
+    qDebug() << "App catalog" << m_appCatalogVersion << "->" << version << (full ? "full," : "delta,") << count << "changed," << removed.count() << "removed";
+    m_appCatalogVersion = version;
 }
 
 void Pebble::appsSorted()
@@ -650,16 +832,17 @@ void Pebble::appsSorted()
     for (int i = 0; i < m_installedWatchfaces->rowCount(); i++) {
         newList << m_installedWatchfaces->get(i)->uuid();
     }
-    m_iface->call("SetAppOrder", newList);
+    callAsync("SetAppOrder", {newList});
 }
 
 void Pebble::refreshScreenshots()
 {
-    m_screenshotModel->clear();
-    QStringList screenshots = fetchProperty("Screenshots").toStringList();
-    foreach (const QString &filename, screenshots) {
-        m_screenshotModel->insert(filename);
-    }
+    fetchAsync("Screenshots", [this](const QVariant &value) {
+        m_screenshotModel->clear();
+        foreach (const QString &filename, value.toStringList()) {
+            m_screenshotModel->insert(filename);
+        }
+    });
 }
 
 void Pebble::screenshotAdded(const QString &filename)
@@ -675,43 +858,53 @@ void Pebble::screenshotRemoved(const QString &filename)
 
 void Pebble::refreshFirmwareUpdateInfo()
 {
-    bool firmwareUpgradeAvailable = fetchProperty("FirmwareUpgradeAvailable").toBool();
-    if (firmwareUpgradeAvailable && !m_firmwareUpgradeAvailable) {
-        m_firmwareUpgradeAvailable = true;
-        m_firmwareReleaseNotes = fetchProperty("FirmwareReleaseNotes").toString();
-        m_candidateVersion = fetchProperty("CandidateFirmwareVersion").toString();
-        qDebug() << "firmare upgrade" << m_firmwareUpgradeAvailable << m_firmwareReleaseNotes << m_candidateVersion;
-        emit firmwareUpgradeAvailableChanged();
-    } else if (!firmwareUpgradeAvailable && m_firmwareUpgradeAvailable) {
-        m_firmwareUpgradeAvailable = false;
-        m_firmwareReleaseNotes.clear();;
-        m_candidateVersion.clear();
-        emit firmwareUpgradeAvailableChanged();
-    }
-    bool upgradingFirmware = fetchProperty("UpgradingFirmware").toBool();
-    if (m_upgradingFirmware != upgradingFirmware) {
-        m_upgradingFirmware = upgradingFirmware;
-        emit upgradingFirmwareChanged();
-    }
+    fetchAsync("FirmwareUpgradeAvailable", [this](const QVariant &value) {
+        bool firmwareUpgradeAvailable = value.toBool();
+        if (firmwareUpgradeAvailable && !m_firmwareUpgradeAvailable) {
+            fetchAsync("FirmwareReleaseNotes", [this](const QVariant &value) {
+                m_firmwareReleaseNotes = value.toString();
+                emit firmwareUpgradeAvailableChanged();
+            });
+            fetchAsync("CandidateFirmwareVersion", [this](const QVariant &value) {
+                m_candidateVersion = value.toString();
+                qDebug() << "firmare upgrade" << m_firmwareUpgradeAvailable << m_firmwareReleaseNotes << m_candidateVersion;
+                emit firmwareUpgradeAvailableChanged();
+            });
+            m_firmwareUpgradeAvailable = true;
+            emit firmwareUpgradeAvailableChanged();
+        } else if (!firmwareUpgradeAvailable && m_firmwareUpgradeAvailable) {
+            m_firmwareUpgradeAvailable = false;
+            m_firmwareReleaseNotes.clear();
+            m_candidateVersion.clear();
+            emit firmwareUpgradeAvailableChanged();
+        }
+    });
+    fetchAsync("UpgradingFirmware", [this](const QVariant &value) {
+        bool upgradingFirmware = value.toBool();
+        if (m_upgradingFirmware != upgradingFirmware) {
+            m_upgradingFirmware = upgradingFirmware;
+            emit upgradingFirmwareChanged();
+        }
+    });
 }
 
 void Pebble::requestScreenshot()
 {
-    m_iface->call("RequestScreenshot");
+    callAsync("RequestScreenshot");
 }
 
 void Pebble::removeScreenshot(const QString &filename)
 {
     qDebug() << "removing screenshot" << filename;
-    m_iface->call("RemoveScreenshot", filename);
+    callAsync("RemoveScreenshot", {filename});
 }
 
 void Pebble::performFirmwareUpgrade()
 {
-    m_iface->call("PerformFirmwareUpgrade");
+    callAsync("PerformFirmwareUpgrade");
 }
 
 void Pebble::dumpLogs(const QString &filename)
 {
-    m_iface->call("DumpLogs", filename);
+    callAsync("DumpLogs", {filename});
 }
@@ -2,7 +2,11 @@
 #define PEBBLE_H
 
 #include <QObject>
-#include <QDBusInterface>
+#include <QDBusObjectPath>
+#include <QDBusMessage>
+#include <QVariantMap>
+
+#include <functional>
 
 class NotificationSourceModel;
 class ApplicationsModel;
@@ -12,9 +16,9 @@ class Pebble : public QObject
 {
     Q_OBJECT
     // hardware details
-    Q_PROPERTY(QString name READ name CONSTANT)
+    Q_PROPERTY(QString name READ name NOTIFY nameChanged)
     Q_PROPERTY(bool connected READ connected NOTIFY connectedChanged)
-    Q_PROPERTY(QString platformString READ platformString CONSTANT)
+    Q_PROPERTY(QString platformString READ platformString NOTIFY platformStringChanged)
     Q_PROPERTY(QString hardwarePlatform READ hardwarePlatform NOTIFY hardwarePlatformChanged)
     Q_PROPERTY(int model READ model NOTIFY modelChanged)
     // Firmware management
@@ -51,9 +55,9 @@ class Pebble : public QObject
     Q_PROPERTY(QString oauthToken READ oauthToken WRITE setOAuthToken NOTIFY oauthTokenChanged)
     Q_PROPERTY(QString accountName READ accountName NOTIFY accountNameChanged)
     Q_PROPERTY(QString accountEmail READ accountEmail NOTIFY accountEmailChanged)
-    Q_PROPERTY(int timelineWindowStart MEMBER m_timelienWindowStart)
-    Q_PROPERTY(int timelineWindowFade MEMBER m_timelienWindowFade)
-    Q_PROPERTY(int timelineWindowEnd MEMBER m_timelienWindowEnd)
+    Q_PROPERTY(int timelineWindowStart MEMBER m_timelienWindowStart NOTIFY timelineWindowChanged)
+    Q_PROPERTY(int timelineWindowFade MEMBER m_timelienWindowFade NOTIFY timelineWindowChanged)
+    Q_PROPERTY(int timelineWindowEnd MEMBER m_timelienWindowEnd NOTIFY timelineWindowChanged)
     // Apps and features
     Q_PROPERTY(QVariantMap cannedResponses READ cannedResponses WRITE setCannedResponses NOTIFY cannedResponsesChanged)
     Q_PROPERTY(QString weatherUnits READ weatherUnits WRITE setWeatherUnits NOTIFY weatherUnitsChanged)
@@ -140,8 +144,8 @@ public slots:
     void setDevConListenPort(quint16 port);
     QString startLogDump();
     QString stopLogDump();
-    QString getLogDump();
-    bool isLogDumping();
+    QString getLogDump() const;
+    bool isLogDumping() const;
     void setLogLevel(int level);
     int getLogLevel() const;
 
@@ -161,6 +165,8 @@ public slots:
     void setWeatherAltKey(const QString &key);
 
 signals:
+    void nameChanged();
+    void platformStringChanged();
     void connectedChanged();
     void hardwarePlatformChanged();
     void modelChanged();
@@ -189,6 +195,7 @@ signals:
     void accountNameChanged();
     void accountEmailChanged();
     void syncAppsFromCloudChanged();
+    void timelineWindowChanged();
 
     void cannedResponsesChanged();
     void weatherUnitsChanged();
@@ -197,9 +204,22 @@ signals:
     void weatherLocationsChanged();
 
 private:
-    QVariant fetchProperty(const QString &propertyName) const;
+    typedef void (Pebble::*NotifySignal)();
+
+    QDBusMessage methodCall(const QString &method, const QVariantList &args) const;
+    // Blocking, only for calls made on explicit user request which need the answer right away
+    QVariant call(const QString &method, const QVariantList &args = QVariantList()) const;
+    void callAsync(const QString &method, const QVariantList &args = QVariantList()) const;
+    void fetchAsync(const QString &method, std::function<void(const QVariant &)> handler) const;
+
+    // Property cache, the first read kicks off an async fetch and the notify
+    // signal fires once the value arrives
+    QVariant cachedProperty(const QString &method, NotifySignal notify) const;
+    void refreshProperty(const QString &method, NotifySignal notify) const;
+    void updateProperty(const QString &method, const QVariant &value, NotifySignal notify) const;
+    static QVariant demarshal(const QVariant &value);
+
     void sendVarMap(const QString &property, const QVariantMap &values);
-    QVariantMap fetchVarMap(const QString &propertyName, const QStringList *keys = 0) const;
 
 private slots:
     void dataChanged();
@@ -208,6 +228,8 @@ private slots:
     void notificationFilterChanged(const QString &sourceId, const QString &name, const QString &icon, const int enabled);
     void refreshNotifications();
     void refreshApps();
+    void appCatalogChanged(quint32 version);
+    void applyAppCatalog(const QDBusMessage &reply);
     void appsSorted();
     void refreshScreenshots();
     void screenshotAdded(const QString &filename);
@@ -215,6 +237,14 @@ private slots:
     void refreshFirmwareUpdateInfo();
     void devConStateChanged(bool state);
     void devConCloudChanged(bool state);
+    void onHealthParamsChanged(const QVariantMap &healthParams);
+    void onImperialUnitsChanged(bool imperialUnits);
+    void onProfileWhenConnectedChanged(const QString &profile);
+    void onProfileWhenDisconnectedChanged(const QString &profile);
+    void onCalendarSyncEnabledChanged(bool enabled);
+    void onWeatherLocationsChanged(const QVariantList &locations);
+    void onLanguageVersionChanged();
+    void onOAuthTokenChanged(const QString &token);
 
 private:
     QDBusObjectPath m_path;
@@ -227,10 +257,14 @@ private:
     QString m_softwareVersion;
     bool m_recovery = false;
     int m_model = 0;
-    QDBusInterface *m_iface;
+    mutable QVariantMap m_cache;
     NotificationSourceModel *m_notifications;
     ApplicationsModel *m_installedApps;
     ApplicationsModel *m_installedWatchfaces;
+    // Last AppCatalog version applied to the models, 0 fetches everything
+    quint32 m_appCatalogVersion = 0;
+    bool m_fetchingApps = false;
+    bool m_appsOutdated = false;
     ScreenshotModel *m_screenshotModel;
 
     bool m_firmwareUpgradeAvailable = false;
@@ -238,9 +272,9 @@ private:
     QString m_candidateVersion;
     bool m_upgradingFirmware = false;
 
-    qint32 m_timelienWindowStart;
-    qint32 m_timelienWindowFade;
-    qint32 m_timelienWindowEnd;
+    qint32 m_timelienWindowStart = 0;
+    qint32 m_timelienWindowFade = 0;
+    qint32 m_timelienWindowEnd = 0;
 };
 
 #endif // PEBBLE_H
@@ -134,6 +134,10 @@ void Pebbles::refresh()
         if (find(p) == -1) {
             Pebble *pebble = new Pebble(p, this);
             connect(pebble, &Pebble::connectedChanged, this, &Pebbles::pebbleConnectedChanged);
+            connect(pebble, &Pebble::nameChanged, this, [this, pebble]() {
+                int idx = m_pebbles.indexOf(pebble);
+                emit dataChanged(index(idx), index(idx), {RoleName, RoleSerialNumber});
+            });
             beginInsertRows(QModelIndex(), m_pebbles.count(), m_pebbles.count());
             m_pebbles.append(pebble);
             endInsertRows();
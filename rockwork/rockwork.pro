@@ -15,6 +15,8 @@ HEADERS += \
     applicationsmodel.h \
     applicationsfiltermodel.h \
     appstoreclient.h \
+    imagecache.h \
+    shareddiskcache.h \
     screenshotmodel.h
 
 SOURCES += main.cpp \
@@ -25,6 +27,8 @@ SOURCES += main.cpp \
     applicationsmodel.cpp \
     applicationsfiltermodel.cpp \
     appstoreclient.cpp \
+    imagecache.cpp \
+    shareddiskcache.cpp \
     screenshotmodel.cpp
 
 RESOURCES += rockwork.qrc
@@ -0,0 +1,72 @@
+#include "shareddiskcache.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QNetworkDiskCache>
+#include <QStandardPaths>
+
+static QMutex s_mutex;
+
+SharedDiskCache::SharedDiskCache(const QString &directory, qint64 maximumSize, QObject *parent):
+    QAbstractNetworkCache(parent)
+{
+    // Live as long as the process, no single access manager or thread owns them
+    static QHash<QString, QNetworkDiskCache*> disks;
+    QMutexLocker l(&s_mutex);
+    m_disk = disks.value(directory);
+    if (!m_disk) {
+        m_disk = new QNetworkDiskCache();
+        m_disk->setCacheDirectory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/" + directory);
+        m_disk->setMaximumCacheSize(maximumSize);
+        disks.insert(directory, m_disk);
+    }
+}
+
+QNetworkCacheMetaData SharedDiskCache::metaData(const QUrl &url)
+{
+    QMutexLocker l(&s_mutex);
+    return m_disk->metaData(url);
+}
+
+void SharedDiskCache::updateMetaData(const QNetworkCacheMetaData &metaData)
+{
+    QMutexLocker l(&s_mutex);
+    m_disk->updateMetaData(metaData);
+}
+
+QIODevice *SharedDiskCache::data(const QUrl &url)
+{
+    QMutexLocker l(&s_mutex);
+    return m_disk->data(url);
+}
+
+bool SharedDiskCache::remove(const QUrl &url)
+{
+    QMutexLocker l(&s_mutex);
+    return m_disk->remove(url);
+}
+
+qint64 SharedDiskCache::cacheSize() const
+{
+    QMutexLocker l(&s_mutex);
+    return m_disk->cacheSize();
+}
+
+QIODevice *SharedDiskCache::prepare(const QNetworkCacheMetaData &metaData)
+{
+    QMutexLocker l(&s_mutex);
+    return m_disk->prepare(metaData);
+}
+
+void SharedDiskCache::insert(QIODevice *device)
+{
+    QMutexLocker l(&s_mutex);
+    m_disk->insert(device);
+}
+
+void SharedDiskCache::clear()
+{
+    QMutexLocker l(&s_mutex);
+    m_disk->clear();
+}
@@ -0,0 +1,31 @@
+#ifndef SHAREDDISKCACHE_H
+#define SHAREDDISKCACHE_H
+
+#include <QAbstractNetworkCache>
+
+class QNetworkDiskCache;
+
+// Network cache backed by one process-wide QNetworkDiskCache per directory. Separate
+// QNetworkDiskCache objects on one directory would step on each other's files, so every
+// access manager using the directory gets one of these instead. Calls are serialized,
+// access managers may live on different threads (QML loaders).
+class SharedDiskCache : public QAbstractNetworkCache
+{
+public:
+    // directory is relative to the cache location
+    SharedDiskCache(const QString &directory, qint64 maximumSize, QObject *parent);
+
+    QNetworkCacheMetaData metaData(const QUrl &url) override;
+    void updateMetaData(const QNetworkCacheMetaData &metaData) override;
+    QIODevice *data(const QUrl &url) override;
+    bool remove(const QUrl &url) override;
+    qint64 cacheSize() const override;
+    QIODevice *prepare(const QNetworkCacheMetaData &metaData) override;
+    void insert(QIODevice *device) override;
+    void clear() override;
+
+private:
+    QNetworkDiskCache *m_disk;
+};
+
+#endif // SHAREDDISKCACHE_H
@@ -2,35 +2,255 @@
 #include "core.h"
 #include "pebblemanager.h"
 #include "libpebble/devconnection.h"
+#include "libpebble/metrics.h"
+#include "libpebble/tracerecorder.h"
+#include "libpebble/threadcall.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDBusMetaType>
+#include <QPointer>
 
 DBusPebble::DBusPebble(Pebble *pebble, QObject *parent):
     QObject(parent),
     m_pebble(pebble)
 {
-    connect(pebble, &Pebble::pebbleConnected, this, &DBusPebble::Connected);
-    connect(pebble, &Pebble::pebbleDisconnected, this, &DBusPebble::Disconnected);
-    connect(pebble, &Pebble::installedAppsChanged, this, &DBusPebble::InstalledAppsChanged);
+    // Property getters are served from the cache below, so the properties a change names
+    // are brought up to date before it is announced
+    const QStringList watchInfo({"IsConnected", "Name", "Recovery", "SerialNumber", "PlatformString", "HardwarePlatform",
+                                 "SoftwareVersion", "LanguageVersion", "Model", "FirmwareUpgradeAvailable"});
+    connect(pebble, &Pebble::pebbleConnected, this, [=]() { refresh(watchInfo, [this]() { emit Connected(); }); });
+    connect(pebble, &Pebble::pebbleDisconnected, this, [=]() { refresh(watchInfo, [this]() { emit Disconnected(); }); });
+    connect(pebble, &Pebble::installedAppsChanged, this, [this](quint32 catalogVersion) {
+        refresh(QStringList(), [this]() { emit InstalledAppsChanged(); }, true);
+        emit AppCatalogChanged(catalogVersion);
+    });
     connect(pebble, &Pebble::openURL, this, &DBusPebble::OpenURL);
-    connect(pebble, &Pebble::notificationFilterChanged, this, &DBusPebble::NotificationFilterChanged);
-    connect(pebble, &Pebble::screenshotAdded, this, &DBusPebble::ScreenshotAdded);
-    connect(pebble, &Pebble::screenshotRemoved, this, &DBusPebble::ScreenshotRemoved);
-    connect(pebble, &Pebble::updateAvailableChanged, this, &DBusPebble::FirmwareUpgradeAvailableChanged);
-    connect(pebble, &Pebble::upgradingFirmwareChanged, this, &DBusPebble::UpgradingFirmwareChanged);
-    connect(pebble, &Pebble::languagePackChanged, this, &DBusPebble::LanguageVersionChanged);
+    connect(pebble, &Pebble::notificationFilterChanged, this, [this](const QString &sourceId, const QString &name, const QString &icon, int enabled) {
+        refresh({"NotificationsFilter"}, [=]() { emit NotificationFilterChanged(sourceId, name, icon, enabled); });
+    });
+    // The signals name the file, no need to list the directory again
+    connect(pebble, &Pebble::screenshotAdded, this, [this](const QString &filename) {
+        QStringList files = m_props.value("Screenshots").toStringList();
+        if (!files.contains(filename))
+            files.append(filename);
+        store("Screenshots", files);
+        emit ScreenshotAdded(filename);
+    });
+    connect(pebble, &Pebble::screenshotRemoved, this, [this](const QString &filename) {
+        QStringList files = m_props.value("Screenshots").toStringList();
+        files.removeAll(filename);
+        store("Screenshots", files);
+        emit ScreenshotRemoved(filename);
+    });
+    connect(pebble, &Pebble::updateAvailableChanged, this, [this]() {
+        refresh({"FirmwareUpgradeAvailable", "FirmwareReleaseNotes", "CandidateFirmwareVersion"}, [this]() { emit FirmwareUpgradeAvailableChanged(); });
+    });
+    connect(pebble, &Pebble::upgradingFirmwareChanged, this, [this]() { refresh({"UpgradingFirmware"}, [this]() { emit UpgradingFirmwareChanged(); }); });
+    connect(pebble, &Pebble::languagePackChanged, this, [this]() { refresh({"LanguageVersion"}, [this]() { emit LanguageVersionChanged(); }); });
     connect(pebble, &Pebble::logsDumped, this, &DBusPebble::LogsDumped);
-    connect(pebble, &Pebble::healtParamsChanged, this, &DBusPebble::HealthParamsChanged);
-    connect(pebble, &Pebble::imperialUnitsChanged, this, &DBusPebble::ImperialUnitsChanged);
-    connect(pebble, &Pebble::profileConnectionSwitchChanged, this, &DBusPebble::onProfileConnectionSwitchChanged);
-    connect(pebble, &Pebble::calendarSyncEnabledChanged, this, &DBusPebble::CalendarSyncEnabledChanged);
-    connect(pebble, &Pebble::weatherLocationsChanged, this, &DBusPebble::WeatherLocationsChanged);
-    connect(pebble, &Pebble::devConServerStateChanged, this, &DBusPebble::DevConnectionChanged);
-    connect(pebble, &Pebble::devConCloudStateChanged, this, &DBusPebble::DevConnCloudChanged);
-    connect(pebble, &Pebble::oauthTokenChanged, this, &DBusPebble::oauthTokenChanged);
+    connect(pebble, &Pebble::healtParamsChanged, this, [this]() { refresh({"HealthParams"}, [this]() { emit HealthParamsChanged(HealthParams()); }); });
+    connect(pebble, &Pebble::imperialUnitsChanged, this, [this]() { refresh({"ImperialUnits"}, [this]() { emit ImperialUnitsChanged(ImperialUnits()); }); });
+    connect(pebble, &Pebble::profileConnectionSwitchChanged, this, [this](bool connected) {
+        refresh({connected ? "ProfileWhenConnected" : "ProfileWhenDisconnected"}, [=]() { onProfileConnectionSwitchChanged(connected); });
+    });
+    connect(pebble, &Pebble::calendarSyncEnabledChanged, this, [this]() { refresh({"CalendarSyncEnabled"}, [this]() { emit CalendarSyncEnabledChanged(CalendarSyncEnabled()); }); });
+    connect(pebble, &Pebble::weatherLocationsChanged, this, [this](const QVariantList &locations) {
+        refresh({"WeatherLocations"}, [=]() { emit WeatherLocationsChanged(locations); });
+    });
+    connect(pebble, &Pebble::devConServerStateChanged, this, [this](bool state) {
+        refresh({"DevConnectionEnabled", "DevConnectionState"}, [=]() { emit DevConnectionChanged(state); });
+    });
+    connect(pebble, &Pebble::devConCloudStateChanged, this, [this](bool state) {
+        refresh({"DevConnCloudEnabled", "DevConnCloudState"}, [=]() { emit DevConnCloudChanged(state); });
+    });
+    connect(pebble, &Pebble::oauthTokenChanged, this, [this](const QString &token) {
+        refresh({"oauthToken", "accountName", "accountEmail"}, [=]() { emit oauthTokenChanged(token); });
+    });
     connect(pebble, &Pebble::voiceSessionSetup, this, &DBusPebble::voiceSessionSetup);
     connect(pebble, &Pebble::voiceSessionStream, this, &DBusPebble::voiceSessionStream);
+    connect(pebble, &Pebble::voiceSessionPcm, this, &DBusPebble::voiceSessionPcm);
     connect(pebble, &Pebble::voiceSessionDumped, this, &DBusPebble::voiceSessionDumped);
     connect(pebble, &Pebble::voiceSessionClosed, this, &DBusPebble::voiceSessionClosed);
     connect(pebble, &Pebble::appButtonPressed, this, &DBusPebble::AppButtonPressed);
+
+    // Waiting for the watch thread is fine once, while the watch is being registered.
+    // The apps are left to the first client asking for them, reading them scans the app directory.
+    quint64 serial = ++m_requested;
+    apply(serial, callOn(m_pebble, [pebble]() { return readProperties(pebble, QStringList()); }), QVariantMap(), false);
+}
+
+typedef QVariant (*PropertyReader)(Pebble *pebble);
+
+// One reader per cached property, so a change only re-reads what it names
+static const QHash<QString, PropertyReader> &propertyReaders()
+{
+    static const QHash<QString, PropertyReader> readers = {
+        {"Name", [](Pebble *p) -> QVariant { return p->name(); }},
+        {"IsConnected", [](Pebble *p) -> QVariant { return p->connected(); }},
+        {"Recovery", [](Pebble *p) -> QVariant { return p->recovery(); }},
+        {"FirmwareUpgradeAvailable", [](Pebble *p) -> QVariant { return p->firmwareUpdateAvailable(); }},
+        {"FirmwareReleaseNotes", [](Pebble *p) -> QVariant { return p->firmwareReleaseNotes(); }},
+        {"CandidateFirmwareVersion", [](Pebble *p) -> QVariant { return p->candidateFirmwareVersion(); }},
+        {"UpgradingFirmware", [](Pebble *p) -> QVariant { return p->upgradingFirmware(); }},
+        {"SerialNumber", [](Pebble *p) -> QVariant { return p->serialNumber(); }},
+        {"PlatformString", [](Pebble *p) -> QVariant { return p->platformString(); }},
+        {"HardwarePlatform", [](Pebble *p) -> QVariant { return p->platformName(); }},
+        {"SoftwareVersion", [](Pebble *p) -> QVariant { return p->softwareVersion(); }},
+        {"LanguageVersion", [](Pebble *p) -> QVariant { return QString("%1:%2").arg(p->language()).arg(QString::number(p->langVer())); }},
+        {"Model", [](Pebble *p) -> QVariant { return int(p->model()); }},
+        {"NotificationsFilter", [](Pebble *p) -> QVariant { return p->notificationsFilter(); }},
+        {"timelineWindowStart", [](Pebble *p) -> QVariant { return p->timelineWindowStart(); }},
+        {"timelineWindowFade", [](Pebble *p) -> QVariant { return p->timelineWindowFade(); }},
+        {"timelineWindowEnd", [](Pebble *p) -> QVariant { return p->timelineWindowEnd(); }},
+        {"syncAppsFromCloud", [](Pebble *p) -> QVariant { return p->syncAppsFromCloud(); }},
+        {"oauthToken", [](Pebble *p) -> QVariant { return p->oauthToken(); }},
+        {"accountName", [](Pebble *p) -> QVariant { return p->accountName(); }},
+        {"accountEmail", [](Pebble *p) -> QVariant { return p->accountEmail(); }},
+        {"WeatherAltKey", [](Pebble *p) -> QVariant { return p->getWeatherAltKey(); }},
+        {"WeatherLanguage", [](Pebble *p) -> QVariant { return p->getWeatherLanguage(); }},
+        {"WeatherUnits", [](Pebble *p) -> QVariant { return p->getWeatherUnits(); }},
+        {"WeatherLocations", [](Pebble *p) -> QVariant { return p->getWeatherLocations(); }},
+        {"DevConnectionEnabled", [](Pebble *p) -> QVariant { return p->devConEnabled(); }},
+        {"DevConnListenPort", [](Pebble *p) -> QVariant { return p->devConListenPort(); }},
+        {"DevConnCloudEnabled", [](Pebble *p) -> QVariant { return p->devConCloudEnabled(); }},
+        {"DevConnectionState", [](Pebble *p) -> QVariant { return p->devConServerState(); }},
+        {"DevConnCloudState", [](Pebble *p) -> QVariant { return p->devConCloudState(); }},
+        {"Screenshots", [](Pebble *p) -> QVariant { return p->screenshots(); }},
+        {"HealthParams", [](Pebble *p) -> QVariant {
+            QVariantMap health;
+            health.insert("enabled", p->healthParams().enabled());
+            health.insert("age", p->healthParams().age());
+            health.insert("gender", p->healthParams().gender() == HealthParams::GenderFemale ? "female" : "male");
+            health.insert("height", p->healthParams().height());
+            health.insert("moreActive", p->healthParams().moreActive());
+            health.insert("sleepMore", p->healthParams().sleepMore());
+            health.insert("weight", p->healthParams().weight());
+            return health;
+        }},
+        {"ImperialUnits", [](Pebble *p) -> QVariant { return p->imperialUnits(); }},
+        {"ProfileWhenConnected", [](Pebble *p) -> QVariant { return p->profileWhen(true); }},
+        {"ProfileWhenDisconnected", [](Pebble *p) -> QVariant { return p->profileWhen(false); }},
+        {"CalendarSyncEnabled", [](Pebble *p) -> QVariant { return p->calendarSyncEnabled(); }},
+    };
+    return readers;
+}
+
+/**
+ * @brief DBusPebble::readProperties - Properties the getters serve, read on the watch thread
+ * @param keys - the ones to read, all when empty
+ */
+QVariantMap DBusPebble::readProperties(Pebble *pebble, const QStringList &keys)
+{
+    const QHash<QString, PropertyReader> &readers = propertyReaders();
+    QVariantMap props;
+    foreach (const QString &key, keys.isEmpty() ? readers.keys() : keys) {
+        props.insert(key, readers.value(key)(pebble));
+    }
+    return props;
+}
+
+/**
+ * @brief DBusPebble::readApps - The installed apps, read on the watch thread
+ */
+QVariantMap DBusPebble::readApps(Pebble *pebble)
+{
+    QStringList ids;
+    QVariantList list;
+    foreach (const QUuid &appId, pebble->installedAppIds()) {
+        QVariantMap app;
+        AppInfo info = pebble->appInfo(appId);
+        app.insert("storeId", info.storeId());
+        app.insert("name", info.shortName());
+        app.insert("vendor", info.companyName());
+        app.insert("watchface", info.isWatchface());
+        app.insert("version", info.versionLabel());
+        app.insert("uuid", info.uuid().toString());
+        app.insert("hasSettings", info.hasSettings());
+        app.insert("icon", info.path() + "/list_image.png");
+        app.insert("systemApp", info.isSystemApp());
+
+        ids << appId.toString();
+        list.append(app);
+    }
+    QVariantMap apps;
+    apps.insert("InstalledAppIds", ids);
+    apps.insert("InstalledApps", list);
+    return apps;
+}
+
+/**
+ * @brief DBusPebble::refresh - Re-reads cached properties without waiting for the watch thread
+ * @param keys - the properties to re-read
+ * @param then - runs on this thread once the cache is up to date
+ * @param apps - re-read the installed apps as well
+ */
+void DBusPebble::refresh(const QStringList &keys, std::function<void()> then, bool apps)
+{
+    Pebble *pebble = m_pebble;
+    QPointer<DBusPebble> self(this);
+    quint64 serial = ++m_requested;
+    invokeOn(pebble, [pebble, self, serial, keys, then, apps]() {
+        QVariantMap props = keys.isEmpty() ? QVariantMap() : readProperties(pebble, keys);
+        QVariantMap appProps = apps ? readApps(pebble) : QVariantMap();
+        // The application object outlives us, self tells whether we are still there
+        invokeOn(QCoreApplication::instance(), [self, serial, props, appProps, then, apps]() {
+            if (!self)
+                return;
+            self->apply(serial, props, appProps, apps);
+            if (then)
+                then();
+        });
+    });
+}
+
+void DBusPebble::apply(quint64 serial, const QVariantMap &props, const QVariantMap &apps, bool withApps)
+{
+    // Reads run on the watch thread in the order they were requested, an older one may still be on its way back
+    for (QVariantMap::const_iterator it = props.begin(); it != props.end(); ++it) {
+        if (serial > m_applied.value(it.key())) {
+            m_applied.insert(it.key(), serial);
+            m_props.insert(it.key(), it.value());
+        }
+    }
+    if (withApps && serial > m_appsApplied) {
+        m_appsApplied = serial;
+        m_apps = apps;
+    }
+}
+
+/**
+ * @brief DBusPebble::store - Caches a value a change signal carried, newer than any read in flight
+ */
+void DBusPebble::store(const QString &key, const QVariant &value)
+{
+    m_applied.insert(key, ++m_requested);
+    m_props.insert(key, value);
+}
+
+/**
+ * @brief DBusPebble::apps - The cached installed apps, read from the watch thread on first use
+ */
+const QVariantMap &DBusPebble::apps() const
+{
+    if (!m_appsApplied) {
+        Pebble *pebble = m_pebble;
+        m_appsApplied = ++const_cast<DBusPebble*>(this)->m_requested;
+        m_apps = callOn(m_pebble, [pebble]() { return readApps(pebble); });
+    }
+    return m_apps;
+}
+
+/**
+ * @brief DBusPebble::change - Runs a setter on the watch thread without waiting for it,
+ * then re-reads the properties it changes. Posted events keep their order, so the read sees the outcome.
+ */
+template<typename F>
+void DBusPebble::change(F f, const QStringList &keys, bool apps)
+{
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [pebble, f]() { f(pebble); });
+    refresh(keys, std::function<void()>(), apps);
 }
 
 QString DBusPebble::Address() const
@@ -40,51 +260,56 @@ QString DBusPebble::Address() const
 
 QString DBusPebble::Name() const
 {
-    return m_pebble->name();
+    return m_props.value("Name").toString();
 }
 
 bool DBusPebble::IsConnected() const
 {
-    return m_pebble->connected();
+    return m_props.value("IsConnected").toBool();
 }
 
 bool DBusPebble::Recovery() const
 {
-    return m_pebble->recovery();
+    return m_props.value("Recovery").toBool();
 }
 
 bool DBusPebble::FirmwareUpgradeAvailable() const
 {
-    return m_pebble->firmwareUpdateAvailable();
+    return m_props.value("FirmwareUpgradeAvailable").toBool();
 }
 
 QString DBusPebble::FirmwareReleaseNotes() const
 {
-    return m_pebble->firmwareReleaseNotes();
+    return m_props.value("FirmwareReleaseNotes").toString();
 }
 
 QString DBusPebble::CandidateFirmwareVersion() const
 {
-    return m_pebble->candidateFirmwareVersion();
+    return m_props.value("CandidateFirmwareVersion").toString();
 }
 
 QVariantMap DBusPebble::NotificationsFilter() const
 {
-    return m_pebble->notificationsFilter();
+    return m_props.value("NotificationsFilter").toMap();
 }
 
 void DBusPebble::SetNotificationFilter(const QString &sourceId, int enabled)
 {
-    m_pebble->setNotificationFilter(sourceId, Pebble::NotificationFilter(enabled));
+    change([=](Pebble *pebble) {
+        pebble->setNotificationFilter(sourceId, Pebble::NotificationFilter(enabled));
+    }, {"NotificationsFilter"});
 }
 
 void DBusPebble::ForgetNotificationFilter(const QString &sourceId)
 {
-    m_pebble->forgetNotificationFilter(sourceId);
+    change([=](Pebble *pebble) {
+        pebble->forgetNotificationFilter(sourceId);
+    }, {"NotificationsFilter"});
 }
 
 QVariantMap DBusPebble::cannedResponses() const
 {
+    // Lives with the platform on this thread
     return m_pebble->cannedMessages();
 }
 /**
@@ -95,16 +320,21 @@ QVariantMap DBusPebble::cannedResponses() const
  */
 void DBusPebble::setCannedResponses(const QVariantMap &cans)
 {
-    m_pebble->setCannedMessages(cans);
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->setCannedMessages(cans);
+    });
 }
 QVariantMap DBusPebble::getCannedResponses(const QStringList &groups) const
 {
-    QHash<QString,QStringList> cans = m_pebble->getCannedMessages(groups);
-    QVariantMap ret;
-    foreach(const QString &key,cans.keys()) {
-        ret.insert(key,QVariant::fromValue(cans.value(key)));
-    }
-    return ret;
+    return callOn(m_pebble, [&]() -> QVariantMap {
+        QHash<QString,QStringList> cans = m_pebble->getCannedMessages(groups);
+        QVariantMap ret;
+        foreach(const QString &key,cans.keys()) {
+            ret.insert(key,QVariant::fromValue(cans.value(key)));
+        }
+        return ret;
+    });
 }
 
 /**
@@ -115,20 +345,25 @@ QVariantMap DBusPebble::getCannedResponses(const QStringList &groups) const
  */
 void DBusPebble::setFavoriteContacts(const QVariantMap &cans)
 {
-    QMap<QString,QStringList> ctxs;
-    foreach(const QString &key, cans.keys()) {
-        ctxs.insert(key,cans.value(key).toStringList());
-    }
-    m_pebble->setCannedContacts(ctxs);
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        QMap<QString,QStringList> ctxs;
+        foreach(const QString &key, cans.keys()) {
+            ctxs.insert(key,cans.value(key).toStringList());
+        }
+        pebble->setCannedContacts(ctxs);
+    });
 }
 QVariantMap DBusPebble::getFavoriteContacts(const QStringList &names) const
 {
-    QMap<QString,QStringList> cans = m_pebble->getCannedContacts(names);
-    QVariantMap ret;
-    foreach(const QString &key,cans.keys()) {
-        ret.insert(key,QVariant::fromValue(cans.value(key)));
-    }
-    return ret;
+    return callOn(m_pebble, [&]() -> QVariantMap {
+        QMap<QString,QStringList> cans = m_pebble->getCannedContacts(names);
+        QVariantMap ret;
+        foreach(const QString &key,cans.keys()) {
+            ret.insert(key,QVariant::fromValue(cans.value(key)));
+        }
+        return ret;
+    });
 }
 
 /**
@@ -138,29 +373,37 @@ QVariantMap DBusPebble::getFavoriteContacts(const QStringList &names) const
  */
 void DBusPebble::voiceSessionResult(const QString &dumpFile, const QVariantList &sentences)
 {
-    m_pebble->voiceSessionResult(dumpFile, sentences);
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->voiceSessionResult(dumpFile, sentences);
+    });
 }
 
 void DBusPebble::resetTimeline()
 {
-    m_pebble->resetTimeline();
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->resetTimeline();
+    });
 }
 
 qint32 DBusPebble::timelineWindowStart() const
 {
-    return m_pebble->timelineWindowStart();
+    return m_props.value("timelineWindowStart").toInt();
 }
 qint32 DBusPebble::timelineWindowFade() const
 {
-    return m_pebble->timelineWindowFade();
+    return m_props.value("timelineWindowFade").toInt();
 }
 qint32 DBusPebble::timelineWindowEnd() const
 {
-    return m_pebble->timelineWindowEnd();
+    return m_props.value("timelineWindowEnd").toInt();
 }
 void DBusPebble::setTimelineWindow(qint32 start, qint32 fade, qint32 end)
 {
-    m_pebble->setTimelineWindow(start,fade,end);
+    change([=](Pebble *pebble) {
+        pebble->setTimelineWindow(start,fade,end);
+    }, {"timelineWindowStart", "timelineWindowFade", "timelineWindowEnd"});
 }
 
 /**
@@ -174,74 +417,89 @@ void DBusPebble::setTimelineWindow(qint32 start, qint32 fade, qint32 end)
  */
 void DBusPebble::insertTimelinePin(const QString &jsonPin)
 {
-    QJsonParseError jpe;
-    QJsonDocument json = QJsonDocument::fromJson(jsonPin.toUtf8(),&jpe);
-    if(jpe.error != QJsonParseError::NoError) {
-        qWarning() << "Cannot parse JSON Pin:" << jpe.errorString() << jsonPin;
-        return;
-    }
-    if(json.isEmpty() || !json.isObject()) {
-        qWarning() << "Empty or flat JSON Pin constructed, ignoring" << jsonPin;
-        return;
-    }
-    m_pebble->insertPin(json.object());
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        QJsonParseError jpe;
+        QJsonDocument json = QJsonDocument::fromJson(jsonPin.toUtf8(),&jpe);
+        if(jpe.error != QJsonParseError::NoError) {
+            qWarning() << "Cannot parse JSON Pin:" << jpe.errorString() << jsonPin;
+            return;
+        }
+        if(json.isEmpty() || !json.isObject()) {
+            qWarning() << "Empty or flat JSON Pin constructed, ignoring" << jsonPin;
+            return;
+        }
+        pebble->insertPin(json.object());
+    });
 }
 
 bool DBusPebble::syncAppsFromCloud() const
 {
-    return m_pebble->syncAppsFromCloud();
+    return m_props.value("syncAppsFromCloud").toBool();
 }
 void DBusPebble::setSyncAppsFromCloud(bool enable)
 {
-    m_pebble->setSyncAppsFromCloud(enable);
+    change([=](Pebble *pebble) {
+        pebble->setSyncAppsFromCloud(enable);
+    }, {"syncAppsFromCloud"});
 }
 
 void DBusPebble::setOAuthToken(const QString &token)
 {
-    m_pebble->setOAuthToken(token);
+    change([=](Pebble *pebble) {
+        pebble->setOAuthToken(token);
+    }, {"oauthToken", "accountName", "accountEmail"});
 }
 QString DBusPebble::oauthToken() const
 {
-    return m_pebble->oauthToken();
+    return m_props.value("oauthToken").toString();
 }
 QString DBusPebble::accountName() const
 {
-    return m_pebble->accountName();
+    return m_props.value("accountName").toString();
 }
 QString DBusPebble::accountEmail() const
 {
-    return m_pebble->accountEmail();
+    return m_props.value("accountEmail").toString();
 }
 
 void DBusPebble::setWeatherApiKey(const QString &key)
 {
-    m_pebble->setWeatherApiKey(key);
+    change([=](Pebble *pebble) {
+        pebble->setWeatherApiKey(key);
+    }, {"WeatherLanguage", "WeatherUnits"});
 }
 void DBusPebble::setWeatherAltKey(const QString &key)
 {
-    m_pebble->setWeatherAltKey(key);
+    change([=](Pebble *pebble) {
+        pebble->setWeatherAltKey(key);
+    }, {"WeatherAltKey", "WeatherLanguage", "WeatherUnits"});
 }
 QString DBusPebble::WeatherAltKey() const
 {
-    return m_pebble->getWeatherAltKey();
+    return m_props.value("WeatherAltKey").toString();
 }
 
 void DBusPebble::setWeatherLanguage(const QString &lang)
 {
-    m_pebble->setWeatherLanguage(lang);
+    change([=](Pebble *pebble) {
+        pebble->setWeatherLanguage(lang);
+    }, {"WeatherLanguage"});
 }
 QString DBusPebble::WeatherLanguage() const
 {
-    return m_pebble->getWeatherLanguage();
+    return m_props.value("WeatherLanguage").toString();
 }
 
 void DBusPebble::setWeatherUnits(const QString &u)
 {
-    m_pebble->setWeatherUnits(u);
+    change([=](Pebble *pebble) {
+        pebble->setWeatherUnits(u);
+    }, {"WeatherUnits"});
 }
 QString DBusPebble::WeatherUnits() const
 {
-    return m_pebble->getWeatherUnits();
+    return m_props.value("WeatherUnits").toString();
 }
 
 /**
@@ -253,11 +511,13 @@ QString DBusPebble::WeatherUnits() const
  */
 void DBusPebble::SetWeatherLocations(const QVariantList &locs)
 {
-    m_pebble->setWeatherLocations(locs);
+    change([=](Pebble *pebble) {
+        pebble->setWeatherLocations(locs);
+    }, {"WeatherLocations"});
 }
 QVariantList DBusPebble::WeatherLocations() const
 {
-    return m_pebble->getWeatherLocations();
+    return m_props.value("WeatherLocations").toList();
 }
 
 /**
@@ -269,60 +529,73 @@ QVariantList DBusPebble::WeatherLocations() const
  */
 void DBusPebble::InjectWeatherData(const QString &loc_name, const QVariantMap &obj)
 {
-    if(!obj.contains("text") || !obj.contains("temperature"))
-        return;
-    m_pebble->injectWeatherConditions(loc_name,obj);
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        if(!obj.contains("text") || !obj.contains("temperature"))
+            return;
+        pebble->injectWeatherConditions(loc_name,obj);
+    });
 }
 
 bool DBusPebble::DevConnectionEnabled() const
 {
-    return m_pebble->devConnection()->enabled();
+    return m_props.value("DevConnectionEnabled").toBool();
 }
 
 quint16 DBusPebble::DevConnListenPort() const
 {
-    return m_pebble->devConnection()->listenPort();
+    return m_props.value("DevConnListenPort").toUInt();
 }
 
 bool DBusPebble::DevConnCloudEnabled() const
 {
-    return m_pebble->devConnection()->cloudEnabled();
+    return m_props.value("DevConnCloudEnabled").toBool();
 }
 
 void DBusPebble::SetDevConnEnabled(bool enabled)
 {
-    m_pebble->devConnection()->setEnabled(enabled);
+    change([=](Pebble *pebble) {
+        pebble->devConnection()->setEnabled(enabled);
+    }, {"DevConnectionEnabled", "DevConnectionState"});
 }
 
 void DBusPebble::SetDevConnListenPort(quint16 port)
 {
-    m_pebble->setDevConListenPort(port);
+    change([=](Pebble *pebble) {
+        pebble->setDevConListenPort(port);
+    }, {"DevConnListenPort"});
 }
 
 void DBusPebble::SetDevConnCloudEnabled(bool enabled)
 {
-    m_pebble->setDevConCloudEnabled(enabled);
+    change([=](Pebble *pebble) {
+        pebble->setDevConCloudEnabled(enabled);
+    }, {"DevConnCloudEnabled", "DevConnCloudState"});
 }
 
 bool DBusPebble::DevConnectionState() const
 {
-    return m_pebble->devConnection()->serverState();
+    return m_props.value("DevConnectionState").toBool();
 }
 
 bool DBusPebble::DevConnCloudState() const
 {
-    return m_pebble->devConnection()->cloudState();
+    return m_props.value("DevConnCloudState").toBool();
 }
 
 QString DBusPebble::startLogDump() const
 {
-    m_pebble->setDevConLogDump(true);
-    return DevConnection::startLogDump();
+    return callOn(m_pebble, [&]() -> QString {
+        m_pebble->setDevConLogDump(true);
+        return DevConnection::startLogDump();
+    });
 }
 QString DBusPebble::stopLogDump() const
 {
-    m_pebble->setDevConLogDump(false);
-    return DevConnection::stopLogDump();
+    return callOn(m_pebble, [&]() -> QString {
+        m_pebble->setDevConLogDump(false);
+        return DevConnection::stopLogDump();
+    });
 }
 QString DBusPebble::getLogDump() const
 {
@@ -334,7 +607,10 @@ bool DBusPebble::isLogDumping() const
 }
 void DBusPebble::setLogLevel(int level) const
 {
-    m_pebble->setDevConLogLevel(level);
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->setDevConLogLevel(level);
+    });
 }
 int DBusPebble::getLogLevel() const
 {
@@ -343,227 +619,357 @@ int DBusPebble::getLogLevel() const
 
 void DBusPebble::InstallApp(const QString &id)
 {
-    qDebug() << "installapp called" << id;
-    m_pebble->installApp(id);
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        qDebug() << "installapp called" << id;
+        pebble->installApp(id);
+    });
 }
 
 void DBusPebble::SideloadApp(const QString &packageFile)
 {
-    m_pebble->sideloadApp(packageFile);
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->sideloadApp(packageFile);
+    });
 }
 
 QStringList DBusPebble::InstalledAppIds() const
 {
-    QStringList ret;
-    foreach (const QUuid &id, m_pebble->installedAppIds()) {
-        ret << id.toString();
-    }
-    return ret;
+    return apps().value("InstalledAppIds").toStringList();
 }
 
 QVariantList DBusPebble::InstalledApps() const
 {
-    QVariantList list;
-    foreach (const QUuid &appId, m_pebble->installedAppIds()) {
-        QVariantMap app;
-        AppInfo info = m_pebble->appInfo(appId);
-        app.insert("storeId", info.storeId());
-        app.insert("name", info.shortName());
-        app.insert("vendor", info.companyName());
-        app.insert("watchface", info.isWatchface());
-        app.insert("version", info.versionLabel());
-        app.insert("uuid", info.uuid().toString());
-        app.insert("hasSettings", info.hasSettings());
-        app.insert("icon", info.path() + "/list_image.png");
-        app.insert("systemApp", info.isSystemApp());
+    return apps().value("InstalledApps").toList();
+}
 
-        list.append(app);
-    }
-    return list;
+/**
+ * @brief Returns the apps that changed since a catalog version seen before.
+ * Pass 0 to get everything. When full is set, changed holds the whole catalog
+ * and anything the client kept from older versions must be dropped. The order
+ * of the apps is only sent when it changed. Returns the current version.
+ * @example gdbus call --session --dest org.rockwork --object-path /org/rockwork/XX_XX_XX_XX_XX_XX --method org.rockwork.Pebble.AppCatalog 0
+ */
+quint32 DBusPebble::AppCatalog(quint32 sinceVersion, bool &full, QList<AppCatalogEntry> &changed, QStringList &removed, QStringList &order) const
+{
+    return callOn(m_pebble, [&]() -> quint32 {
+        AppManager::CatalogDelta delta = m_pebble->appCatalog(sinceVersion);
+        full = delta.full;
+        changed.clear();
+        foreach (const QUuid &appId, delta.changed) {
+            AppInfo info = m_pebble->appInfo(appId);
+            AppCatalogEntry entry;
+            entry.uuid = info.uuid().toString();
+            entry.storeId = info.storeId();
+            entry.name = info.shortName();
+            entry.vendor = info.companyName();
+            entry.version = info.versionLabel();
+            entry.icon = info.path() + "/list_image.png";
+            entry.watchface = info.isWatchface();
+            entry.hasSettings = info.hasSettings();
+            entry.systemApp = info.isSystemApp();
+            changed.append(entry);
+        }
+        removed.clear();
+        foreach (const QUuid &appId, delta.removed) {
+            removed << appId.toString();
+        }
+        order.clear();
+        if (delta.orderChanged) {
+            foreach (const QUuid &appId, m_pebble->installedAppIds()) {
+                order << appId.toString();
+            }
+        }
+        return delta.version;
+    });
 }
 
 void DBusPebble::RemoveApp(const QString &id)
 {
-    m_pebble->removeApp(id);
+    change([=](Pebble *pebble) {
+        pebble->removeApp(id);
+    }, QStringList(), true);
 }
 
 void DBusPebble::ConfigurationURL(const QString &uuid)
 {
-    m_pebble->requestConfigurationURL(QUuid(uuid));
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->requestConfigurationURL(QUuid(uuid));
+    });
 }
 
 void DBusPebble::ConfigurationClosed(const QString &uuid, const QString &result)
 {
-    m_pebble->configurationClosed(QUuid(uuid), result);
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->configurationClosed(QUuid(uuid), result);
+    });
 }
 
 void DBusPebble::SetAppOrder(const QStringList &newList)
 {
-    QList<QUuid> uuidList;
-    foreach (const QString &id, newList) {
-        uuidList << QUuid(id);
-    }
-    m_pebble->setAppOrder(uuidList);
+    change([=](Pebble *pebble) {
+        QList<QUuid> uuidList;
+        foreach (const QString &id, newList) {
+            uuidList << QUuid(id);
+        }
+        pebble->setAppOrder(uuidList);
+    }, QStringList(), true);
 }
 
 void DBusPebble::SendAppData(const QString &uuid, const QVariantMap &data)
 {
-    m_pebble->sendAppData(QUuid(uuid), QVariantMap(data));
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->sendAppData(QUuid(uuid), QVariantMap(data));
+    });
 }
 
 void DBusPebble::CloseApp(const QString &uuid)
 {
-    m_pebble->closeApp(QUuid(uuid));
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->closeApp(QUuid(uuid));
+    });
 }
 
 void DBusPebble::LaunchApp(const QString &uuid)
 {
-    m_pebble->launchApp(QUuid(uuid));
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->launchApp(QUuid(uuid));
+    });
 }
 
 void DBusPebble::RequestScreenshot()
 {
-    m_pebble->requestScreenshot();
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->requestScreenshot();
+    });
 }
 
 QStringList DBusPebble::Screenshots() const
 {
-    return m_pebble->screenshots();
+    return m_props.value("Screenshots").toStringList();
 }
 
 void DBusPebble::RemoveScreenshot(const QString &filename)
 {
-    qDebug() << "Should remove screenshot" << filename;
-    m_pebble->removeScreenshot(filename);
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        qDebug() << "Should remove screenshot" << filename;
+        pebble->removeScreenshot(filename);
+    });
 }
 
 void DBusPebble::PerformFirmwareUpgrade()
 {
-    m_pebble->upgradeFirmware();
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->upgradeFirmware();
+    });
 }
 
 void DBusPebble::LoadLanguagePack(const QString &pblFile) const
 {
-    m_pebble->loadLanguagePack(pblFile);
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->loadLanguagePack(pblFile);
+    });
 }
 
 bool DBusPebble::UpgradingFirmware() const
 {
-    return m_pebble->upgradingFirmware();
+    return m_props.value("UpgradingFirmware").toBool();
 }
 
 QString DBusPebble::SerialNumber() const
 {
-    return m_pebble->serialNumber();
+    return m_props.value("SerialNumber").toString();
 }
 
 QString DBusPebble::PlatformString() const
 {
-    return m_pebble->platformString();
+    return m_props.value("PlatformString").toString();
 }
 
 QString DBusPebble::HardwarePlatform() const
 {
-    return m_pebble->platformName();
+    return m_props.value("HardwarePlatform").toString();
 }
 
 QString DBusPebble::SoftwareVersion() const
 {
-    return m_pebble->softwareVersion();
+    return m_props.value("SoftwareVersion").toString();
 }
 
 QString DBusPebble::LanguageVersion() const
 {
-    return QString("%1:%2").arg(m_pebble->language()).arg(QString::number(m_pebble->langVer()));
+    return m_props.value("LanguageVersion").toString();
 }
 
 int DBusPebble::Model() const
 {
-    return m_pebble->model();
+    return m_props.value("Model").toInt();
 }
 
 void DBusPebble::DumpLogs(const QString &fileName) const
 {
-    qDebug() << "dumplogs" << fileName;
-    m_pebble->dumpLogs(fileName);
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        qDebug() << "dumplogs" << fileName;
+        pebble->dumpLogs(fileName);
+    });
+}
+
+/**
+ * @brief DBusPebble::Metrics - Snapshot of daemon counters and latency histograms for this watch
+ * @return a{sv} - {"counters": a{st}, "histograms": a{s{count,min,max,mean,p50,p90,p99,p999}}, ...}
+ * @example gdbus call -e -d org.rockwork -o /org/rockwork/B0_B4_48_00_00_00 -m org.rockwork.Pebble.Metrics
+ */
+QVariantMap DBusPebble::Metrics() const
+{
+    return callOn(m_pebble, [&]() { return m_pebble->metrics()->snapshot(); });
+}
+
+void DBusPebble::ResetMetrics()
+{
+    Pebble *pebble = m_pebble;
+    invokeOn(pebble, [=]() {
+        pebble->metrics()->writeSnapshot();
+        pebble->metrics()->reset();
+    });
+}
+
+/**
+ * @brief DBusPebble::DumpTrace - Write recent frame trace (pcap, DLT_USER0) of this watch
+ * @param fileName - target file, empty for trace-<timestamp>.pcap in the watch storage dir
+ * @return s - written file name or empty on failure
+ * @example gdbus call -e -d org.rockwork -o /org/rockwork/B0_B4_48_00_00_00 -m org.rockwork.Pebble.DumpTrace ""
+ */
+QString DBusPebble::DumpTrace(const QString &fileName) const
+{
+    return callOn(m_pebble, [&]() -> QString {
+        QString target = fileName;
+        if (target.isEmpty())
+            target = m_pebble->storagePath() + "trace-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".pcap";
+        return m_pebble->traceRecorder()->dump(target) ? target : QString();
+    });
+}
+
+/**
+ * @brief DBusPebble::AnalyzeTrace - Per-endpoint bandwidth, round trips and stalls of a trace capture
+ * @param fileName - capture written by DumpTrace
+ * @return a{sv} - see TraceRecorder::analyze
+ * @example gdbus call -e -d org.rockwork -o /org/rockwork/B0_B4_48_00_00_00 -m org.rockwork.Pebble.AnalyzeTrace "/path/to/trace.pcap"
+ */
+QVariantMap DBusPebble::AnalyzeTrace(const QString &fileName) const
+{
+    return TraceRecorder::analyze(fileName);
 }
 
 QVariantMap DBusPebble::HealthParams() const
 {
-    QVariantMap map;
-    map.insert("enabled", m_pebble->healthParams().enabled());
-    map.insert("age", m_pebble->healthParams().age());
-    map.insert("gender", m_pebble->healthParams().gender() == HealthParams::GenderFemale ? "female" : "male");
-    map.insert("height", m_pebble->healthParams().height());
-    map.insert("moreActive", m_pebble->healthParams().moreActive());
-    map.insert("sleepMore", m_pebble->healthParams().sleepMore());
-    map.insert("weight", m_pebble->healthParams().weight());
-    return map;
+    return m_props.value("HealthParams").toMap();
 }
 
 void DBusPebble::SetHealthParams(const QVariantMap &healthParams)
 {
-    ::HealthParams params;
-    params.setEnabled(healthParams.value("enabled").toBool());
-    params.setAge(healthParams.value("age").toInt());
-    params.setGender(healthParams.value("gender").toString() == "female" ? HealthParams::GenderFemale : HealthParams::GenderMale);
-    params.setHeight(healthParams.value("height").toInt());
-    params.setWeight(healthParams.value("weight").toInt());
-    params.setMoreActive(healthParams.value("moreActive").toBool());
-    params.setSleepMore(healthParams.value("sleepMore").toBool());
-    m_pebble->setHealthParams(params);
+    change([=](Pebble *pebble) {
+        ::HealthParams params;
+        params.setEnabled(healthParams.value("enabled").toBool());
+        params.setAge(healthParams.value("age").toInt());
+        params.setGender(healthParams.value("gender").toString() == "female" ? HealthParams::GenderFemale : HealthParams::GenderMale);
+        params.setHeight(healthParams.value("height").toInt());
+        params.setWeight(healthParams.value("weight").toInt());
+        params.setMoreActive(healthParams.value("moreActive").toBool());
+        params.setSleepMore(healthParams.value("sleepMore").toBool());
+        pebble->setHealthParams(params);
+    }, {"HealthParams"});
 }
 
 bool DBusPebble::ImperialUnits() const
 {
-    return m_pebble->imperialUnits();
+    return m_props.value("ImperialUnits").toBool();
 }
 
 void DBusPebble::SetImperialUnits(bool imperialUnits)
 {
-    qDebug() << "setting imperial units" << imperialUnits;
-    m_pebble->setImperialUnits(imperialUnits);
+    change([=](Pebble *pebble) {
+        qDebug() << "setting imperial units" << imperialUnits;
+        pebble->setImperialUnits(imperialUnits);
+    }, {"ImperialUnits"});
 }
 
 void DBusPebble::onProfileConnectionSwitchChanged(bool connected) {
     if (connected)
-        emit ProfileWhenConnectedChanged();
+        emit ProfileWhenConnectedChanged(ProfileWhenConnected());
     else
-        emit ProfileWhenDisconnectedChanged();
+        emit ProfileWhenDisconnectedChanged(ProfileWhenDisconnected());
 }
 
 QString DBusPebble::ProfileWhenConnected() {
-    return m_pebble->profileWhen(true);
+    return m_props.value("ProfileWhenConnected").toString();
 }
 
 QString DBusPebble::ProfileWhenDisconnected() {
-    return m_pebble->profileWhen(false);
+    return m_props.value("ProfileWhenDisconnected").toString();
 }
 
 void DBusPebble::SetProfileWhenConnected(const QString &profile) {
-    qDebug() << "setting connected profile: " << profile;
-    m_pebble->setProfileWhen(true, profile);
+    change([=](Pebble *pebble) {
+        qDebug() << "setting connected profile: " << profile;
+        pebble->setProfileWhen(true, profile);
+    }, {"ProfileWhenConnected"});
 }
 
 void DBusPebble::SetProfileWhenDisconnected(const QString &profile) {
-    qDebug() << "setting disconnected profile: " << profile;
-    m_pebble->setProfileWhen(false, profile);
+    change([=](Pebble *pebble) {
+        qDebug() << "setting disconnected profile: " << profile;
+        pebble->setProfileWhen(false, profile);
+    }, {"ProfileWhenDisconnected"});
 }
 
 bool DBusPebble::CalendarSyncEnabled() const
 {
-    return m_pebble->calendarSyncEnabled();
+    return m_props.value("CalendarSyncEnabled").toBool();
 }
 
 void DBusPebble::SetCalendarSyncEnabled(bool enabled)
 {
-    m_pebble->setCalendarSyncEnabled(enabled);
+    change([=](Pebble *pebble) {
+        pebble->setCalendarSyncEnabled(enabled);
+    }, {"CalendarSyncEnabled"});
+}
+
+
+QDBusArgument &operator<<(QDBusArgument &argument, const AppCatalogEntry &entry)
+{
+    argument.beginStructure();
+    argument << entry.uuid << entry.storeId << entry.name << entry.vendor << entry.version << entry.icon
+             << entry.watchface << entry.hasSettings << entry.systemApp;
+    argument.endStructure();
+    return argument;
 }
 
+const QDBusArgument &operator>>(const QDBusArgument &argument, AppCatalogEntry &entry)
+{
+    argument.beginStructure();
+    argument >> entry.uuid >> entry.storeId >> entry.name >> entry.vendor >> entry.version >> entry.icon
+             >> entry.watchface >> entry.hasSettings >> entry.systemApp;
+    argument.endStructure();
+    return argument;
+}
 
 DBusInterface::DBusInterface(QObject *parent) :
     QObject(parent)
 {
+    qDBusRegisterMetaType<AppCatalogEntry>();
+    qDBusRegisterMetaType<QList<AppCatalogEntry> >();
+
     QDBusConnection::sessionBus().registerService("org.rockwork");
     QDBusConnection::sessionBus().registerObject("/org/rockwork/Manager", this, QDBusConnection::ExportScriptableSlots|QDBusConnection::ExportScriptableSignals);
 
@@ -612,7 +1018,8 @@ void DBusInterface::pebbleRemoved(Pebble *pebble)
     QString address = pebble->address().toString().replace(":", "_");
 
     QDBusConnection::sessionBus().unregisterObject("/org/rockwork/" + address);
-    m_dbusPebbles.remove(address);
+    // The Pebble is going away on its thread, don't leave a dangling interface behind
+    delete m_dbusPebbles.take(address);
 
     emit PebblesChanged();
 }
@@ -4,9 +4,36 @@
 #include <QObject>
 #include <QDBusAbstractAdaptor>
 #include <QDBusObjectPath>
+#include <QDBusArgument>
+#include <QHash>
+
+#include <functional>
 
 class Pebble;
 
+// One app of the catalog, marshalled as (ssssssbbb)
+struct AppCatalogEntry
+{
+    QString uuid;
+    QString storeId;
+    QString name;
+    QString vendor;
+    QString version;
+    QString icon;
+    bool watchface = false;
+    bool hasSettings = false;
+    bool systemApp = false;
+};
+Q_DECLARE_METATYPE(AppCatalogEntry)
+Q_DECLARE_METATYPE(QList<AppCatalogEntry>)
+
+QDBusArgument &operator<<(QDBusArgument &argument, const AppCatalogEntry &entry);
+const QDBusArgument &operator>>(const QDBusArgument &argument, AppCatalogEntry &entry);
+
+// Lives on the main thread with the bus connection. The Pebble runs on its own
+// thread. Setters and commands are posted there with invokeOn(), only calls returning
+// data wait with callOn(). Property getters answer from a cache refreshed on the
+// Pebble's change signals, so clients never wait on a busy watch.
 class DBusPebble: public QObject
 {
     Q_OBJECT
@@ -19,6 +46,7 @@ signals:
     void Disconnected();
     void NotificationFilterChanged(const QString &sourceId, const QString &name, const QString &icon, int enabled);
     void InstalledAppsChanged();
+    void AppCatalogChanged(quint32 version);
     void OpenURL(const QString &uuid, const QString &url);
     void ScreenshotAdded(const QString &filename);
     void ScreenshotRemoved(const QString &filename);
@@ -27,11 +55,12 @@ signals:
     void LanguageVersionChanged();
     void LogsDumped(bool success);
 
-    void HealthParamsChanged();
-    void ImperialUnitsChanged();
-    void ProfileWhenConnectedChanged();
-    void ProfileWhenDisconnectedChanged();
-    void CalendarSyncEnabledChanged();
+    // Settings signals carry the new value so clients can keep a cache without calling back
+    void HealthParamsChanged(const QVariantMap &healthParams);
+    void ImperialUnitsChanged(bool imperialUnits);
+    void ProfileWhenConnectedChanged(const QString &profile);
+    void ProfileWhenDisconnectedChanged(const QString &profile);
+    void CalendarSyncEnabledChanged(bool enabled);
     void WeatherLocationsChanged(const QVariantList &locations);
 
     void DevConnectionChanged(const bool state);
@@ -41,6 +70,8 @@ signals:
 
     void voiceSessionSetup(const QString &dumpFile, const QString &contentType, const QString &appUuid);
     void voiceSessionStream(const QString &dumpFile);
+    // Live 16bit PCM of the session, read the unix socket at socketPath until EOF
+    void voiceSessionPcm(const QString &dumpFile, const QString &socketPath, const QString &contentType);
     void voiceSessionDumped(const QString &dumpFile);
     void voiceSessionClosed(const QString &dumpFIle);
 
@@ -110,6 +141,7 @@ public slots:
     void SideloadApp(const QString &packageFile);
     QStringList InstalledAppIds() const;
     QVariantList InstalledApps() const;
+    quint32 AppCatalog(quint32 sinceVersion, bool &full, QList<AppCatalogEntry> &changed, QStringList &removed, QStringList &order) const;
     void RemoveApp(const QString &id);
     void ConfigurationURL(const QString &uuid);
     void ConfigurationClosed(const QString &uuid, const QString &result);
@@ -121,6 +153,10 @@ public slots:
     QStringList Screenshots() const;
     void RemoveScreenshot(const QString &filename);
     void DumpLogs(const QString &fileName) const;
+    QVariantMap Metrics() const;
+    void ResetMetrics();
+    QString DumpTrace(const QString &fileName) const;
+    QVariantMap AnalyzeTrace(const QString &fileName) const;
 
     void setWeatherApiKey(const QString &key);
     QString WeatherUnits() const;
@@ -151,7 +187,20 @@ public slots:
     void SetCalendarSyncEnabled(bool enabled);
 
 private:
+    static QVariantMap readProperties(Pebble *pebble, const QStringList &keys);
+    static QVariantMap readApps(Pebble *pebble);
+    const QVariantMap &apps() const;
+    void refresh(const QStringList &keys, std::function<void()> then = std::function<void()>(), bool apps = false);
+    void apply(quint64 serial, const QVariantMap &props, const QVariantMap &apps, bool withApps);
+    void store(const QString &key, const QVariant &value);
+    template<typename F> void change(F f, const QStringList &keys, bool apps = false);
+
     Pebble *m_pebble;
+    QVariantMap m_props;
+    mutable QVariantMap m_apps;
+    quint64 m_requested = 0;
+    QHash<QString, quint64> m_applied; // serial of the read each property came from
+    mutable quint64 m_appsApplied = 0;
 };
 
 class DBusInterface : public QObject
@@ -1,6 +1,7 @@
 #include "appdownloader.h"
 #include "pebble.h"
 #include "ziphelper.h"
+#include "filedownload.h"
 
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
@@ -89,29 +90,24 @@ void AppDownloader::appJsonFetched()
 
 void AppDownloader::fetchPackage(const QString &url, const QString &file)
 {
-    QNetworkRequest request(url);
-    QNetworkReply *reply = m_nam->get(request);
     qDebug() << "Fetching app to" << file;
-    reply->setProperty("file", file);
-    connect(reply, &QNetworkReply::finished, this, &AppDownloader::packageFetched);
+    FileDownload *download = new FileDownload(m_nam, QUrl(url), m_storagePath + file, this);
+    download->setProperty("file", file);
+    connect(download, &FileDownload::finished, this, &AppDownloader::packageFetched);
+    download->start();
 }
 
-void AppDownloader::packageFetched()
+void AppDownloader::packageFetched(bool success)
 {
-    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
-    reply->deleteLater();
-
-    QString file = reply->property("file").toString();
+    FileDownload *download = qobject_cast<FileDownload*>(sender());
+    download->deleteLater();
 
-    QFile f(m_storagePath + file);
-    if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
-        qWarning() << "Error opening file for writing";
+    if (!success) {
+        qWarning() << "Error fetching app package" << download->url();
         return;
     }
-    f.write(reply->readAll());
-    f.flush();
-    f.close();
 
+    QString file = download->property("file").toString();
     QString appid = file.split("/").first();
 
     if (!ZipHelper::unpackArchive(m_storagePath+file, m_storagePath + appid)) {
@@ -20,7 +20,7 @@ signals:
 
 private slots:
     void appJsonFetched();
-    void packageFetched();
+    void packageFetched(bool success);
 
 private:
     void fetchPackage(const QString &url, const QString &storeId);
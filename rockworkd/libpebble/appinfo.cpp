@@ -23,14 +23,14 @@ AppInfo::AppInfo(const QString &path):
         return;
     }
 
-    QFile f(path + "/appinfo.json");
-    if (!f.open(QFile::ReadOnly)) {
+    QByteArray appinfo = read("appinfo.json");
+    if (appinfo.isEmpty()) {
         qWarning() << "Error opening appinfo.json";
         return;
     }
 
     QJsonParseError error;
-    QJsonDocument jsonDoc = QJsonDocument::fromJson(f.readAll(), &error);
+    QJsonDocument jsonDoc = QJsonDocument::fromJson(appinfo, &error);
     if (error.error != QJsonParseError::NoError) {
         qWarning() << "Error parsing appinfo.json";
         return;
@@ -71,8 +71,7 @@ AppInfo::AppInfo(const QString &path):
         }
     }
 
-    QFile jsApp(path + "/pebble-js-app.js");
-    m_isJsKit = jsApp.exists();
+    m_isJsKit = exists("pebble-js-app.js");
 }
 
 AppInfo::AppInfo(const QUuid &uuid, bool isWatchFace, const QString &name, const QString &vendor, bool hasSettings):
@@ -164,15 +163,12 @@ AppInfo::Capabilities AppInfo::capabilities() const
 QVariantMap & AppInfo::layouts(HardwarePlatform hw)
 {
     if(!m_layouts.contains(hw)) {
-        QString lf=file(FileTypeLayouts,hw);
-        QFile f(lf);
-        if(f.exists()) {
-            if(f.open(QFile::ReadOnly)) {
-                QJsonParseError jpe;
-                QJsonDocument jd=QJsonDocument::fromJson(f.readAll(),&jpe);
-                if(jpe.error==QJsonParseError::NoError) {
-                    m_layouts.insert(hw,jd.toVariant().toMap());
-                }
+        QByteArray lf=data(FileTypeLayouts,hw);
+        if(!lf.isEmpty()) {
+            QJsonParseError jpe;
+            QJsonDocument jd=QJsonDocument::fromJson(lf,&jpe);
+            if(jpe.error==QJsonParseError::NoError) {
+                m_layouts.insert(hw,jd.toVariant().toMap());
             }
         }
     }
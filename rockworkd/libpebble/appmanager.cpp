@@ -1,4 +1,5 @@
 #include <QDir>
+#include <QDateTime>
 #include <QSettings>
 
 #include "appmanager.h"
@@ -21,6 +22,12 @@ AppManager::AppManager(Pebble *pebble, WatchConnection *connection)
       m_pebble(pebble),
       m_connection(connection)
 {
+    // Versions carry a random epoch in their top bits so a client holding one from
+    // a previous run of the daemon is told to start over
+    qsrand(QDateTime::currentMSecsSinceEpoch());
+    newCatalogEpoch();
+    connect(this, &AppManager::appsChanged, this, &AppManager::updateCatalog);
+
     QDir dataDir(m_pebble->storagePath() + "/apps/");
     if (!dataDir.exists() && !dataDir.mkpath(dataDir.absolutePath())) {
         qWarning() << "could not create apps dir" << dataDir.absolutePath();
@@ -58,7 +65,118 @@ AppInfo AppManager::info(const QUuid &uuid) const
 //    return m_appsUuids.value(m_appsIds.value(id));
 //}
 
+quint32 AppManager::catalogVersion() const
+{
+    return m_catalogVersion;
+}
+
+AppManager::CatalogDelta AppManager::catalogSince(quint32 version) const
+{
+    CatalogDelta delta;
+    delta.version = m_catalogVersion;
+    // Anything from another epoch falls outside the range, as do versions whose tombstones were pruned
+    delta.full = version < m_catalogBase || version > m_catalogVersion;
+    if (delta.full) {
+        delta.changed = m_catalogOrder;
+        delta.orderChanged = true;
+        return delta;
+    }
+    for (QHash<QUuid, QPair<quint32, QString> >::const_iterator it = m_catalog.begin(); it != m_catalog.end(); ++it) {
+        if (it.value().first > version) {
+            delta.changed.append(it.key());
+        }
+    }
+    for (QHash<QUuid, quint32>::const_iterator it = m_catalogRemoved.begin(); it != m_catalogRemoved.end(); ++it) {
+        if (it.value() > version) {
+            delta.removed.append(it.key());
+        }
+    }
+    delta.orderChanged = m_orderVersion > version;
+    return delta;
+}
+
+QString AppManager::catalogFingerprint(const AppInfo &info)
+{
+    return QStringList({info.path(), info.storeId(), info.shortName(), info.companyName(), info.versionLabel(),
+                        QString::number(info.isWatchface()), QString::number(info.hasSettings()), QString::number(info.isSystemApp())}).join('\n');
+}
+
+void AppManager::updateCatalog()
+{
+    if (m_scanning) {
+        return;
+    }
+    quint32 next = m_catalogVersion + 1;
+    bool changed = false;
+    foreach (const QUuid &uuid, m_appList) {
+        QString fingerprint = catalogFingerprint(m_apps.value(uuid));
+        if (!m_catalog.contains(uuid) || m_catalog.value(uuid).second != fingerprint) {
+            m_catalog.insert(uuid, qMakePair(next, fingerprint));
+            m_catalogRemoved.remove(uuid);
+            changed = true;
+        }
+    }
+    foreach (const QUuid &uuid, m_catalog.keys()) {
+        if (!m_apps.contains(uuid)) {
+            m_catalog.remove(uuid);
+            m_catalogRemoved.insert(uuid, next);
+            changed = true;
+        }
+    }
+    if (m_catalogOrder != m_appList) {
+        m_catalogOrder = m_appList;
+        m_orderVersion = next;
+        changed = true;
+    }
+    if (!changed) {
+        return;
+    }
+    m_catalogVersion = next;
+
+    // Removals older than the last s_maxCatalogRemoved are forgotten, clients from before them start over
+    while (m_catalogRemoved.count() > s_maxCatalogRemoved) {
+        quint32 oldest = next;
+        foreach (quint32 version, m_catalogRemoved) {
+            oldest = qMin(oldest, version);
+        }
+        for (QHash<QUuid, quint32>::iterator it = m_catalogRemoved.begin(); it != m_catalogRemoved.end();) {
+            it = it.value() == oldest ? m_catalogRemoved.erase(it) : it + 1;
+        }
+        m_catalogBase = oldest;
+    }
+
+    if ((m_catalogVersion & s_catalogCounterMask) == s_catalogCounterMask) {
+        qDebug() << "App catalog versions used up, starting a new epoch";
+        newCatalogEpoch();
+    }
+}
+
+void AppManager::newCatalogEpoch()
+{
+    quint32 epoch;
+    do {
+        epoch = (quint32(qrand()) << s_catalogCounterBits) & ~s_catalogCounterMask;
+    } while (epoch == (m_catalogBase & ~s_catalogCounterMask));
+    // Counter starts at 1, version 0 always asks for everything
+    m_catalogBase = epoch | 1;
+    m_catalogVersion = m_catalogBase;
+    m_orderVersion = m_catalogBase;
+    for (QHash<QUuid, QPair<quint32, QString> >::iterator it = m_catalog.begin(); it != m_catalog.end(); ++it) {
+        it.value().first = m_catalogBase;
+    }
+    m_catalogRemoved.clear();
+}
+
 void AppManager::rescan()
+{
+    // Diff the catalog once against the outcome rather than for every app found
+    m_scanning = true;
+    scanApps();
+    m_scanning = false;
+    emit appsChanged();
+}
+
+void AppManager::scanApps()
 {
     m_appList.clear();
     m_apps.clear();
@@ -40,10 +40,22 @@ public:
         ActionGetAppBankUuids = 5
     };
 
+    // What changed in the app list since a given catalog version
+    struct CatalogDelta {
+        quint32 version = 0;
+        bool full = false; // client must drop what it has, changed holds everything
+        QList<QUuid> changed;
+        QList<QUuid> removed;
+        bool orderChanged = false;
+    };
+
     explicit AppManager(Pebble *pebble, WatchConnection *connection);
 
     QList<QUuid> appUuids() const;
 
+    quint32 catalogVersion() const;
+    CatalogDelta catalogSince(quint32 version) const;
+
     AppInfo info(const QUuid &uuid) const;
 
     void insertAppMetaData(const QUuid &uuid, bool force=false);
@@ -65,6 +77,7 @@ private slots:
     void blobdbAckHandler(quint8 db, quint8 cmd, const QByteArray &key, quint8 ack);
     void handleAppFetchMessage(const QByteArray &data);
     void sortingReply(const QByteArray &data);
+    void updateCatalog();
 
 signals:
     void appsChanged();
@@ -73,11 +86,27 @@ signals:
     void appInserted(const QUuid &uuid);
 
 private:
+    void scanApps();
+    static QString catalogFingerprint(const AppInfo &info);
+    void newCatalogEpoch();
+    // Catalog version: random epoch in the top bits, change counter below
+    static const int s_catalogCounterBits = 20;
+    static const quint32 s_catalogCounterMask = (1u << s_catalogCounterBits) - 1;
+    static const int s_maxCatalogRemoved = 64;
+
     Pebble *m_pebble;
     WatchConnection *m_connection;
     QList<QUuid> m_appList;
     QHash<QUuid, AppInfo> m_apps;
     QString m_blobDBStoragePath;
+
+    bool m_scanning = false;
+    quint32 m_catalogBase = 0; // oldest version a delta can be served from
+    quint32 m_catalogVersion;
+    quint32 m_orderVersion;
+    QList<QUuid> m_catalogOrder;
+    QHash<QUuid, QPair<quint32, QString> > m_catalog; // version it last changed at, fingerprint
+    QHash<QUuid, quint32> m_catalogRemoved;
 };
 
 #endif // APPMANAGER_H
@@ -4,6 +4,7 @@
 #include "appmsgmanager.h"
 #include "watchdatareader.h"
 #include "watchdatawriter.h"
+#include "metrics.h"
 
 // TODO D-Bus server for non JS kit apps!!!!
 
@@ -75,17 +76,28 @@ void AppMsgManager::handleApplicationMessage(const QByteArray &data)
 }
 
 void AppMsgManager::send(const QUuid &uuid, const QVariantMap &data, const std::function<void ()> &ackCallback, const std::function<void ()> &nackCallback)
+{
+    //TODO check for byte arrays and byte arrays with strings (https://developer.pebble.com/guides/pebble-apps/pebblekit-js/js-app-comm/#appmessage-objects-in-javascript)
+    WatchConnection::Dict dict = mapAppKeys(uuid, data);
+    qDebug() << "Encoding appmsg to" << uuid << "with dict" << dict;
+
+    QByteArray encoded;
+    WatchDataWriter writer(&encoded);
+    writer.writeDict(dict);
+    sendEncoded(uuid, encoded, ackCallback, nackCallback);
+}
+
+void AppMsgManager::sendEncoded(const QUuid &uuid, const QByteArray &dict, const std::function<void ()> &ackCallback, const std::function<void ()> &nackCallback)
 {
     PendingTransaction trans;
     trans.uuid = uuid;
     trans.transactionId = ++_lastTransactionId;
-    //TODO check for byte arrays and byte arrays with strings (https://developer.pebble.com/guides/pebble-apps/pebblekit-js/js-app-comm/#appmessage-objects-in-javascript)
-    trans.dict = mapAppKeys(uuid, data);
+    trans.dict = dict;
     trans.ackCallback = ackCallback;
     trans.nackCallback = nackCallback;
 
     qDebug() << "Queueing appmsg" << trans.transactionId << "to" << trans.uuid
-                      << "with dict" << trans.dict;
+                      << "with" << trans.dict.size() << "bytes of dict";
 
     _pending.enqueue(trans);
     if (_pending.size() == 1) {
@@ -100,9 +112,21 @@ void AppMsgManager::setMessageHandler(const QUuid &uuid, MessageHandlerFunc func
     _handlers.insert(uuid, func);
 }
 
+void AppMsgManager::setEncodedMessageHandler(const QUuid &uuid, EncodedMessageHandlerFunc func)
+{
+    _encodedHandlers.insert(uuid, func);
+}
+
 void AppMsgManager::clearMessageHandler(const QUuid &uuid)
 {
     _handlers.remove(uuid);
+    _encodedHandlers.remove(uuid);
+}
+
+void AppMsgManager::reportUnknownAppKey(const QUuid &uuid, int key)
+{
+    qWarning() << "Unknown appKey value" << key << "for app with GUID" << uuid;
+    emit appButtonPressed(uuid.toString(), key);
 }
 
 uint AppMsgManager::lastTransactionId() const
@@ -200,8 +224,7 @@ QVariantMap AppMsgManager::mapAppKeys(const QUuid &uuid, const WatchConnection::
         if (info.appKeys().values().contains(it.key())) {
             data.insert(info.appKeys().key(it.key()), it.value());
         } else {
-            qWarning() << "Unknown appKey value" << it.key() << "for app with GUID" << uuid;
-            emit appButtonPressed(uuid.toString(), it.key());
+            reportUnknownAppKey(uuid, it.key());
             data.insert(QString::number(it.key()), it.value());
         }
     }
@@ -242,6 +265,19 @@ bool AppMsgManager::unpackPushMessage(const QByteArray &msg, quint8 *transaction
     return true;
 }
 
+bool AppMsgManager::unpackPushHeader(const QByteArray &msg, quint8 *transaction, QUuid *uuid)
+{
+    WatchDataReader reader(msg);
+    quint8 code = reader.read<quint8>();
+    Q_UNUSED(code);
+    Q_ASSERT(code == AppMessagePush);
+
+    *transaction = reader.read<quint8>();
+    *uuid = reader.readUuid();
+
+    return !reader.bad();
+}
+
 QByteArray AppMsgManager::buildPushMessage(quint8 transaction, const QUuid &uuid, const WatchConnection::Dict &dict)
 {
     QByteArray ba;
@@ -254,6 +290,19 @@ QByteArray AppMsgManager::buildPushMessage(quint8 transaction, const QUuid &uuid
     return ba;
 }
 
+QByteArray AppMsgManager::buildPushMessage(quint8 transaction, const QUuid &uuid, const QByteArray &dict)
+{
+    QByteArray ba;
+    ba.reserve(1 + 1 + 16 + dict.size());
+    WatchDataWriter writer(&ba);
+    writer.write<quint8>(AppMessagePush);
+    writer.write<quint8>(transaction);
+    writer.writeUuid(uuid);
+    ba.append(dict);
+
+    return ba;
+}
+
 QByteArray AppMsgManager::buildLaunchMessage(quint8 messageType, const QUuid &uuid)
 {
     QByteArray ba;
@@ -346,29 +395,42 @@ void AppMsgManager::handleLauncherPushMessage(const QByteArray &data)
 
 void AppMsgManager::handlePushMessage(const QByteArray &data)
 {
-    quint8 transaction;
+    quint8 transaction = 0;
     QUuid uuid;
-    WatchConnection::Dict dict;
 
-    if (!unpackPushMessage(data, &transaction, &uuid, &dict)) {
+    if (!unpackPushHeader(data, &transaction, &uuid)) {
         qWarning() << "Failed to parse APP_MSG PUSH";
         m_connection->writeToPebble(WatchConnection::EndpointApplicationMessage, buildNackMessage(transaction));
         return;
     }
 
-    qDebug() << "Received appmsg PUSH from" << uuid << "with" << dict;
-
-    QVariantMap msg = mapAppKeys(uuid, dict);
-    qDebug() << "Mapped dict" << msg;
-
     bool result;
 
-    MessageHandlerFunc handler = _handlers.value(uuid);
-    if (handler) {
-        result = handler(msg);
+    EncodedMessageHandlerFunc encodedHandler = _encodedHandlers.value(uuid);
+    if (encodedHandler) {
+        // Type, transaction and uuid make up the header, the dict follows
+        qDebug() << "Received appmsg PUSH from" << uuid << "with" << data.size() - 18 << "bytes of dict";
+        result = encodedHandler(data.mid(18));
     } else {
-        // No handler? Let's just send an ACK.
-        result = false;
+        WatchConnection::Dict dict;
+        if (!unpackPushMessage(data, &transaction, &uuid, &dict)) {
+            qWarning() << "Failed to parse APP_MSG PUSH";
+            m_connection->writeToPebble(WatchConnection::EndpointApplicationMessage, buildNackMessage(transaction));
+            return;
+        }
+
+        qDebug() << "Received appmsg PUSH from" << uuid << "with" << dict;
+
+        QVariantMap msg = mapAppKeys(uuid, dict);
+        qDebug() << "Mapped dict" << msg;
+
+        MessageHandlerFunc handler = _handlers.value(uuid);
+        if (handler) {
+            result = handler(msg);
+        } else {
+            // No handler? Let's just send an ACK.
+            result = false;
+        }
     }
 
     if (result) {
@@ -405,6 +467,8 @@ void AppMsgManager::handleAckMessage(const QByteArray &data, bool ack)
     qDebug() << "Got " << (ack ? "ACK" : "NACK") << " to transaction" << trans.transactionId;
 
     _timeout->stop();
+    m_pebble->metrics()->recordSince("appmsg.ack.latency", trans.sent);
+    m_pebble->metrics()->count(ack ? "appmsg.ack" : "appmsg.nack");
 
     if (ack) {
         if (trans.ackCallback) {
@@ -448,6 +512,7 @@ void AppMsgManager::handleTimeout()
     PendingTransaction trans = _pending.dequeue();
 
     qWarning() << "timeout on appmsg transaction" << trans.transactionId;
+    m_pebble->metrics()->count("appmsg.timeout");
 
     if (trans.nackCallback) {
         trans.nackCallback();
@@ -465,6 +530,7 @@ void AppMsgManager::transmitNextPendingTransaction()
 
     QByteArray msg = buildPushMessage(trans.transactionId, trans.uuid, trans.dict);
 
+    trans.sent = Metrics::now();
     m_connection->writeToPebble(WatchConnection::EndpointApplicationMessage, msg);
 
     _timeout->start();
@@ -29,11 +29,22 @@ public:
     void send(const QUuid &uuid, const QVariantMap &data,
               const std::function<void()> &ackCallback,
               const std::function<void()> &nackCallback);
+    // Sends a dictionary the caller already encoded in the wire format
+    // (item count followed by the key/type/length/value tuples)
+    void sendEncoded(const QUuid &uuid, const QByteArray &dict,
+                     const std::function<void()> &ackCallback,
+                     const std::function<void()> &nackCallback);
 
     typedef std::function<bool(const QVariantMap &)> MessageHandlerFunc;
     void setMessageHandler(const QUuid &uuid, MessageHandlerFunc func);
+    // Like setMessageHandler, but the handler gets the encoded dictionary as it came off the wire
+    typedef std::function<bool(const QByteArray &)> EncodedMessageHandlerFunc;
+    void setEncodedMessageHandler(const QUuid &uuid, EncodedMessageHandlerFunc func);
     void clearMessageHandler(const QUuid &uuid);
 
+    // For handlers resolving keys themselves, an incoming key the app does not declare
+    void reportUnknownAppKey(const QUuid &uuid, int key);
+
     uint lastTransactionId() const;
     uint nextTransactionId() const;
 
@@ -53,8 +64,10 @@ private:
 
     static bool unpackAppLaunchMessage(const QByteArray &msg, QUuid *uuid);
     static bool unpackPushMessage(const QByteArray &msg, quint8 *transaction, QUuid *uuid, WatchConnection::Dict *dict);
+    static bool unpackPushHeader(const QByteArray &msg, quint8 *transaction, QUuid *uuid);
 
     static QByteArray buildPushMessage(quint8 transaction, const QUuid &uuid, const WatchConnection::Dict &dict);
+    static QByteArray buildPushMessage(quint8 transaction, const QUuid &uuid, const QByteArray &dict);
     static QByteArray buildLaunchMessage(quint8 messageType, const QUuid &uuid);
     static QByteArray buildAckMessage(quint8 transaction);
     static QByteArray buildNackMessage(quint8 transaction);
@@ -79,13 +92,15 @@ private:
     Pebble *m_pebble;
     WatchConnection *m_connection;
     QHash<QUuid, MessageHandlerFunc> _handlers;
+    QHash<QUuid, EncodedMessageHandlerFunc> _encodedHandlers;
     quint8 _lastTransactionId;
     QUuid m_currentUuid;
 
     struct PendingTransaction {
         quint8 transactionId;
         QUuid uuid;
-        WatchConnection::Dict dict;
+        QByteArray dict; // Encoded, ready to be appended to the push header
+        qint64 sent = 0;
         std::function<void()> ackCallback;
         std::function<void()> nackCallback;
     };
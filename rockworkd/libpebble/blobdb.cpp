@@ -3,6 +3,7 @@
 #include "watchconnection.h"
 #include "watchdatareader.h"
 #include "watchdatawriter.h"
+#include "metrics.h"
 
 #include <QDebug>
 
@@ -85,7 +86,9 @@ void BlobDB::blobCommandReply(const QByteArray &data)
         return;
     } else if (status != StatusSuccess) {
         qWarning() << "Blob Command failed:" << status << BlobDBErrMsg[status];
+        m_pebble->metrics()->count("blobdb.failed");
     }
+    m_pebble->metrics()->recordSince("blobdb.rtt", m_currentCommand->m_sent);
     emit blobCommandResult(m_currentCommand->m_database, m_currentCommand->m_command, m_currentCommand->m_key, status);
     delete m_currentCommand;
     m_currentCommand = nullptr;
@@ -98,6 +101,8 @@ void BlobDB::sendNext()
         return;
     }
     m_currentCommand = m_commandQueue.takeFirst();
+    m_currentCommand->m_sent = Metrics::now();
+    m_pebble->metrics()->count("blobdb.commands");
     m_connection->writeToPebble(WatchConnection::EndpointBlobDB, m_currentCommand->serialize());
 }
 
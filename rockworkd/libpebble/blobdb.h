@@ -79,6 +79,7 @@ private:
         quint16 m_token;
         BlobDB::BlobDBId m_database;
         quint32 m_timestamp;
+        qint64 m_sent = 0;
 
         QByteArray m_key;
         QByteArray m_value;
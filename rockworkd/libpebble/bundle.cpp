@@ -1,14 +1,19 @@
 #include "bundle.h"
+#include "zipreader.h"
 
 #include <QVariantMap>
 #include <QFileInfo>
+#include <QDir>
+#include <QBuffer>
 #include <QDebug>
 #include <QJsonParseError>
 
 Bundle::Bundle(const QString &path):
     m_path(path)
 {
-
+    if (!path.isEmpty() && QFileInfo(path).isFile()) {
+        m_zip = QSharedPointer<ZipReader>(new ZipReader(path));
+    }
 }
 
 QString Bundle::path() const
@@ -33,27 +38,27 @@ QString Bundle::file(Bundle::FileType type, HardwarePlatform hardwarePlatform) c
 
     switch (hardwarePlatform) {
     case HardwarePlatformAplite:
-        if (QFileInfo::exists(path() + "/aplite/")) {
+        if (exists("aplite/")) {
             possibleDirs.append("aplite");
         }
         possibleDirs.append("");
         break;
     case HardwarePlatformBasalt:
-        if (QFileInfo::exists(path() + "/basalt/")) {
+        if (exists("basalt/")) {
             possibleDirs.append("basalt");
         }
         possibleDirs.append("");
         break;
     case HardwarePlatformChalk:
-        if (QFileInfo::exists(path() + "/chalk/")) {
+        if (exists("chalk/")) {
             possibleDirs.append("chalk");
         }
         break;
     case HardwarePlatformDiorite:
-        if (QFileInfo::exists(path() + "/diorite/")) {
+        if (exists("diorite/")) {
             possibleDirs.append("diorite");
         }
-        if (QFileInfo::exists(path() + "/aplite/")) {
+        if (exists("aplite/")) {
             possibleDirs.append("aplite");
         }
         possibleDirs.append("");
@@ -66,7 +71,7 @@ QString Bundle::file(Bundle::FileType type, HardwarePlatform hardwarePlatform) c
     QString manifestFilename;
     QString subDir;
     foreach (const QString &dir, possibleDirs) {
-        if (QFileInfo::exists(m_path + "/" + dir + "/manifest.json")) {
+        if (exists(dir.isEmpty() ? "manifest.json" : dir + "/manifest.json")) {
             subDir = "/" + dir;
             manifestFilename = m_path + subDir + "/manifest.json";
             break;
@@ -82,19 +87,10 @@ QString Bundle::file(Bundle::FileType type, HardwarePlatform hardwarePlatform) c
         return manifestFilename;
     }
 
-    QFile manifest(manifestFilename);
-    if (!manifest.open(QFile::ReadOnly)) {
-        qWarning() << "Error opening" << manifestFilename;
-        return QString();
-    }
-    QJsonParseError error;
-    QJsonDocument jsonDoc = QJsonDocument::fromJson(manifest.readAll(), &error);
-    if (error.error != QJsonParseError::NoError) {
-        qWarning() << "Error parsing" << manifestFilename;
+    QVariantMap manifestMap = manifest(manifestFilename);
+    if (manifestMap.isEmpty()) {
         return QString();
     }
-
-    QVariantMap manifestMap = jsonDoc.toVariant().toMap();
     switch (type) {
     case FileTypeApplication:
         return m_path + subDir + "/" + manifestMap.value("application").toMap().value("name").toString();
@@ -135,20 +131,7 @@ quint32 Bundle::crc(Bundle::FileType type, HardwarePlatform hardwarePlatform) co
     default: ;
     }
 
-    QFile manifest(file(FileTypeManifest, hardwarePlatform));
-    if (!manifest.open(QFile::ReadOnly)) {
-        qWarning() << "Error opening manifest file";
-        return 0;
-    }
-
-    QJsonParseError error;
-    QJsonDocument jsonDoc = QJsonDocument::fromJson(manifest.readAll(), &error);
-    if (error.error != QJsonParseError::NoError) {
-        qWarning() << "Error parsing manifest file";
-        return 0;
-    }
-
-    QVariantMap manifestMap = jsonDoc.toVariant().toMap();
+    QVariantMap manifestMap = manifest(file(FileTypeManifest, hardwarePlatform));
     switch (type) {
     case FileTypeApplication:
         return manifestMap.value("application").toMap().value("crc").toUInt();
@@ -163,3 +146,84 @@ quint32 Bundle::crc(Bundle::FileType type, HardwarePlatform hardwarePlatform) co
     }
     return 0;
 }
+
+bool Bundle::isArchive() const
+{
+    return !m_zip.isNull();
+}
+
+bool Bundle::exists(const QString &name) const
+{
+    if (m_zip) {
+        if (!name.endsWith('/')) {
+            return m_zip->contains(name);
+        }
+        // Directory entries are optional in zip files
+        foreach (const QString &entry, m_zip->entries()) {
+            if (entry.startsWith(name)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return QFileInfo::exists(m_path + "/" + name);
+}
+
+QByteArray Bundle::read(const QString &name) const
+{
+    if (m_zip) {
+        return m_zip->read(name);
+    }
+    QFile f(m_path + "/" + name);
+    if (!f.open(QFile::ReadOnly)) {
+        return QByteArray();
+    }
+    return f.readAll();
+}
+
+QByteArray Bundle::data(Bundle::FileType type, HardwarePlatform hardwarePlatform) const
+{
+    QString fileName = file(type, hardwarePlatform);
+    if (fileName.isEmpty()) {
+        return QByteArray();
+    }
+    return read(relativeName(fileName));
+}
+
+QIODevice *Bundle::open(Bundle::FileType type, HardwarePlatform hardwarePlatform) const
+{
+    QIODevice *dev;
+    if (m_zip) {
+        QBuffer *buf = new QBuffer();
+        buf->setData(data(type, hardwarePlatform));
+        dev = buf;
+    } else {
+        dev = new QFile(file(type, hardwarePlatform));
+    }
+    if (!dev->open(QIODevice::ReadOnly)) {
+        qWarning() << "Error opening" << file(type, hardwarePlatform);
+    }
+    return dev;
+}
+
+QString Bundle::relativeName(const QString &fileName) const
+{
+    return QDir::cleanPath(fileName).mid(QDir::cleanPath(m_path).length() + 1);
+}
+
+QVariantMap Bundle::manifest(const QString &manifestFilename) const
+{
+    if (m_manifests.contains(manifestFilename)) {
+        return m_manifests.value(manifestFilename);
+    }
+
+    QJsonParseError error;
+    QJsonDocument jsonDoc = QJsonDocument::fromJson(read(relativeName(manifestFilename)), &error);
+    if (error.error != QJsonParseError::NoError) {
+        qWarning() << "Error parsing" << manifestFilename;
+        return QVariantMap();
+    }
+    QVariantMap manifestMap = jsonDoc.toVariant().toMap();
+    m_manifests.insert(manifestFilename, manifestMap);
+    return manifestMap;
+}
@@ -2,9 +2,17 @@
 #define BUNDLE_H
 
 #include <QString>
+#include <QHash>
+#include <QVariantMap>
+#include <QSharedPointer>
 
 #include "enums.h"
 
+class ZipReader;
+QT_FORWARD_DECLARE_CLASS(QIODevice)
+
+// A pbw/pbz either unpacked to a directory or read in place from the archive file.
+// For archives file() returns pseudo paths below the archive, use data()/open() to get the content.
 class Bundle
 {
 public:
@@ -26,8 +34,20 @@ public:
     QString file(FileType type, HardwarePlatform hardwarePlatform = HardwarePlatformUnknown) const;
     quint32 crc(FileType type, HardwarePlatform hardwarePlatform = HardwarePlatformUnknown) const;
 
+    bool isArchive() const;
+    bool exists(const QString &name) const;
+    QByteArray read(const QString &name) const;
+    QByteArray data(FileType type, HardwarePlatform hardwarePlatform = HardwarePlatformUnknown) const;
+    // Caller takes ownership
+    QIODevice *open(FileType type, HardwarePlatform hardwarePlatform = HardwarePlatformUnknown) const;
+
 private:
+    QString relativeName(const QString &fileName) const;
+    QVariantMap manifest(const QString &manifestFilename) const;
+
     QString m_path;
+    QSharedPointer<ZipReader> m_zip;
+    mutable QHash<QString, QVariantMap> m_manifests;
 
 };
 
@@ -10,6 +10,7 @@
 #include <QTemporaryFile>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QTimer>
 
 #include <QMutex>
 #include <QDebug>
@@ -19,6 +20,8 @@
 DevConnection * DevConnection::s_instance=0;
 QtMessageHandler DevConnection::s_omh=0;
 QFile * DevConnection::s_dump = nullptr;
+LogBuffer DevConnection::s_log;
+LogFlusher * DevConnection::s_flusher = nullptr;
 int DevConnection::s_logSev = 1;
 //
 QMutex mtx;
@@ -45,21 +48,13 @@ void DevConnection::destroyLogging(DevConnection *instance)
     }
 }
 
-QStringList ml={"D","W","C","F"};
+// Hot path - called for every log line from any thread. Only stash the record,
+// formatting happens in the dump flusher thread and in the socket drain timer.
 void DevConnection::appLogBroadcast(QtMsgType t, const QMessageLogContext &ctx, const QString &msg)
 {
     if(s_omh && t >= s_logSev)
         s_omh(t,ctx,msg);
-    mtx.lock();
-    if(s_instance) {
-        QByteArray m(1,char(DevPacket::OCPhoneAppLog));
-        m.append(QString("[%1] %2:%3 %4").arg(ml.at(t)).arg(ctx.function).arg(ctx.line).arg(msg).toUtf8());
-        QMetaObject::invokeMethod(s_instance,"broadcast",Qt::QueuedConnection,Q_ARG(QByteArray,m));
-    }
-    mtx.unlock();
-    if(s_dump && s_dump->isOpen()) {
-        s_dump->write(QString("%1 [%2] %3:%4 %5\n").arg(QDateTime::currentDateTime().toString(Qt::ISODate),ml.at(t),ctx.function,QString::number(ctx.line),msg).toUtf8());
-    }
+    s_log.append(t,ctx,msg);
 }
 void DevConnection::setLogLevel(int level)
 {
@@ -72,17 +67,26 @@ int DevConnection::getLogLevel()
 
 QString DevConnection::startLogDump()
 {
+    stopLogDump();
     if(s_dump)
         delete s_dump;
     s_dump = new QTemporaryFile("/tmp/rockpoold.XXXXXX.log");
-    if(s_dump->open(QFile::ReadWrite))
+    if(s_dump->open(QFile::ReadWrite)) {
+        s_flusher = new LogFlusher(&s_log,s_dump);
+        s_flusher->start(QThread::LowPriority);
         return s_dump->fileName();
+    }
     delete s_dump;
     s_dump = nullptr;
     return "";
 }
 QString DevConnection::stopLogDump()
 {
+    if(s_flusher) {
+        s_flusher->stop();
+        delete s_flusher;
+        s_flusher = nullptr;
+    }
     if(s_dump && s_dump->isOpen()) {
         s_dump->close();
         return s_dump->fileName();
@@ -102,8 +106,11 @@ DevConnection::DevConnection(Pebble *pebble, WatchConnection *connection):
     QObject(pebble),
     m_pebble(pebble),
     m_connection(connection),
-    m_qtwsServer(0)
+    m_qtwsServer(0),
+    m_logDrain(new QTimer(this))
 {
+    m_logDrain->setInterval(200);
+    connect(m_logDrain, &QTimer::timeout, this, &DevConnection::drainLogs);
     //connect(connection, &WatchConnection::watchConnected, this, &DevConnection::onWatchConnected);
     //connect(connection, &WatchConnection::watchDisconnected, this, &DevConnection::onWatchDisconnected);
     connection->registerEndpointHandler(WatchConnection::EndpointAppLogs, this, "handleMessage");
@@ -217,6 +224,7 @@ void DevConnection::disableConnection()
         }
         m_clients.clear();
     }
+    m_logDrain->stop();
 }
 void DevConnection::enableConnection(quint16 port)
 {
@@ -253,6 +261,10 @@ void DevConnection::installBundle(const QString &file)
 void DevConnection::socketConnected()
 {
     QWebSocket *sock = m_qtwsServer->nextPendingConnection();
+    if(m_clients.isEmpty()) {
+        m_logCursor = s_log.head();
+        m_logDrain->start();
+    }
     m_clients.append(sock);
     qDebug() << "Accepted new connection from" << sock->peerAddress().toString();
     QObject::connect(sock,&QWebSocket::textMessageReceived,this,&DevConnection::textDataReceived);
@@ -263,6 +275,8 @@ void DevConnection::socketDisconnected()
 {
      QWebSocket *sock = qobject_cast<QWebSocket *>(sender());
      m_clients.removeAll(sock);
+     if(m_clients.isEmpty())
+         m_logDrain->stop();
      sock->deleteLater();
      qDebug() << "Client disconnected:" << sock->peerAddress().toString();
 }
@@ -302,6 +316,15 @@ void DevConnection::broadcast(const QByteArray &msg)
     }
 }
 
+void DevConnection::drainLogs()
+{
+    foreach (const LogBuffer::Record &rec, s_log.read(m_logCursor, 256)) {
+        QByteArray m(1,char(DevPacket::OCPhoneAppLog));
+        m.append(LogBuffer::format(rec,false));
+        broadcast(m);
+    }
+}
+
 // DevPacket implementation (and definition)
 DevPacket::DevPacket(const QByteArray &data, QWebSocket *sock, DevConnection *srv):
     QObject(srv),
@@ -3,7 +3,10 @@
 
 #include <QObject>
 
+#include "logbuffer.h"
+
 QT_FORWARD_DECLARE_CLASS(QFile)
+QT_FORWARD_DECLARE_CLASS(QTimer)
 QT_FORWARD_DECLARE_CLASS(QWebSocketServer)
 QT_FORWARD_DECLARE_CLASS(QWebSocket)
 QT_FORWARD_DECLARE_CLASS(DevPacket)
@@ -58,12 +61,15 @@ private slots:
     void rawDataReceived(const QByteArray &data);
     void handleMessage(const QByteArray &data);
     void broadcast(const QByteArray &msg);
+    void drainLogs();
 private:
     QList<QWebSocket *> m_clients;
     Pebble *m_pebble;
     WatchConnection *m_connection;
     QWebSocketServer *m_qtwsServer;
     quint16 m_port = 0;
+    QTimer *m_logDrain;
+    LogBuffer::Cursor m_logCursor = 0;
     // kinda singleton
     static DevConnection *s_instance;
     static void installLogging(DevConnection *instance, bool override = false);
@@ -72,6 +78,8 @@ private:
     static QtMessageHandler s_omh;
     static int s_logSev;
     static QFile *s_dump;
+    static LogBuffer s_log;
+    static LogFlusher *s_flusher;
 };
 
 class DevPacket : public QObject
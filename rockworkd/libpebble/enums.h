@@ -117,5 +117,7 @@ enum Capability {
 };
 Q_DECLARE_FLAGS(Capabilities, Capability)
 
+Q_DECLARE_METATYPE(MusicControlButton)
+
 #endif // ENUMS_H
 
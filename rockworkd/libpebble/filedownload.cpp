@@ -0,0 +1,214 @@
+#include "filedownload.h"
+
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QTimer>
+#include <QDebug>
+
+static const int MaxRetries = 3;
+static const qint64 ChunkSize = 64 * 1024;
+
+FileDownload::FileDownload(QNetworkAccessManager *nam, const QUrl &url, const QString &fileName, QObject *parent):
+    QObject(parent),
+    m_nam(nam),
+    m_url(url),
+    m_fileName(fileName),
+    m_part(fileName + ".part"),
+    m_validatorFile(fileName + ".part.validator"),
+    m_sha(QCryptographicHash::Sha256)
+{
+}
+
+void FileDownload::setExpectedHash(const QByteArray &hash)
+{
+    m_expectedHash = hash.toLower();
+}
+
+QUrl FileDownload::url() const
+{
+    return m_url;
+}
+
+QString FileDownload::fileName() const
+{
+    return m_fileName;
+}
+
+QByteArray FileDownload::hash() const
+{
+    return m_hash;
+}
+
+void FileDownload::start()
+{
+    if (!resumeFromPart()) {
+        fail();
+        return;
+    }
+    request();
+}
+
+// Leftover from an earlier attempt: rehash what we have so the digest continues from there
+bool FileDownload::resumeFromPart()
+{
+    m_sha.reset();
+    m_offset = 0;
+    if (!m_part.open(QFile::ReadWrite)) {
+        qWarning() << "Cannot open" << m_part.fileName() << m_part.errorString();
+        return false;
+    }
+    m_validator.clear();
+    if (m_validatorFile.open(QFile::ReadOnly)) {
+        m_validator = m_validatorFile.readAll().trimmed();
+        m_validatorFile.close();
+    }
+    if (m_validator.isEmpty()) {
+        // Nothing to tell whether the server still has the same file, the bytes are useless
+        if (m_part.size() > 0)
+            qDebug() << "No validator for" << m_part.fileName() << "restarting";
+        restart();
+        return true;
+    }
+    while (!m_part.atEnd()) {
+        QByteArray chunk = m_part.read(ChunkSize);
+        m_sha.addData(chunk);
+        m_offset += chunk.size();
+    }
+    if (m_offset > 0)
+        qDebug() << "Resuming download of" << m_url.fileName() << "at" << m_offset;
+    return true;
+}
+
+void FileDownload::restart()
+{
+    m_part.resize(0);
+    m_part.seek(0);
+    m_sha.reset();
+    m_offset = 0;
+    m_validator.clear();
+    m_validatorFile.remove();
+}
+
+// Remembers what identifies this version of the file, for a resume after an interruption
+void FileDownload::storeValidator()
+{
+    QByteArray etag = m_reply->rawHeader("ETag");
+    // If-Range only takes strong ETags, a weak one falls back to the date
+    m_validator = !etag.isEmpty() && !etag.startsWith("W/") ? etag : m_reply->rawHeader("Last-Modified");
+    if (m_validator.isEmpty()) {
+        m_validatorFile.remove();
+        return;
+    }
+    if (!m_validatorFile.open(QFile::WriteOnly | QFile::Truncate) || m_validatorFile.write(m_validator) != m_validator.size()) {
+        qWarning() << "Cannot write" << m_validatorFile.fileName() << m_validatorFile.errorString();
+        m_validatorFile.close();
+        m_validatorFile.remove();
+        return;
+    }
+    m_validatorFile.close();
+}
+
+void FileDownload::request()
+{
+    QNetworkRequest request(m_url);
+    if (m_offset > 0) {
+        request.setRawHeader("Range", "bytes=" + QByteArray::number(m_offset) + "-");
+        // Sends the whole file (200) instead of the range if it changed since
+        request.setRawHeader("If-Range", m_validator);
+    }
+    m_reply = m_nam->get(request);
+    m_replyChecked = false;
+    connect(m_reply, &QNetworkReply::readyRead, this, &FileDownload::readyRead);
+    connect(m_reply, &QNetworkReply::finished, this, &FileDownload::replyFinished);
+}
+
+void FileDownload::readyRead()
+{
+    int status = m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status != 200 && status != 206)
+        return; // error body, dealt with in replyFinished
+    if (!m_replyChecked) {
+        if (status == 200 && m_offset > 0) {
+            qDebug() << "File changed or range ignored, restarting" << m_url.fileName();
+            restart();
+        }
+        if (status == 200)
+            storeValidator();
+        m_replyChecked = true;
+    }
+    while (m_reply->bytesAvailable() > 0) {
+        QByteArray chunk = m_reply->read(ChunkSize);
+        if (m_part.write(chunk) != chunk.size()) {
+            qWarning() << "Error writing" << m_part.fileName() << m_part.errorString();
+            m_reply->abort();
+            return;
+        }
+        m_sha.addData(chunk);
+        m_offset += chunk.size();
+    }
+    qint64 total = m_reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+    if (status == 206) {
+        // Content-Length only covers the range, "Content-Range: bytes 100-999/1000" has the full size
+        QByteArray range = m_reply->rawHeader("Content-Range");
+        total = range.mid(range.indexOf('/') + 1).toLongLong();
+    }
+    emit progress(m_offset, total);
+}
+
+void FileDownload::replyFinished()
+{
+    QNetworkReply *reply = m_reply;
+    m_reply = nullptr;
+    reply->deleteLater();
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    if (status == 416) {
+        // Our .part is stale or bigger than the file, start over
+        qWarning() << "Range not satisfiable for" << m_url.fileName() << "restarting";
+        restart();
+        if (++m_retries > MaxRetries) {
+            fail();
+            return;
+        }
+        request();
+        return;
+    }
+
+    if (reply->error() != QNetworkReply::NoError) {
+        qWarning() << "Error downloading" << m_url.toString() << reply->errorString() << "at" << m_offset;
+        if (++m_retries > MaxRetries || (status >= 400 && status < 500)) {
+            fail();
+            return;
+        }
+        QTimer::singleShot(2000 * m_retries, this, &FileDownload::request);
+        return;
+    }
+
+    m_part.flush();
+    m_hash = m_sha.result().toHex();
+    if (!m_expectedHash.isEmpty() && m_hash != m_expectedHash) {
+        qWarning() << "Downloaded data hash doesn't match" << m_hash << m_expectedHash;
+        m_part.remove();
+        m_validatorFile.remove();
+        fail();
+        return;
+    }
+    m_part.close();
+    if (QFile::exists(m_fileName))
+        QFile::remove(m_fileName);
+    if (!m_part.rename(m_fileName)) {
+        qWarning() << "Cannot move download to" << m_fileName << m_part.errorString();
+        fail();
+        return;
+    }
+    m_validatorFile.remove();
+    emit finished(true);
+}
+
+void FileDownload::fail()
+{
+    if (m_part.isOpen())
+        m_part.close();
+    emit finished(false);
+}
@@ -0,0 +1,63 @@
+#ifndef FILEDOWNLOAD_H
+#define FILEDOWNLOAD_H
+
+#include <QObject>
+#include <QUrl>
+#include <QFile>
+#include <QCryptographicHash>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+
+// Streams an HTTP download into <fileName>.part as data arrives, hashing it on the fly.
+// Interrupted transfers are resumed with a Range request, also across restarts as long
+// as the .part file survives. The resume is conditional (If-Range) on the ETag or
+// Last-Modified kept in <fileName>.part.validator, a .part without one starts over.
+// On success the .part file is renamed to fileName.
+class FileDownload : public QObject
+{
+    Q_OBJECT
+public:
+    FileDownload(QNetworkAccessManager *nam, const QUrl &url, const QString &fileName, QObject *parent = 0);
+
+    // Hex encoded SHA-256 the finished file must match, empty to skip verification
+    void setExpectedHash(const QByteArray &hash);
+
+    QUrl url() const;
+    QString fileName() const;
+    QByteArray hash() const;
+
+public slots:
+    void start();
+
+signals:
+    void progress(qint64 received, qint64 total);
+    void finished(bool success);
+
+private slots:
+    void readyRead();
+    void replyFinished();
+
+private:
+    bool resumeFromPart();
+    void restart();
+    void storeValidator();
+    void request();
+    void fail();
+
+    QNetworkAccessManager *m_nam;
+    QNetworkReply *m_reply = nullptr;
+    QUrl m_url;
+    QString m_fileName;
+    QFile m_part;
+    QFile m_validatorFile;
+    QByteArray m_validator;
+    QCryptographicHash m_sha;
+    QByteArray m_expectedHash;
+    QByteArray m_hash;
+    qint64 m_offset = 0;
+    bool m_replyChecked = false;
+    int m_retries = 0;
+};
+
+#endif // FILEDOWNLOAD_H
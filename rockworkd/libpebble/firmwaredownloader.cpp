@@ -1,8 +1,9 @@
 #include "firmwaredownloader.h"
-#include "ziphelper.h"
 #include "pebble.h"
 #include "watchconnection.h"
 #include "uploadmanager.h"
+#include "filedownload.h"
+#include "watchdatawriter.h"
 
 #include <QNetworkAccessManager>
 #include <QUrlQuery>
@@ -11,7 +12,6 @@
 #include <QJsonDocument>
 #include <QFile>
 #include <QDir>
-#include <QCryptographicHash>
 
 FirmwareDownloader::FirmwareDownloader(Pebble *pebble, WatchConnection *connection):
     QObject(pebble),
@@ -63,55 +63,30 @@ void FirmwareDownloader::performUpgrade()
     m_upgradeInProgress = true;
     emit upgradingChanged();
 
-    QNetworkRequest request(m_url);
-    QNetworkReply *reply = m_nam->get(request);
-    connect(reply, &QNetworkReply::finished, [this, reply](){
-        reply->deleteLater();
-
-        if (reply->error() != QNetworkReply::NoError) {
-            qWarning() << "Erorr fetching firmware" << reply->errorString();
-            m_upgradeInProgress = false;
-            emit upgradingChanged();
-            return;
-        }
-
-        QByteArray data = reply->readAll();
-
-        QByteArray hash = QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex();
-
-        if (hash != m_hash) {
-            qWarning() << "Downloaded data hash doesn't match hash from target";
-            m_upgradeInProgress = false;
-            emit upgradingChanged();
-            return;
-        }
+    QString path = "/tmp/" + m_pebble->address().toString().replace(":", "_");
+    QDir dir(path);
+    if (!dir.exists() && !dir.mkpath(dir.absolutePath())) {
+        qWarning() << "Error saving file" << dir.absolutePath();
+        m_upgradeInProgress = false;
+        emit upgradingChanged();
+        return;
+    }
 
-        QDir dir("/tmp/" + m_pebble->address().toString().replace(":", "_"));
-        if (!dir.exists() && !dir.mkpath(dir.absolutePath())) {
-            qWarning() << "Error saving file" << dir.absolutePath();
-            m_upgradeInProgress = false;
-            emit upgradingChanged();
-            return;
-        }
-        QString path = "/tmp/" + m_pebble->address().toString().replace(":", "_");
-        QFile f(path + "/" + reply->request().url().fileName());
-        if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
-            qWarning() << "Cannot open tmp file for writing" << f.fileName();
-            m_upgradeInProgress = false;
-            emit upgradingChanged();
-            return;
-        }
-        f.write(data);
-        f.close();
+    // Streamed to disk and hashed while downloading, a leftover .part from an aborted attempt is resumed
+    FileDownload *download = new FileDownload(m_nam, QUrl(m_url), path + "/" + QUrl(m_url).fileName(), this);
+    download->setExpectedHash(m_hash);
+    connect(download, &FileDownload::finished, [this, download](bool success){
+        download->deleteLater();
 
-        if (!ZipHelper::unpackArchive(f.fileName(), path)) {
-            qWarning() << "Error unpacking firmware archive";
+        if (!success) {
+            qWarning() << "Error fetching firmware" << download->url();
             m_upgradeInProgress = false;
             emit upgradingChanged();
             return;
         }
 
-        Bundle firmware(path);
+        // Read in place from the archive, members are checked against their zip CRC when read
+        Bundle firmware(download->fileName());
         if (firmware.file(Bundle::FileTypeFirmware).isEmpty() || firmware.file(Bundle::FileTypeResources).isEmpty()) {
             qWarning() << "Firmware bundle file missing binary or resources";
             m_upgradeInProgress = false;
@@ -119,18 +94,32 @@ void FirmwareDownloader::performUpgrade()
             return;
         }
 
-        if(QFile::exists(path + "/layouts.json.auto")) {
-            if(QFile::exists(m_pebble->storagePath() + "/layouts.json.auto"))
-                QFile::remove(m_pebble->storagePath() + "/layouts.json.auto");
-            QFile::rename(path+"/layouts.json.auto",m_pebble->storagePath()+"/layouts.json.auto");
-            emit layoutsChanged();
+        // The zip CRC only covers the transfer, the manifest says what the watch will be checking against
+        foreach (Bundle::FileType type, QList<Bundle::FileType>() << Bundle::FileTypeFirmware << Bundle::FileTypeResources) {
+            quint32 crc = firmware.crc(type);
+            if (crc != 0 && WatchDataWriter::stm32crc(firmware.data(type)) != crc) {
+                qWarning() << "CRC mismatch for" << firmware.file(type) << "manifest:" << crc;
+                m_upgradeInProgress = false;
+                emit upgradingChanged();
+                return;
+            }
+        }
+
+        if (firmware.exists("layouts.json.auto")) {
+            QFile layouts(m_pebble->storagePath() + "/layouts.json.auto");
+            if (layouts.open(QFile::WriteOnly | QFile::Truncate)) {
+                layouts.write(firmware.read("layouts.json.auto"));
+                layouts.close();
+                emit layoutsChanged();
+            }
         }
 
         qDebug() << "** Starting firmware upgrade **";
-        m_bundlePath = path;
+        m_bundlePath = download->fileName();
         m_connection->systemMessage(WatchConnection::SystemMessageFirmwareStart);
 
     });
+    download->start();
 }
 
 void FirmwareDownloader::checkForNewFirmware()
@@ -200,11 +189,11 @@ void FirmwareDownloader::systemMessageReceived(const QByteArray &data)
     Bundle firmware(m_bundlePath);
 
     qDebug() << "** Uploading firmware resources...";
-    m_connection->uploadManager()->uploadFirmwareResources(firmware.file(Bundle::FileTypeResources), firmware.crc(Bundle::FileTypeResources), [this, firmware]() {
+    m_connection->uploadManager()->uploadFirmwareResources(firmware.open(Bundle::FileTypeResources), firmware.file(Bundle::FileTypeResources), firmware.crc(Bundle::FileTypeResources), [this, firmware]() {
         qDebug() << "** Firmware resources uploaded. OK";
 
         qDebug() << "** Uploading firmware binary...";
-        m_connection->uploadManager()->uploadFirmwareBinary(false, firmware.file(Bundle::FileTypeFirmware), firmware.crc(Bundle::FileTypeFirmware), [this]() {
+        m_connection->uploadManager()->uploadFirmwareBinary(false, firmware.open(Bundle::FileTypeFirmware), firmware.file(Bundle::FileTypeFirmware), firmware.crc(Bundle::FileTypeFirmware), [this]() {
             qDebug() << "** Firmware binary uploaded. OK";
             m_connection->systemMessage(WatchConnection::SystemMessageFirmwareComplete);
             m_upgradeInProgress = false;
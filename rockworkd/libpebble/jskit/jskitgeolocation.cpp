@@ -1,226 +1,77 @@
-#include <limits>
-
 #include "jskitgeolocation.h"
 
-JSKitGeolocation::JSKitGeolocation(QJSEngine *engine) :
+JSKitGeolocation::JSKitGeolocation(QJSEngine *engine, PositionService *positions) :
     QObject(engine),
     l(metaObject()->className()),
     m_engine(engine),
-    m_source(0),
-    m_lastWatcherId(0)
-{
-}
-
-void JSKitGeolocation::getCurrentPosition(const QJSValue &successCallback, const QJSValue &errorCallback, const QVariantMap &options)
-{
-    setupWatcher(successCallback, errorCallback, options, true);
-}
-
-int JSKitGeolocation::watchPosition(const QJSValue &successCallback, const QJSValue &errorCallback, const QVariantMap &options)
+    m_positions(positions)
 {
-    return setupWatcher(successCallback, errorCallback, options, false);
 }
 
-void JSKitGeolocation::clearWatch(int watcherId)
+JSKitGeolocation::~JSKitGeolocation()
 {
-    removeWatcher(watcherId);
+    // The service may be gone already while the watch is torn down
+    if (m_positions)
+        m_positions->cancelAll(this);
 }
 
-void JSKitGeolocation::handleError(QGeoPositionInfoSource::Error error)
-{
-    qCWarning(l) << "positioning error: " << error;
-
-    if (m_watchers.empty()) {
-        qCWarning(l) << "got position error but no one is watching";
-        stopAndRemove();
-    }
-    else {
-        QJSValue obj;
-        if (error == QGeoPositionInfoSource::AccessError) {
-            obj = buildPositionErrorObject(PERMISSION_DENIED, "permission denied");
-        } else {
-            obj = buildPositionErrorObject(POSITION_UNAVAILABLE, "position unavailable");
-        }
-
-        for (auto it = m_watchers.begin(); it != m_watchers.end(); /*no adv*/) {
-            invokeCallback(it->errorCallback, obj);
-
-            if (it->once) {
-                it = m_watchers.erase(it);
-            } else {
-                it->timer.restart();
-                ++it;
-            }
-        }
-    }
-}
-
-void JSKitGeolocation::handlePosition(const QGeoPositionInfo &pos)
-{
-    qCDebug(l) << "got position at" << pos.timestamp() << "type" << pos.coordinate().type();
-
-    if (m_watchers.empty()) {
-        qCWarning(l) << "got position update but no one is watching";
-        stopAndRemove();
-    }
-    else {
-        QJSValue obj = buildPositionObject(pos);
-
-        for (auto it = m_watchers.begin(); it != m_watchers.end(); /*no adv*/) {
-            invokeCallback(it->successCallback, obj);
-
-            if (it->once) {
-                it = m_watchers.erase(it);
-            } else {
-                it->timer.restart();
-                ++it;
-            }
-        }
-    }
-}
-
-void JSKitGeolocation::handleTimeout()
+void JSKitGeolocation::getCurrentPosition(const QJSValue &successCallback, const QJSValue &errorCallback, const QVariantMap &options)
 {
-    qCDebug(l) << "positioning timeout";
-
-    if (m_watchers.empty()) {
-        qCWarning(l) << "got position timeout but no one is watching";
-        stopAndRemove();
-    }
-    else {
-        QJSValue obj = buildPositionErrorObject(TIMEOUT, "timeout");
-
-        for (auto it = m_watchers.begin(); it != m_watchers.end(); /*no adv*/) {
-            if (it->timer.hasExpired(it->timeout)) {
-                qCDebug(l) << "positioning timeout for watch" << it->watcherId
-                                 << ", watch is" << it->timer.elapsed() << "ms old, timeout is" << it->timeout;
-                invokeCallback(it->errorCallback, obj);
+    bool highAccuracy = options.value("enableHighAccuracy", false).toBool();
+    int timeout = options.value("timeout", -1).toInt();
+    qlonglong maximumAge = options.value("maximumAge", 0).toLongLong();
 
-                if (it->once) {
-                    it = m_watchers.erase(it);
-                } else {
-                    it->timer.restart();
-                    ++it;
-                }
-            } else {
-                ++it;
-            }
-        }
+    qCDebug(l) << "getting position, gps=" << highAccuracy << "timeout=" << timeout << "maximumAge=" << maximumAge;
 
-        QMetaObject::invokeMethod(this, "updateTimeouts", Qt::QueuedConnection);
-    }
+    m_positions->requestPosition(maximumAge, timeout, highAccuracy, this, buildCallback(successCallback, errorCallback));
 }
 
-void JSKitGeolocation::updateTimeouts()
+int JSKitGeolocation::watchPosition(const QJSValue &successCallback, const QJSValue &errorCallback, const QVariantMap &options)
 {
-    int once_timeout = -1, updates_timeout = -1;
-
-    Q_FOREACH(const Watcher &watcher, m_watchers) {
-        qint64 rem_timeout = watcher.timeout - watcher.timer.elapsed();
-        qCDebug(l) << "watch" << watcher.watcherId << "rem timeout" << rem_timeout;
+    bool highAccuracy = options.value("enableHighAccuracy", false).toBool();
+    int timeout = options.value("timeout", 0).toInt();
+    qlonglong maximumAge = options.value("maximumAge", 0).toLongLong();
 
-        if (rem_timeout >= 0) {
-            // Make sure the limits aren't too large
-            rem_timeout = qMin<qint64>(rem_timeout, std::numeric_limits<int>::max());
+    qCDebug(l) << "setting up watcher, gps=" << highAccuracy << "timeout=" << timeout << "maximumAge=" << maximumAge;
 
-            if (watcher.once) {
-                once_timeout = once_timeout >= 0 ? qMin<int>(once_timeout, rem_timeout) : rem_timeout;
-            } else {
-                updates_timeout = updates_timeout >= 0 ? qMin<int>(updates_timeout, rem_timeout) : rem_timeout;
-            }
-        }
+    // A recent enough fix is the first update
+    QGeoPositionInfo pos = m_positions->cachedFix(maximumAge, highAccuracy);
+    if (pos.isValid()) {
+        invokeCallback(successCallback, buildPositionObject(pos));
     }
 
-    if (updates_timeout >= 0) {
-        qCDebug(l) << "setting location update interval to" << updates_timeout;
-        m_source->setUpdateInterval(updates_timeout);
-        m_source->startUpdates();
-    } else {
-        qCDebug(l) << "stopping updates";
-        m_source->stopUpdates();
-    }
+    // Expect an update at least every timeout
+    int watcherId = m_positions->watchPosition(qMax(timeout, 0), this, buildCallback(successCallback, errorCallback));
+    qCDebug(l) << "added new watcher" << watcherId;
 
-    if (once_timeout >= 0) {
-        qCDebug(l) << "requesting single location update with timeout" << once_timeout;
-        m_source->requestUpdate(once_timeout);
-    }
-
-    if (once_timeout == 0 && updates_timeout == 0) {
-        stopAndRemove();
-    }
+    return watcherId;
 }
 
-int JSKitGeolocation::setupWatcher(const QJSValue &successCallback, const QJSValue &errorCallback, const QVariantMap &options, bool once)
+void JSKitGeolocation::clearWatch(int watcherId)
 {
-    Watcher watcher;
-    watcher.successCallback = successCallback;
-    watcher.errorCallback = errorCallback;
-    watcher.highAccuracy = options.value("enableHighAccuracy", false).toBool();
-    watcher.timeout = options.value("timeout", std::numeric_limits<int>::max() - 1).toInt();
-    watcher.maximumAge = options.value("maximumAge", 0).toLongLong();
-    watcher.once = once;
-    watcher.watcherId = ++m_lastWatcherId;
-
-    qCDebug(l) << "setting up watcher, gps=" << watcher.highAccuracy << "timeout=" << watcher.timeout << "maximumAge=" << watcher.maximumAge << "once=" << watcher.once;
-
-    if (!m_source) {
-        m_source = QGeoPositionInfoSource::createDefaultSource(this);
-
-        connect(m_source, static_cast<void (QGeoPositionInfoSource::*)(QGeoPositionInfoSource::Error)>(&QGeoPositionInfoSource::error),
-                this, &JSKitGeolocation::handleError);
-        connect(m_source, &QGeoPositionInfoSource::positionUpdated,
-                this, &JSKitGeolocation::handlePosition);
-        connect(m_source, &QGeoPositionInfoSource::updateTimeout,
-                this, &JSKitGeolocation::handleTimeout);
-    }
-
-    if (watcher.maximumAge > 0) {
-        QDateTime threshold = QDateTime::currentDateTime().addMSecs(-qint64(watcher.maximumAge));
-        QGeoPositionInfo pos = m_source->lastKnownPosition(watcher.highAccuracy);
-        qCDebug(l) << "got pos timestamp" << pos.timestamp() << " but we want" << threshold;
-
-        if (pos.isValid() && pos.timestamp() >= threshold) {
-            invokeCallback(watcher.successCallback, buildPositionObject(pos));
-
-            if (once) {
-                return -1;
-            }
-        } else if (watcher.timeout == 0 && once) {
-            // If the timeout has already expired, and we have no cached data
-            // Do not even bother to turn on the GPS; return error object now.
-            invokeCallback(watcher.errorCallback, buildPositionErrorObject(TIMEOUT, "no cached position"));
-            return -1;
-        }
-    }
-
-    watcher.timer.start();
-    m_watchers.append(watcher);
-
-    qCDebug(l) << "added new watcher" << watcher.watcherId;
-    QMetaObject::invokeMethod(this, "updateTimeouts", Qt::QueuedConnection);
-
-    return watcher.watcherId;
+    qCDebug(l) << "removing watcherId" << watcherId;
+    m_positions->cancel(watcherId);
 }
 
-void JSKitGeolocation::removeWatcher(int watcherId)
+PositionService::Callback JSKitGeolocation::buildCallback(const QJSValue &successCallback, const QJSValue &errorCallback)
 {
-    Watcher watcher;
-
-    qCDebug(l) << "removing watcherId" << watcher.watcherId;
-
-    for (int i = 0; i < m_watchers.size(); i++) {
-        if (m_watchers[i].watcherId == watcherId) {
-            watcher = m_watchers.takeAt(i);
+    return [this, successCallback, errorCallback](const QGeoPositionInfo &pos, PositionService::Error error) {
+        switch (error) {
+        case PositionService::NoError:
+            qCDebug(l) << "got position at" << pos.timestamp() << "type" << pos.coordinate().type();
+            invokeCallback(successCallback, buildPositionObject(pos));
+            break;
+        case PositionService::AccessError:
+            invokeCallback(errorCallback, buildPositionErrorObject(PERMISSION_DENIED, "permission denied"));
+            break;
+        case PositionService::Unavailable:
+            invokeCallback(errorCallback, buildPositionErrorObject(POSITION_UNAVAILABLE, "position unavailable"));
+            break;
+        case PositionService::Timeout:
+            invokeCallback(errorCallback, buildPositionErrorObject(TIMEOUT, "timeout"));
             break;
         }
-    }
-
-    if (watcher.watcherId != watcherId) {
-        qCWarning(l) << "watcherId not found";
-        return;
-    }
-
-    QMetaObject::invokeMethod(this, "updateTimeouts", Qt::QueuedConnection);
+    };
 }
 
 QJSValue JSKitGeolocation::buildPositionObject(const QGeoPositionInfo &pos)
@@ -289,14 +140,3 @@ void JSKitGeolocation::invokeCallback(QJSValue callback, QJSValue event)
         qCWarning(l) << "callback is not callable";
     }
 }
-
-void JSKitGeolocation::stopAndRemove()
-{
-    if (m_source) {
-        qCDebug(l) << "removing source";
-
-        m_source->stopUpdates();
-        m_source->deleteLater();
-        m_source = 0;
-    }
-}
@@ -1,21 +1,22 @@
 #ifndef JSKITGEOLOCATION_H
 #define JSKITGEOLOCATION_H
 
-#include <QElapsedTimer>
-#include <QGeoPositionInfoSource>
+#include <QGeoPositionInfo>
 #include <QJSValue>
 #include <QLoggingCategory>
 #include <QJSEngine>
+#include <QPointer>
+
+#include "../positionservice.h"
 
 class JSKitGeolocation : public QObject
 {
     Q_OBJECT
     QLoggingCategory l;
 
-    struct Watcher;
-
 public:
-    explicit JSKitGeolocation(QJSEngine *engine);
+    explicit JSKitGeolocation(QJSEngine *engine, PositionService *positions);
+    ~JSKitGeolocation();
 
     enum PositionError {
         PERMISSION_DENIED = 1,
@@ -28,39 +29,16 @@ public:
     Q_INVOKABLE int watchPosition(const QJSValue &successCallback, const QJSValue &errorCallback = QJSValue(), const QVariantMap &options = QVariantMap());
     Q_INVOKABLE void clearWatch(int watcherId);
 
-private slots:
-    void handleError(const QGeoPositionInfoSource::Error error);
-    void handlePosition(const QGeoPositionInfo &pos);
-    void handleTimeout();
-    void updateTimeouts();
-
 private:
-    int setupWatcher(const QJSValue &successCallback, const QJSValue &errorCallback, const QVariantMap &options, bool once);
-    void removeWatcher(int watcherId);
+    PositionService::Callback buildCallback(const QJSValue &successCallback, const QJSValue &errorCallback);
 
     QJSValue buildPositionObject(const QGeoPositionInfo &pos);
     QJSValue buildPositionErrorObject(PositionError error, const QString &message = QString());
-    QJSValue buildPositionErrorObject(const QGeoPositionInfoSource::Error error);
     void invokeCallback(QJSValue callback, QJSValue event);
-    void stopAndRemove();
 
 private:
     QJSEngine *m_engine;
-    QGeoPositionInfoSource *m_source;
-
-    struct Watcher {
-        QJSValue successCallback;
-        QJSValue errorCallback;
-        int watcherId;
-        bool once;
-        bool highAccuracy;
-        int timeout;
-        QElapsedTimer timer;
-        qlonglong maximumAge;
-    };
-
-    QList<Watcher> m_watchers;
-    int m_lastWatcherId;
+    QPointer<PositionService> m_positions;
 };
 
 #endif // JSKITGEOLOCATION_H
@@ -1,9 +1,12 @@
 #include <QFile>
 #include <QDir>
 #include <QUrl>
+#include <QTimer>
 
 #include "jskitmanager.h"
 #include "jskitpebble.h"
+#include "../metrics.h"
+#include "../watchdatareader.h"
 
 JSKitManager::JSKitManager(Pebble *pebble, WatchConnection *connection, AppManager *apps, AppMsgManager *appmsg, QObject *parent) :
     QObject(parent),
@@ -103,65 +106,83 @@ void JSKitManager::handleAppStopped(const QUuid &uuid)
     }
 }
 
-void JSKitManager::handleAppMessage(const QUuid &uuid, const QVariantMap &msg)
+bool JSKitManager::decodeAppMessage(const QByteArray &dict, QJSValue *payload)
+{
+    // Builds the payload straight from the tuples, with the same rules as WatchDataReader::readDict()
+    WatchDataReader reader(dict);
+    const int n = reader.readLE<quint8>();
+
+    for (int i = 0; i < n; i++) {
+        if (reader.checkBad(4 + 1 + 2)) return false;
+        const int key = reader.readLE<qint32>();
+        const int type = reader.readLE<quint8>();
+        const int width = reader.readLE<quint16>();
+
+        QString name = m_appKeyNames.value(key);
+        if (name.isEmpty()) {
+            m_appmsg->reportUnknownAppKey(m_curApp.uuid(), key);
+            name = QString::number(key);
+        }
+
+        switch (type) {
+        case WatchConnection::DictItemTypeBytes: {
+            QByteArray bytes = reader.readBytes(width);
+            QJSValue array = m_engine->newArray(bytes.size());
+            for (int j = 0; j < bytes.size(); j++) {
+                array.setProperty(j, int(bytes.at(j)));
+            }
+            payload->setProperty(name, array);
+            break;
+        }
+        case WatchConnection::DictItemTypeString:
+            payload->setProperty(name, reader.readFixedString(width));
+            break;
+        case WatchConnection::DictItemTypeUInt:
+            switch (width) {
+            case sizeof(quint8):
+                payload->setProperty(name, uint(reader.readLE<quint8>()));
+                break;
+            case sizeof(quint16):
+                payload->setProperty(name, uint(reader.readLE<quint16>()));
+                break;
+            case sizeof(quint32):
+                payload->setProperty(name, uint(reader.readLE<quint32>()));
+                break;
+            default:
+                return false;
+            }
+            break;
+        case WatchConnection::DictItemTypeInt:
+            switch (width) {
+            case sizeof(qint8):
+                payload->setProperty(name, int(reader.readLE<qint8>()));
+                break;
+            case sizeof(qint16):
+                payload->setProperty(name, int(reader.readLE<qint16>()));
+                break;
+            case sizeof(qint32):
+                payload->setProperty(name, int(reader.readLE<qint32>()));
+                break;
+            default:
+                return false;
+            }
+            break;
+        default:
+            qCWarning(l) << "Unknown dict item type:" << type;
+            return false;
+        }
+    }
+
+    return !reader.bad();
+}
+
+void JSKitManager::handleAppMessage(const QUuid &uuid, const QJSValue &payload)
 {
     if (m_curApp.uuid() == uuid) {
-        qCDebug(l) << "handling app message" << uuid << msg;
+        qCDebug(l) << "handling app message" << uuid;
 
         if (m_engine) {
             QJSValue eventObj = m_engine->newObject();
-            QJSValue payload = m_engine->newObject();
-
-            //These variables are up here to avoid cross initialization
-            QByteArray byteArray;
-            QJSValue array;
-
-            QMapIterator<QString, QVariant> it(msg);
-            while (it.hasNext()) {
-                it.next();
-
-                switch (int(it.value().type())) {
-                case QMetaType::Char:
-                case QMetaType::UChar:
-                case QMetaType::SChar:
-                    payload.setProperty(it.key(), m_engine->toScriptValue(it.value().value<char>()));
-                    break;
-                case QMetaType::Int:
-                case QMetaType::Short:
-                case QMetaType::UShort:
-                    payload.setProperty(it.key(), m_engine->toScriptValue(it.value().toInt()));
-                    break;
-                case QMetaType::UInt:
-                    payload.setProperty(it.key(), m_engine->toScriptValue(it.value().toUInt()));
-                    break;
-                case QMetaType::Bool:
-                    payload.setProperty(it.key(), m_engine->toScriptValue(it.value().toBool()));
-                    break;
-                case QMetaType::Float:
-                case QMetaType::Double:
-                    payload.setProperty(it.key(), m_engine->toScriptValue(it.value().toDouble()));
-                    break;
-                case QMetaType::QByteArray:
-                    byteArray = it.value().toByteArray();
-
-                    array = m_engine->newArray(byteArray.size());
-                    for (int i = 0; i < byteArray.size(); i++) {
-                        array.setProperty(i, m_engine->toScriptValue<int>(byteArray[i]));
-                    }
-
-                    payload.setProperty(it.key(), array);
-
-                    break;
-                case QMetaType::QString:
-                    payload.setProperty(it.key(), m_engine->toScriptValue(it.value().toString()));
-                    break;
-                default:
-                    qWarning() << "JSKitManager::handleAppMessage" << "Unknown dict item type:" << it.value().typeName();
-                    break;
-                }
-            }
-
-            //eventObj.setProperty("payload", m_engine->toScriptValue(msg));
             eventObj.setProperty("payload", payload);
 
             m_jspebble->invokeCallbacks("appmessage", QJSValueList({eventObj}));
@@ -205,12 +226,13 @@ void JSKitManager::startJsApp()
         return;
     }
 
+    qint64 started = Metrics::now();
     m_engine = new QJSEngine(this);
     m_jspebble = new JSKitPebble(m_curApp, this, m_engine);
     m_jsconsole = new JSKitConsole(m_engine);
     m_jsstorage = new JSKitLocalStorage(m_engine, m_pebble->storagePath(), m_curApp.uuid());
-    m_jsgeo = new JSKitGeolocation(m_engine);
-    m_jstimer = new JSKitTimer(m_engine);
+    m_jsgeo = new JSKitGeolocation(m_engine, m_pebble->positions());
+    m_jstimer = new JSKitTimer(m_engine, m_pebble->timers());
     m_jsperformance = new JSKitPerformance(m_engine);
 
     qCDebug(l) << "starting JS app" << m_curApp.shortName();
@@ -240,24 +262,36 @@ void JSKitManager::startJsApp()
     loadJsFile(":/typedarray.js");
 
     // Now the actual script
-    QString jsApp = m_curApp.file(AppInfo::FileTypeJsApp, HardwarePlatformUnknown);
-    QFile f(jsApp);
-    if (!f.open(QFile::ReadOnly)) {
-        qCWarning(l) << "Error opening" << jsApp;
+    QByteArray jsApp = m_curApp.data(AppInfo::FileTypeJsApp, HardwarePlatformUnknown);
+    if (jsApp.isEmpty()) {
+        qCWarning(l) << "Error opening" << m_curApp.file(AppInfo::FileTypeJsApp, HardwarePlatformUnknown);
         return;
     }
-    QJSValue ret = m_engine->evaluate(QString::fromUtf8(f.readAll()));
+    QJSValue ret = m_engine->evaluate(QString::fromUtf8(jsApp));
     qCDebug(l) << "loaded script" << ret.toString();
 
     // Setup the message callback
     QUuid uuid = m_curApp.uuid();
-    m_appmsg->setMessageHandler(uuid, [this, uuid](const QVariantMap &msg) {
-        QMetaObject::invokeMethod(this, "handleAppMessage", Qt::QueuedConnection,
-                                  Q_ARG(QUuid, uuid),
-                                  Q_ARG(QVariantMap, msg));
+    m_appKeyNames.clear();
+    const QHash<QString, int> appKeys = m_curApp.appKeys();
+    for (QHash<QString, int>::const_iterator it = appKeys.constBegin(); it != appKeys.constEnd(); ++it) {
+        m_appKeyNames.insert(it.value(), it.key());
+    }
+    m_appmsg->setEncodedMessageHandler(uuid, [this, uuid](const QByteArray &dict) {
+        QJSValue payload = m_engine->newObject();
+        if (!decodeAppMessage(dict, &payload)) {
+            qCWarning(l) << "Failed to decode app message from" << uuid;
+            return false;
+        }
 
-        // Invoke the slot as a queued connection to give time for the ACK message
-        // to go through first.
+        // Deliver it from the event loop to give time for the ACK message
+        // to go through first. The engine may have been replaced by then.
+        QPointer<QJSEngine> engine = m_engine;
+        QTimer::singleShot(0, this, [this, uuid, payload, engine]() {
+            if (engine && engine == m_engine) {
+                handleAppMessage(uuid, payload);
+            }
+        });
 
         return true;
     });
@@ -276,6 +310,7 @@ void JSKitManager::startJsApp()
     }
 
     m_configurationUuid = QUuid();
+    m_pebble->metrics()->recordSince("jskit.start.duration", started);
 }
 
 void JSKitManager::stopJsApp()
@@ -46,9 +46,10 @@ signals:
 private slots:
     void handleAppStarted(const QUuid &uuid);
     void handleAppStopped(const QUuid &uuid);
-    void handleAppMessage(const QUuid &uuid, const QVariantMap &msg);
 
 private:
+    bool decodeAppMessage(const QByteArray &dict, QJSValue *payload);
+    void handleAppMessage(const QUuid &uuid, const QJSValue &payload);
     bool loadJsFile(const QString &filename);
     void startJsApp();
     void stopJsApp();
@@ -61,6 +62,7 @@ private:
     AppManager *m_apps;
     AppMsgManager *m_appmsg;
     AppInfo m_curApp;
+    QHash<int, QString> m_appKeyNames;
     QJSEngine *m_engine;
     QPointer<JSKitPebble> m_jspebble;
     QPointer<JSKitConsole> m_jsconsole;
@@ -2,6 +2,8 @@
 #include <QCryptographicHash>
 #include <QSettings>
 #include <QJsonObject>
+#include <QJSValueIterator>
+#include <QtNumeric>
 
 #include "jskitpebble.h"
 #include "jskitxmlhttprequest.h"
@@ -9,6 +11,7 @@
 #include "../timelinemanager.h"
 #include "../timelinesync.h"
 #include "../appglances.h"
+#include "../watchdatawriter.h"
 static const char *token_salt = "0feeb7416d3c4546a19b04bccd8419b1";
 
 JSKitPebble::JSKitPebble(const AppInfo &info, JSKitManager *mgr, QObject *parent) :
@@ -59,15 +62,15 @@ void JSKitPebble::showSimpleNotificationOnPebble(const QString &title, const QSt
 
 uint JSKitPebble::sendAppMessage(QJSValue message, QJSValue callbackForAck, QJSValue callbackForNack)
 {
-    QVariantMap data = message.toVariant().toMap();
+    QByteArray dict = encodeAppMessage(message);
     QPointer<JSKitPebble> pebbObj = this;
     uint transactionId = m_mgr->m_appmsg->nextTransactionId();
 
-    qCDebug(l) << "sendAppMessage" << data;
+    qCDebug(l) << "sendAppMessage" << dict.toHex();
 
-    m_mgr->m_appmsg->send(
+    m_mgr->m_appmsg->sendEncoded(
         m_appInfo.uuid(),
-        data,
+        dict,
         [this, pebbObj, transactionId, callbackForAck]() mutable {
             if (pebbObj.isNull()) return;
 
@@ -101,6 +104,96 @@ uint JSKitPebble::sendAppMessage(QJSValue message, QJSValue callbackForAck, QJSV
     return transactionId;
 }
 
+// Numbers went through QVariant::toInt() before, which rounds where QJSValue::toInt() truncates
+static int roundedInt(const QJSValue &value)
+{
+    double number = value.toNumber();
+    return qIsFinite(number) ? int(qRound64(number)) : 0;
+}
+
+QByteArray JSKitPebble::encodeAppMessage(const QJSValue &message) const
+{
+    // Writes the same tuples WatchDataWriter::writeDict() produces for message.toVariant(),
+    // straight from the JS object.
+    const QHash<QString, int> appKeys = m_appInfo.appKeys();
+    QByteArray dict;
+    WatchDataWriter writer(&dict);
+    writer.writeLE<quint8>(0); // Item count, filled in at the end
+    quint8 count = 0;
+
+    QJSValueIterator it(message);
+    while (it.hasNext()) {
+        it.next();
+
+        int key;
+        QHash<QString, int>::const_iterator appKey = appKeys.constFind(it.name());
+        if (appKey != appKeys.constEnd()) {
+            key = appKey.value();
+        } else {
+            // Even if we do not know about this appkey, it may already be a numeric key
+            bool ok = false;
+            key = it.name().toInt(&ok);
+            if (!ok) {
+                qCWarning(l) << "Unknown appKey" << it.name() << "for app with GUID" << m_appInfo.uuid();
+                continue;
+            }
+        }
+
+        const QJSValue value = it.value();
+        if (value.isNull() || value.isUndefined()) {
+            // Skipped, as writeDict() did
+            continue;
+        }
+        if (count == 0xFF) {
+            qCWarning(l) << "Dictionary is too large to encode";
+            return QByteArray(1, '\0');
+        }
+
+        QVariant bytes;
+        writer.writeLE<quint32>(key);
+        if (value.isBool()) {
+            writer.writeLE<quint8>(WatchConnection::DictItemTypeInt);
+            writer.writeLE<quint16>(sizeof(char));
+            writer.writeLE<char>(value.toBool());
+        } else if (value.isNumber()) {
+            // Treat numbers as ints
+            writer.writeLE<quint8>(WatchConnection::DictItemTypeInt);
+            writer.writeLE<quint16>(sizeof(int));
+            writer.writeLE<int>(roundedInt(value));
+        } else if (value.isArray()) {
+            // Generally a list of byte values
+            const int length = value.property("length").toInt();
+            writer.writeLE<quint8>(WatchConnection::DictItemTypeBytes);
+            writer.writeLE<quint16>(length);
+            for (int i = 0; i < length; i++) {
+                writer.writeLE<char>(roundedInt(value.property(i)));
+            }
+        } else if (value.isObject() && (bytes = value.toVariant()).type() == QVariant::ByteArray) {
+            // ArrayBuffer
+            QByteArray ba = bytes.toByteArray();
+            writer.writeLE<quint8>(WatchConnection::DictItemTypeBytes);
+            writer.writeLE<quint16>(ba.size());
+            dict.append(ba);
+        } else {
+            if (!value.isString()) {
+                qCWarning(l) << "Sending" << it.name() << "as string:" << value.toString();
+            }
+            QByteArray s = value.toString().toUtf8();
+            if (s.isEmpty() || s[s.size() - 1] != '\0') {
+                // Add null terminator if it doesn't have one
+                s.append('\0');
+            }
+            writer.writeLE<quint8>(WatchConnection::DictItemTypeString);
+            writer.writeLE<quint16>(s.size());
+            dict.append(s);
+        }
+        count++;
+    }
+
+    dict[0] = count;
+    return dict;
+}
+
 void JSKitPebble::appGlanceReload(QJSValue slices, QJSValue callbackForAck, QJSValue callbackForNack)
 {
     QVariantList vs = slices.toVariant().toList();
@@ -155,6 +248,8 @@ void JSKitPebble::timelineSubscribe(const QString &topic, QJSValue successCallba
             }
         },[this,topic,failureCallback](const QString &err)mutable{
             qCDebug(l) << "Cannot subscribe to" << topic << err;
+            // Token may have been rejected, look it up again next time
+            m_timelineToken.clear();
             if (failureCallback.isCallable()) {
                 failureCallback.call(QJSValueList({err}));
             }
@@ -172,6 +267,8 @@ void JSKitPebble::timelineUnsubscribe(const QString &topic, QJSValue successCall
             }
         },[this,topic,failureCallback](const QString &err)mutable{
             qCDebug(l) << "Cannot unsubscribe from" << topic << err;
+            // Token may have been rejected, look it up again next time
+            m_timelineToken.clear();
             if (failureCallback.isCallable()) {
                 failureCallback.call(QJSValueList({err}));
             }
@@ -191,7 +288,8 @@ void JSKitPebble::timelineSubscriptions(QJSValue successCallback, QJSValue failu
                 }
                 successCallback.call(QJSValueList({argArray}));
             }
-        },[failureCallback](const QString &err)mutable{
+        },[this,failureCallback](const QString &err)mutable{
+            m_timelineToken.clear();
             if (failureCallback.isCallable()) {
                 failureCallback.call(QJSValueList({err}));
             }
@@ -433,7 +531,7 @@ QJSValue JSKitPebble::createXMLHttpRequest()
 
 QJSValue JSKitPebble::createWebSocket(const QString &url, const QJSValue &protocols)
 {
-    JSKitWebSocket *ws = new JSKitWebSocket(m_mgr->engine(), url, protocols);
+    JSKitWebSocket *ws = new JSKitWebSocket(m_mgr, url, protocols);
     return m_mgr->engine()->newQObject(ws);
 }
 
@@ -38,6 +38,8 @@ public:
 
 private:
     QJSValue buildAckEventObject(uint transaction, const QString &message = QString()) const;
+    // Encodes an AppMessage into the wire dictionary, resolving keys through the app's key table
+    QByteArray encodeAppMessage(const QJSValue &message) const;
 
     template<typename Func>
     void getTokenInternal(Func ack, QJSValue &failureCallback);
@@ -1,23 +1,27 @@
-#include <QTimerEvent>
-
 #include "jskittimer.h"
+#include "../timerwheel.h"
 
-JSKitTimer::JSKitTimer(QJSEngine *engine) :
+JSKitTimer::JSKitTimer(QJSEngine *engine, TimerWheel *timers) :
     QObject(engine),
     l(metaObject()->className()),
-    m_engine(engine)
+    m_engine(engine),
+    m_timers(timers)
 {
 }
 
+JSKitTimer::~JSKitTimer()
+{
+    // Drop the expressions while we still know which ones are ours, unless the wheel went first
+    if (m_timers)
+        m_timers->stopAll(this);
+}
+
 int JSKitTimer::setInterval(QJSValue expression, int delay) //TODO support optional parameters
 {
     qCDebug(l) << "Setting interval for " << delay << "ms: " << expression.toString();
 
     if (expression.isString() || expression.isCallable()) {
-        int timerId = startTimer(delay);
-        m_intervals.insert(timerId, expression);
-
-        return timerId;
+        return m_timers->start(delay, this, [this, expression]() { invoke(expression); }, true);
     }
 
     return -1;
@@ -26,8 +30,7 @@ int JSKitTimer::setInterval(QJSValue expression, int delay) //TODO support optio
 void JSKitTimer::clearInterval(int timerId)
 {
     qCDebug(l) << "Killing interval " << timerId ;
-    killTimer(timerId);
-    m_intervals.remove(timerId);
+    m_timers->stop(timerId, this);
 }
 
 int JSKitTimer::setTimeout(QJSValue expression, int delay) //TODO support optional parameters
@@ -35,10 +38,7 @@ int JSKitTimer::setTimeout(QJSValue expression, int delay) //TODO support option
     qCDebug(l) << "Setting timeout for " << delay << "ms: " << expression.toString();
 
     if (expression.isString() || expression.isCallable()) {
-        int timerId = startTimer(delay);
-        m_timeouts.insert(timerId, expression);
-
-        return timerId;
+        return m_timers->start(delay, this, [this, expression]() { invoke(expression); });
     }
 
     return -1;
@@ -47,27 +47,11 @@ int JSKitTimer::setTimeout(QJSValue expression, int delay) //TODO support option
 void JSKitTimer::clearTimeout(int timerId)
 {
     qCDebug(l) << "Killing timeout " << timerId ;
-    killTimer(timerId);
-    m_timeouts.remove(timerId);
+    m_timers->stop(timerId, this);
 }
 
-void JSKitTimer::timerEvent(QTimerEvent *event)
+void JSKitTimer::invoke(QJSValue expression)
 {
-    int id = event->timerId();
-
-    QJSValue expression; // find in either intervals or timeouts
-    if (m_intervals.contains(id)) {
-        expression = m_intervals.value(id);
-    } else if (m_timeouts.contains(id)) {
-        expression = m_timeouts.value(id);
-        killTimer(id); // timeouts don't repeat
-    } else {
-        qCWarning(l) << "Unknown timer event";
-        killTimer(id); // interval nor timeout exist. kill the timer
-
-        return;
-    }
-
     if (expression.isCallable()) { // call it if it's a function
         expression.call().toString();
     }
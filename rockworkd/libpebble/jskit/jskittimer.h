@@ -4,6 +4,9 @@
 #include <QLoggingCategory>
 #include <QJSValue>
 #include <QJSEngine>
+#include <QPointer>
+
+class TimerWheel;
 
 class JSKitTimer : public QObject
 {
@@ -11,7 +14,8 @@ class JSKitTimer : public QObject
     QLoggingCategory l;
 
 public:
-    explicit JSKitTimer(QJSEngine *engine);
+    explicit JSKitTimer(QJSEngine *engine, TimerWheel *timers);
+    ~JSKitTimer();
 
     Q_INVOKABLE int setInterval(QJSValue expression, int delay);
     Q_INVOKABLE void clearInterval(int timerId);
@@ -19,13 +23,11 @@ public:
     Q_INVOKABLE int setTimeout(QJSValue expression, int delay);
     Q_INVOKABLE void clearTimeout(int timerId);
 
-protected:
-    void timerEvent(QTimerEvent *event);
-
 private:
+    void invoke(QJSValue expression);
+
     QJSEngine *m_engine;
-    QHash<int, QJSValue> m_intervals;
-    QHash<int, QJSValue> m_timeouts;
+    QPointer<TimerWheel> m_timers;
 };
 
 #endif // JSKITTIMER_P_H
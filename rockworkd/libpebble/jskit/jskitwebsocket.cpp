@@ -1,16 +1,42 @@
 #include "jskitwebsocket.h"
 #include "jskitmanager.h"
-
-JSKitWebSocket::JSKitWebSocket(QJSEngine *engine, const QString &url, const QJSValue &protocols) :
-    QObject(engine),
+#include "../pebble.h"
+#include "../metrics.h"
+
+// The polyfill keeps ArrayBuffer contents in a plain _bytes array. These move the whole
+// message through a latin1 string with a single call instead of one call per byte.
+static const char *polyfillToBuffer =
+        "(function(s) {"
+        "    var b = new ArrayBuffer(s.length);"
+        "    for (var i = 0; i < s.length; i++) b._bytes[i] = s.charCodeAt(i);"
+        "    return b;"
+        "})";
+static const char *polyfillFromBuffer =
+        "(function(b, offset, length) {"
+        "    var s = '';"
+        "    for (var i = offset; i < offset + length; i += 4096)"
+        "        s += String.fromCharCode.apply(null, b._bytes.slice(i, Math.min(i + 4096, offset + length)));"
+        "    return s;"
+        "})";
+
+JSKitWebSocket::JSKitWebSocket(JSKitManager *mgr, const QString &url, const QJSValue &protocols) :
+    QObject(mgr->engine()),
     l(metaObject()->className()),
-    m_engine(engine),
+    m_mgr(mgr),
+    m_engine(mgr->engine()),
     m_webSocket(new QWebSocket("", QWebSocketProtocol::VersionLatest, this)),
     m_url(url)
 {
     //As of QT 5.5: "QWebSocket currently does not support extensions and subprotocols"
     Q_UNUSED(protocols)
 
+    // Native ArrayBuffers convert to and from QByteArray
+    m_nativeBuffers = m_engine->toScriptValue(QByteArray(1, 0)).property("byteLength").toInt() == 1;
+    if (!m_nativeBuffers) {
+        m_polyfillToBuffer = m_engine->evaluate(polyfillToBuffer);
+        m_polyfillFromBuffer = m_engine->evaluate(polyfillFromBuffer);
+    }
+
     connect(m_webSocket, &QWebSocket::connected,
             this, &JSKitWebSocket::handleConnected);
     connect(m_webSocket, &QWebSocket::disconnected,
@@ -23,6 +49,8 @@ JSKitWebSocket::JSKitWebSocket(QJSEngine *engine, const QString &url, const QJSV
             this, &JSKitWebSocket::handleTextMessageReceived);
     connect(m_webSocket, &QWebSocket::binaryMessageReceived,
             this, &JSKitWebSocket::handleBinaryMessageReceived);
+    connect(m_webSocket, &QWebSocket::bytesWritten,
+            this, &JSKitWebSocket::handleBytesWritten);
 
     qCDebug(l) << "WebSocket opened for" << url;
     //m_webSocket->ignoreSslErrors();
@@ -52,26 +80,12 @@ void JSKitWebSocket::send(const QJSValue &data)
     } else if (data.isObject()) {
         if (data.hasProperty("byteLength")) {
             // Looks like an ArrayView or an ArrayBufferView!
-            QJSValue buffer = data.property("buffer");
-            if (buffer.isUndefined()) {
-                // We must assume we've been passed an ArrayBuffer directly
-                buffer = data;
-            }
-
-            QJSValue array = buffer.property("_bytes");
-            int byteLength = buffer.property("byteLength").toInt();
-
-            if (array.isArray()) {
-                QByteArray byteData;
-                byteData.reserve(byteLength);
-
-                for (int i = 0; i < byteLength; i++) {
-                    byteData.append(array.property(i).toInt());
-                }
-
+            QByteArray byteData;
+            if (fromArrayBuffer(data, byteData)) {
                 qCDebug(l) << "sending binary message with" << byteData.length() << "bytes";
 
                 m_bufferedAmount += byteData.size();
+                m_mgr->pebble()->metrics()->count("jskit.websocket.tx.bytes", byteData.size());
                 m_webSocket->sendBinaryMessage(byteData);
             } else {
                 qCWarning(l) << "Refusing to send an unknown/invalid ArrayBuffer" << data.toString();
@@ -150,6 +164,40 @@ QJSValue JSKitWebSocket::onopen() const
     return m_onopen;
 }
 
+QJSValue JSKitWebSocket::toArrayBuffer(const QByteArray &data)
+{
+    if (m_nativeBuffers) {
+        return m_engine->toScriptValue(data);
+    }
+    return m_polyfillToBuffer.call({QJSValue(QString::fromLatin1(data))});
+}
+
+bool JSKitWebSocket::fromArrayBuffer(const QJSValue &data, QByteArray &bytes)
+{
+    QJSValue buffer = data.property("buffer");
+    int offset = data.property("byteOffset").toInt();
+    int length = data.property("byteLength").toInt();
+    if (buffer.isUndefined()) {
+        // We must assume we've been passed an ArrayBuffer directly
+        buffer = data;
+        offset = 0;
+    }
+
+    if (m_nativeBuffers) {
+        QVariant var = buffer.toVariant();
+        if (var.type() != QVariant::ByteArray) {
+            return false;
+        }
+        bytes = var.toByteArray().mid(offset, length);
+        return true;
+    }
+    if (!buffer.property("_bytes").isArray()) {
+        return false;
+    }
+    bytes = m_polyfillFromBuffer.call({buffer, offset, length}).toString().toLatin1();
+    return true;
+}
+
 quint32 JSKitWebSocket::bufferedAmount()
 {
     return m_bufferedAmount;
@@ -262,33 +310,28 @@ void JSKitWebSocket::handleBinaryMessageReceived(const QByteArray &message)
 {
     qCDebug(l) << "Binary message recieved";
 
+    m_mgr->pebble()->metrics()->count("jskit.websocket.rx.bytes", message.size());
     if (m_onmessage.isCallable()) {
         if (m_binaryType == "arraybuffer") {
-            QJSValue arrayBufferProto = m_engine->globalObject().property("ArrayBuffer").property("prototype");
-            QJSValue arrayBuf = m_engine->newObject();
-
-            if (arrayBufferProto.isUndefined()) {
-                qCWarning(l) << "Cannot find proto of ArrayBuffer";
-            } else {
-                arrayBuf.setPrototype(arrayBufferProto);
-                arrayBuf.setProperty("byteLength", m_engine->toScriptValue<uint>(message.size()));
-
-                QJSValue array = m_engine->newArray(message.size());
-                for (int i = 0; i < message.size(); i++) {
-                    array.setProperty(i, m_engine->toScriptValue<int>(message[i]));
-                }
+            qint64 started = Metrics::now();
+            QJSValue arrayBuf = toArrayBuffer(message);
+            qCDebug(l) << "calling onmessage with ArrayBuffer of" << message.size() << "bytes";
 
-                arrayBuf.setProperty("_bytes", array);
-                qCDebug(l) << "calling onmessage with ArrayBuffer of" << message.size() << "bytes";
-
-                callOnmessage(arrayBuf);
-            }
+            callOnmessage(arrayBuf);
+            // Time per message including the handler, against rx.bytes this gives the throughput
+            m_mgr->pebble()->metrics()->recordSince("jskit.websocket.rx.duration", started);
         } else {
             qCWarning(l) << "unsupported binaryType:" << m_binaryType;
         }
     }
 }
 
+void JSKitWebSocket::handleBytesWritten(qint64 bytes)
+{
+    // Frame headers are counted as well, so don't go below zero
+    m_bufferedAmount -= qMin<qint64>(bytes, m_bufferedAmount);
+}
+
 void JSKitWebSocket::callOnmessage(QJSValue data)
 {
     if (m_onmessage.isCallable()) {
@@ -5,6 +5,8 @@
 #include <QWebSocket>
 #include <QJSEngine>
 
+class JSKitManager;
+
 class JSKitWebSocket : public QObject
 {
     Q_OBJECT
@@ -22,7 +24,7 @@ class JSKitWebSocket : public QObject
     Q_PROPERTY(QString url READ url)
 
 public:
-    explicit JSKitWebSocket(QJSEngine *engine, const QString &url, const QJSValue &protocols=QJSValue());
+    explicit JSKitWebSocket(JSKitManager *mgr, const QString &url, const QJSValue &protocols=QJSValue());
 
     enum ReadyStates {
         CONNECTING = 0,
@@ -56,12 +58,21 @@ private slots:
     void handleSslErrors(const QList<QSslError> &errors);
     void handleTextMessageReceived(const QString &message);
     void handleBinaryMessageReceived(const QByteArray &message);
+    void handleBytesWritten(qint64 bytes);
 
 private:
     void callOnmessage(QJSValue data);
+    // Converts between QByteArray and ArrayBuffer (or any view on one) in one go
+    QJSValue toArrayBuffer(const QByteArray &data);
+    bool fromArrayBuffer(const QJSValue &data, QByteArray &bytes);
 
 private:
+    JSKitManager *m_mgr;
     QJSEngine *m_engine;
+    // Engine has native ArrayBuffers, otherwise the typedarray.js polyfill is in use
+    bool m_nativeBuffers;
+    QJSValue m_polyfillToBuffer;
+    QJSValue m_polyfillFromBuffer;
     QWebSocket *m_webSocket;
 
     QString m_binaryType = "arraybuffer";
@@ -0,0 +1,124 @@
+#include "logbuffer.h"
+
+#include <QDateTime>
+#include <QFile>
+
+// Readers poll anyway, a burst wakes them every that many records
+static const int WAKE_BATCH = 256;
+
+LogBuffer::LogBuffer(int capacity):
+    m_ring(capacity)
+{
+}
+
+void LogBuffer::append(QtMsgType type, const QMessageLogContext &ctx, const QString &msg)
+{
+    QMutexLocker l(&m_mutex);
+    Record &rec = m_ring[m_head % m_ring.size()];
+    rec.ts = QDateTime::currentMSecsSinceEpoch();
+    rec.type = type;
+    // Not necessarily a Q_FUNC_INFO literal, handlers can be fed any context
+    rec.function = QByteArray(ctx.function);
+    rec.line = ctx.line;
+    rec.msg = msg;
+    // Readers that are behind don't wait, only wake them when they were caught up
+    bool caughtUp = m_readHead == m_head;
+    m_head++;
+    if (caughtUp || m_head - m_signalled >= WAKE_BATCH) {
+        m_signalled = m_head;
+        m_cond.wakeAll();
+    }
+}
+
+LogBuffer::Cursor LogBuffer::head() const
+{
+    QMutexLocker l(&m_mutex);
+    return m_head;
+}
+
+QVector<LogBuffer::Record> LogBuffer::read(Cursor &cursor, int max)
+{
+    QMutexLocker l(&m_mutex);
+    QVector<Record> ret;
+    if (m_head - cursor > (Cursor)m_ring.size()) {
+        m_dropped += m_head - cursor - m_ring.size();
+        cursor = m_head - m_ring.size();
+    }
+    int n = m_head - cursor;
+    if (max >= 0 && n > max)
+        n = max;
+    ret.reserve(n);
+    for (int i = 0; i < n; i++)
+        ret.append(m_ring.at((cursor + i) % m_ring.size()));
+    cursor += n;
+    m_readHead = qMax(m_readHead, cursor);
+    return ret;
+}
+
+bool LogBuffer::wait(Cursor cursor, unsigned long msecs)
+{
+    QMutexLocker l(&m_mutex);
+    if (m_head != cursor)
+        return true;
+    return m_cond.wait(&m_mutex, msecs);
+}
+
+void LogBuffer::wakeAll()
+{
+    QMutexLocker l(&m_mutex);
+    m_cond.wakeAll();
+}
+
+quint64 LogBuffer::dropped() const
+{
+    QMutexLocker l(&m_mutex);
+    return m_dropped;
+}
+
+static const char lvl[] = {'D','W','C','F','I'};
+QByteArray LogBuffer::format(const Record &rec, bool timestamp)
+{
+    QByteArray ret;
+    if (timestamp) {
+        ret.append(QDateTime::fromMSecsSinceEpoch(rec.ts).toString(Qt::ISODate).toLatin1());
+        ret.append(' ');
+    }
+    ret.append('[').append(lvl[qBound(0, int(rec.type), 4)]).append("] ");
+    ret.append(rec.function).append(':').append(QByteArray::number(rec.line)).append(' ');
+    ret.append(rec.msg.toUtf8());
+    return ret;
+}
+
+LogFlusher::LogFlusher(LogBuffer *buffer, QFile *file, QObject *parent):
+    QThread(parent),
+    m_buffer(buffer),
+    m_file(file),
+    m_cursor(buffer->head()),
+    m_stop(0)
+{
+}
+
+void LogFlusher::stop()
+{
+    m_stop.store(1);
+    m_buffer->wakeAll();
+    wait();
+}
+
+void LogFlusher::run()
+{
+    while (true) {
+        bool stopping = m_stop.load();
+        m_buffer->wait(m_cursor, 1000);
+        QVector<LogBuffer::Record> recs = m_buffer->read(m_cursor);
+        if (!recs.isEmpty()) {
+            QByteArray chunk;
+            foreach (const LogBuffer::Record &rec, recs)
+                chunk.append(LogBuffer::format(rec)).append('\n');
+            m_file->write(chunk);
+            m_file->flush();
+        }
+        if (stopping)
+            break;
+    }
+}
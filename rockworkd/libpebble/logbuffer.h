@@ -0,0 +1,68 @@
+#ifndef LOGBUFFER_H
+#define LOGBUFFER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QAtomicInt>
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+
+// Fixed size ring of unformatted log records. Producers (message handler, any thread)
+// only take a timestamp and a refcounted copy of the message; formatting is deferred
+// to whoever reads the records - dump flusher thread or dev connection socket drain.
+class LogBuffer
+{
+public:
+    struct Record {
+        qint64 ts;
+        QtMsgType type;
+        QByteArray function;
+        int line;
+        QString msg;
+    };
+    typedef quint64 Cursor;
+
+    explicit LogBuffer(int capacity = 4096);
+
+    void append(QtMsgType type, const QMessageLogContext &ctx, const QString &msg);
+    Cursor head() const;
+    // Returns records after cursor and advances it. Overrun records are skipped and counted.
+    QVector<Record> read(Cursor &cursor, int max = -1);
+    bool wait(Cursor cursor, unsigned long msecs);
+    void wakeAll();
+    quint64 dropped() const;
+
+    static QByteArray format(const Record &rec, bool timestamp = true);
+
+private:
+    mutable QMutex m_mutex;
+    QWaitCondition m_cond;
+    QVector<Record> m_ring;
+    Cursor m_head = 0;
+    Cursor m_readHead = 0; // furthest any reader got
+    Cursor m_signalled = 0; // head at the last wake up
+    quint64 m_dropped = 0;
+};
+
+// Background writer of the log dump. Owns the dump file while running.
+class LogFlusher : public QThread
+{
+    Q_OBJECT
+public:
+    LogFlusher(LogBuffer *buffer, QFile *file, QObject *parent = 0);
+
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    LogBuffer *m_buffer;
+    QFile *m_file;
+    LogBuffer::Cursor m_cursor;
+    QAtomicInt m_stop;
+};
+
+#endif // LOGBUFFER_H
@@ -0,0 +1,242 @@
+#include "metrics.h"
+#include "pebble.h"
+#include "uploadmanager.h"
+
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QTimer>
+#include <QtEndian>
+#include <QDebug>
+
+Histogram::Histogram()
+{
+    reset();
+}
+
+void Histogram::reset()
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_count = 0;
+    m_sum = 0;
+    m_min = 0;
+    m_max = 0;
+}
+
+int Histogram::bucketIndex(quint64 value)
+{
+    if (value >= (Q_UINT64_C(1) << MaxBits))
+        value = (Q_UINT64_C(1) << MaxBits) - 1;
+    if (value < SubBuckets)
+        return value;
+    int msb = 0;
+    for (quint64 v = value; v > 1; v >>= 1)
+        msb++;
+    int shift = msb - SubBucketBits;
+    return (shift + 1) * SubBuckets + ((value >> shift) & (SubBuckets - 1));
+}
+
+quint64 Histogram::bucketMidpoint(int idx)
+{
+    if (idx < SubBuckets)
+        return idx;
+    int shift = idx / SubBuckets - 1;
+    quint64 low = quint64(SubBuckets + idx % SubBuckets) << shift;
+    return low + ((Q_UINT64_C(1) << shift) >> 1);
+}
+
+void Histogram::record(quint64 value)
+{
+    m_buckets[bucketIndex(value)]++;
+    if (m_count == 0 || value < m_min)
+        m_min = value;
+    if (value > m_max)
+        m_max = value;
+    m_count++;
+    m_sum += value;
+}
+
+quint64 Histogram::percentile(double p) const
+{
+    if (m_count == 0)
+        return 0;
+    quint64 rank = qMax<quint64>(1, quint64(p / 100.0 * m_count + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; i++) {
+        seen += m_buckets[i];
+        if (seen >= rank)
+            return qBound(m_min, bucketMidpoint(i), m_max);
+    }
+    return m_max;
+}
+
+QVariantMap Histogram::toVariantMap() const
+{
+    QVariantMap ret;
+    ret.insert("count", m_count);
+    ret.insert("min", min());
+    ret.insert("max", max());
+    ret.insert("mean", mean());
+    ret.insert("p50", percentile(50));
+    ret.insert("p90", percentile(90));
+    ret.insert("p99", percentile(99));
+    ret.insert("p999", percentile(99.9));
+    return ret;
+}
+
+/**
+ * @brief Metrics::Metrics
+ * @param pebble
+ * @param connection
+ *
+ * Per-watch registry of counters and latency histograms. Subsystems report into it
+ * through Pebble::metrics(), frame traffic is sampled straight off the connection.
+ * Histograms named *.latency/*.rtt/*.duration are in microseconds.
+ * Snapshot is available over D-Bus and dumped to metrics.json every 5 minutes.
+ */
+Metrics::Metrics(Pebble *pebble, WatchConnection *connection):
+    QObject(pebble),
+    m_pebble(pebble),
+    m_snapshotTimer(new QTimer(this)),
+    m_started(now())
+{
+    connect(connection, &WatchConnection::rawIncomingMsg, this, &Metrics::onRawIncomingMsg);
+    connect(connection, &WatchConnection::rawOutgoingMsg, this, &Metrics::onRawOutgoingMsg);
+    connect(connection, &WatchConnection::frameDispatched, this, &Metrics::onFrameDispatched);
+    connect(connection, &WatchConnection::frameWritten, this, &Metrics::onFrameWritten);
+    connect(connection->uploadManager(), &UploadManager::uploadFinished, this, &Metrics::onUploadFinished);
+
+    m_snapshotTimer->setInterval(5 * 60 * 1000);
+    connect(m_snapshotTimer, &QTimer::timeout, this, &Metrics::writeSnapshot);
+    m_snapshotTimer->start();
+}
+
+Metrics::~Metrics()
+{
+    qDeleteAll(m_histograms);
+}
+
+qint64 Metrics::now()
+{
+    static QElapsedTimer clock;
+    if (!clock.isValid())
+        clock.start();
+    return clock.nsecsElapsed() / 1000;
+}
+
+void Metrics::count(const QString &name, quint64 inc)
+{
+    QMutexLocker l(&m_mutex);
+    m_counters[name] += inc;
+}
+
+void Metrics::record(const QString &name, quint64 value)
+{
+    QMutexLocker l(&m_mutex);
+    Histogram *h = m_histograms.value(name);
+    if (!h) {
+        h = new Histogram();
+        m_histograms.insert(name, h);
+    }
+    h->record(value);
+}
+
+QVariantMap Metrics::snapshot() const
+{
+    QMutexLocker l(&m_mutex);
+    QVariantMap counters;
+    for (QHash<QString,quint64>::const_iterator it = m_counters.begin(); it != m_counters.end(); ++it)
+        counters.insert(it.key(), it.value());
+    QVariantMap histograms;
+    for (QHash<QString,Histogram*>::const_iterator it = m_histograms.begin(); it != m_histograms.end(); ++it)
+        histograms.insert(it.key(), it.value()->toVariantMap());
+    publish(m_rx, "rx", counters, histograms);
+    publish(m_tx, "tx", counters, histograms);
+
+    QVariantMap ret;
+    ret.insert("version", QStringLiteral(VERSION));
+    ret.insert("firmware", m_pebble->softwareVersion());
+    ret.insert("timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    ret.insert("uptime", (now() - m_started) / 1000000);
+    ret.insert("counters", counters);
+    ret.insert("histograms", histograms);
+    return ret;
+}
+
+void Metrics::reset()
+{
+    QMutexLocker l(&m_mutex);
+    m_counters.clear();
+    qDeleteAll(m_histograms);
+    m_histograms.clear();
+    m_rx = FrameStats();
+    m_tx = FrameStats();
+}
+
+void Metrics::writeSnapshot() const
+{
+    QSaveFile f(m_pebble->storagePath() + "metrics.json");
+    if (!f.open(QFile::WriteOnly)) {
+        qWarning() << "Cannot write metrics snapshot to" << f.fileName() << f.errorString();
+        return;
+    }
+    f.write(QJsonDocument(QJsonObject::fromVariantMap(snapshot())).toJson());
+    f.commit();
+}
+
+void Metrics::onRawIncomingMsg(const QByteArray &msg)
+{
+    countFrame(m_rx, msg);
+}
+
+void Metrics::onRawOutgoingMsg(const QByteArray &msg)
+{
+    countFrame(m_tx, msg);
+}
+
+void Metrics::countFrame(FrameStats &stats, const QByteArray &msg)
+{
+    QMutexLocker l(&m_mutex);
+    stats.frames++;
+    stats.bytes += msg.size();
+    stats.size.record(msg.size());
+    if (msg.size() >= 4)
+        stats.endpoints[qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(msg.constData()) + 2)]++;
+}
+
+// Names match what count()/record() would have used: frames.rx, bytes.rx, frames.rx.<endpoint>, frames.rx.size
+void Metrics::publish(const FrameStats &stats, const QString &dir, QVariantMap &counters, QVariantMap &histograms)
+{
+    if (stats.frames == 0)
+        return;
+    counters.insert("frames." + dir, stats.frames);
+    counters.insert("bytes." + dir, stats.bytes);
+    for (QHash<quint16,quint64>::const_iterator it = stats.endpoints.begin(); it != stats.endpoints.end(); ++it)
+        counters.insert(QString("frames.%1.%2").arg(dir).arg(it.key()), it.value());
+    histograms.insert("frames." + dir + ".size", stats.size.toVariantMap());
+}
+
+void Metrics::onFrameDispatched(WatchConnection::Endpoint endpoint, qint64 usecs)
+{
+    record("frames.rx.latency", usecs);
+    if (usecs > 100000)
+        qDebug() << "Slow handler for endpoint" << endpoint << usecs << "us";
+}
+
+void Metrics::onFrameWritten(WatchConnection::Endpoint endpoint, qint64 usecs)
+{
+    Q_UNUSED(endpoint);
+    record("frames.tx.latency", usecs);
+}
+
+void Metrics::onUploadFinished(WatchConnection::UploadType type, int bytes, qint64 usecs)
+{
+    Q_UNUSED(type);
+    count("putbytes.uploads");
+    count("putbytes.bytes", bytes);
+    record("putbytes.duration", usecs);
+    if (usecs > 0)
+        record("putbytes.throughput", quint64(bytes) * 1000000 / usecs); // bytes per second
+}
@@ -0,0 +1,98 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QVariantMap>
+
+#include "watchconnection.h"
+
+class Pebble;
+class QTimer;
+
+// Log-linear (HDR-style) histogram. Values below 8 are exact, above that each
+// power of two is split into 8 sub-buckets, so the relative error stays under
+// 12.5% regardless of magnitude while the whole thing is a fixed flat array.
+class Histogram
+{
+public:
+    Histogram();
+
+    void record(quint64 value);
+    void reset();
+
+    quint64 count() const {return m_count;}
+    quint64 min() const {return m_count ? m_min : 0;}
+    quint64 max() const {return m_max;}
+    double mean() const {return m_count ? double(m_sum) / m_count : 0;}
+    quint64 percentile(double p) const;
+
+    QVariantMap toVariantMap() const;
+
+private:
+    static const int SubBucketBits = 3;
+    static const int SubBuckets = 1 << SubBucketBits;
+    static const int MaxBits = 36; // ~19 hours in usecs
+    static const int BucketCount = (MaxBits - SubBucketBits + 1) * SubBuckets;
+
+    static int bucketIndex(quint64 value);
+    static quint64 bucketMidpoint(int idx);
+
+    quint64 m_buckets[BucketCount];
+    quint64 m_count;
+    quint64 m_sum;
+    quint64 m_min;
+    quint64 m_max;
+};
+
+class Metrics : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Metrics(Pebble *pebble, WatchConnection *connection);
+    ~Metrics();
+
+    // Monotonic microseconds since daemon start, use it for all intervals
+    static qint64 now();
+
+    void count(const QString &name, quint64 inc = 1);
+    void record(const QString &name, quint64 value);
+    void recordSince(const QString &name, qint64 start) {record(name, now() - start);}
+
+    QVariantMap snapshot() const;
+    void reset();
+
+public slots:
+    void writeSnapshot() const;
+
+private slots:
+    void onRawIncomingMsg(const QByteArray &msg);
+    void onRawOutgoingMsg(const QByteArray &msg);
+    void onFrameDispatched(WatchConnection::Endpoint endpoint, qint64 usecs);
+    void onFrameWritten(WatchConnection::Endpoint endpoint, qint64 usecs);
+    void onUploadFinished(WatchConnection::UploadType type, int bytes, qint64 usecs);
+
+private:
+    // Frame traffic of one direction, counted without building names per frame
+    struct FrameStats {
+        quint64 frames = 0;
+        quint64 bytes = 0;
+        Histogram size;
+        QHash<quint16,quint64> endpoints;
+    };
+    void countFrame(FrameStats &stats, const QByteArray &msg);
+    static void publish(const FrameStats &stats, const QString &dir, QVariantMap &counters, QVariantMap &histograms);
+
+    Pebble *m_pebble;
+    QTimer *m_snapshotTimer;
+    qint64 m_started;
+
+    mutable QMutex m_mutex;
+    QHash<QString,quint64> m_counters;
+    QHash<QString,Histogram*> m_histograms;
+    FrameStats m_rx;
+    FrameStats m_tx;
+};
+
+#endif // METRICS_H
@@ -1,18 +1,24 @@
 #include "musicendpoint.h"
 #include "pebble.h"
-#include "core.h"
-#include "platforminterface.h"
 #include "watchdatawriter.h"
 #include "watchconnection.h"
+#include "timerwheel.h"
+#include "metrics.h"
 
 #include <QDebug>
 
+// Players report status and position changes in bursts
+static const int STATE_DELAY = 250;
+// Position changes the watch could not have extrapolated by itself
+static const qint64 DRIFT_MSEC = 1500;
+
 MusicEndpoint::MusicEndpoint(Pebble *pebble, WatchConnection *connection):
     QObject(pebble),
     m_pebble(pebble),
     m_watchConnection(connection)
 {
     m_watchConnection->registerEndpointHandler(WatchConnection::EndpointMusicControl, this, "handleMessage");
+    connect(m_watchConnection, &WatchConnection::watchDisconnected, this, &MusicEndpoint::resetSync);
 }
 
 void MusicEndpoint::setMusicMetadata(const MusicMetaData &metaData)
@@ -22,11 +28,13 @@ void MusicEndpoint::setMusicMetadata(const MusicMetaData &metaData)
     writeMetadata();
 }
 
-MusicPlayState MusicEndpoint::getMusicPlayState() {
-    return Core::instance()->platform()->getMusicPlayState();
+void MusicEndpoint::resetSync()
+{
+    m_sentMetadata.clear();
+    m_stateSent = false;
 }
 
-void MusicEndpoint::writeMetadata()
+void MusicEndpoint::writeMetadata(bool force)
 {
     if (!m_watchConnection->isConnected()) {
         return;
@@ -42,14 +50,47 @@ void MusicEndpoint::writeMetadata()
     writer.writeLE(m_metaData.trackCount);
     writer.writeLE(m_metaData.currentTrack);
 
+    if (!force && res == m_sentMetadata) {
+        m_pebble->metrics()->count("music.metadata.skipped");
+        return;
+    }
+    m_sentMetadata = res;
+    m_pebble->metrics()->count("music.metadata.sent");
     m_watchConnection->writeToPebble(WatchConnection::EndpointMusicControl, res);
 }
 
 void MusicEndpoint::writePlayState(const MusicPlayState &playState) {
-    qDebug() << "Writing playstate. Position: " << playState.trackPosition;
+    m_playState = playState;
+    m_playStateTime = Metrics::now();
+    if (!m_stateTimer) {
+        m_stateTimer = m_pebble->timers()->start(STATE_DELAY, this, [this]() {
+            m_stateTimer = 0;
+            syncPlayState();
+        });
+    }
+}
+
+void MusicEndpoint::syncPlayState(bool force)
+{
     if (!m_watchConnection->isConnected()) {
         return;
     }
+
+    qint64 now = Metrics::now();
+    MusicPlayState playState = m_playState;
+    playState.trackPosition = qint32(positionAt(m_playState, m_playStateTime, now));
+
+    if (!force && m_stateSent
+            && playState.state == m_sentState.state
+            && playState.playRate == m_sentState.playRate
+            && playState.shuffle == m_sentState.shuffle
+            && playState.repeat == m_sentState.repeat
+            && qAbs(playState.trackPosition - positionAt(m_sentState, m_sentStateTime, now)) <= DRIFT_MSEC) {
+        m_pebble->metrics()->count("music.state.skipped");
+        return;
+    }
+
+    qDebug() << "Writing playstate. Position: " << playState.trackPosition;
     QByteArray res;
     WatchDataWriter writer(&res);
     res.append(MusicControlUpdatePlayStateInfo); // MusicControlUpdatePlayStateInfo
@@ -59,9 +100,22 @@ void MusicEndpoint::writePlayState(const MusicPlayState &playState) {
     res.append(playState.shuffle);
     res.append(playState.repeat);
 
+    m_sentState = playState;
+    m_sentStateTime = now;
+    m_stateSent = true;
+    m_pebble->metrics()->count("music.state.sent");
     m_watchConnection->writeToPebble(WatchConnection::EndpointMusicControl, res);
 }
 
+qint64 MusicEndpoint::positionAt(const MusicPlayState &playState, qint64 reported, qint64 now)
+{
+    // The watch moves a playing track along at the play rate, in percent
+    if (playState.state != MusicPlayState::StatePlaying) {
+        return playState.trackPosition;
+    }
+    return playState.trackPosition + (now - reported) / 1000 * playState.playRate / 100;
+}
+
 void MusicEndpoint::handleMessage(const QByteArray &data)
 {
     qDebug() << "Music control : " << data.toHex().toInt();
@@ -89,8 +143,14 @@ void MusicEndpoint::handleMessage(const QByteArray &data)
         controlButton = MusicControlVolumeDown;
         break;
     case MusicControlGetCurrentTrack: // MusicControlGetCurrentTrack
-        writeMetadata();
-        writePlayState(getMusicPlayState());
+        // The watch lost track, send everything again
+        writeMetadata(true);
+        if (m_stateTimer) {
+            m_pebble->timers()->stop(m_stateTimer, this);
+            m_stateTimer = 0;
+        }
+        // Resend the mirrored state, the platform lives on the main thread and pushes every change here
+        syncPlayState(true);
         return;
     default:
         qWarning() << "Unhandled music control button pressed:" << data.toHex();
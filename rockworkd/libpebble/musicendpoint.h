@@ -26,14 +26,25 @@ signals:
     void musicControlPressed(MusicControlButton button);
 
 private:
-    void writeMetadata();
-    MusicPlayState getMusicPlayState();
+    void writeMetadata(bool force = false);
+    void syncPlayState(bool force = false);
+    void resetSync();
+    static qint64 positionAt(const MusicPlayState &playState, qint64 reported, qint64 now);
 
 private:
     Pebble *m_pebble;
     WatchConnection *m_watchConnection;
 
     MusicMetaData m_metaData;
+    // What the watch has, it extrapolates the position of a playing track by itself
+    QByteArray m_sentMetadata;
+    MusicPlayState m_sentState;
+    qint64 m_sentStateTime = 0;
+    bool m_stateSent = false;
+    // Latest state from the player, waiting for its burst to settle
+    MusicPlayState m_playState;
+    qint64 m_playStateTime = 0;
+    int m_stateTimer = 0;
 };
 
 #endif // MUSICENDPOINT_H
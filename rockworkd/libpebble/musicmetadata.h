@@ -2,6 +2,7 @@
 #define MUSICMETADATA_H
 
 #include <QString>
+#include <QMetaType>
 
 class MusicMetaData
 {
@@ -49,4 +50,7 @@ public:
     Repeat repeat;
 };
 
+Q_DECLARE_METATYPE(MusicMetaData)
+Q_DECLARE_METATYPE(MusicPlayState)
+
 #endif // MUSICMETADATA_H
@@ -21,18 +21,24 @@
 #include "timelinemanager.h"
 #include "timelinesync.h"
 #include "voiceendpoint.h"
+#include "voicestream.h"
 #include "sendtextapp.h"
 #include "weatherapp.h"
 #include "weatherprovidertwc.h"
 #include "weatherproviderwu.h"
 #include "uploadmanager.h"
+#include "metrics.h"
+#include "threadcall.h"
+#include "tracerecorder.h"
+#include "settingsstore.h"
+#include "timerwheel.h"
+#include "positionservice.h"
 
 #include "QDir"
 #include <QDateTime>
 #include <QStandardPaths>
 #include <QSettings>
 #include <QTimeZone>
-#include <QTemporaryDir>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
@@ -44,13 +50,22 @@
 Pebble::Pebble(const QBluetoothAddress &address, QObject *parent):
     QObject(parent),
     m_address(address),
-    m_nam(new QNetworkAccessManager(this))
+    m_nam(new QNetworkAccessManager(this)),
+    m_timers(new TimerWheel(this)),
+    m_positions(new PositionService(this))
 {
     QString watchPath = m_address.toString().replace(':', '_');
     m_storagePath = QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/" + watchPath + "/";
     m_imagePath = QStandardPaths::writableLocation(QStandardPaths::PicturesLocation) + "/screenshots/Pebble/";
 
+    m_watchInfo = new SettingsStore(m_storagePath + "watchinfo.conf", this);
+    m_appSettings = new SettingsStore(m_storagePath + "appsettings.conf", this);
+    m_notificationSettings = new SettingsStore(m_storagePath + "notifications.conf", this);
+    m_cannedSettings = new SettingsStore(m_storagePath + "canned_messages.conf", this);
+
     m_connection = new WatchConnection(this);
+    m_metrics = new Metrics(this, m_connection);
+    m_traceRecorder = new TraceRecorder(this, m_connection);
     QObject::connect(m_connection, &WatchConnection::watchConnected, this, &Pebble::onPebbleConnected);
     QObject::connect(m_connection, &WatchConnection::watchDisconnected, this, &Pebble::onPebbleDisconnected);
     QObject::connect(Core::instance()->platform(), &PlatformInterface::timeChanged, this, &Pebble::syncTime);
@@ -59,8 +74,6 @@ Pebble::Pebble(const QBluetoothAddress &address, QObject *parent):
     m_connection->registerEndpointHandler(WatchConnection::EndpointPhoneVersion, this, "phoneVersionAsked");
     m_connection->registerEndpointHandler(WatchConnection::EndpointFactorySettings, this, "factorySettingsReceived");
 
-    m_dataLogEndpoint = new DataLoggingEndpoint(this, m_connection);
-
     m_blobDB = new BlobDB(this, m_connection);
 
     QHash<QString,QStringList> cans = getCannedMessages();
@@ -71,23 +84,44 @@ Pebble::Pebble(const QBluetoothAddress &address, QObject *parent):
     QObject::connect(m_timelineManager, &TimelineManager::removeNotification, Core::instance()->platform(), &PlatformInterface::removeNotification);
 
     QObject::connect(Core::instance()->platform(), &PlatformInterface::newTimelinePin, this, &Pebble::insertPin);
+    QObject::connect(Core::instance()->platform(), &PlatformInterface::newNotification, this, &Pebble::insertNotification);
     QObject::connect(Core::instance()->platform(), &PlatformInterface::delTimelinePin, this, &Pebble::removePin);
 
+    // Still on the main thread here, later platform state only arrives through queued signals
+    PlatformInterface *platform = Core::instance()->platform();
+    m_deviceActive = platform->deviceIsActive();
+    QObject::connect(platform, &PlatformInterface::deviceActiveChanged, this, [this, platform]() {
+        bool active = platform->deviceIsActive();
+        invokeOn(this, [this, active]() { m_deviceActive = active; });
+    }, Qt::DirectConnection);
+
     m_musicEndpoint = new MusicEndpoint(this, m_connection);
-    m_musicEndpoint->setMusicMetadata(Core::instance()->platform()->musicMetaData());
+    m_musicEndpoint->setMusicMetadata(platform->musicMetaData());
+    m_musicEndpoint->writePlayState(platform->getMusicPlayState());
     QObject::connect(m_musicEndpoint, &MusicEndpoint::musicControlPressed, Core::instance()->platform(), &PlatformInterface::sendMusicControlCommand);
     QObject::connect(Core::instance()->platform(), &PlatformInterface::musicMetadataChanged, m_musicEndpoint, &MusicEndpoint::setMusicMetadata);
     QObject::connect(Core::instance()->platform(), &PlatformInterface::musicPlayStateChanged, m_musicEndpoint, &MusicEndpoint::writePlayState);
 
     m_phoneCallEndpoint = new PhoneCallEndpoint(this, m_connection);
     QObject::connect(m_phoneCallEndpoint, &PhoneCallEndpoint::hangupCall, Core::instance()->platform(), &PlatformInterface::hangupCall);
-    QObject::connect(Core::instance()->platform(), &PlatformInterface::incomingCall, m_phoneCallEndpoint, &PhoneCallEndpoint::incomingCall);
-    QObject::connect(Core::instance()->platform(), &PlatformInterface::callStarted, m_phoneCallEndpoint, &PhoneCallEndpoint::callStarted);
-    QObject::connect(Core::instance()->platform(), &PlatformInterface::callEnded, m_phoneCallEndpoint, &PhoneCallEndpoint::callEnded);
+    // Stamped in the platform's thread, so the call latency covers the hop over to ours
+    PhoneCallEndpoint *phone = m_phoneCallEndpoint;
+    QObject::connect(Core::instance()->platform(), &PlatformInterface::incomingCall, phone, [phone](uint cookie, const QString &number, const QString &name) {
+        qint64 signalled = Metrics::now();
+        invokeOn(phone, [phone, cookie, number, name, signalled]() { phone->incomingCall(cookie, number, name, signalled); });
+    }, Qt::DirectConnection);
+    QObject::connect(Core::instance()->platform(), &PlatformInterface::callStarted, phone, [phone](uint cookie) {
+        qint64 signalled = Metrics::now();
+        invokeOn(phone, [phone, cookie, signalled]() { phone->callStarted(cookie, signalled); });
+    }, Qt::DirectConnection);
+    QObject::connect(Core::instance()->platform(), &PlatformInterface::callEnded, phone, [phone](uint cookie, bool missed) {
+        qint64 signalled = Metrics::now();
+        invokeOn(phone, [phone, cookie, missed, signalled]() { phone->callEnded(cookie, missed, signalled); });
+    }, Qt::DirectConnection);
 
     m_appGlances = new AppGlances(this, m_connection);
     m_appManager = new AppManager(this, m_connection);
-    QObject::connect(m_appManager, &AppManager::appsChanged, this, &Pebble::installedAppsChanged);
+    QObject::connect(m_appManager, &AppManager::appsChanged, this, [this]() { emit installedAppsChanged(m_appManager->catalogVersion()); });
     QObject::connect(m_appManager, &AppManager::idMismatchDetected, this, &Pebble::resetPebble);
     QObject::connect(m_appManager, &AppManager::appInserted, this, &Pebble::appInstalled);
 
@@ -95,103 +129,175 @@ Pebble::Pebble(const QBluetoothAddress &address, QObject *parent):
     QObject::connect(m_timelineSync, &TimelineSync::oauthTokenChanged, this, &Pebble::oauthTokenChanged);
 
     m_appMsgManager = new AppMsgManager(this, m_connection);
-    m_jskitManager = new JSKitManager(this, m_connection, m_appManager, m_appMsgManager, this);
-    QObject::connect(m_jskitManager, &JSKitManager::openURL, this, &Pebble::openURL);
-    QObject::connect(m_jskitManager, &JSKitManager::appNotification, this, &Pebble::insertPin);
     QObject::connect(m_appMsgManager, &AppMsgManager::appStarted, this, &Pebble::appStarted);
     QObject::connect(m_appMsgManager, &AppMsgManager::appButtonPressed, this, &Pebble::onAppButtonPressed);
 
-    m_weatherApp = new WeatherApp(this, getWeatherLocations());
-    QObject::connect(m_weatherApp, &WeatherApp::locationsChanged, this, &Pebble::saveWeatherLocations);
-
-    m_appDownloader = new AppDownloader(m_storagePath, this);
-    QObject::connect(m_appDownloader, &AppDownloader::downloadFinished, this, &Pebble::appDownloadFinished);
-
-    m_screenshotEndpoint = new ScreenshotEndpoint(this, m_connection, this);
-    QObject::connect(m_screenshotEndpoint, &ScreenshotEndpoint::screenshotAdded, this, &Pebble::screenshotAdded);
-    QObject::connect(m_screenshotEndpoint, &ScreenshotEndpoint::screenshotRemoved, this, &Pebble::screenshotRemoved);
-
     m_firmwareDownloader = new FirmwareDownloader(this, m_connection);
     QObject::connect(m_firmwareDownloader, &FirmwareDownloader::updateAvailableChanged, this, &Pebble::slotUpdateAvailableChanged);
     QObject::connect(m_firmwareDownloader, &FirmwareDownloader::upgradingChanged, this, &Pebble::upgradingFirmwareChanged);
     QObject::connect(m_firmwareDownloader, &FirmwareDownloader::layoutsChanged, m_timelineManager, &TimelineManager::reloadLayouts);
 
-    m_logEndpoint = new WatchLogEndpoint(this, m_connection);
-    QObject::connect(m_logEndpoint, &WatchLogEndpoint::logsFetched, this, &Pebble::logsDumped);
+    QObject::connect(m_timelineManager, &TimelineManager::actionSendText, this, [this](const QString &contact, const QString &text) {
+        sendTextApp()->handleTextAction(contact, text);
+    });
+
+    m_model = (Model)m_watchInfo->value("watchModel", (int)ModelUnknown).toInt();
 
-    m_sendTextApp = new SendTextApp(this, m_connection);
-    QObject::connect(m_sendTextApp, &SendTextApp::contactBlobSet, this, &Pebble::saveTextContacts);
-    QObject::connect(m_sendTextApp, &SendTextApp::messageBlobSet, this, &Pebble::saveTextMessages);
-    QObject::connect(m_sendTextApp, &SendTextApp::sendTextMessage, Core::instance()->platform(), &PlatformInterface::sendTextMessage);
-    QObject::connect(m_timelineManager, &TimelineManager::actionSendText, m_sendTextApp, &SendTextApp::handleTextAction);
-    setCannedContacts(getCannedContacts(),false);
+    m_healthParams.setEnabled(m_appSettings->value("activityParams/enabled").toBool());
+    m_healthParams.setAge(m_appSettings->value("activityParams/age").toUInt());
+    m_healthParams.setHeight(m_appSettings->value("activityParams/height").toInt());
+    m_healthParams.setGender((HealthParams::Gender)m_appSettings->value("activityParams/gender").toInt());
+    m_healthParams.setWeight(m_appSettings->value("activityParams/weight").toInt());
+    m_healthParams.setMoreActive(m_appSettings->value("activityParams/moreActive").toBool());
+    m_healthParams.setSleepMore(m_appSettings->value("activityParams/sleepMore").toBool());
 
-    m_voiceEndpoint = new VoiceEndpoint(this, m_connection);
-    QObject::connect(m_voiceEndpoint, &VoiceEndpoint::sessionSetupRequest, this, &Pebble::voiceSessionRequest);
-    QObject::connect(m_voiceEndpoint, &VoiceEndpoint::audioFrame, this, &Pebble::voiceAudioStream);
-    QObject::connect(m_voiceEndpoint, &VoiceEndpoint::sessionCloseNotice, this, &Pebble::voiceSessionClose);
+    m_imperialUnits = m_appSettings->value("unitsDistance/enabled", false).toBool();
+
+    m_calendarSyncEnabled = m_appSettings->value("calendar/calendarSyncEnabled", true).toBool();
 
-    QSettings watchInfo(m_storagePath + "/watchinfo.conf", QSettings::IniFormat);
-    m_model = (Model)watchInfo.value("watchModel", (int)ModelUnknown).toInt();
-
-    QSettings settings(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    settings.beginGroup("activityParams");
-    m_healthParams.setEnabled(settings.value("enabled").toBool());
-    m_healthParams.setAge(settings.value("age").toUInt());
-    m_healthParams.setHeight(settings.value("height").toInt());
-    m_healthParams.setGender((HealthParams::Gender)settings.value("gender").toInt());
-    m_healthParams.setWeight(settings.value("weight").toInt());
-    m_healthParams.setMoreActive(settings.value("moreActive").toBool());
-    m_healthParams.setSleepMore(settings.value("sleepMore").toBool());
-    settings.endGroup();
-
-    settings.beginGroup("unitsDistance");
-    m_imperialUnits = settings.value("imperialUnits", false).toBool();
-    settings.endGroup();
-
-    settings.beginGroup("calendar");
-    m_calendarSyncEnabled = settings.value("calendarSyncEnabled", true).toBool();
-    settings.endGroup();
-
-    m_weatherProv = nullptr;
-    settings.beginGroup(WeatherApp::appConfigKey);
-    initWeatherProvider(settings);
-    settings.endGroup();
-
-    settings.beginGroup("profileWhen");
-    m_profileWhenConnected = settings.value("connected", "").toString();
-    m_profileWhenDisconnected = settings.value("disconnected", "").toString();
-    settings.endGroup();
+    m_profileWhenConnected = m_appSettings->value("profileWhen/connected", "").toString();
+    m_profileWhenDisconnected = m_appSettings->value("profileWhen/disconnected", "").toString();
 
     QObject::connect(m_connection, &WatchConnection::watchConnected, this, &Pebble::profileSwitchRequired);
     QObject::connect(m_connection, &WatchConnection::watchDisconnected, this, &Pebble::profileSwitchRequired);
     QObject::connect(this, &Pebble::profileConnectionSwitchChanged, this, &Pebble::profileSwitchRequired);
 
-    m_devConnection = new DevConnection(this, m_connection);
-    QObject::connect(m_devConnection, &DevConnection::serverStateChanged, this, &Pebble::devConServerStateChanged);
-    QObject::connect(m_devConnection, &DevConnection::cloudStateChanged, this, &Pebble::devConCloudStateChanged);
-    settings.beginGroup("devConnection");
-    // DeveloperConnection is a backdoor to the pebble, it has no authentication whatsoever.
-    // Dont ever enable it automatically, only on-demand by explicit user request!!111
-    //m_devConnection->setEnabled(settings.value("enabled", true).toBool());
-    m_devConnection->setPort(settings.value("listenPort", 9000).toInt());
-    m_devConnection->setCloudEnabled(settings.value("useCloud", true).toBool()); // not implemented yet
-    // Custom Logging params
-    m_devConnection->setLogLevel(settings.value("logVerbosity", 1).toInt()); // by default suppress debug logging
-    if(settings.value("logDump", false).toBool()) // by default dump is not enabled
-        qWarning() << "Dumping logs to" << m_devConnection->startLogDump(); // dump logs to file if enabled
-    settings.endGroup();
-
-    settings.beginGroup("timeline");
     m_timelineManager->setTimelineWindow(
         // Past boundary of the timeline window - used for pin validation & retention
-        settings.value("pastDays",m_timelineManager->daysPast()).toInt(),
+        m_appSettings->value("timeline/pastDays",m_timelineManager->daysPast()).toInt(),
         // Time after which undelivered notifications are considered obsolete
-        settings.value("eventFadeout",m_timelineManager->secsEventFadeout()).toInt(),
+        m_appSettings->value("timeline/eventFadeout",m_timelineManager->secsEventFadeout()).toInt(),
         // Future boundary of the timeline window - used for pin validation & retention
-        settings.value("futureDays",m_timelineManager->daysFuture()).toInt()
+        m_appSettings->value("timeline/futureDays",m_timelineManager->daysFuture()).toInt()
     );
-    settings.endGroup();
+
+    // A log dump asked for in the settings has to start with the daemon
+    if (m_appSettings->value("devConnection/logDump", false).toBool())
+        devConnection();
+
+    // Transport, timeline and notification paths are up. Whatever the watch talks to
+    // follows when it connects, the rest on first use.
+    traceStartup("core");
+}
+
+Pebble::~Pebble()
+{
+    // Children are deleted in creation order, which takes the timer wheel and position
+    // service down before the JS app still holding timers and watches on them
+    delete m_jskitManager;
+    m_jskitManager = nullptr;
+}
+
+void Pebble::initDeferred()
+{
+    if (m_deferredReady)
+        return;
+    m_deferredReady = true;
+
+    // Endpoints which only ever react to the watch
+    m_dataLogEndpoint = new DataLoggingEndpoint(this, m_connection);
+    m_voiceEndpoint = new VoiceEndpoint(this, m_connection);
+    QObject::connect(m_voiceEndpoint, &VoiceEndpoint::sessionSetupRequest, this, &Pebble::voiceSessionRequest);
+    QObject::connect(m_voiceEndpoint, &VoiceEndpoint::audioFrame, this, &Pebble::voiceAudioStream);
+    QObject::connect(m_voiceEndpoint, &VoiceEndpoint::sessionCloseNotice, this, &Pebble::voiceSessionClose);
+
+    // Apps started on the watch may bring JS, send-text and weather in
+    jskitManager();
+    sendTextApp();
+    weatherApp();
+    traceStartup("deferred");
+}
+
+/**
+ * @brief Pebble::traceStartup marks a startup milestone, in microseconds since daemon start.
+ * Shows up in the metrics snapshot as startup.<stage>.
+ */
+void Pebble::traceStartup(const QString &stage)
+{
+    qint64 usecs = Metrics::now();
+    qDebug() << "Startup" << stage << "reached after" << usecs / 1000 << "ms for" << m_address.toString();
+    m_metrics->record("startup." + stage, usecs);
+}
+
+AppManager *Pebble::appManager() const
+{
+    if (!m_appsScanned) {
+        m_appsScanned = true;
+        m_appManager->rescan();
+    }
+    return m_appManager;
+}
+
+JSKitManager *Pebble::jskitManager() const
+{
+    if (!m_jskitManager) {
+        Pebble *self = const_cast<Pebble*>(this);
+        m_jskitManager = new JSKitManager(self, m_connection, appManager(), m_appMsgManager, self);
+        QObject::connect(m_jskitManager, &JSKitManager::openURL, self, &Pebble::openURL);
+        QObject::connect(m_jskitManager, &JSKitManager::appNotification, self, &Pebble::insertPin);
+    }
+    return m_jskitManager;
+}
+
+AppDownloader *Pebble::appDownloader() const
+{
+    if (!m_appDownloader) {
+        Pebble *self = const_cast<Pebble*>(this);
+        m_appDownloader = new AppDownloader(m_storagePath, self);
+        QObject::connect(m_appDownloader, &AppDownloader::downloadFinished, self, &Pebble::appDownloadFinished);
+    }
+    return m_appDownloader;
+}
+
+ScreenshotEndpoint *Pebble::screenshotEndpoint() const
+{
+    if (!m_screenshotEndpoint) {
+        Pebble *self = const_cast<Pebble*>(this);
+        m_screenshotEndpoint = new ScreenshotEndpoint(self, m_connection, self);
+        QObject::connect(m_screenshotEndpoint, &ScreenshotEndpoint::screenshotAdded, self, &Pebble::screenshotAdded);
+        QObject::connect(m_screenshotEndpoint, &ScreenshotEndpoint::screenshotRemoved, self, &Pebble::screenshotRemoved);
+    }
+    return m_screenshotEndpoint;
+}
+
+WatchLogEndpoint *Pebble::logEndpoint() const
+{
+    if (!m_logEndpoint) {
+        Pebble *self = const_cast<Pebble*>(this);
+        m_logEndpoint = new WatchLogEndpoint(self, m_connection);
+        QObject::connect(m_logEndpoint, &WatchLogEndpoint::logsFetched, self, &Pebble::logsDumped);
+    }
+    return m_logEndpoint;
+}
+
+SendTextApp *Pebble::sendTextApp() const
+{
+    if (!m_sendTextApp) {
+        Pebble *self = const_cast<Pebble*>(this);
+        m_sendTextApp = new SendTextApp(self, m_connection);
+        QObject::connect(m_sendTextApp, &SendTextApp::contactBlobSet, self, &Pebble::saveTextContacts);
+        QObject::connect(m_sendTextApp, &SendTextApp::messageBlobSet, self, &Pebble::saveTextMessages);
+        QObject::connect(m_sendTextApp, &SendTextApp::sendTextMessage, Core::instance()->platform(), &PlatformInterface::sendTextMessage);
+        self->setCannedContacts(getCannedContacts(),false);
+    }
+    return m_sendTextApp;
+}
+
+WeatherApp *Pebble::weatherApp() const
+{
+    if (!m_weatherApp) {
+        Pebble *self = const_cast<Pebble*>(this);
+        m_weatherApp = new WeatherApp(self, getWeatherLocations());
+        QObject::connect(m_weatherApp, &WeatherApp::locationsChanged, self, &Pebble::saveWeatherLocations);
+        self->initWeatherProvider();
+    }
+    return m_weatherApp;
+}
+
+WeatherProvider *Pebble::weatherProvider() const
+{
+    weatherApp();
+    return m_weatherProv;
 }
 
 QBluetoothAddress Pebble::address() const
@@ -251,6 +357,26 @@ AppGlances * Pebble::appGlances() const
     return m_appGlances;
 }
 
+Metrics * Pebble::metrics() const
+{
+    return m_metrics;
+}
+
+TimerWheel * Pebble::timers() const
+{
+    return m_timers;
+}
+
+PositionService * Pebble::positions() const
+{
+    return m_positions;
+}
+
+TraceRecorder * Pebble::traceRecorder() const
+{
+    return m_traceRecorder;
+}
+
 bool Pebble::syncAppsFromCloud() const
 {
     return m_timelineSync->syncFromCloud();
@@ -443,34 +569,62 @@ bool Pebble::upgradingFirmware() const
 
 DevConnection * Pebble::devConnection()
 {
+    if (!m_devConnection) {
+        m_devConnection = new DevConnection(this, m_connection);
+        QObject::connect(m_devConnection, &DevConnection::serverStateChanged, this, &Pebble::devConServerStateChanged);
+        QObject::connect(m_devConnection, &DevConnection::cloudStateChanged, this, &Pebble::devConCloudStateChanged);
+        // DeveloperConnection is a backdoor to the pebble, it has no authentication whatsoever.
+        // Dont ever enable it automatically, only on-demand by explicit user request!!111
+        //m_devConnection->setEnabled(m_appSettings->value("devConnection/enabled", true).toBool());
+        m_devConnection->setPort(m_appSettings->value("devConnection/listenPort", 9000).toInt());
+        m_devConnection->setCloudEnabled(m_appSettings->value("devConnection/useCloud", true).toBool()); // not implemented yet
+        // Custom Logging params
+        m_devConnection->setLogLevel(m_appSettings->value("devConnection/logVerbosity", 1).toInt()); // by default suppress debug logging
+        if(m_appSettings->value("devConnection/logDump", false).toBool()) // by default dump is not enabled
+            qWarning() << "Dumping logs to" << m_devConnection->startLogDump(); // dump logs to file if enabled
+    }
     return m_devConnection;
 }
+// Developer connection state as served to clients, without bringing the connection up
+bool Pebble::devConEnabled() const
+{
+    return m_devConnection && m_devConnection->enabled();
+}
+quint16 Pebble::devConListenPort() const
+{
+    return m_devConnection ? m_devConnection->listenPort() : m_appSettings->value("devConnection/listenPort", 9000).toInt();
+}
+bool Pebble::devConCloudEnabled() const
+{
+    return m_devConnection ? m_devConnection->cloudEnabled() : m_appSettings->value("devConnection/useCloud", true).toBool();
+}
+bool Pebble::devConServerState() const
+{
+    return m_devConnection && m_devConnection->serverState();
+}
+bool Pebble::devConCloudState() const
+{
+    return m_devConnection && m_devConnection->cloudState();
+}
+
 void Pebble::setDevConListenPort(quint16 port)
 {
-    m_devConnection->setPort(port);
-    QSettings settings(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    settings.beginGroup("devConnection");
-    settings.setValue("listenPort", port);
+    devConnection()->setPort(port);
+    m_appSettings->setValue("devConnection/listenPort", port);
 }
 void Pebble::setDevConCloudEnabled(bool enabled)
 {
-    m_devConnection->setCloudEnabled(enabled);
-    QSettings settings(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    settings.beginGroup("devConnection");
-    settings.setValue("useCloud", enabled);
+    devConnection()->setCloudEnabled(enabled);
+    m_appSettings->setValue("devConnection/useCloud", enabled);
 }
 void Pebble::setDevConLogLevel(int level)
 {
     DevConnection::setLogLevel(level);
-    QSettings settings(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    settings.beginGroup("devConnection");
-    settings.setValue("logVerbosity", level);
+    m_appSettings->setValue("devConnection/logVerbosity", level);
 }
 void Pebble::setDevConLogDump(bool enable)
 {
-    QSettings settings(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    settings.beginGroup("devConnection");
-    settings.setValue("logDump", enable);
+    m_appSettings->setValue("devConnection/logDump", enable);
 }
 
 qint32 Pebble::timelineWindowStart() const
@@ -494,11 +648,9 @@ void Pebble::setTimelineWindow(qint32 start, qint32 fade, qint32 end)
     if(fade > 0)
         fade = -fade;
     m_timelineManager->setTimelineWindow(start,fade,end);
-    QSettings setts(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    setts.beginGroup("timeline");
-    setts.setValue("daysPast",start);
-    setts.setValue("eventFadeout",fade);
-    setts.setValue("futureDays",end);
+    m_appSettings->setValue("timeline/pastDays",start);
+    m_appSettings->setValue("timeline/eventFadeout",fade);
+    m_appSettings->setValue("timeline/futureDays",end);
     // Since window has changed try to re-sync timeline
     emit m_timelineSync->syncUrlChanged("");
     syncCalendar(); // and calendar
@@ -510,16 +662,13 @@ void Pebble::setHealthParams(const HealthParams &healthParams)
     m_blobDB->insert(BlobDB::BlobDBIdAppSettings,healthParams);
     emit healtParamsChanged();
 
-    QSettings healthSettings(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    healthSettings.beginGroup("activityParams");
-    healthSettings.setValue("enabled", m_healthParams.enabled());
-    healthSettings.setValue("age", m_healthParams.age());
-    healthSettings.setValue("height", m_healthParams.height());
-    healthSettings.setValue("gender", m_healthParams.gender());
-    healthSettings.setValue("weight", m_healthParams.weight());
-    healthSettings.setValue("moreActive", m_healthParams.moreActive());
-    healthSettings.setValue("sleepMore", m_healthParams.sleepMore());
-
+    m_appSettings->setValue("activityParams/enabled", m_healthParams.enabled());
+    m_appSettings->setValue("activityParams/age", m_healthParams.age());
+    m_appSettings->setValue("activityParams/height", m_healthParams.height());
+    m_appSettings->setValue("activityParams/gender", m_healthParams.gender());
+    m_appSettings->setValue("activityParams/weight", m_healthParams.weight());
+    m_appSettings->setValue("activityParams/moreActive", m_healthParams.moreActive());
+    m_appSettings->setValue("activityParams/sleepMore", m_healthParams.sleepMore());
 }
 
 HealthParams Pebble::healthParams() const
@@ -533,9 +682,7 @@ void Pebble::setImperialUnits(bool imperial)
     m_blobDB->setUnits(imperial);
     emit imperialUnitsChanged();
 
-    QSettings settings(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    settings.beginGroup("unitsDistance");
-    settings.setValue("enabled", m_imperialUnits);
+    m_appSettings->setValue("unitsDistance/enabled", m_imperialUnits);
 }
 
 bool Pebble::imperialUnits() const
@@ -545,53 +692,47 @@ bool Pebble::imperialUnits() const
 
 void Pebble::setWeatherUnits(const QString &u)
 {
-    if(m_weatherProv)
+    if(weatherProvider())
         m_weatherProv->setUnits(u.at(0));
-    QSettings appCfg(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    appCfg.beginGroup(WeatherApp::appConfigKey);
-    appCfg.setValue("units",u);
-    appCfg.endGroup();
+    m_appSettings->setValue(WeatherApp::appConfigKey + "/units",u);
 }
 QString Pebble::getWeatherUnits() const
 {
+    if (!m_weatherApp)
+        return weatherConfigured() ? m_appSettings->value(WeatherApp::appConfigKey + "/units", "m").toString().left(1) : "m";
     return m_weatherProv ? m_weatherProv->getUnits() : 'm';
 }
 
 void Pebble::setWeatherApiKey(const QString &key)
 {
     //((WebWeatherProvider*)m_weatherProv)->setApiKey(key);
-    QSettings appCfg(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    appCfg.beginGroup(WeatherApp::appConfigKey);
-    appCfg.setValue("apiKey",key);
-    initWeatherProvider(appCfg);
-    appCfg.endGroup();
+    m_appSettings->setValue(WeatherApp::appConfigKey + "/apiKey",key);
+    initWeatherProvider();
 }
 
 void Pebble::setWeatherAltKey(const QString &key)
 {
     //((WebWeatherProvider*)m_weatherProv)->setApiKey(key);
-    QSettings appCfg(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    appCfg.beginGroup(WeatherApp::appConfigKey);
 #ifdef WEATHERPROVIDERWU_H
-    appCfg.setValue("wuKey",key);
+    m_appSettings->setValue(WeatherApp::appConfigKey + "/wuKey",key);
+#else
+    Q_UNUSED(key);
 #endif
-    initWeatherProvider(appCfg);
-    appCfg.endGroup();
+    initWeatherProvider();
 }
 QString Pebble::getWeatherAltKey() const
 {
     QString key;
-    QSettings appCfg(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    appCfg.beginGroup(WeatherApp::appConfigKey);
 #ifdef WEATHERPROVIDERWU_H
-    key = appCfg.value("wuKey").toString();
+    key = m_appSettings->value(WeatherApp::appConfigKey + "/wuKey").toString();
 #endif
-    appCfg.endGroup();
     return key;
 }
 
-void Pebble::initWeatherProvider(const QSettings &settings)
+void Pebble::initWeatherProvider()
 {
+    weatherApp(); // providers feed the app
+    QVariantMap settings = m_appSettings->group(WeatherApp::appConfigKey);
     QString apiKey;
 #define INIT_WEATHER_PROV(key,type) \
     if(settings.contains(key) && !settings.value(key).toString().isEmpty()) {\
@@ -630,54 +771,60 @@ void Pebble::initWeatherProvider(const QSettings &settings)
 
 void Pebble::setWeatherLanguage(const QString &lang)
 {
-    if(m_weatherProv)
+    if(weatherProvider())
         m_weatherProv->setLanguage(lang);
-    QSettings appCfg(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    appCfg.beginGroup(WeatherApp::appConfigKey);
-    appCfg.setValue("language",lang);
-    appCfg.endGroup();
+    m_appSettings->setValue(WeatherApp::appConfigKey + "/language",lang);
 }
 QString Pebble::getWeatherLanguage() const
 {
+    if (!m_weatherApp)
+        return weatherConfigured() ? m_appSettings->value(WeatherApp::appConfigKey + "/language").toString() : "";
     return m_weatherProv ? m_weatherProv->getLanguage() : "";
 }
 
+// Whether initWeatherProvider() will come up with a provider, without building the weather app
+bool Pebble::weatherConfigured() const
+{
+    QVariantMap settings = m_appSettings->group(WeatherApp::appConfigKey);
+#ifdef WEATHERPROVIDERWU_H
+    if (!settings.value("wuKey").toString().isEmpty())
+        return true;
+#endif
+    return !settings.value("apiKey").toString().isEmpty();
+}
+
 QVariantList Pebble::getWeatherLocations() const
 {
     QVariantList locs;
-    QSettings appCfg(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    int n = appCfg.beginReadArray(WeatherApp::appConfigKey);
-    for(int i=0;i<n;i++) {
+    foreach(const QVariantMap &loc, m_appSettings->readArray(WeatherApp::appConfigKey)) {
         QStringList city;
-        appCfg.setArrayIndex(i);
-        city.append(appCfg.value("name").toString());
-        city.append(appCfg.value("lat").toString());
-        city.append(appCfg.value("lng").toString());
+        city.append(loc.value("name").toString());
+        city.append(loc.value("lat").toString());
+        city.append(loc.value("lng").toString());
         locs.append(city);
     }
-    appCfg.endArray();
     qDebug() << "Deserialized" << locs.size() << "locations";
     return locs;
 }
 
 void Pebble::setWeatherLocations(const QVariantList &locs)
 {
-    m_weatherApp->setLocations(locs);
+    weatherApp()->setLocations(locs);
 }
 
 void Pebble::saveWeatherLocations() const
 {
     QVariantList locs = m_weatherApp->getLocations();
-    QSettings appCfg(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    appCfg.beginWriteArray(WeatherApp::appConfigKey,locs.count());
+    QList<QVariantMap> cities;
     for(int i=0;i<locs.count();i++) {
         QStringList city = locs.at(i).toStringList();
-        appCfg.setArrayIndex(i);
-        appCfg.setValue("name",city.first());
-        appCfg.setValue("lat",city.at(1));
-        appCfg.setValue("lng",city.at(2));
+        QVariantMap loc;
+        loc.insert("name",city.first());
+        loc.insert("lat",city.at(1));
+        loc.insert("lng",city.at(2));
+        cities.append(loc);
     }
-    appCfg.endArray();
+    m_appSettings->writeArray(WeatherApp::appConfigKey,cities);
     emit weatherLocationsChanged(locs);
 }
 
@@ -693,12 +840,12 @@ void Pebble::injectWeatherConditions(const QString &location, const QVariantMap
     obs.tomorrow.temp_hi = twc.value("tomorrow_hi",SHRT_MAX).toInt();
     obs.tomorrow.temp_low = twc.value("tomorrow_low",SHRT_MAX).toInt();
     obs.tomorrow.condition = twc.value("tomorrow_icon").toInt();
-    m_weatherApp->injectObservation(location, obs, true);
+    weatherApp()->injectObservation(location, obs, true);
 }
 
 void Pebble::dumpLogs(const QString &fileName) const
 {
-    m_logEndpoint->fetchLogs(fileName);
+    logEndpoint()->fetchLogs(fileName);
 }
 
 QString Pebble::storagePath() const
@@ -725,6 +872,10 @@ void Pebble::voiceSessionRequest(const QUuid &appUuid, const SpeexInfo &codec)
                 QString::number(codec.bitstreamVer),
                 QString::number(codec.frameSize));
         emit voiceSessionSetup(m_voiceSessDump->fileName(),mime,appUuid.toString());
+        // Decoded PCM is served live to local recognizers, the dump stays for file based ones
+        m_voiceStream = new VoiceStream(codec,QFileInfo(m_voiceSessDump->fileName()).fileName(),this);
+        if(m_voiceStream->isListening())
+            emit voiceSessionPcm(m_voiceSessDump->fileName(),m_voiceStream->socketPath(),m_voiceStream->contentType());
         m_voiceEndpoint->sessionSetupResponse(VoiceEndpoint::ResSuccess,appUuid);
         qDebug() << "Opened session for" << mime << "to" << m_voiceSessDump->fileName() << "from" << appUuid.toString();
     } else {
@@ -739,6 +890,10 @@ void Pebble::voiceSessionClose(quint16 sesId)
     emit voiceSessionClosed(m_voiceSessDump->fileName());
     m_voiceSessDump->deleteLater();
     m_voiceSessDump = 0;
+    if(m_voiceStream) {
+        m_voiceStream->deleteLater();
+        m_voiceStream = nullptr;
+    }
 }
 void Pebble::voiceAudioStream(quint16 sid, const AudioStream &frames)
 {
@@ -751,9 +906,14 @@ void Pebble::voiceAudioStream(quint16 sid, const AudioStream &frames)
         for(int i=0;i<frames.count;i++) {
             m_voiceSessDump->write(frames.frames.at(i).data);
         }
+        if(m_voiceStream)
+            m_voiceStream->addFrames(frames);
+        m_metrics->count("voice.frames",frames.count);
     } else {
         qDebug() << "Audio Stream has finished dumping to" << m_voiceSessDump->fileName();
         m_voiceSessDump->close();
+        if(m_voiceStream)
+            m_voiceStream->finish();
         emit voiceSessionDumped(m_voiceSessDump->fileName());
     }
 }
@@ -765,6 +925,10 @@ void Pebble::voiceAudioStop()
         m_voiceSessDump->deleteLater();
         emit voiceSessionClosed(m_voiceSessDump->fileName());
         m_voiceSessDump = nullptr;
+        if(m_voiceStream) {
+            m_voiceStream->deleteLater();
+            m_voiceStream = nullptr;
+        }
     } else {
         m_voiceEndpoint->stopAudioStream();
     }
@@ -795,6 +959,7 @@ void Pebble::voiceSessionResult(const QString &fileName, const QVariantList &sen
     }
 }
 
+// Platform state, call from the platform's thread
 QVariantMap Pebble::cannedMessages() const
 {
     QVariantMap ret;
@@ -804,53 +969,49 @@ QVariantMap Pebble::cannedMessages() const
     return ret;
 }
 
-void inline saveMsgs(QSettings &cMsgs, const QStringList &msgs, const QString &grp)
+void inline saveArray(SettingsStore *store, const QStringList &items, const QString &grp, const QString &key)
 {
-    cMsgs.beginWriteArray(grp,msgs.count());
-    for(int i=0;i<msgs.count();i++) {
-        cMsgs.setArrayIndex(i);
-        cMsgs.setValue("msg",msgs.at(i));
+    QList<QVariantMap> entries;
+    foreach(const QString &item, items) {
+        QVariantMap entry;
+        entry.insert(key,item);
+        entries.append(entry);
     }
-    cMsgs.endArray();
+    store->writeArray(grp,entries);
 }
 
 void Pebble::setCannedMessages(const QVariantMap &cans) const
 {
-    QSettings cMsgs(m_storagePath + "/canned_messages.conf", QSettings::IniFormat);
     QHash<QString,QStringList> pass;
     foreach(const QString &grp,cans.keys()) {
         QStringList msgs = cans.value(grp).toStringList();
         pass.insert(grp,msgs);
         // Skip cans stored on pebble - need ACK to save
         if(SendTextApp::appKeys.contains(grp.toUtf8())) continue;
-        saveMsgs(cMsgs,msgs,grp);
+        saveArray(m_cannedSettings,msgs,grp,"msg");
     }
-    Core::instance()->platform()->setCannedResponses(pass);
-    m_sendTextApp->setCannedMessages(pass);
+    PlatformInterface *platform = Core::instance()->platform();
+    invokeOn(platform, [platform, pass]() { platform->setCannedResponses(pass); });
+    sendTextApp()->setCannedMessages(pass);
 }
 
 void Pebble::saveTextMessages(const QByteArray &key) const
 {
-    QSettings cMsgs(m_storagePath + "/canned_messages.conf", QSettings::IniFormat);
-    QStringList msgs = m_sendTextApp->getCannedMessages(key);
-    saveMsgs(cMsgs,msgs,QString::fromUtf8(key));
+    QStringList msgs = sendTextApp()->getCannedMessages(key);
+    saveArray(m_cannedSettings,msgs,QString::fromUtf8(key),"msg");
     emit messagesChanged();
 }
 
 QHash<QString,QStringList> Pebble::getCannedMessages(const QStringList &groups) const
 {
     QHash<QString,QStringList> cans;
-    QSettings cMsgs(m_storagePath + "/canned_messages.conf", QSettings::IniFormat);
-    foreach(const QString &grp,cMsgs.childGroups()) {
+    foreach(const QString &grp,m_cannedSettings->childGroups()) {
         if(groups.isEmpty() || groups.contains(grp)) {
-            int msgn = cMsgs.beginReadArray(grp);
             QStringList msgs;
-            for(int i=0;i<msgn;i++) {
-                cMsgs.setArrayIndex(i);
-                if(cMsgs.contains("msg"))
-                    msgs.append(cMsgs.value("msg").toString());
+            foreach(const QVariantMap &entry, m_cannedSettings->readArray(grp)) {
+                if(entry.contains("msg"))
+                    msgs.append(entry.value("msg").toString());
             }
-            cMsgs.endArray();
             if(!msgs.isEmpty())
                 cans.insert(grp,msgs);
         }
@@ -864,26 +1025,18 @@ void Pebble::setCannedContacts(const QMap<QString, QStringList> &cans, bool push
     for(QMap<QString,QStringList>::const_iterator it=cans.begin();it!=cans.end();it++) {
         ret.append(SendTextApp::Contact({it.key(),it.value()}));
     }
-    m_sendTextApp->setCannedContacts(ret,push);
+    sendTextApp()->setCannedContacts(ret,push);
 }
 void Pebble::saveTextContacts() const
 {
-    QList<SendTextApp::Contact> ctxs = m_sendTextApp->getCannedContacts();
+    QList<SendTextApp::Contact> ctxs = sendTextApp()->getCannedContacts();
     QStringList all=getCannedContacts().keys();
-    QSettings cCtx(m_storagePath + "/canned_messages.conf", QSettings::IniFormat);
     foreach(const SendTextApp::Contact c, ctxs) {
-        cCtx.beginWriteArray(c.name,c.numbers.length());
-        for(int i=0;i<c.numbers.length();i++) {
-            cCtx.setArrayIndex(i);
-            cCtx.setValue("ctx",c.numbers.at(i));
-        }
-        cCtx.endArray();
+        saveArray(m_cannedSettings,c.numbers,c.name,"ctx");
         all.removeAll(c.name);
     }
     foreach (const QString &c, all) {
-        cCtx.beginGroup(c);
-        cCtx.remove("");
-        cCtx.endGroup();
+        m_cannedSettings->remove(c);
     }
     emit contactsChanged();
 }
@@ -891,16 +1044,12 @@ void Pebble::saveTextContacts() const
 QMap<QString,QStringList> Pebble::getCannedContacts(const QStringList &people) const
 {
     QMap<QString,QStringList> ret;
-    QSettings cCtx(m_storagePath + "/canned_messages.conf", QSettings::IniFormat);
-    foreach (const QString &name, cCtx.childGroups()) {
+    foreach (const QString &name, m_cannedSettings->childGroups()) {
         if(people.isEmpty() || people.contains(name)) {
-            int ctxn = cCtx.beginReadArray(name);
-            for(int i=0;i<ctxn;i++) {
-                cCtx.setArrayIndex(i);
-                if(cCtx.contains("ctx"))
-                    ret[name].append(cCtx.value("ctx").toString());
+            foreach(const QVariantMap &entry, m_cannedSettings->readArray(name)) {
+                if(entry.contains("ctx"))
+                    ret[name].append(entry.value("ctx").toString());
             }
-            cCtx.endArray();
         }
     }
     return ret;
@@ -909,74 +1058,63 @@ QMap<QString,QStringList> Pebble::getCannedContacts(const QStringList &people) c
 QVariantMap Pebble::notificationsFilter() const
 {
     QVariantMap ret;
-    QString settingsFile = m_storagePath + "/notifications.conf";
-    QSettings s(settingsFile, QSettings::IniFormat);
-
-    foreach (const QString &group, s.childGroups()) {
-        s.beginGroup(group);
+    foreach (const QString &group, m_notificationSettings->childGroups()) {
+        QVariantMap s = m_notificationSettings->group(group);
         QVariantMap notif;
         notif.insert("enabled", Pebble::NotificationFilter(s.value("enabled").toInt()));
         notif.insert("icon", s.value("icon").toString());
         notif.insert("name", s.value("name").toString());
         ret.insert(group, notif);
-        s.endGroup();
     }
     return ret;
 }
 
 void Pebble::setNotificationFilter(const QString &sourceId, const NotificationFilter enabled)
 {
-    QString settingsFile = m_storagePath + "/notifications.conf";
-    QSettings s(settingsFile, QSettings::IniFormat);
-    s.beginGroup(sourceId);
-    if (s.value("enabled").toInt() != enabled) {
-        s.setValue("enabled", enabled);
-        emit notificationFilterChanged(sourceId, s.value("name").toString(), s.value("icon").toString(), enabled);
+    QString group = sourceId + "/";
+    if (m_notificationSettings->value(group + "enabled").toInt() != enabled) {
+        m_notificationSettings->setValue(group + "enabled", enabled);
+        emit notificationFilterChanged(sourceId, m_notificationSettings->value(group + "name").toString(), m_notificationSettings->value(group + "icon").toString(), enabled);
     }
-    s.endGroup();
 }
 
 void Pebble::forgetNotificationFilter(const QString &sourceId) {
     if (sourceId.isEmpty()) return; // don't remove everything by accident
-    QString settingsFile = m_storagePath + "/notifications.conf";
-    QSettings s(settingsFile, QSettings::IniFormat);
-    s.remove(sourceId);
+    m_notificationSettings->remove(sourceId);
     emit notificationFilterChanged(sourceId, "", "", NotificationForgotten);
 }
 
 void Pebble::setNotificationFilter(const QString &sourceId, const QString &name, const QString &icon, const NotificationFilter enabled)
 {
-    QString settingsFile = m_storagePath + "/notifications.conf";
-    QSettings s(settingsFile, QSettings::IniFormat);
+    SettingsStore *s = m_notificationSettings;
+    QString group = sourceId + "/";
     qDebug() << "Setting" << sourceId << ":" << name << "with icon" << icon << "to" << enabled;
     bool changed = false;
-    s.beginGroup(sourceId);
-    if (s.value("enabled").toInt() != enabled) {
-        s.setValue("enabled", enabled);
+    if (s->value(group + "enabled").toInt() != enabled) {
+        s->setValue(group + "enabled", enabled);
         changed = true;
     }
 
-    if (!icon.isEmpty() && s.value("icon").toString() != icon) {
-        s.setValue("icon", icon);
+    if (!icon.isEmpty() && s->value(group + "icon").toString() != icon) {
+        s->setValue(group + "icon", icon);
         changed = true;
     }
-    else if (s.value("icon").toString().isEmpty()) {
-        s.setValue("icon", findNotificationData(sourceId, "Icon"));
+    else if (s->value(group + "icon").toString().isEmpty()) {
+        s->setValue(group + "icon", findNotificationData(sourceId, "Icon"));
         changed = true;
     }
 
-    if (!name.isEmpty() && s.value("name").toString() != name) {
-        s.setValue("name", name);
+    if (!name.isEmpty() && s->value(group + "name").toString() != name) {
+        s->setValue(group + "name", name);
         changed = true;
     }
-    else if (s.value("name").toString().isEmpty()) {
-        s.setValue("name", findNotificationData(sourceId, "Name"));
+    else if (s->value(group + "name").toString().isEmpty()) {
+        s->setValue(group + "name", findNotificationData(sourceId, "Name"));
         changed = true;
     }
 
     if (changed)
-        emit notificationFilterChanged(sourceId, s.value("name").toString(), s.value("icon").toString(), enabled);
-    s.endGroup();
+        emit notificationFilterChanged(sourceId, s->value(group + "name").toString(), s->value(group + "icon").toString(), enabled);
 
 }
 
@@ -1022,14 +1160,9 @@ void Pebble::insertPin(const QJsonObject &json)
                 sourceId = dataSource.join("%3A");
                 pinObj.insert("dataSource",QString("%1:%2").arg(sourceId).arg(parent));
             }
-            QVariantMap notifFilter = notificationsFilter().value(sourceId).toMap();
-            NotificationFilter f = NotificationFilter(notifFilter.value("enabled", QVariant(NotificationEnabled)).toInt());
-            if (f==NotificationDisabled || (f==Pebble::NotificationDisabledActive && Core::instance()->platform()->deviceIsActive())) {
-                qDebug() << "Notifications for" << sourceId << "disabled.";
+            if (!acceptNotification(sourceId, pinObj.value("source").toString(), pinObj.value("sourceIcon").toString())) {
                 return;
             }
-            // In case it wasn't there before, make sure to write it to the config now so it will appear in the config app.
-            setNotificationFilter(sourceId, pinObj.value("source").toString(), pinObj.value("sourceIcon").toString(), NotificationEnabled);
             // Build mute action so that we can mute event passing through this section
             QJsonArray actions = pinObj.value("actions").toArray();
             QJsonObject mute;
@@ -1055,7 +1188,46 @@ void Pebble::insertPin(const QJsonObject &json)
         pinObj.insert("updateTime",QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
     qDebug() << "Inserting pin" << QJsonDocument(pinObj).toJson();
     m_timelineManager->insertTimelinePin(pinObj);
+    if(m_firstNotification && pinObj.value("type").toString() == "notification") {
+        m_firstNotification = false;
+        traceStartup("firstNotification");
+    }
+}
+void Pebble::insertNotification(const NotificationPin &notification)
+{
+    NotificationPin n(notification);
+    n.sourceId.replace(":", "%3A"); // Escape colon in the srcId
+    if (!acceptNotification(n.sourceId, n.source, n.sourceIcon)) {
+        return;
+    }
+    // Build mute action so that we can mute event passing through this section
+    QString sender = n.sourceName.isEmpty() ? n.source : n.sourceName;
+    n.actions.append({QString("mute"), QString(sender.isEmpty() ? "Mute" : "Mute " + sender), QStringList()});
+    // These must be present for retention and updates
+    if (!n.createTime.isValid())
+        n.createTime = QDateTime::currentDateTimeUtc();
+    if (!n.updateTime.isValid())
+        n.updateTime = QDateTime::currentDateTimeUtc();
+    qDebug() << "Inserting notification" << n.id << n.guid;
+    m_timelineManager->insertNotification(n);
+    if (m_firstNotification) {
+        m_firstNotification = false;
+        traceStartup("firstNotification");
+    }
+}
+
+bool Pebble::acceptNotification(const QString &sourceId, const QString &name, const QString &icon)
+{
+    NotificationFilter f = NotificationFilter(m_notificationSettings->value(sourceId + "/enabled", NotificationEnabled).toInt());
+    if (f==NotificationDisabled || (f==Pebble::NotificationDisabledActive && m_deviceActive)) {
+        qDebug() << "Notifications for" << sourceId << "disabled.";
+        return false;
+    }
+    // In case it wasn't there before, make sure to write it to the config now so it will appear in the config app.
+    setNotificationFilter(sourceId, name, icon, NotificationEnabled);
+    return true;
 }
+
 void Pebble::removePin(const QString &guid)
 {
     m_timelineManager->removeTimelinePin(guid);
@@ -1063,7 +1235,7 @@ void Pebble::removePin(const QString &guid)
 
 void Pebble::clearAppDB()
 {
-    m_appManager->clearApps();
+    appManager()->clearApps();
 }
 
 void Pebble::clearTimeline()
@@ -1073,7 +1245,9 @@ void Pebble::clearTimeline()
 
 void Pebble::syncCalendar()
 {
-    Core::instance()->platform()->syncOrganizer(m_timelineManager->daysFuture());
+    qint32 days = m_timelineManager->daysFuture();
+    PlatformInterface *platform = Core::instance()->platform();
+    invokeOn(platform, [platform,days]() { platform->syncOrganizer(days); });
 }
 
 void Pebble::setCalendarSyncEnabled(bool enabled)
@@ -1086,16 +1260,14 @@ void Pebble::setCalendarSyncEnabled(bool enabled)
     qDebug() << "Changing calendar sync enabled to" << enabled;
 
     if (!m_calendarSyncEnabled) {
-        Core::instance()->platform()->stopOrganizer();
+        PlatformInterface *platform = Core::instance()->platform();
+        invokeOn(platform, [platform]() { platform->stopOrganizer(); });
         m_timelineManager->clearTimeline(PlatformInterface::UUID);
     } else {
         syncCalendar();
     }
 
-    QSettings settings(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    settings.beginGroup("calendar");
-    settings.setValue("calendarSyncEnabled", m_calendarSyncEnabled);
-    settings.endGroup();
+    m_appSettings->setValue("calendar/calendarSyncEnabled", m_calendarSyncEnabled);
 }
 
 bool Pebble::calendarSyncEnabled() const
@@ -1119,16 +1291,12 @@ void Pebble::setProfileWhen(const bool connected, const QString &profile)
     *profileWhen = profile;
     emit profileConnectionSwitchChanged(connected);
 
-    QSettings settings(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-    settings.beginGroup("profileWhen");
-
-    settings.setValue(connected?"connected":"disconnected", *profileWhen);
-    settings.endGroup();
+    m_appSettings->setValue(connected?"profileWhen/connected":"profileWhen/disconnected", *profileWhen);
 }
 
 void Pebble::installApp(const QString &id)
 {
-    m_appDownloader->downloadApp(id);
+    appDownloader()->downloadApp(id);
 }
 
 void Pebble::sideloadApp(const QString &packageFile)
@@ -1137,16 +1305,12 @@ void Pebble::sideloadApp(const QString &packageFile)
     targetFile.remove("file://");
 
     QString id;
-    QTemporaryDir td;
-    if(td.isValid()) {
-        if (!ZipHelper::unpackArchive(targetFile, td.path())) {
-            qWarning() << "Error unpacking App zip file" << targetFile << "to" << td.path();
-            return;
-        }
-        qDebug() << "Pre-scanning app" << td.path();
-        AppInfo info(td.path());
+    {
+        // Metadata is read straight from the package, no need to unpack it twice
+        qDebug() << "Pre-scanning app" << targetFile;
+        AppInfo info(targetFile);
         if (!info.isValid()) {
-            qWarning() << "Error parsing App metadata" << targetFile << "at" << td.path();
+            qWarning() << "Error parsing App metadata" << targetFile;
             return;
         }
         if(installedAppIds().contains(info.uuid())) {
@@ -1176,28 +1340,38 @@ void Pebble::sideloadApp(const QString &packageFile)
 
 QList<QUuid> Pebble::installedAppIds()
 {
-    return m_appManager->appUuids();
+    return appManager()->appUuids();
+}
+
+quint32 Pebble::appCatalogVersion() const
+{
+    return appManager()->catalogVersion();
+}
+
+AppManager::CatalogDelta Pebble::appCatalog(quint32 sinceVersion) const
+{
+    return appManager()->catalogSince(sinceVersion);
 }
 
 void Pebble::setAppOrder(const QList<QUuid> &newList)
 {
-    m_appManager->setAppOrder(newList);
+    appManager()->setAppOrder(newList);
 }
 
 AppInfo Pebble::appInfo(const QUuid &uuid)
 {
-    return m_appManager->info(uuid);
+    return appManager()->info(uuid);
 }
 
 AppInfo Pebble::currentApp()
 {
-    return m_jskitManager->currentApp();
+    return jskitManager()->currentApp();
 }
 
 void Pebble::removeApp(const QUuid &uuid)
 {
     qDebug() << "Should remove app:" << uuid;
-    m_appManager->wipeApp(uuid,true);
+    appManager()->wipeApp(uuid,true);
     m_timelineSync->syncLocker(true);
 }
 
@@ -1217,7 +1391,7 @@ void Pebble::launchApp(const QUuid &uuid)
 }
 
 void Pebble::requestConfigurationURL(const QUuid &uuid) {
-    if (m_jskitManager->currentApp().uuid() == uuid) {
+    if (jskitManager()->currentApp().uuid() == uuid) {
         m_jskitManager->showConfiguration();
     }
     else {
@@ -1228,24 +1402,24 @@ void Pebble::requestConfigurationURL(const QUuid &uuid) {
 
 void Pebble::configurationClosed(const QUuid &uuid, const QString &result)
 {
-    if (m_jskitManager->currentApp().uuid() == uuid) {
+    if (jskitManager()->currentApp().uuid() == uuid) {
         m_jskitManager->handleWebviewClosed(result);
     }
 }
 
 void Pebble::requestScreenshot()
 {
-    m_screenshotEndpoint->requestScreenshot();
+    screenshotEndpoint()->requestScreenshot();
 }
 
 QStringList Pebble::screenshots() const
 {
-    return m_screenshotEndpoint->screenshots();
+    return ScreenshotEndpoint::screenshots(this);
 }
 
 void Pebble::removeScreenshot(const QString &filename)
 {
-    m_screenshotEndpoint->removeScreenshot(filename);
+    screenshotEndpoint()->removeScreenshot(filename);
 }
 
 bool Pebble::firmwareUpdateAvailable() const
@@ -1312,6 +1486,12 @@ void Pebble::loadLanguagePack(const QString &pblFile) const
 void Pebble::onPebbleConnected()
 {
     qDebug() << "Pebble connected:" << m_name;
+    // The watch may beat the event loop, endpoints it talks to have to be there now
+    initDeferred();
+    if (m_firstConnection) {
+        m_firstConnection = false;
+        traceStartup("connected");
+    }
     QByteArray data;
     WatchDataWriter w(&data);
     w.write<quint8>(0); // Command fetch
@@ -1334,7 +1514,9 @@ void Pebble::profileSwitchRequired()
     QString *targetProfile = m_connection->isConnected()?&m_profileWhenConnected:&m_profileWhenDisconnected;
     if (targetProfile->isEmpty()) return;
     qDebug() << "Request Profile Switch: connected=" << m_connection->isConnected() << " profile=" << targetProfile;
-     Core::instance()->platform()->setProfile(*targetProfile);
+    PlatformInterface *platform = Core::instance()->platform();
+    QString profile = *targetProfile;
+    invokeOn(platform, [platform,profile]() { platform->setProfile(profile); });
 }
 
 void Pebble::pebbleVersionReceived(const QByteArray &data)
@@ -1386,10 +1568,10 @@ void Pebble::pebbleVersionReceived(const QByteArray &data)
 //    m_isUnfaithful = true;
 
     if (!m_recovery) {
-        m_appManager->rescan();
+        // Installs and removals keep the list current, it is only read from disk once
+        appManager();
 
-        QSettings version(m_storagePath + "/watchinfo.conf", QSettings::IniFormat);
-        if (version.value("syncedWithVersion").toString() != QStringLiteral(VERSION)) {
+        if (m_watchInfo->value("syncedWithVersion").toString() != QStringLiteral(VERSION)) {
             m_isUnfaithful = true;
         }
 
@@ -1403,7 +1585,7 @@ void Pebble::pebbleVersionReceived(const QByteArray &data)
             m_blobDB->setUnits(m_imperialUnits);
             m_timelineSync->syncLocker();
         }
-        version.setValue("syncedWithVersion", QStringLiteral(VERSION));
+        m_watchInfo->setValue("syncedWithVersion", QStringLiteral(VERSION));
 
         syncTime();
     }
@@ -1426,8 +1608,7 @@ void Pebble::factorySettingsReceived(const QByteArray &data)
         return;
     }
     m_model = (Model)reader.read<quint32>();
-    QSettings s(m_storagePath + "/watchinfo.conf", QSettings::IniFormat);
-    s.setValue("watchModel", m_model);
+    m_watchInfo->setValue("watchModel", m_model);
 }
 
 void Pebble::phoneVersionAsked(const QByteArray &data)
@@ -1464,17 +1645,17 @@ void Pebble::phoneVersionAsked(const QByteArray &data)
 
 void Pebble::appDownloadFinished(const QString &id)
 {
-    QUuid uuid = m_appManager->scanApp(m_storagePath + "/apps/" + id);
+    QUuid uuid = appManager()->scanApp(m_storagePath + "/apps/" + id);
     if (uuid.isNull()) {
         qWarning() << "Error scanning downloaded app. Won't install on watch";
         return;
     }
     // Stop running pebble app to avoid race-condition with JSkit stop
-    if (m_jskitManager->currentApp().uuid() == uuid) {
+    if (jskitManager()->currentApp().uuid() == uuid) {
         m_appMsgManager->closeApp(uuid);
     }
     // Force app replacement to allow update from store/sdk
-    m_appManager->insertAppMetaData(uuid,true);
+    appManager()->insertAppMetaData(uuid,true);
     // The app will be re-launched here anyway
     m_pendingInstallations.append(uuid);
 }
@@ -1487,10 +1668,9 @@ void Pebble::appInstalled(const QUuid &uuid) {
     if (uuid == m_lastSyncedAppUuid) {
         m_lastSyncedAppUuid = QUuid();
 
-        m_appManager->setAppOrder(m_appManager->appUuids());
-        QSettings settings(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-        if (settings.contains("watchface")) {
-            m_appMsgManager->launchApp(settings.value("watchface").toUuid());
+        appManager()->setAppOrder(appManager()->appUuids());
+        if (m_appSettings->contains("watchface")) {
+            m_appMsgManager->launchApp(m_appSettings->value("watchface").toUuid());
         }
     }
     m_timelineSync->syncLocker();
@@ -1498,11 +1678,10 @@ void Pebble::appInstalled(const QUuid &uuid) {
 
 void Pebble::appStarted(const QUuid &uuid)
 {
-    AppInfo info = m_appManager->info(uuid);
+    AppInfo info = appManager()->info(uuid);
     if (info.isWatchface()) {
-        QSettings settings(m_storagePath + "/appsettings.conf", QSettings::IniFormat);
-        settings.setValue("watchface", uuid.toString());
-    } else if(uuid == WeatherApp::appUUID && m_weatherProv != nullptr) {
+        m_appSettings->setValue("watchface", uuid.toString());
+    } else if(uuid == WeatherApp::appUUID && weatherProvider() != nullptr) {
         m_weatherProv->refreshWeather();
     }
 }
@@ -1535,10 +1714,10 @@ void Pebble::resetPebble()
 
 void Pebble::syncApps()
 {
-    foreach (const QUuid &appUuid, m_appManager->appUuids()) {
-        if (!m_appManager->info(appUuid).isSystemApp()) {
-            qDebug() << "Inserting app" << m_appManager->info(appUuid).shortName() << "into BlobDB";
-            m_appManager->insertAppMetaData(appUuid);
+    foreach (const QUuid &appUuid, appManager()->appUuids()) {
+        if (!appManager()->info(appUuid).isSystemApp()) {
+            qDebug() << "Inserting app" << appManager()->info(appUuid).shortName() << "into BlobDB";
+            appManager()->insertAppMetaData(appUuid);
             m_lastSyncedAppUuid = appUuid;
         }
     }
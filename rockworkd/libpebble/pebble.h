@@ -4,6 +4,7 @@
 #include "musicmetadata.h"
 #include "appinfo.h"
 #include "healthparams.h"
+#include "appmanager.h"
 
 #include <QObject>
 #include <QBluetoothAddress>
@@ -14,7 +15,6 @@ class WatchConnection;
 class MusicEndpoint;
 class PhoneCallEndpoint;
 class AppGlances;
-class AppManager;
 class AppMsgManager;
 class BankManager;
 class JSKitManager;
@@ -26,16 +26,22 @@ class WatchLogEndpoint;
 class DataLoggingEndpoint;
 class DevConnection;
 class TimelineManager;
+struct NotificationPin;
 class TimelineSync;
 class SendTextApp;
 class WeatherApp;
 class WeatherProvider;
 class VoiceEndpoint;
+class VoiceStream;
+class Metrics;
+class TraceRecorder;
+class SettingsStore;
+class TimerWheel;
+class PositionService;
 struct SpeexInfo;
 struct AudioStream;
 
 class QNetworkAccessManager;
-class QSettings;
 
 class Pebble : public QObject
 {
@@ -52,6 +58,7 @@ class Pebble : public QObject
 
 public:
     explicit Pebble(const QBluetoothAddress &address, QObject *parent = 0);
+    ~Pebble();
 
     QBluetoothAddress address() const;
 
@@ -66,6 +73,11 @@ public:
     TimelineSync *tlSync() const;
     TimelineManager *timeline() const;
     AppGlances *appGlances() const;
+    Metrics *metrics() const;
+    TraceRecorder *traceRecorder() const;
+    // Shared by everything running on this watch's thread
+    TimerWheel *timers() const;
+    PositionService *positions() const;
 
     QDateTime softwareBuildTime() const;
     QString softwareVersion() const;
@@ -91,6 +103,11 @@ public:
         NotificationEnabled = 2
     };
     DevConnection * devConnection();
+    bool devConEnabled() const;
+    quint16 devConListenPort() const;
+    bool devConCloudEnabled() const;
+    bool devConServerState() const;
+    bool devConCloudState() const;
 
     bool syncAppsFromCloud() const;
     const QString oauthToken() const;
@@ -128,6 +145,7 @@ public slots:
     void forgetNotificationFilter(const QString &sourceId);
     QString findNotificationData(const QString &sourceId, const QString &key);
     void insertPin(const QJsonObject &json);
+    void insertNotification(const NotificationPin &notification);
     void removePin(const QString &guid);
 
     void setDevConListenPort(quint16 port);
@@ -145,6 +163,8 @@ public slots:
     void installApp(const QString &id);
     void sideloadApp(const QString &packageFile);
     QList<QUuid> installedAppIds();
+    quint32 appCatalogVersion() const;
+    AppManager::CatalogDelta appCatalog(quint32 sinceVersion) const;
     void setAppOrder(const QList<QUuid> &newList);
     AppInfo appInfo(const QUuid &uuid);
     void removeApp(const QUuid &uuid);
@@ -199,7 +219,8 @@ private slots:
     void voiceAudioStream(quint16 sid, const AudioStream &frames);
     void voiceSessionClose(quint16 sesId);
     void saveWeatherLocations() const;
-    void initWeatherProvider(const QSettings &settings);
+    void initWeatherProvider();
+    void initDeferred();
 
     void resetPebble();
     void syncApps();
@@ -214,7 +235,7 @@ signals:
     void pebbleDisconnected();
     void notificationFilterChanged(const QString &sourceId, const QString &name, const QString &icon, const NotificationFilter enabled);
     void musicControlPressed(MusicControlButton control);
-    void installedAppsChanged();
+    void installedAppsChanged(quint32 catalogVersion);
     void openURL(const QString &uuid, const QString &url);
     void screenshotAdded(const QString &filename);
     void screenshotRemoved(const QString &filename);
@@ -227,6 +248,7 @@ signals:
     void weatherLocationsChanged(const QVariantList &locations) const;
     void voiceSessionSetup(const QString &fileName, const QString &format, const QString &appUuid);
     void voiceSessionStream(const QString &fileName);
+    void voiceSessionPcm(const QString &fileName, const QString &socketPath, const QString &contentType);
     void voiceSessionDumped(const QString &fileName);
     void voiceSessionClosed(const QString &fileName);
 
@@ -241,6 +263,19 @@ signals:
     void appButtonPressed(const QString &uuid, const int &key);
 private:
     void setHardwareRevision(HardwareRevision hardwareRevision);
+    void traceStartup(const QString &stage);
+    bool acceptNotification(const QString &sourceId, const QString &name, const QString &icon);
+    bool weatherConfigured() const;
+
+    // Built on first use, the watch-facing ones by initDeferred() on connect
+    AppManager *appManager() const;
+    JSKitManager *jskitManager() const;
+    AppDownloader *appDownloader() const;
+    ScreenshotEndpoint *screenshotEndpoint() const;
+    WatchLogEndpoint *logEndpoint() const;
+    SendTextApp *sendTextApp() const;
+    WeatherApp *weatherApp() const;
+    WeatherProvider *weatherProvider() const;
 
     QBluetoothAddress m_address;
     QString m_name;
@@ -258,24 +293,27 @@ private:
     bool m_recovery = false;
 
     WatchConnection *m_connection;
+    Metrics *m_metrics;
+    TraceRecorder *m_traceRecorder;
     MusicEndpoint *m_musicEndpoint;
     PhoneCallEndpoint *m_phoneCallEndpoint;
     AppGlances *m_appGlances;
     AppManager *m_appManager;
     AppMsgManager *m_appMsgManager;
-    JSKitManager *m_jskitManager;
+    mutable JSKitManager *m_jskitManager = nullptr;
     BankManager *m_bankManager;
     BlobDB *m_blobDB;
-    AppDownloader *m_appDownloader;
-    ScreenshotEndpoint *m_screenshotEndpoint;
+    mutable AppDownloader *m_appDownloader = nullptr;
+    mutable ScreenshotEndpoint *m_screenshotEndpoint = nullptr;
     FirmwareDownloader *m_firmwareDownloader;
-    WatchLogEndpoint *m_logEndpoint;
-    DataLoggingEndpoint *m_dataLogEndpoint;
-    SendTextApp * m_sendTextApp;
-    WeatherApp * m_weatherApp;
-    WeatherProvider * m_weatherProv;
-    VoiceEndpoint * m_voiceEndpoint;
+    mutable WatchLogEndpoint *m_logEndpoint = nullptr;
+    DataLoggingEndpoint *m_dataLogEndpoint = nullptr;
+    mutable SendTextApp * m_sendTextApp = nullptr;
+    mutable WeatherApp * m_weatherApp = nullptr;
+    mutable WeatherProvider * m_weatherProv = nullptr;
+    VoiceEndpoint * m_voiceEndpoint = nullptr;
     QTemporaryFile* m_voiceSessDump = nullptr;
+    VoiceStream* m_voiceStream = nullptr;
 
     QString m_storagePath;
     QString m_imagePath;
@@ -287,12 +325,26 @@ private:
     QString m_profileWhenDisconnected = "ignore";
     HealthParams m_healthParams;
     bool m_imperialUnits = false;
-    DevConnection *m_devConnection;
+    DevConnection *m_devConnection = nullptr;
+    SettingsStore *m_watchInfo;
+    SettingsStore *m_appSettings;
+    SettingsStore *m_notificationSettings;
+    SettingsStore *m_cannedSettings;
+    bool m_deferredReady = false;
+    mutable bool m_appsScanned = false;
+    bool m_firstConnection = true;
+    bool m_firstNotification = true;
+    // Mirrors the platform's state, which lives on the main thread
+    bool m_deviceActive = false;
     TimelineManager *m_timelineManager;
     TimelineSync *m_timelineSync;
     QNetworkAccessManager *m_nam;
+    TimerWheel *m_timers;
+    PositionService *m_positions;
 };
 
+Q_DECLARE_METATYPE(Pebble::NotificationFilter)
+
 /*
   Capabilities received from phone:
   In order, starting at zero, in little-endian (unlike the rest of the messsage), the bits sent by the watch indicate support for:
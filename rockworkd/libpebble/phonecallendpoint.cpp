@@ -4,6 +4,11 @@
 #include "watchconnection.h"
 #include "watchdatareader.h"
 #include "watchdatawriter.h"
+#include "metrics.h"
+#include "timerwheel.h"
+
+// Bulk transfers resume after this even if the end of the call never got signalled
+static const int RING_TIMEOUT = 120000;
 
 PhoneCallEndpoint::PhoneCallEndpoint(Pebble *pebble, WatchConnection *connection):
     QObject(pebble),
@@ -11,9 +16,19 @@ PhoneCallEndpoint::PhoneCallEndpoint(Pebble *pebble, WatchConnection *connection
     m_connection(connection)
 {
     m_connection->registerEndpointHandler(WatchConnection::EndpointPhoneControl, this, "handlePhoneEvent");
+
+    connect(m_connection, &WatchConnection::frameWritten, this, [this](WatchConnection::Endpoint endpoint, qint64 usecs) {
+        Q_UNUSED(usecs)
+        if (endpoint == WatchConnection::EndpointPhoneControl && !m_signalled.isEmpty()) {
+            m_pebble->metrics()->recordSince("phonecall.latency", m_signalled.dequeue());
+        }
+    });
+    connect(m_connection, &WatchConnection::watchDisconnected, this, [this]() {
+        m_signalled.clear();
+    });
 }
 
-void PhoneCallEndpoint::incomingCall(uint cookie, const QString &number, const QString &name)
+void PhoneCallEndpoint::incomingCall(uint cookie, const QString &number, const QString &name, qint64 signalled)
 {
     QStringList tmp;
     tmp.append(number);
@@ -25,24 +40,26 @@ void PhoneCallEndpoint::incomingCall(uint cookie, const QString &number, const Q
 //        act = CallActionOutgoing;
 //    }
 
-    phoneControl(act, cookie, tmp);
-
+    setRinging(cookie, true);
+    phoneControl(act, cookie, tmp, signalled);
 }
 
-void PhoneCallEndpoint::callStarted(uint cookie)
+void PhoneCallEndpoint::callStarted(uint cookie, qint64 signalled)
 {
-    phoneControl(CallActionStart, cookie, QStringList());
+    phoneControl(CallActionStart, cookie, QStringList(), signalled);
+    setRinging(cookie, false);
 }
 
-void PhoneCallEndpoint::callEnded(uint cookie, bool missed)
+void PhoneCallEndpoint::callEnded(uint cookie, bool missed, qint64 signalled)
 {
     Q_UNUSED(missed)
     // FIXME: The watch doesn't seem to react on Missed... So let's always "End" it for now
 //    phoneControl(missed ? CallActionMissed : CallActionEnd, cookie, QStringList());
-    phoneControl(CallActionEnd, cookie, QStringList());
+    phoneControl(CallActionEnd, cookie, QStringList(), signalled);
+    setRinging(cookie, false);
 }
 
-void PhoneCallEndpoint::phoneControl(char act, uint cookie, QStringList datas)
+void PhoneCallEndpoint::phoneControl(char act, uint cookie, QStringList datas, qint64 signalled)
 {
     QByteArray head;
     WatchDataWriter w(&head);
@@ -64,9 +81,37 @@ void PhoneCallEndpoint::phoneControl(char act, uint cookie, QStringList datas)
         break;
     }
     qDebug() << "PhoneEndpoint>" << head.toHex();
+    if (m_connection->isConnected()) {
+        m_signalled.enqueue(signalled ? signalled : Metrics::now());
+    }
     m_connection->writeToPebble(WatchConnection::EndpointPhoneControl, head);
 }
 
+void PhoneCallEndpoint::setRinging(uint cookie, bool ringing)
+{
+    if (ringing) {
+        m_ringing.insert(cookie);
+    } else {
+        m_ringing.remove(cookie);
+    }
+
+    // Keep uploads and syncs from competing with the ringing screen and the user's answer
+    m_pebble->timers()->stop(m_ringTimer, this);
+    m_ringTimer = 0;
+    if (!m_ringing.isEmpty()) {
+        if (!m_connection->bulkPaused()) {
+            m_pebble->metrics()->count("phonecall.bulk.paused");
+        }
+        m_ringTimer = m_pebble->timers()->start(RING_TIMEOUT, this, [this]() {
+            qWarning() << "Still ringing after" << RING_TIMEOUT << "ms, resuming bulk transfers";
+            m_ringTimer = 0;
+            m_ringing.clear();
+            m_connection->setBulkPaused(false);
+        });
+    }
+    m_connection->setBulkPaused(!m_ringing.isEmpty());
+}
+
 void PhoneCallEndpoint::handlePhoneEvent(const QByteArray &data)
 {
 
@@ -2,6 +2,8 @@
 #define PHONECALLENDPOINT_H
 
 #include <QObject>
+#include <QQueue>
+#include <QSet>
 
 class Pebble;
 class WatchConnection;
@@ -30,9 +32,10 @@ public:
     explicit PhoneCallEndpoint(Pebble *pebble, WatchConnection *connection);
 
 public slots:
-    void incomingCall(uint cookie, const QString &number, const QString &name);
-    void callStarted(uint cookie);
-    void callEnded(uint cookie, bool missed);
+    // signalled is the Metrics::now() of the platform's signal, 0 for now
+    void incomingCall(uint cookie, const QString &number, const QString &name, qint64 signalled = 0);
+    void callStarted(uint cookie, qint64 signalled = 0);
+    void callEnded(uint cookie, bool missed, qint64 signalled = 0);
 
 signals:
     void answerCall(uint cookie);
@@ -40,7 +43,8 @@ signals:
     void callState(quint32 cooke, const QList<CallState> &state);
 
 private:
-    void phoneControl(char act, uint cookie, QStringList datas);
+    void phoneControl(char act, uint cookie, QStringList datas, qint64 signalled);
+    void setRinging(uint cookie, bool ringing);
 
 private slots:
     void handlePhoneEvent(const QByteArray &data);
@@ -48,6 +52,10 @@ private slots:
 private:
     Pebble *m_pebble;
     WatchConnection *m_connection;
+
+    QSet<uint> m_ringing;
+    int m_ringTimer = 0;
+    QQueue<qint64> m_signalled; // Of the call control frames on their way to the socket
 };
 
 #endif // PHONECALLENDPOINT_H
@@ -3,6 +3,7 @@
 
 #include "libpebble/pebble.h"
 #include "libpebble/musicmetadata.h"
+#include "libpebble/timelinemanager.h"
 
 #include <QObject>
 #include <QJsonObject>
@@ -36,11 +37,13 @@ signals:
 public:
     virtual void actionTriggered(const QUuid &uuid, const QString &actToken, const QJsonObject &param) const = 0;
     virtual void removeNotification(const QUuid &uuid) const = 0;
-    virtual const QHash<QString,QStringList>& cannedResponses() const = 0;
+    // Called from the watch threads, implementations must be thread safe
+    virtual QHash<QString,QStringList> cannedResponses() const = 0;
     virtual void setCannedResponses(const QHash<QString,QStringList> &cans) = 0;
     virtual void sendTextMessage(const QString &account, const QString &contact, const QString &text) const = 0;
 signals:
     void newTimelinePin(const QJsonObject &pin);
+    void newNotification(const NotificationPin &notification);
 
 // Music
 public:
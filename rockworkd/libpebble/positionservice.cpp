@@ -0,0 +1,279 @@
+#include "positionservice.h"
+#include "pebble.h"
+#include "metrics.h"
+#include "timerwheel.h"
+
+#include <QGeoPositionInfoSource>
+#include <QMutex>
+#include <QDebug>
+
+#include <limits>
+
+// Cached fixes better than this are good enough for enableHighAccuracy requests
+static const qreal HIGH_ACCURACY_METERS = 50;
+
+static QMutex *fixLock()
+{
+    static QMutex lock;
+    return &lock;
+}
+
+static QGeoPositionInfo *fix()
+{
+    static QGeoPositionInfo pos;
+    return &pos;
+}
+
+PositionService::PositionService(Pebble *pebble):
+    QObject(pebble),
+    m_pebble(pebble),
+    m_timers(pebble->timers())
+{
+}
+
+QGeoPositionInfo PositionService::lastFix()
+{
+    QMutexLocker locker(fixLock());
+    return *fix();
+}
+
+QGeoPositionInfo PositionService::cachedFix(qint64 maximumAge, bool highAccuracy)
+{
+    if (maximumAge <= 0) {
+        return QGeoPositionInfo();
+    }
+    QDateTime threshold = QDateTime::currentDateTimeUtc().addMSecs(-maximumAge);
+
+    QGeoPositionInfo pos = lastFix();
+    if (highAccuracy && !(pos.hasAttribute(QGeoPositionInfo::HorizontalAccuracy)
+                          && pos.attribute(QGeoPositionInfo::HorizontalAccuracy) <= HIGH_ACCURACY_METERS)) {
+        pos = QGeoPositionInfo();
+    }
+    // Other applications may have had a fix since
+    if (source()) {
+        QGeoPositionInfo known = m_source->lastKnownPosition(highAccuracy);
+        if (known.isValid() && (!pos.isValid() || known.timestamp() > pos.timestamp())) {
+            pos = known;
+        }
+    }
+
+    if (pos.isValid() && pos.timestamp() >= threshold) {
+        return pos;
+    }
+    return QGeoPositionInfo();
+}
+
+int PositionService::requestPosition(qint64 maximumAge, int timeout, bool highAccuracy, QObject *context, const Callback &callback)
+{
+    QGeoPositionInfo pos = cachedFix(maximumAge, highAccuracy);
+    if (pos.isValid()) {
+        qDebug() << "Answering position request from the fix of" << pos.timestamp();
+        m_pebble->metrics()->count("position.fix.cached");
+        callback(pos, NoError);
+        return 0;
+    }
+    if (timeout == 0) {
+        // Not worth turning on the GPS for
+        callback(QGeoPositionInfo(), Timeout);
+        return 0;
+    }
+    if (!source()) {
+        callback(QGeoPositionInfo(), Unavailable);
+        return 0;
+    }
+
+    int id = ++m_lastId;
+    Request &request = m_requests[id];
+    request.callback = callback;
+    request.context = context;
+    if (timeout > 0) {
+        request.deadline = Metrics::now() + timeout * 1000LL;
+        request.timer = m_timers->start(timeout, this, [this, id]() {
+            finish(id, QGeoPositionInfo(), Timeout);
+        });
+    }
+
+    if (m_updatePending) {
+        qDebug() << "Joining pending position request," << m_requests.count() << "waiting";
+        m_pebble->metrics()->count("position.fix.joined");
+    } else {
+        requestUpdate();
+    }
+    return id;
+}
+
+int PositionService::watchPosition(int interval, QObject *context, const Callback &callback)
+{
+    if (!source()) {
+        callback(QGeoPositionInfo(), Unavailable);
+        return 0;
+    }
+
+    int id = ++m_lastId;
+    Request &request = m_requests[id];
+    request.callback = callback;
+    request.context = context;
+    request.once = false;
+    request.interval = qMax(interval, 0);
+    updateWatches();
+    return id;
+}
+
+void PositionService::cancel(int id)
+{
+    if (!m_requests.contains(id)) {
+        return;
+    }
+    Request request = m_requests.take(id);
+    if (request.timer && m_timers) {
+        m_timers->stop(request.timer, this);
+    }
+    if (!request.once) {
+        updateWatches();
+    }
+}
+
+void PositionService::cancelAll(const QObject *context)
+{
+    foreach (int id, m_requests.keys()) {
+        if (m_requests.value(id).context == context) {
+            cancel(id);
+        }
+    }
+}
+
+void PositionService::positionUpdated(const QGeoPositionInfo &pos)
+{
+    qDebug() << "Got position fix of" << pos.timestamp() << "for" << m_requests.count() << "requests";
+    {
+        QMutexLocker locker(fixLock());
+        *fix() = pos;
+    }
+    m_updatePending = false;
+
+    foreach (int id, m_requests.keys()) {
+        finish(id, pos, NoError);
+    }
+}
+
+void PositionService::positionError(int error)
+{
+    qWarning() << "Positioning error:" << error;
+    if (error == QGeoPositionInfoSource::NoError) {
+        return;
+    }
+    m_updatePending = false;
+
+    foreach (int id, m_requests.keys()) {
+        finish(id, QGeoPositionInfo(), error == QGeoPositionInfoSource::AccessError ? AccessError : Unavailable);
+    }
+}
+
+void PositionService::updateTimeout()
+{
+    qDebug() << "Positioning timeout";
+    m_updatePending = false;
+
+    bool waiting = false;
+    foreach (int id, m_requests.keys()) {
+        if (!m_requests.contains(id)) {
+            continue;
+        }
+        const Request &request = m_requests[id];
+        if (request.once && request.deadline) {
+            // Has a timeout of its own, keep trying till then
+            waiting = true;
+        } else {
+            finish(id, QGeoPositionInfo(), Timeout);
+        }
+    }
+    if (waiting) {
+        requestUpdate();
+    }
+}
+
+QGeoPositionInfoSource * PositionService::source()
+{
+    if (!m_source) {
+        m_source = QGeoPositionInfoSource::createDefaultSource(this);
+        if (!m_source) {
+            qWarning() << "No position source available";
+            return nullptr;
+        }
+        connect(m_source, static_cast<void (QGeoPositionInfoSource::*)(QGeoPositionInfoSource::Error)>(&QGeoPositionInfoSource::error),
+                this, &PositionService::positionError);
+        connect(m_source, &QGeoPositionInfoSource::positionUpdated, this, &PositionService::positionUpdated);
+        connect(m_source, &QGeoPositionInfoSource::updateTimeout, this, &PositionService::updateTimeout);
+    }
+    return m_source;
+}
+
+void PositionService::requestUpdate()
+{
+    // Wait for the most patient request, or as long as the provider likes if one has no timeout
+    qint64 now = Metrics::now();
+    qint64 timeout = 1;
+    foreach (const Request &request, m_requests) {
+        if (!request.once) {
+            continue;
+        }
+        if (!request.deadline) {
+            timeout = 0;
+            break;
+        }
+        timeout = qMax(timeout, (request.deadline - now) / 1000);
+    }
+
+    qDebug() << "Requesting position fix with timeout" << timeout;
+    m_pebble->metrics()->count("position.fix.requested");
+    m_updatePending = true;
+    m_source->requestUpdate(int(qMin<qint64>(timeout, std::numeric_limits<int>::max())));
+}
+
+void PositionService::updateWatches()
+{
+    int interval = -1;
+    foreach (int id, m_requests.keys()) {
+        const Request &request = m_requests[id];
+        if (request.once) {
+            continue;
+        }
+        if (!request.context) {
+            m_requests.remove(id);
+            continue;
+        }
+        interval = interval < 0 ? request.interval : qMin(interval, request.interval);
+    }
+    if (interval == m_interval) {
+        return;
+    }
+
+    m_interval = interval;
+    if (interval < 0) {
+        qDebug() << "Stopping position updates";
+        m_source->stopUpdates();
+    } else {
+        qDebug() << "Starting position updates every" << interval << "ms";
+        m_source->setUpdateInterval(interval);
+        m_source->startUpdates();
+    }
+}
+
+void PositionService::finish(int id, const QGeoPositionInfo &pos, Error error)
+{
+    if (!m_requests.contains(id)) {
+        return;
+    }
+    Request request = m_requests.value(id);
+    if (request.once || !request.context) {
+        m_requests.remove(id);
+        if (request.timer && m_timers) {
+            m_timers->stop(request.timer, this);
+        }
+    }
+    if (request.context) {
+        request.callback(pos, error);
+    } else if (!request.once) {
+        updateWatches();
+    }
+}
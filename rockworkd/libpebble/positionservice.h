@@ -0,0 +1,81 @@
+#ifndef POSITIONSERVICE_H
+#define POSITIONSERVICE_H
+
+#include <QObject>
+#include <QHash>
+#include <QPointer>
+#include <QGeoPositionInfo>
+
+#include <functional>
+
+class Pebble;
+class TimerWheel;
+class QGeoPositionInfoSource;
+
+/**
+ * @brief The PositionService class is the one position source of a watch thread. The last
+ * fix is cached for the whole daemon and hands out requests which accept its age and
+ * accuracy; the others are folded into a single pending provider request and answered
+ * together when the fix comes in. Continuous watches share the provider's update stream
+ * at the shortest interval any of them asked for.
+ */
+class PositionService : public QObject
+{
+    Q_OBJECT
+public:
+    enum Error {
+        NoError,
+        AccessError,
+        Unavailable,
+        Timeout
+    };
+
+    // Gets the fix when the error is NoError
+    typedef std::function<void(const QGeoPositionInfo &, Error)> Callback;
+
+    explicit PositionService(Pebble *pebble);
+
+    // Latest fix of any watch thread, may be invalid
+    static QGeoPositionInfo lastFix();
+    // Freshest known fix at most maximumAge ms old, or an invalid one
+    QGeoPositionInfo cachedFix(qint64 maximumAge, bool highAccuracy);
+
+    // Answers once, from the cache if possible. A timeout of 0 only looks at the cache, a
+    // negative one waits for as long as the provider does. Returns an id for cancel().
+    int requestPosition(qint64 maximumAge, int timeout, bool highAccuracy, QObject *context, const Callback &callback);
+    // Answers every fix and error until cancelled, 0 leaves the interval to the provider
+    int watchPosition(int interval, QObject *context, const Callback &callback);
+    void cancel(int id);
+    void cancelAll(const QObject *context);
+
+private slots:
+    void positionUpdated(const QGeoPositionInfo &pos);
+    void positionError(int error);
+    void updateTimeout();
+
+private:
+    struct Request {
+        Callback callback;
+        QPointer<QObject> context;
+        bool once = true;
+        int interval = 0;
+        qint64 deadline = 0; // Metrics::now() based, 0 for none
+        int timer = 0;
+    };
+
+    QGeoPositionInfoSource *source();
+    void requestUpdate();
+    void updateWatches();
+    void finish(int id, const QGeoPositionInfo &pos, Error error);
+
+    Pebble *m_pebble;
+    // Created before us and so deleted first when the watch goes away
+    QPointer<TimerWheel> m_timers;
+    QGeoPositionInfoSource *m_source = nullptr;
+    QHash<int, Request> m_requests;
+    int m_lastId = 0;
+    int m_interval = -1; // Of the running update stream, -1 when stopped
+    bool m_updatePending = false;
+};
+
+#endif // POSITIONSERVICE_H
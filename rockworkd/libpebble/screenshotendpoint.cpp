@@ -30,12 +30,12 @@ void ScreenshotEndpoint::removeScreenshot(const QString &filename)
     }
 }
 
-QStringList ScreenshotEndpoint::screenshots() const
+QStringList ScreenshotEndpoint::screenshots(const Pebble *pebble)
 {
-    QDir dir(m_pebble->imagePath());
+    QDir dir(pebble->imagePath());
 
     // move old screenshots to the new location
-    QDir oldDir(m_pebble->storagePath() + "/screenshots/");
+    QDir oldDir(pebble->storagePath() + "/screenshots/");
     if (oldDir.exists()) {
         qDebug() << "Migrating screenshots to new location";
         foreach (const QString &filename, oldDir.entryList(QDir::Files)) {
@@ -52,7 +52,7 @@ QStringList ScreenshotEndpoint::screenshots() const
 
     QStringList ret;
     foreach (const QString &filename, dir.entryList(QDir::Files)) {
-        ret << m_pebble->imagePath() + filename;
+        ret << pebble->imagePath() + filename;
     }
     return ret;
 }
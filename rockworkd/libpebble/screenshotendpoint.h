@@ -30,7 +30,8 @@ public:
     void requestScreenshot();
     void removeScreenshot(const QString &filename);
 
-    QStringList screenshots() const;
+    // Lists the image directory, no endpoint needed
+    static QStringList screenshots(const Pebble *pebble);
 
 signals:
     void screenshotAdded(const QString &filename);
@@ -0,0 +1,185 @@
+#include "settingsstore.h"
+#include "threadcall.h"
+
+#include <QCoreApplication>
+#include <QRegularExpression>
+#include <QSettings>
+#include <QDebug>
+
+// Settings tend to change in bursts (a settings page, a filter toggled per app)
+static const int SYNC_DELAY = 2000;
+// Failed writes are retried, doubling the delay up to SYNC_DELAY << MAX_SYNC_BACKOFF
+static const int MAX_SYNC_BACKOFF = 5;
+
+SettingsStore::SettingsStore(const QString &fileName, QObject *parent):
+    QObject(parent),
+    m_fileName(fileName),
+    m_syncTimer(this)
+{
+    QSettings settings(m_fileName, QSettings::IniFormat);
+    foreach (const QString &key, settings.allKeys()) {
+        m_values.insert(key, settings.value(key));
+    }
+
+    m_syncTimer.setSingleShot(true);
+    m_syncTimer.setInterval(SYNC_DELAY);
+    connect(&m_syncTimer, &QTimer::timeout, this, &SettingsStore::sync);
+
+    // The store may live on a watch thread which has no chance to run its timers
+    // once the main loop is gone, so flush synchronously on the way out.
+    m_quitConnection = connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, [this]() {
+        callOn(this, [this]() { sync(); });
+    });
+}
+
+SettingsStore::~SettingsStore()
+{
+    disconnect(m_quitConnection);
+    sync();
+}
+
+QString SettingsStore::fileName() const
+{
+    return m_fileName;
+}
+
+bool SettingsStore::contains(const QString &key) const
+{
+    return m_values.contains(key);
+}
+
+QVariant SettingsStore::value(const QString &key, const QVariant &defaultValue) const
+{
+    return m_values.value(key, defaultValue);
+}
+
+void SettingsStore::setValue(const QString &key, const QVariant &value)
+{
+    QMap<QString,QVariant>::iterator it = m_values.find(key);
+    if (it != m_values.end() && it.value() == value) {
+        return;
+    }
+    m_values.insert(key, value);
+    scheduleSync();
+    emit valueChanged(key, value);
+}
+
+void SettingsStore::remove(const QString &key)
+{
+    QString pfx = prefix(key);
+    bool removed = false;
+    QMap<QString,QVariant>::iterator it = m_values.begin();
+    while (it != m_values.end()) {
+        if (key.isEmpty() || it.key() == key || it.key().startsWith(pfx)) {
+            it = m_values.erase(it);
+            removed = true;
+        } else {
+            ++it;
+        }
+    }
+    if (removed) {
+        scheduleSync();
+        emit valueChanged(key, QVariant());
+    }
+}
+
+QStringList SettingsStore::childGroups(const QString &group) const
+{
+    QString pfx = prefix(group);
+    QStringList ret;
+    QMap<QString,QVariant>::const_iterator it = m_values.lowerBound(pfx);
+    for (; it != m_values.end() && it.key().startsWith(pfx); ++it) {
+        int slash = it.key().indexOf('/', pfx.length());
+        if (slash < 0) {
+            continue;
+        }
+        QString child = it.key().mid(pfx.length(), slash - pfx.length());
+        if (ret.isEmpty() || ret.last() != child) {
+            ret.append(child);
+        }
+    }
+    return ret;
+}
+
+QVariantMap SettingsStore::group(const QString &group) const
+{
+    QString pfx = prefix(group);
+    QVariantMap ret;
+    QMap<QString,QVariant>::const_iterator it = m_values.lowerBound(pfx);
+    for (; it != m_values.end() && it.key().startsWith(pfx); ++it) {
+        QString key = it.key().mid(pfx.length());
+        if (!key.contains('/')) {
+            ret.insert(key, it.value());
+        }
+    }
+    return ret;
+}
+
+QList<QVariantMap> SettingsStore::readArray(const QString &name) const
+{
+    QList<QVariantMap> ret;
+    int size = value(prefix(name) + "size").toInt();
+    for (int i = 1; i <= size; i++) {
+        ret.append(group(prefix(name) + QString::number(i)));
+    }
+    return ret;
+}
+
+void SettingsStore::writeArray(const QString &name, const QList<QVariantMap> &items)
+{
+    // Leave plain keys of a group sharing the array's name alone, like QSettings does
+    QRegularExpression entry("^" + QRegularExpression::escape(prefix(name)) + "(size$|\\d+/)");
+    QMap<QString,QVariant>::iterator it = m_values.begin();
+    while (it != m_values.end()) {
+        if (entry.match(it.key()).hasMatch()) {
+            it = m_values.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_values.insert(prefix(name) + "size", items.count());
+    for (int i = 0; i < items.count(); i++) {
+        QString pfx = prefix(name) + QString::number(i + 1) + "/";
+        for (QVariantMap::const_iterator item = items.at(i).begin(); item != items.at(i).end(); ++item) {
+            m_values.insert(pfx + item.key(), item.value());
+        }
+    }
+    scheduleSync();
+    emit valueChanged(prefix(name) + "size", items.count());
+}
+
+void SettingsStore::sync()
+{
+    m_syncTimer.stop();
+    if (!m_dirty) {
+        return;
+    }
+    // Rewrite the whole file, QSettings commits it through QSaveFile so readers
+    // never get to see a half written file.
+    QSettings settings(m_fileName, QSettings::IniFormat);
+    settings.clear();
+    for (QMap<QString,QVariant>::const_iterator it = m_values.begin(); it != m_values.end(); ++it) {
+        settings.setValue(it.key(), it.value());
+    }
+    settings.sync();
+    if (settings.status() != QSettings::NoError) {
+        m_syncFailures = qMin(m_syncFailures + 1, MAX_SYNC_BACKOFF);
+        qWarning() << "Cannot write settings to" << m_fileName << settings.status() << "retrying in" << (SYNC_DELAY << m_syncFailures) << "ms";
+        m_syncTimer.start(SYNC_DELAY << m_syncFailures);
+        return;
+    }
+    m_dirty = false;
+    m_syncFailures = 0;
+    m_syncTimer.setInterval(SYNC_DELAY);
+}
+
+void SettingsStore::scheduleSync()
+{
+    m_dirty = true;
+    m_syncTimer.start();
+}
+
+QString SettingsStore::prefix(const QString &group)
+{
+    return group.isEmpty() ? group : group + "/";
+}
@@ -0,0 +1,57 @@
+#ifndef SETTINGSSTORE_H
+#define SETTINGSSTORE_H
+
+#include <QObject>
+#include <QMap>
+#include <QTimer>
+#include <QVariantMap>
+
+/**
+ * @brief The SettingsStore class keeps one INI file of a watch in memory.
+ * The file is read once on construction, reads are served from memory and writes
+ * are batched behind a short debounce before the file is replaced as a whole.
+ * Keys are full QSettings paths ("group/key"), arrays use the QSettings layout
+ * ("name/size", "name/1/key") so the files stay readable by QSettings.
+ */
+class SettingsStore : public QObject
+{
+    Q_OBJECT
+public:
+    SettingsStore(const QString &fileName, QObject *parent);
+    ~SettingsStore();
+
+    QString fileName() const;
+
+    bool contains(const QString &key) const;
+    QVariant value(const QString &key, const QVariant &defaultValue = QVariant()) const;
+    void setValue(const QString &key, const QVariant &value);
+    // Removes the key and everything grouped under it
+    void remove(const QString &key);
+
+    QStringList childGroups(const QString &group = QString()) const;
+    QVariantMap group(const QString &group) const;
+
+    QList<QVariantMap> readArray(const QString &name) const;
+    void writeArray(const QString &name, const QList<QVariantMap> &items);
+
+public slots:
+    // Writes pending changes right away
+    void sync();
+
+signals:
+    // Invalid value when the key was removed
+    void valueChanged(const QString &key, const QVariant &value);
+
+private:
+    void scheduleSync();
+    static QString prefix(const QString &group);
+
+    QString m_fileName;
+    QMap<QString,QVariant> m_values;
+    QTimer m_syncTimer;
+    QMetaObject::Connection m_quitConnection;
+    bool m_dirty = false;
+    int m_syncFailures = 0;
+};
+
+#endif // SETTINGSSTORE_H
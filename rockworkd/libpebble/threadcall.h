@@ -0,0 +1,53 @@
+#ifndef THREADCALL_H
+#define THREADCALL_H
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QSemaphore>
+
+#include <type_traits>
+
+// Every Pebble runs its protocol stack on its own thread. These helpers cross the
+// boundary with a functor executed in the thread of the context object, or in place
+// when the caller is already there.
+
+// Fire and forget, for setters and commands
+template<typename F>
+void invokeOn(QObject *context, F f)
+{
+    if (context->thread() == QThread::currentThread()) {
+        f();
+        return;
+    }
+    QTimer::singleShot(0, context, f);
+}
+
+// Waits for the functor to run. Only ever block towards a watch thread, watch threads
+// must not block on the main thread or this deadlocks.
+template<typename F>
+typename std::enable_if<std::is_void<typename std::result_of<F()>::type>::value>::type
+callOn(QObject *context, F f)
+{
+    if (context->thread() == QThread::currentThread()) {
+        f();
+        return;
+    }
+    QSemaphore done;
+    QTimer::singleShot(0, context, [&f, &done]() {
+        f();
+        done.release();
+    });
+    done.acquire();
+}
+
+template<typename F>
+typename std::enable_if<!std::is_void<typename std::result_of<F()>::type>::value, typename std::result_of<F()>::type>::type
+callOn(QObject *context, F f)
+{
+    typename std::result_of<F()>::type ret;
+    callOn(context, [&ret, &f]() { ret = f(); });
+    return ret;
+}
+
+#endif // THREADCALL_H
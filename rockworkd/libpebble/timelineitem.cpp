@@ -36,6 +36,11 @@ void TimelineItem::setParentId(QUuid parentId) {
     m_parentId = parentId;
 }
 
+quint8 TimelineItem::layout() const
+{
+    return m_layout;
+}
+
 void TimelineItem::setLayout(quint8 layout)
 {
     m_layout = layout;
@@ -135,6 +135,7 @@ public:
     QDateTime ts() const;
 
     void setParentId(QUuid parentId);
+    quint8 layout() const;
     void setLayout(quint8 layout);
     void setFlags(Flags flags);
 
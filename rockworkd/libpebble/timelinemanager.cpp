@@ -2,6 +2,8 @@
 #include "platforminterface.h"
 #include "sendtextapp.h"
 #include "blobdb.h"
+#include "metrics.h"
+#include "timerwheel.h"
 
 #include "watchdatareader.h"
 #include "watchdatawriter.h"
@@ -36,26 +38,22 @@ QHash<QString,TimelineAction::Type> name2act{
     {"open",   TimelineAction::TypeOpenPin}
 };
 const BlobDB::BlobDBId TimelinePin::item2blob[4] = {BlobDB::BlobDBIdTest,BlobDB::BlobDBIdNotification,BlobDB::BlobDBIdPin,BlobDB::BlobDBIdReminder};
-TimelinePin::TimelinePin(const TimelinePin &src):
-    m_manager(src.m_manager),
-    m_uuid(src.m_uuid),
-    m_parent(src.m_parent),
-    m_kind(src.m_kind),
-    m_type(src.m_type),
-    m_created(src.m_created),
-    m_updated(src.m_updated),
-    m_time(src.m_time),
-    m_pin(src.m_pin),
-    m_topics(src.m_topics),
-    m_rejected(src.m_rejected),
-    m_sendable(src.m_sendable),
-    m_deleted(src.m_deleted),
-    m_sent(src.m_sent)
+
+// Snapshot is three lines of created, updated and flags followed by the JSON
+static bool readSnapshot(const QString &path, QStringList *header, QByteArray *body)
 {
-    //buildActions();
-    //qDebug() << "Pin deep copy - be sure to know what you're doing" << m_uuid;
-    m_pending = src.m_pending;
+    QFile f_pin(path);
+    if(!f_pin.open(QFile::ReadOnly | QFile::Text)) {
+        qWarning() << "Cannot open pin snapshot at" << f_pin.fileName() << f_pin.errorString();
+        return false;
+    }
+    for(int i=0;i<3;i++)
+        header->append(QString(f_pin.readLine()));
+    *body = f_pin.readAll();
+    f_pin.close();
+    return true;
 }
+
 TimelinePin::TimelinePin(const QJsonObject &obj, TimelineManager *manager, const QUuid &uuid, const TimelinePin *parent):
     m_manager(manager),
     m_pin(obj)
@@ -63,8 +61,8 @@ TimelinePin::TimelinePin(const QJsonObject &obj, TimelineManager *manager, const
     initJson();
     if(m_uuid.isNull() && !uuid.isNull())
         m_uuid = uuid;
-    if(m_created.isNull())
-        m_created = QDateTime::currentDateTimeUtc();
+    if(m_created == NoTime)
+        m_created = packTime(QDateTime::currentDateTimeUtc());
     if(parent) {
         m_parent = parent->guid();
     }
@@ -74,11 +72,17 @@ void TimelinePin::initJson()
     if(m_pin.contains("guid"))
         m_uuid = m_pin.value("guid").toVariant().toUuid();
     m_parent = QUuid(m_pin.value("dataSource").toString().split(":").last());
-    m_kind = m_pin.value("dataSource").toString().split(":").first();
-    m_created = m_pin.value("createTime").toVariant().toDateTime().toUTC();
-    m_updated = m_pin.value("updateTime").toVariant().toDateTime().toUTC();
-    m_time = m_pin.value("time").toVariant().toDateTime().toUTC();
-    m_topics = m_pin.value("topicKeys").toVariant().toStringList();
+    m_kind = m_manager->intern(m_pin.value("dataSource").toString().split(":").first());
+    m_source = m_manager->intern(m_pin.value("source").toString());
+    m_created = packTime(m_pin.value("createTime").toVariant().toDateTime().toUTC());
+    m_updated = packTime(m_pin.value("updateTime").toVariant().toDateTime().toUTC());
+    m_time = packTime(m_pin.value("time").toVariant().toDateTime().toUTC());
+    m_topics.clear();
+    foreach(const QString &topic, m_pin.value("topicKeys").toVariant().toStringList())
+        m_topics.append(m_manager->intern(topic));
+    m_duration = m_pin.value("duration").toInt();
+    m_allDay = m_pin.contains("allDay");
+    m_hasReminders = !m_pin.value("reminders").toArray().isEmpty();
     if(m_pin.contains("type"))
         m_type = name2type.value(m_pin.value("type").toString(),TimelineItem::TypeInvalid);
     else if(m_pin.contains("layout") && m_pin.value("layout").toObject().contains("type"))
@@ -87,17 +91,15 @@ void TimelinePin::initJson()
 TimelinePin::TimelinePin(const QString &fileName, TimelineManager *manager):
     m_manager(manager)
 {
-    QFile f_pin(m_manager->m_timelineStoragePath + "/" + fileName);
-    if(!f_pin.open(QFile::ReadOnly | QFile::Text)) {
-        qWarning() << "Cannot open pin snapshot at" << f_pin.fileName() << f_pin.errorString();
+    QStringList header;
+    QByteArray body;
+    if(!readSnapshot(m_manager->m_timelineStoragePath + "/" + fileName, &header, &body))
         return;
-    }
-    QString create = f_pin.readLine();
-    QString update = f_pin.readLine();
-    QString flags = f_pin.readLine();
+    QString create = header.at(0);
+    QString update = header.at(1);
+    QString flags = header.at(2);
     QJsonParseError jpe;
-    QJsonDocument pinDoc = QJsonDocument::fromJson(f_pin.readAll(),&jpe);
-    f_pin.close();
+    QJsonDocument pinDoc = QJsonDocument::fromJson(body,&jpe);
     if(jpe.error || pinDoc.object().isEmpty()) {
         qWarning() << "Cannot thaw pin" << fileName << jpe.errorString();
         return;
@@ -110,37 +112,89 @@ TimelinePin::TimelinePin(const QString &fileName, TimelineManager *manager):
     m_rejected = (flags.at(2) == '1');
     m_deleted = (flags.at(3) == '1');
     if(created().isNull() && !create.isEmpty())
-        m_created = QDateTime::fromString(create);
+        m_created = packTime(QDateTime::fromString(create));
     if(updated().isNull() && !update.isEmpty())
-        m_updated = QDateTime::fromString(update);
+        m_updated = packTime(QDateTime::fromString(update));
     if(m_uuid.isNull())
         m_uuid=QUuid(fileName);
 }
 
-void TimelinePin::flush() const
+QString TimelinePin::fileName() const
+{
+    return m_manager->m_timelineStoragePath+"/"+m_uuid.toString().mid(1,36);
+}
+
+QJsonObject TimelinePin::applyChanges(QJsonObject obj) const
+{
+    if(m_jsonDirty) {
+        if(m_time != NoTime)
+            obj.insert("time",unpackTime(m_time).toString(Qt::ISODate));
+        if(m_topics.isEmpty())
+            obj.remove("topicKeys");
+        else
+            obj.insert("topicKeys",QJsonArray::fromStringList(m_topics));
+    }
+    return obj;
+}
+
+QJsonObject TimelinePin::json() const
+{
+    if(!m_pin.isEmpty() || !m_manager)
+        return applyChanges(m_pin);
+    QStringList header;
+    QByteArray body;
+    if(!readSnapshot(fileName(), &header, &body))
+        return QJsonObject();
+    return applyChanges(QJsonDocument::fromJson(body).object());
+}
+
+const QString TimelinePin::id() const
 {
-    QFile f_pin(m_manager->m_timelineStoragePath+"/"+m_uuid.toString().mid(1,36));
-    if(!f_pin.open(QFile::ReadWrite | QFile::Text)) {
+    QJsonObject pin = json();
+    return pin.contains("id")?pin.value("id").toString():m_uuid.toString();
+}
+
+void TimelinePin::flush(const TimelineItem *item) const
+{
+    QByteArray body;
+    if(m_pin.isEmpty()) {
+        // Compact pin, the JSON only has to be touched when it changed
+        QStringList header;
+        if(!readSnapshot(fileName(), &header, &body))
+            return;
+        if(m_jsonDirty)
+            body = QJsonDocument(applyChanges(QJsonDocument::fromJson(body).object())).toJson();
+    } else {
+        body = QJsonDocument(applyChanges(m_pin)).toJson();
+    }
+    QFile f_pin(fileName());
+    if(!f_pin.open(QFile::WriteOnly | QFile::Truncate | QFile::Text)) {
         qWarning() << "Cannot freeze pin to" << f_pin.fileName() << f_pin.errorString();
         return;
     }
     QTextStream out(&f_pin);
-    out << m_created.toString(Qt::ISODate) << endl;
-    out << m_updated.toString(Qt::ISODate) << endl;
+    out << created().toString(Qt::ISODate) << endl;
+    out << updated().toString(Qt::ISODate) << endl;
     out << (m_sendable?"1":"0");
     out << (m_sent?"1":"0");
     out << (m_rejected?"1":"0");
     out << (m_deleted?"1":"0") << endl;
-    out << QJsonDocument(m_pin).toJson();
+    out << body;
     out.flush();
     f_pin.close();
-    m_manager->addPin(*this);
+    m_jsonDirty = false;
+    m_manager->addPin(*this, item);
 }
 void TimelinePin::send() const
 {
-    flush(); // store persistent state and index (add to manager) the pin
+    send(toItem());
+}
+
+void TimelinePin::send(const TimelineItem &item) const
+{
+    flush(&item); // store persistent state and index (add to manager) the pin
     m_pending = true;       // mark as pending
-    m_manager->insert(*this); // insert into blobdb
+    m_manager->insert(*this, item); // insert into blobdb
 }
 
 void TimelinePin::remove() const
@@ -160,7 +214,7 @@ void TimelinePin::remove() const
 void TimelinePin::erase(bool force) const
 {
     if(m_sent && !force) return;
-    QFile::remove(m_manager->m_timelineStoragePath + "/" + m_uuid.toString().mid(1,36));
+    QFile::remove(fileName());
     m_manager->removePin(m_uuid);
 }
 
@@ -174,22 +228,22 @@ void TimelinePin::updateTopics(const TimelinePin &pin)
         foreach (const QString &topic, pin.topics())
             m_manager->m_idx_subscription[topic].append(guid());
         m_manager->m_mtx_pinStorage.unlock();
-        m_pin.insert("topicKeys",pin.m_pin.value("topicKeys"));
         m_topics = pin.topics();
-        m_updated = pin.updated();
+        m_updated = pin.m_updated;
+        m_jsonDirty = true;
     }
 }
 
 void TimelinePin::update(const TimelineItem &item, const QDateTime ts)
 {
-    if(ts > m_updated) {
-        m_updated = ts.toUTC();
-        m_time = item.ts().toUTC();
-        m_pin.insert("time",m_time.toString(Qt::ISODate));
+    if(ts > updated()) {
+        m_updated = packTime(ts.toUTC());
+        m_time = packTime(item.ts().toUTC());
+        m_jsonDirty = true;
         if(m_sent)
             flush();
     } else {
-        qDebug() << "Stale update, our mtime" << m_updated.toString(Qt::ISODate) << "their" << ts.toString(Qt::ISODate);
+        qDebug() << "Stale update, our mtime" << updated().toString(Qt::ISODate) << "their" << ts.toString(Qt::ISODate);
     }
 }
 
@@ -197,15 +251,60 @@ TimelineItem TimelinePin::toItem() const
 {
     // I think flags are depricated, even though still present in the protocol. But let's try it out, not much computation
     TimelineItem::Flag flag = (m_type == TimelineItem::TypeNotification) ? TimelineItem::FlagSingleEvent :
-                                                (m_pin.contains("allDay") ? TimelineItem::FlagAllDay : TimelineItem::FlagNone);
+                                                (m_allDay ? TimelineItem::FlagAllDay : TimelineItem::FlagNone);
     TimelineItem timelineItem(guid(), type(), flag, time(), duration());
     qDebug() << "Itemizing pin" << m_uuid;
     timelineItem.setParentId(m_parent);
-    timelineItem = m_manager->parseLayout(timelineItem, layout());
-    timelineItem = m_manager->parseActions(timelineItem, getActions());
+    if(m_encodedLayouts == m_manager->m_layoutsGeneration) {
+        timelineItem.setLayout(m_layoutId);
+        WatchDataReader r(m_encoded);
+        for(int i=0;i<m_attributeCount;i++) {
+            TimelineAttribute attribute;
+            attribute.deserialize(r);
+            timelineItem.appendAttribute(attribute);
+        }
+        for(int i=0;i<m_actionCount;i++) {
+            TimelineAction action;
+            action.deserialize(r);
+            timelineItem.appendAction(action);
+        }
+        return timelineItem;
+    }
+    QJsonObject pin = json();
+    timelineItem = m_manager->parseLayout(timelineItem, pin.value("layout").toObject());
+    timelineItem = m_manager->parseActions(timelineItem, buildActions(pin));
+    encode(timelineItem);
     return timelineItem;
 }
 
+void TimelinePin::encode(const TimelineItem &item) const
+{
+    QList<TimelineAttribute> attributes = item.attributes();
+    QList<TimelineAction> actions = item.actions();
+    m_encoded.clear();
+    foreach(const TimelineAttribute &attribute, attributes)
+        m_encoded.append(attribute.serialize());
+    foreach(const TimelineAction &action, actions)
+        m_encoded.append(action.serialize());
+    m_attributeCount = attributes.count();
+    m_actionCount = actions.count();
+    m_layoutId = item.layout();
+    m_encodedLayouts = m_manager->m_layoutsGeneration;
+}
+
+void TimelinePin::compact(const TimelineItem *item)
+{
+    if(m_pin.isEmpty())
+        return;
+    if(item)
+        encode(*item);
+    // Action ids from the watch are resolved against these
+    m_actionTypes.clear();
+    foreach(const QJsonValue &action, buildActions(m_pin))
+        m_actionTypes.append(m_manager->intern(action.toObject().value("type").toString()));
+    m_pin = QJsonObject();
+}
+
 TimelinePin::PtrList TimelinePin::kids(TimelineItem::Type type) const
 {
     TimelinePin::PtrList ret = m_manager->pinKids(m_uuid);
@@ -217,32 +316,33 @@ TimelinePin::PtrList TimelinePin::kids(TimelineItem::Type type) const
 
 const TimelinePin TimelinePin::makeNotification(const TimelinePin *old) const
 {
+    QJsonObject pin = json();
     QString key;
     QJsonValue time;
     if(old!=nullptr) { // Existing pin - update if already sent
         TimelinePin::PtrList kids = old->kids();
-        if(m_pin.contains("updateNotification") && !kids.isEmpty() && kids.first()->sent()) {
+        if(pin.contains("updateNotification") && !kids.isEmpty() && kids.first()->sent()) {
             qDebug() << "Update notification" << kids.first()->guid() << "for existing pin" << m_uuid;
             key = "updateNotification";
-        } else if(m_pin.contains("createNotification") && (kids.isEmpty() || !kids.first()->sent())) {
+        } else if(pin.contains("createNotification") && (kids.isEmpty() || !kids.first()->sent())) {
             qDebug() << "Create notification for existing pin: no notifications sent yet" << m_uuid;
             key = "createNotification";
         }
         if(!key.isEmpty())
-            time = m_pin.value(key).toObject().contains("time") ? m_pin.value(key).toObject().value("time") : m_pin.value("createTime");
+            time = pin.value(key).toObject().contains("time") ? pin.value(key).toObject().value("time") : pin.value("createTime");
     } else { // New pin - createNotification
-        if(m_pin.contains("createNotification")) {
+        if(pin.contains("createNotification")) {
             qDebug() << "Create new notification for the new pin" << m_uuid;
             key = "createNotification";
-            time = m_pin.contains("updateNotification") && m_pin.value("updateNotification").toObject().contains("time") ?
-                        m_pin.value("updateNotification").toObject().value("time") : m_pin.value("createTime");
+            time = pin.contains("updateNotification") && pin.value("updateNotification").toObject().contains("time") ?
+                        pin.value("updateNotification").toObject().value("time") : pin.value("createTime");
         }
     }
     if(!key.isEmpty()) {
         // Ignore notification more than an hour old
         if(time.toVariant().toDateTime().secsTo(QDateTime::currentDateTimeUtc().addSecs(m_manager->m_event_fadeout))<0) {
-            QJsonObject n_pin=m_pin.value(key).toObject();
-            n_pin.insert("dataSource",QString("%1:%2").arg(m_pin.value("id").toString(),m_parent.toString().mid(1,36)));
+            QJsonObject n_pin=pin.value(key).toObject();
+            n_pin.insert("dataSource",QString("%1:%2").arg(pin.value("id").toString(),m_parent.toString().mid(1,36)));
             if(created().isValid())
                 n_pin.insert("createTime",created().toString(Qt::ISODate));
             if(updated().isValid())
@@ -257,9 +357,10 @@ const TimelinePin TimelinePin::makeNotification(const TimelinePin *old) const
 
 const QList<TimelinePin> TimelinePin::makeReminders() const
 {
+    QJsonObject pin = json();
     QList<TimelinePin> reminders;
-    for(int i = 0; i < qMin(m_pin.value("reminders").toArray().size(),3);i++) {
-        QJsonObject obj=m_pin.value("reminders").toArray().at(i).toObject();
+    for(int i = 0; i < qMin(pin.value("reminders").toArray().size(),3);i++) {
+        QJsonObject obj=pin.value("reminders").toArray().at(i).toObject();
         QDateTime at = obj.value("time").toVariant().toDateTime().toUTC();
         if(at > QDateTime::currentDateTimeUtc().addSecs(-15*60))
             reminders.append(TimelinePin(obj,m_manager,QUuid::createUuid(),this));
@@ -268,56 +369,47 @@ const QList<TimelinePin> TimelinePin::makeReminders() const
     }
     return reminders;
 }
-void TimelinePin::buildActions() const
+QJsonArray TimelinePin::buildActions(const QJsonObject &pin) const
 {
-    if(m_pin.contains("actions")) {
-        QJsonArray acts = m_pin.value("actions").toArray();
-        for(int i=0;i<acts.size();i++) {
-            qDebug() << "Adding action" << acts[i].toObject().value("type").toString() << acts[i].toObject().value("title").toString();
-            m_actions.append(acts[i]);
-        }
-    }
-    if(!m_actions.first().toObject().value("type").toString().startsWith("dismiss") &&
+    QJsonArray acts = pin.value("actions").toArray();
+    if(!acts.first().toObject().value("type").toString().startsWith("dismiss") &&
             (m_type == TimelineItem::TypeNotification || m_type == TimelineItem::TypeReminder)) {
         QJsonObject action;
         // TypeDismiss is not relayed back so use TypeGeneric if you need to handle it
         action.insert("type",QString("dismiss"));
         action.insert("title",QString(gettext("Dismiss")));
-        m_actions.prepend(action);
+        acts.prepend(action);
     }
-    if(m_actions.last().toObject().value("type").toString() != "mute") {
+    if(acts.last().toObject().value("type").toString() != "mute") {
         QJsonObject actOpen,actMute;
         if(m_type == TimelineItem::TypePin) {
             actOpen.insert("type",QString("remove"));
             actOpen.insert("title",QString("Remove"));
-            m_actions.append(actOpen);
+            acts.append(actOpen);
         } else {
             actOpen.insert("type",QString("open"));
             actOpen.insert("title",QString("Open"));
-            m_actions.append(actOpen);
+            acts.append(actOpen);
         }
         actMute.insert("type",QString("mute"));
         actMute.insert("title",QString("Mute"));
-        m_actions.append(actMute);
+        acts.append(actMute);
     }
+    return acts;
 }
 
-const QJsonArray & TimelinePin::getActions() const
+QJsonArray TimelinePin::getActions() const
 {
-    if(!m_actions.isEmpty())
-        return m_actions;
-    buildActions();
-    return m_actions;
+    return buildActions(json());
 }
 QList<TimelineAttribute> TimelinePin::handleAction(TimelineAction::Type atype, quint8 id, const QJsonObject &param) const
 {
-    if(m_actions.isEmpty()) {
-        qWarning() << "Action for re-serialized event - platform event must already be missing";
-        buildActions();
-    }
     Q_UNUSED(atype)
-    QJsonObject action = m_actions.at(id).toObject();
-    QString a_type = action.value("type").toString();
+    QString a_type;
+    if(!m_actionTypes.isEmpty())
+        a_type = m_actionTypes.value(id);
+    else
+        a_type = getActions().at(id).toObject().value("type").toString();
     QList<TimelineAttribute> attributes;
     if(a_type == "mute") {
         emit m_manager->muteSource(m_kind);
@@ -355,6 +447,7 @@ QList<TimelineAttribute> TimelinePin::handleAction(TimelineAction::Type atype, q
  */
 TimelineManager::TimelineManager(Pebble *pebble, WatchConnection *connection):
     QObject(pebble),
+    m_mtx_pinStorage(QMutex::Recursive),
     m_pebble(pebble),
     m_connection(connection)
 {
@@ -399,10 +492,12 @@ TimelineManager::TimelineManager(Pebble *pebble, WatchConnection *connection):
 #endif // DATA_MIGRATION
     // Also run maintenance cycle on watch connection - to redeliver notifications and stuff
     connect(connection, &WatchConnection::watchConnected, this, &TimelineManager::doMaintenance, Qt::QueuedConnection);
-    startTimer(180000);
+    pebble->timers()->start(180000, this, [this]() { doMaintenance(); }, true);
 }
 
 void TimelineManager::reloadLayouts() {
+    // Pins encoded against the previous layouts get rebuilt from their JSON
+    m_layoutsGeneration++;
     QFile lf(m_timelineStoragePath + "/../layouts.json.auto");
     lf.open(QFile::ReadOnly);
     qDebug() << "Loading layouts file from" << lf.fileName() << lf.errorString();
@@ -552,22 +647,11 @@ TimelineAttribute TimelineManager::parseAttribute(const QString &key, const QJso
     } else if(attr.type == "isodate-unixtime") {
         attribute.setInt<quint32>(val.toVariant().toDateTime().toUTC().toTime_t());
     } else if(attr.type == "color-uint8") {
-        QString col = val.toString();
-        quint8 rgba8 = pebbleCol.value(col);
-        if(rgba8 == 0 && col.at(0) != '#') {
-            // last attempt - to use QT color names
-            QColor qc(col);
-            if(qc.isValid()) {
-                col=qc.name(); // should give #RRGGBB formated color string which is parsed down below
-            } else {
-                qWarning() << "Cannot parse color definition, ignoring:" << key << col << rgba8 << pebbleCol.contains(col);
-                return att_inval;
-            }
-        }
-        if(rgba8 == 0) { // Cannot be 0 - black is 192(opaque alpha). Parse #RRGGBB color string compressing to rgba8 color space.
-            rgba8 = 192 | (((quint8)col.mid(1,2).toInt(0,16)) >> 6) << 4 | (((quint8)col.mid(3,2).toInt(0,16)) >> 6) << 2 | (((quint8)col.mid(5,2).toInt(0,16)) >> 6);
+        quint8 rgba8 = parseColor(val.toString());
+        if(rgba8 == 0) {
+            qWarning() << "Cannot parse color definition, ignoring:" << key << val.toString();
+            return att_inval;
         }
-        qDebug() << "Evaluated color to" << rgba8;
         attribute.setByte(rgba8);
     } else if(attr.type == "enum-uint8") {
         if(!attr.enums.contains(val.toString())) {
@@ -590,6 +674,27 @@ TimelineAttribute TimelineManager::parseAttribute(const QString &key, const QJso
     }
     return attribute;
 }
+// Returns 0 for unknown colors - black is 192 (opaque alpha)
+quint8 TimelineManager::parseColor(const QString &color) const
+{
+    QString col = color;
+    if(col.isEmpty())
+        return 0;
+    quint8 rgba8 = pebbleCol.value(col);
+    if(rgba8 == 0 && col.at(0) != '#') {
+        // last attempt - to use QT color names
+        QColor qc(col);
+        if(qc.isValid()) {
+            col=qc.name(); // should give #RRGGBB formated color string which is parsed down below
+        } else {
+            return 0;
+        }
+    }
+    if(rgba8 == 0) { // Parse #RRGGBB color string compressing to rgba8 color space.
+        rgba8 = 192 | (((quint8)col.mid(1,2).toInt(0,16)) >> 6) << 4 | (((quint8)col.mid(3,2).toInt(0,16)) >> 6) << 2 | (((quint8)col.mid(5,2).toInt(0,16)) >> 6);
+    }
+    return rgba8;
+}
 QJsonObject &TimelineManager::deserializeAttribute(const TimelineAttribute &attr, QJsonObject &obj)
 {
     foreach(const QString &key,m_attributes.keys()) {
@@ -753,8 +858,11 @@ void TimelineManager::notifyHandler(BlobDB::BlobDBId db, BlobDB::Operation cmd,
 }
 
 // Storage Ops
-void TimelineManager::addPin(const TimelinePin &pin)
+void TimelineManager::addPin(const TimelinePin &pin, const TimelineItem *item)
 {
+    // The index only keeps compact pins, the JSON is in the snapshot by now
+    TimelinePin stored(pin);
+    stored.compact(item);
     m_mtx_pinStorage.lock();
     // We may be re-inserting the pin - eg update. Parent is ok but time & topics may change.
     if(m_pin_idx_guid.contains(pin.guid())) {
@@ -762,13 +870,22 @@ void TimelineManager::addPin(const TimelinePin &pin)
         foreach(const QString &topic,m_pin_idx_guid.value(pin.guid()).topics())
             m_idx_subscription[topic].removeAll(pin.guid());
     }
-    m_pin_idx_guid.insert(pin.guid(),pin);
+    m_pin_idx_guid.insert(pin.guid(),stored);
     m_pin_idx_parent[pin.parent()].append(pin.guid());
     m_pin_idx_time[pin.gmtime_t()].append(pin.guid());
     foreach(const QString &topic,pin.topics())
         m_idx_subscription[topic].append(pin.guid());
     m_mtx_pinStorage.unlock();
 }
+QString TimelineManager::intern(const QString &string)
+{
+    QMutexLocker lock(&m_mtx_pinStorage);
+    QSet<QString>::const_iterator it = m_strings.constFind(string);
+    if(it != m_strings.constEnd())
+        return *it;
+    m_strings.insert(string);
+    return string;
+}
 void TimelineManager::removePin(const QUuid &guid)
 {
     qDebug() << "Removing timeline pin:" << guid.toString();
@@ -827,15 +944,29 @@ void TimelineManager::setTimelineWindow(int daysPast, int eventFadeout, int days
     m_future_days = daysFuture;
 }
 
-void TimelineManager::timerEvent(QTimerEvent *event)
+void TimelineManager::beginTransaction()
 {
-    if(event) {
+    m_mtx_pinStorage.lock();
+    m_transaction++;
+}
+
+void TimelineManager::commitTransaction()
+{
+    m_transaction--;
+    m_mtx_pinStorage.unlock();
+    if(m_transaction == 0 && m_maintenanceDeferred) {
+        m_maintenanceDeferred = false;
         doMaintenance();
     }
 }
 
 void TimelineManager::doMaintenance()
 {
+    if(m_transaction > 0) {
+        m_maintenanceDeferred = true;
+        return;
+    }
+    qint64 started = Metrics::now();
     // End is future boundary - now+7. 7 is calendar window, pypkjs uses +4.
     time_t window_end = QDateTime::currentDateTimeUtc().addDays(m_future_days).toTime_t();
     // Start is past boundary - now-2. This is questionable. Pebble keeps up to 72hrs.
@@ -907,6 +1038,8 @@ void TimelineManager::doMaintenance()
     qDebug() << "Cleaning up" << cleanup.size() << "discarded pins";
     foreach(const TimelinePin*pin,cleanup)
         pin->erase();
+    m_pebble->metrics()->recordSince("timeline.maintenance.duration", started);
+    m_pebble->metrics()->record("timeline.maintenance.pins", m_pin_idx_guid.count());
 }
 
 // Don't call these directly, pin will call it when needed
@@ -915,6 +1048,11 @@ void TimelineManager::insert(const TimelinePin &pin)
     qDebug() << "inserting TimelinePin into blobdb:" << pin.blobId() << pin.guid().toString();
     m_pebble->blobdb()->insert(pin.blobId(), pin.toItem());
 }
+void TimelineManager::insert(const TimelinePin &pin, const TimelineItem &item)
+{
+    qDebug() << "inserting prebuilt TimelinePin into blobdb:" << pin.blobId() << pin.guid().toString();
+    m_pebble->blobdb()->insert(pin.blobId(), item);
+}
 void TimelineManager::remove(const TimelinePin &pin)
 {
     qDebug() << "removing TimelinePin from blobdb:" << pin.blobId() << pin.guid().toString();
@@ -1048,7 +1186,7 @@ void TimelineManager::insertTimelinePin(const QJsonObject &json)
             return;
         }
         qDebug() << "Update for existing pin" << old->updated() << pin.updated();
-        if(!old->reminders().isEmpty()) {
+        if(old->hasReminders()) {
             qDebug() << "Removing old reminders for" << old->guid().toString() << "- we'll add 'm later";
             foreach(const TimelinePin* kid, pinKids(old->guid())) {
                 if(kid->type()==TimelineItem::TypeReminder)
@@ -1065,7 +1203,7 @@ void TimelineManager::insertTimelinePin(const QJsonObject &json)
         qDebug() << "Sending notification" << notice.guid() << "for pin" << pin.guid();
         notice.send(); // Store, add to index and send to watches
     }
-    if(!pin.reminders().isEmpty()) {
+    if(pin.hasReminders()) {
         //qDebug() << "Sending" << pin.reminders().count() << "reminders for pin" << pin.guid();
         foreach(const TimelinePin &rmd,pin.makeReminders()) {
             qDebug() << rmd.guid() << rmd.time().toString(Qt::ISODate);
@@ -1073,6 +1211,108 @@ void TimelineManager::insertTimelinePin(const QJsonObject &json)
         }
     }
 }
+QJsonObject NotificationPin::toJson() const
+{
+    QJsonObject pin;
+    QJsonObject layout;
+    QJsonArray acts;
+    pin.insert("id",id);
+    pin.insert("guid",guid.toString().mid(1,36));
+    pin.insert("type",QString("notification"));
+    pin.insert("createTime",createTime.toUTC().toString(Qt::ISODate));
+    pin.insert("updateTime",updateTime.toUTC().toString(Qt::ISODate));
+    pin.insert("dataSource",QString("%1:%2").arg(sourceId,parent.toString().mid(1,36)));
+    pin.insert("source",source);
+    if(!sourceIcon.isEmpty())
+        pin.insert("sourceIcon",sourceIcon);
+    if(!sourceName.isEmpty())
+        pin.insert("sourceName",sourceName);
+    foreach(const Action &action, actions) {
+        QJsonObject act;
+        act.insert("type",action.type);
+        act.insert("title",action.title);
+        if(!action.cannedResponses.isEmpty())
+            act.insert("cannedResponse",QJsonArray::fromStringList(action.cannedResponses));
+        acts.append(act);
+    }
+    pin.insert("actions",acts);
+    layout.insert("type",QString("commNotification"));
+    layout.insert("title",title);
+    layout.insert("subtitle",subtitle);
+    layout.insert("body",body);
+    if(!sender.isEmpty())
+        layout.insert("sender",sender);
+    layout.insert("tinyIcon",tinyIcon);
+    layout.insert("backgroundColor",backgroundColor);
+    pin.insert("layout",layout);
+    return pin;
+}
+
+/**
+ * @brief TimelineManager::insertNotification
+ * @param notification
+ *
+ * Native counterpart of insertTimelinePin() for notifications. The blobdb item is
+ * assembled straight from the typed fields, the JSON is only built for the snapshot.
+ * Actions are completed the same way TimelinePin::buildActions() would, so action ids
+ * match when the pin is later restored from its snapshot.
+ */
+void TimelineManager::insertNotification(const NotificationPin &notification)
+{
+    if(notification.guid.isNull() || notification.sourceId.isEmpty() || notification.parent.isNull()) {
+        qWarning() << (notification.guid.isNull()?"GUID":"") << (notification.sourceId.isEmpty()?"Kind":"") << (notification.parent.isNull()?"Parent":"") << "missing from notification, ignoring.";
+        return;
+    }
+    NotificationPin n(notification);
+    if(n.actions.isEmpty() || !n.actions.first().type.startsWith("dismiss")) {
+        // TypeDismiss is not relayed back so use TypeGeneric if you need to handle it
+        n.actions.prepend({QString("dismiss"),QString(gettext("Dismiss")),QStringList()});
+    }
+    if(n.actions.last().type != "mute") {
+        n.actions.append({QString("open"),QString("Open"),QStringList()});
+        n.actions.append({QString("mute"),QString("Mute"),QStringList()});
+    }
+
+    TimelineItem item(n.guid, TimelineItem::TypeNotification, TimelineItem::FlagSingleEvent,
+                      n.updateTime.isValid() ? n.updateTime : n.createTime, 0);
+    item.setParentId(n.parent);
+    item.setLayout(TimelineLayoutCommNotification);
+    TimelineAttribute title(TimelineAttrTitle), subtitle(TimelineAttrSubtitle), body(TimelineAttrBody);
+    title.setString(n.title,63);
+    subtitle.setString(n.subtitle,63);
+    body.setString(n.body,511);
+    item.appendAttribute(title);
+    item.appendAttribute(subtitle);
+    item.appendAttribute(body);
+    if(!n.sender.isEmpty()) {
+        TimelineAttribute sender(TimelineAttrSender);
+        sender.setString(n.sender,63);
+        item.appendAttribute(sender);
+    }
+    quint32 icon = n.tinyIcon.isEmpty() ? 0 : getRes(n.tinyIcon);
+    if(icon != 0)
+        item.appendAttribute(TimelineAttribute(TimelineAttrTinyIcon,icon));
+    quint8 color = parseColor(n.backgroundColor);
+    if(color != 0) {
+        TimelineAttribute background(TimelineAttrBackgroundColor);
+        background.setByte(color);
+        item.appendAttribute(background);
+    }
+    for(int i=0;i<n.actions.count();i++) {
+        const NotificationPin::Action &action = n.actions.at(i);
+        TimelineAction tlAct(i,name2act.value(action.type,TimelineAction::TypeGeneric));
+        TimelineAttribute actTitle(TimelineAttrTitle);
+        actTitle.setString(action.title,63);
+        tlAct.appendAttribute(actTitle);
+        if(!action.cannedResponses.isEmpty())
+            tlAct.appendAttribute(TimelineAttribute(TimelineAttrCannedResponse,action.cannedResponses));
+        item.appendAction(tlAct);
+    }
+
+    TimelinePin pin(n.toJson(),this);
+    pin.send(item);
+}
+
 void TimelineManager::removeTimelinePin(const QString &guid)
 {
     TimelinePin * pin = getPin(QUuid(guid));
@@ -11,6 +11,9 @@
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
+#include <QSet>
+
+#include <limits>
 
 // layouts.json attribute representation
 struct Attr {
@@ -21,31 +24,83 @@ struct Attr {
     QHash<QString,quint8> enums;
 };
 
-// Wrapper class to encapsulate persistance, serialization and nested objects
+// Attribute and layout ids of layouts.json used by the native notification path.
+// These never changed between firmware releases so they are resolved at compile time.
+enum TimelineAttributeId : quint8 {
+    TimelineAttrTitle = 1,
+    TimelineAttrSubtitle = 2,
+    TimelineAttrBody = 3,
+    TimelineAttrTinyIcon = 4,
+    TimelineAttrCannedResponse = 8,
+    TimelineAttrSender = 12,
+    TimelineAttrBackgroundColor = 28
+};
+enum TimelineLayoutId : quint8 {
+    TimelineLayoutCommNotification = 5
+};
+
+// Notification filled in natively by platform integrations. It goes to the watch
+// without passing through JSON, the JSON pin is only produced to store it.
+struct NotificationPin {
+    struct Action {
+        QString type;
+        QString title;
+        QStringList cannedResponses;
+    };
+
+    QString id;
+    QUuid guid;
+    QDateTime createTime;
+    QDateTime updateTime;
+    // Filter and mute key of the source, together with parent it forms the dataSource
+    QString sourceId;
+    QUuid parent;
+    QString source;
+    QString sourceName;
+    QString sourceIcon;
+
+    QString title;
+    QString subtitle;
+    QString body;
+    // Token the reply to a canned response is addressed to
+    QString sender;
+    QString tinyIcon;
+    QString backgroundColor;
+    QList<Action> actions;
+
+    QJsonObject toJson() const;
+};
+Q_DECLARE_METATYPE(NotificationPin)
+
+// Wrapper class to encapsulate persistance, serialization and nested objects.
+// Pins held by the manager are compact: the JSON is dropped once it is in the snapshot
+// and read back from there by json() and the few accessors needing it, while the item
+// for the watch is kept pre-encoded.
 class TimelineManager;
 class TimelinePin {
 public:
     TimelinePin() {}
-    TimelinePin(const TimelinePin &src);
     TimelinePin(const QJsonDocument &json, TimelineManager *manager) : TimelinePin(json.object(),manager){}
     TimelinePin(const QJsonObject &obj, TimelineManager *manager, const QUuid &uuid = QUuid(), const TimelinePin *parent = 0);
     TimelinePin(const QString &fileName, TimelineManager *manager);
 
-    const QString id() const {return m_pin.contains("id")?m_pin.value("id").toString():m_uuid.toString();}
+    QJsonObject json() const;
+    const QString id() const;
     const QUuid & guid() const {return m_uuid;}
     const QUuid & parent() const {return m_parent;}
     QString kind() const {return m_kind;}
-    QString source() const {return m_pin.value("source").toString();}
+    QString source() const {return m_source;}
     TimelineItem::Type type() const {return m_type;}
     BlobDB::BlobDBId blobId() const {return item2blob[m_type];}
-    QDateTime time() const  {return (m_time.isValid()?m_time:(m_updated.isValid()?m_updated:m_created));}
-    quint32 gmtime_t() const {return time().toTime_t();}
-    QDateTime created() const {return m_created;}
-    QDateTime updated() const {return m_updated;}
-    int duration() const {return m_pin.value("duration").toInt();}
-    const QJsonObject layout() const {return m_pin.value("layout").toObject();}
-    QJsonArray actions() const {return m_pin.value("actions").toArray();}
-    QJsonArray reminders() const {return m_pin.value("reminders").toArray();}
+    QDateTime time() const  {return unpackTime(packedTime());}
+    quint32 gmtime_t() const {return packedTime() == NoTime ? quint32(-1) : quint32(packedTime() / 1000);}
+    QDateTime created() const {return unpackTime(m_created);}
+    QDateTime updated() const {return unpackTime(m_updated);}
+    int duration() const {return m_duration;}
+    const QJsonObject layout() const {return json().value("layout").toObject();}
+    QJsonArray actions() const {return json().value("actions").toArray();}
+    QJsonArray reminders() const {return json().value("reminders").toArray();}
+    bool hasReminders() const {return m_hasReminders;}
     QStringList topics() const { return m_topics;}
 
     // Lifecycle control flags
@@ -65,7 +120,7 @@ public:
     PtrList kids(TimelineItem::Type type=TimelineItem::TypeNotification) const;
     const TimelinePin makeNotification(const TimelinePin *old) const;
     const QList<TimelinePin> makeReminders() const;
-    const QJsonArray & getActions() const;
+    QJsonArray getActions() const;
     QList<TimelineAttribute> handleAction(TimelineAction::Type atype, quint8 id, const QJsonObject &param) const;
     void updateTopics(const TimelinePin &pin);
 
@@ -73,31 +128,58 @@ public:
 
     // watch operations
     TimelineItem toItem() const;
-    void flush() const;
+    void flush(const TimelineItem *item = nullptr) const;
     void remove() const;
     void send() const;
+    // Same as send() with an item built up front
+    void send(const TimelineItem &item) const;
     void erase(bool force=false) const;
 
 private:
+    friend class TimelineManager;
+    static const qint64 NoTime = std::numeric_limits<qint64>::min();
+    static qint64 packTime(const QDateTime &dt) {return dt.isValid() ? dt.toMSecsSinceEpoch() : NoTime;}
+    static QDateTime unpackTime(qint64 t) {return t == NoTime ? QDateTime() : QDateTime::fromMSecsSinceEpoch(t, Qt::UTC);}
+    qint64 packedTime() const {return m_time != NoTime ? m_time : (m_updated != NoTime ? m_updated : m_created);}
+
     void initJson();
-    void buildActions() const;
+    QString fileName() const;
+    QJsonObject applyChanges(QJsonObject obj) const;
+    QJsonArray buildActions(const QJsonObject &pin) const;
+    void encode(const TimelineItem &item) const;
+    void compact(const TimelineItem *item);
 
-    TimelineManager *m_manager;
+    TimelineManager *m_manager = nullptr;
     QUuid m_uuid;
     QUuid m_parent;
+    // Interned by the manager, pins of a source share the string data
     QString m_kind;
-    TimelineItem::Type m_type = TimelineItem::TypeInvalid;
-    QDateTime m_created;
-    QDateTime m_updated;
-    QDateTime m_time;
-    QJsonObject m_pin;
+    QString m_source;
     QStringList m_topics;
+    QStringList m_actionTypes;
+    // Msecs since epoch, NoTime when unset
+    qint64 m_created = NoTime;
+    qint64 m_updated = NoTime;
+    qint64 m_time = NoTime;
+    // Full JSON, only kept until the pin is compacted into the manager's index
+    QJsonObject m_pin;
+    // Layout attributes followed by the actions, as they go to the watch
+    mutable QByteArray m_encoded;
+    mutable int m_encodedLayouts = -1; // Generation of the layouts m_encoded was built with
+    mutable quint8 m_layoutId = 0;
+    mutable quint8 m_attributeCount = 0;
+    mutable quint8 m_actionCount = 0;
+    quint16 m_duration = 0;
+    TimelineItem::Type m_type = TimelineItem::TypeInvalid;
+    bool m_allDay = false;
+    bool m_hasReminders = false;
     bool m_rejected = false;
     bool m_sendable = true;
     bool m_deleted = false;
     bool m_sent = false;
     mutable bool m_pending = false;
-    mutable QJsonArray m_actions;
+    // Time or topics changed since the snapshot was written
+    mutable bool m_jsonDirty = false;
 
     static const BlobDB::BlobDBId item2blob[4];
 };
@@ -116,8 +198,13 @@ public:
     Attr getAttr(const QString &key) const;
     // New Timeline API
     void insertTimelinePin(const QJsonObject &json);
+    void insertNotification(const NotificationPin &notification);
     void removeTimelinePin(const QString &guid);
     void clearTimeline(const QUuid &parent);
+    // Batch of pin operations applied atomically against the storage index.
+    // Maintenance requested meanwhile is deferred until commit.
+    void beginTransaction();
+    void commitTransaction();
 
     void setTimelineWindow(int daysPast, int eventFadeout, int daysFuture);
     int daysPast() const {return m_past_days;}
@@ -149,18 +236,18 @@ private slots:
     void blobdbAckHandler(BlobDB::BlobDBId db, BlobDB::Operation cmd, const QByteArray &key, BlobDB::Status ack);
     void doMaintenance();
 
-protected:
-    void timerEvent(QTimerEvent *event) override;
-
 private:
     void insert(const class TimelinePin &pin);
+    void insert(const class TimelinePin &pin, const TimelineItem &item);
+    quint8 parseColor(const QString &color) const;
     void remove(const class TimelinePin &pin);
-    void addPin(const class TimelinePin &pin);
+    void addPin(const class TimelinePin &pin, const TimelineItem *item = nullptr);
     quint32 pinCount(const QUuid *parent = 0);
     bool pinExists(const QUuid &guid) const;
     TimelinePin * getPin(const QUuid &guid);
     void removePin(const QUuid &guid);
     const TimelinePin::PtrList pinKids(const QUuid &parent);
+    QString intern(const QString &string);
 
     // In-Memory Pin Storage Index. We need:
     // - global index <QUuid,TimelinePin> - object storage hash {guid: pin} - primary pin storage
@@ -173,6 +260,8 @@ private:
     QHash<QString,QList<QUuid>> m_idx_subscription;
     // All should be updated in atomic syncronized transaction to prevent retention/sync timer race condition
     QMutex m_mtx_pinStorage;
+    int m_transaction = 0;
+    bool m_maintenanceDeferred = false;
 
     // Timeline window knobs. Pebble doesn't show future further than 48hrs ahead.
     // However it keeps pins on watches and shows them once the time has come
@@ -184,6 +273,9 @@ private:
     QHash<QString,quint8> m_layouts;
     QHash<QString,qint32> m_resources;
     QHash<QString,Attr> m_attributes;
+    int m_layoutsGeneration = 0;
+    // Kinds, sources, topics and action types repeat across most pins
+    QSet<QString> m_strings;
 
     Pebble *m_pebble;
     WatchConnection *m_connection;
@@ -1,20 +1,25 @@
 #include "timelinesync.h"
 #include "timelinemanager.h"
 #include "pebble.h"
+#include "metrics.h"
 
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include <QUrlQuery>
 #include <QSettings>
+#include <QSaveFile>
+#include <QTimer>
 
 /**
  * @brief TimelineSync::TimelineSync
  * @param pebble
  * @param manager
  *
- * TimelineSync class starts a timer to run a websync task, to pull pins from pebble.com. For
- * authorisation it uses OAuth2 token which is locally stored. Valid token should be set by
+ * TimelineSync class runs a websync task to pull pins from pebble.com. Polling is adaptive - it
+ * speeds up after updates, backs off while idle or failing, uses conditional requests and pauses
+ * while the watch is disconnected. Updates of one reply are applied in one timeline transaction.
+ * For authorisation it uses OAuth2 token which is locally stored. Valid token should be set by
  * pebble class i.e. via DBus. If token results in Auth.Error - token is cleared and stored.
  * Cleared (empty) token means websync is disabled (stops the timer).
  *
@@ -28,6 +33,7 @@
  */
 TimelineSync::TimelineSync(Pebble *pebble, TimelineManager *manager):
   QObject(pebble),
+  m_syncTimer(new QTimer(this)),
   m_nam(pebble->nam()),
   m_pebble(pebble),
   m_manager(manager)
@@ -42,26 +48,46 @@ TimelineSync::TimelineSync(Pebble *pebble, TimelineManager *manager):
     m_accountId = m_ini->value("accountId").toString();
     // Whether we install apps which are in the locker but missing locally
     m_syncFromCloud = m_ini->value("syncFromCloud").toBool();
+    // Validators of the last sync reply and current poll interval
+    m_syncETag = m_ini->value("syncETag").toByteArray();
+    m_syncModified = m_ini->value("syncModified").toByteArray();
+    m_syncInterval = m_ini->value("syncInterval",s_minSyncInterval).toInt();
+    // Locker and sandbox tokens from last run - serves JSKit token requests before network is up
+    loadLockerCache();
 
     // Make connection to itself queued to prevent recursive closure and yield to event loop
-    connect(this, &TimelineSync::timelineOp, this, &TimelineSync::webOpHandler, Qt::QueuedConnection);
+    connect(this, &TimelineSync::timelineOps, this, &TimelineSync::webOpsHandler, Qt::QueuedConnection);
     connect(this, &TimelineSync::syncUrlChanged, this, &TimelineSync::resyncUrl,Qt::QueuedConnection);
     connect(this,&TimelineSync::wipePinKind,manager,&TimelineManager::wipeTimeline,Qt::QueuedConnection);
     // Shortcut to catch token becoming invalid - invalidates timeline and account info
     connect(this, &TimelineSync::oauthTokenChanged, this, &TimelineSync::setOAuthToken,Qt::QueuedConnection);
-    // websync needs more frequent update to keep apps up-to-whatever-they-need
-    if(!m_oauthToken.isEmpty())
-        m_tmr_websync = startTimer(30000);
+    m_syncTimer->setSingleShot(true);
+    connect(m_syncTimer, &QTimer::timeout, this, &TimelineSync::doWebsync);
+    // Nobody will see the pins while disconnected, catch up once the watch is back
+    connect(pebble, &Pebble::pebbleConnected, this, &TimelineSync::onPebbleConnected);
+    connect(pebble, &Pebble::pebbleDisconnected, this, &TimelineSync::onPebbleDisconnected);
 }
 
 const QString TimelineSync::subscriptionsUrl = "https://timeline-api.getpebble.com/v1/user/subscriptions";
 const QString TimelineSync::s_internalApi = "https://timeline-sync.getpebble.com";
 const QString TimelineSync::s_lockerUrl = "https://api2.getpebble.com/v2/locker/";
 
-void TimelineSync::resyncUrl(const QString &url)
+void TimelineSync::setSyncUrl(const QString &url)
 {
+    if(url == m_syncUrl) return;
     m_syncUrl=url;
     m_ini->setValue("syncUrl",url);
+    // Validators are only meaningful for the url they came from
+    m_syncETag.clear();
+    m_syncModified.clear();
+    m_validatorsPending = false;
+    m_ini->remove("syncETag");
+    m_ini->remove("syncModified");
+}
+
+void TimelineSync::resyncUrl(const QString &url)
+{
+    setSyncUrl(url);
     doWebsync();
 }
 
@@ -98,13 +124,26 @@ QJsonObject processJsonReply(QNetworkReply *rpl, QString &err)
     return QJsonObject();
 }
 
-void TimelineSync::timerEvent(QTimerEvent *event)
+void TimelineSync::scheduleWebsync(bool activity)
 {
-    if(event) {
-        if(!m_pendingReply.isNull())
-            m_pendingReply->abort();
+    if(activity)
+        m_syncInterval = s_minSyncInterval;
+    else
+        m_syncInterval = qMin(m_syncInterval*2, s_maxSyncInterval);
+    m_ini->setValue("syncInterval",m_syncInterval);
+    if(!m_oauthToken.isEmpty() && m_pebble->connected())
+        m_syncTimer->start(m_syncInterval);
+}
+
+void TimelineSync::onPebbleConnected()
+{
+    if(!m_oauthToken.isEmpty())
         doWebsync();
-    }
+}
+
+void TimelineSync::onPebbleDisconnected()
+{
+    m_syncTimer->stop();
 }
 
 void TimelineSync::doWebsync()
@@ -113,17 +152,42 @@ void TimelineSync::doWebsync()
         qDebug() << "No valid authentication token, skipping WebSync";
         return;
     }
+    if(!m_pebble->connected()) {
+        qDebug() << "Watch is not connected, pausing WebSync";
+        m_syncTimer->stop();
+        return;
+    }
+    if(!m_pendingReply.isNull())
+        m_pendingReply->abort();
     // Attempt to bring up internal state since qt is not tracking it properly
     if(m_nam->networkAccessible()!=QNetworkAccessManager::Accessible)
         m_nam->setNetworkAccessible(QNetworkAccessManager::Accessible);
-    qDebug() << "Syncing from" << syncUrl();
-    QNetworkReply *rpl = m_nam->get(authedRequest(syncUrl()));
+    qDebug() << "Syncing from" << syncUrl() << "every" << m_syncInterval/1000 << "s";
+    QNetworkRequest req = authedRequest(syncUrl());
+    if(!m_syncETag.isEmpty())
+        req.setRawHeader("If-None-Match",m_syncETag);
+    if(!m_syncModified.isEmpty())
+        req.setRawHeader("If-Modified-Since",m_syncModified);
+    QNetworkReply *rpl = m_nam->get(req);
     m_pendingReply = rpl;
     connect(rpl,&QNetworkReply::finished,[this,rpl](){
+        if(rpl->error() == QNetworkReply::OperationCanceledError) {
+            rpl->deleteLater();
+            return; // superseded by a newer sync
+        }
+        if(rpl->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304) {
+            rpl->deleteLater();
+            m_pebble->metrics()->count("timeline.sync.notmodified");
+            scheduleWebsync(false);
+            return;
+        }
+        QByteArray etag = rpl->rawHeader("ETag");
+        QByteArray modified = rpl->rawHeader("Last-Modified");
         QString err;
         QJsonObject obj = processJsonReply(rpl,err);
         if(!err.isEmpty()) {
             qWarning() << "Cannot parse response" << err;
+            scheduleWebsync(false);
             return;
         }
         if(obj.contains("error")) {
@@ -134,6 +198,7 @@ void TimelineSync::doWebsync()
                 return;
             }
             qCritical() << "Unknown error received" << obj.value("error").toString() << obj;
+            scheduleWebsync(false);
             return;
         }
         if(obj.value("mustResync").toBool()) {
@@ -143,21 +208,45 @@ void TimelineSync::doWebsync()
             return;
         }
         QJsonArray arr = obj.value("updates").toArray();
+        // A 304 for these validators would skip the ops, so they only count once the ops are applied
+        m_pendingETag = etag;
+        m_pendingModified = modified;
+        m_validatorsPending = true;
         if(arr.count()>0) {
             qDebug() << "Got stuff to work on" << obj;
-            for(int i=0;i<arr.size();i++) {
-                emit timelineOp(arr.at(i).toObject());
-            }
+            m_pebble->metrics()->count("timeline.sync.ops",arr.count());
+            emit timelineOps(arr);
+        } else {
+            storeValidators();
         }
         if(obj.contains("nextPageURL")) {
             emit syncUrlChanged(obj.value("nextPageURL").toString());
         } else {
-            m_syncUrl = obj.value("syncURL").toString();
-            m_ini->setValue("syncUrl",m_syncUrl);
+            setSyncUrl(obj.value("syncURL").toString());
+            scheduleWebsync(arr.count()>0);
         }
     });
 }
 
+void TimelineSync::webOpsHandler(const QJsonArray &ops)
+{
+    m_manager->beginTransaction();
+    for(int i=0;i<ops.size();i++)
+        webOpHandler(ops.at(i).toObject());
+    m_manager->commitTransaction();
+    storeValidators();
+}
+
+void TimelineSync::storeValidators()
+{
+    if(!m_validatorsPending) return;
+    m_validatorsPending = false;
+    m_syncETag = m_pendingETag;
+    m_syncModified = m_pendingModified;
+    m_ini->setValue("syncETag",m_syncETag);
+    m_ini->setValue("syncModified",m_syncModified);
+}
+
 void TimelineSync::webOpHandler(const QJsonObject &op)
 {
     QString opt = op.value("type").toString();
@@ -180,10 +269,14 @@ void TimelineSync::timelineApiQuery(const QByteArray &verb, const QString &url,
 {
     qDebug() << "API call for" << verb << url << token;
     QNetworkReply *rpl = m_nam->sendCustomRequest(authedRequest(url,token),verb);
-    connect(rpl,&QNetworkReply::finished,[this,rpl,ctx,ack,nack](){
+    connect(rpl,&QNetworkReply::finished,[this,rpl,ctx,ack,nack,token](){
+        int status = rpl->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
         QString err;
         QJsonObject obj=processJsonReply(rpl,err);
         if(obj.isEmpty()) {
+            // Server no longer accepts this timeline token, don't hand it out again
+            if(!token.isEmpty() && (status == 401 || status == 403))
+                dropSandboxToken(token);
             if(nack)
                 nack(ctx,err);
             else
@@ -202,16 +295,12 @@ void TimelineSync::setOAuthToken(const QString &token)
     m_ini->setValue("oauthToken",token);
     if(token.isEmpty()) {
         qDebug() << "Setting empty oauth: disable websync and cleanup web resources";
-        if(m_tmr_websync) {
-            killTimer(m_tmr_websync);
-            m_tmr_websync = 0;
-        }
+        m_syncTimer->stop();
         m_ini->remove("accountId");
         m_accountId = "";
-        m_syncUrl = "";
-        m_ini->remove("syncUrl");
+        setSyncUrl("");
         emit wipePinKind("web");
-        m_locker.clear();
+        clearLockerCache();
         emit oauthTokenChanged(m_oauthToken);
     } else {
         // Try to validate token by requesting accountId and comparing it to current
@@ -224,8 +313,7 @@ void TimelineSync::setOAuthToken(const QString &token)
                 if(obj.contains("id") && obj.value("id").isString()) {
                     if(m_accountId == obj.value("id").toString())
                         return; // it was token refresh
-                    if(m_tmr_websync==0)
-                        m_tmr_websync=startTimer(30000);
+                    m_syncInterval = s_minSyncInterval;
                     qDebug() << "OAuth Token validated but points to different account" << m_accountId << obj.value("id").toString();
                     m_accountId = obj.value("id").toString();
                     m_ini->setValue("accountId",m_accountId);
@@ -238,7 +326,7 @@ void TimelineSync::setOAuthToken(const QString &token)
                     emit syncUrlChanged(initialSyncUrl());
 
                     // Also - the locker
-                    m_locker.clear();
+                    clearLockerCache();
                     fetchLocker(); // Don't do actual synchronisation here, defer to next time
                     return;
                 } else {
@@ -282,17 +370,37 @@ void TimelineSync::syncLocker(bool force)
 }
 void TimelineSync::fetchLocker(bool force, void (*next)(void*), void *ctx) const
 {
-    if(!m_oauthToken.isEmpty() && (m_locker.isEmpty() || force)) {
-        qDebug() << "Fetching locker content" << force;
-        // Attempt to bring up internal state since qt is not tracking it properly
-        if(m_nam->networkAccessible()!=QNetworkAccessManager::Accessible)
-            m_nam->setNetworkAccessible(QNetworkAccessManager::Accessible);
-        QNetworkReply *rpl = m_nam->get(authedRequest(s_lockerUrl));
-        connect(rpl,&QNetworkReply::finished, [this,rpl,next,ctx](){
+    if(m_oauthToken.isEmpty() || (!force && !m_locker.isEmpty() && lockerFresh())) {
+        if(next)
+            next(ctx);
+        return;
+    }
+    if(next)
+        m_lockerWaiters.append(qMakePair(next,ctx));
+    if(m_lockerFetching)
+        return; // will be called back when in-flight fetch completes
+    m_lockerFetching = true;
+    qDebug() << "Fetching locker content" << force;
+    // Attempt to bring up internal state since qt is not tracking it properly
+    if(m_nam->networkAccessible()!=QNetworkAccessManager::Accessible)
+        m_nam->setNetworkAccessible(QNetworkAccessManager::Accessible);
+    QNetworkRequest req = authedRequest(s_lockerUrl);
+    if(!m_lockerETag.isEmpty() && !m_locker.isEmpty())
+        req.setRawHeader("If-None-Match",m_lockerETag);
+    QNetworkReply *rpl = m_nam->get(req);
+    connect(rpl,&QNetworkReply::finished, [this,rpl](){
+        if(rpl->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304) {
+            rpl->deleteLater();
+            qDebug() << "Locker not modified";
+            m_lockerFetched = QDateTime::currentDateTimeUtc();
+            saveLockerCache();
+        } else {
+            QByteArray etag = rpl->rawHeader("ETag");
             QString err;
             QJsonObject obj = processJsonReply(rpl,err);
             if(!obj.isEmpty()) {
                 if(obj.contains("applications")) {
+                    m_locker.clear();
                     QJsonArray arr = obj.value("applications").toArray();
                     for(int i=0;i<arr.size();i++) {
                         QJsonObject el(arr.at(i).toObject());
@@ -300,17 +408,165 @@ void TimelineSync::fetchLocker(bool force, void (*next)(void*), void *ctx) const
                         qDebug() << "Adding to locker" << el.value("title").toString();
                         m_locker.insert(QUuid(el.value("uuid").toString()),el);
                     }
+                    m_lockerETag = etag;
+                    m_lockerFetched = QDateTime::currentDateTimeUtc();
+                    saveLockerCache();
                 } else {
                     qWarning() << "Response does not contain applications array:" << QJsonDocument(obj).toJson();
                 }
             } else
                 qWarning() << err;
-            if(next)
-                next(ctx);
-        });
-    } else if(next)
-        next(ctx);
+        }
+        m_lockerFetching = false;
+        QList<QPair<void(*)(void*),void*>> waiters;
+        waiters.swap(m_lockerWaiters);
+        for(int i=0;i<waiters.size();i++)
+            waiters.at(i).first(waiters.at(i).second);
+    });
+}
+
+bool TimelineSync::lockerFresh() const
+{
+    return m_lockerFetched.isValid() && m_lockerFetched.secsTo(QDateTime::currentDateTimeUtc()) < s_lockerTTL;
 }
+
+void TimelineSync::loadLockerCache()
+{
+    QFile f(m_timelineStoragePath + "/locker.json");
+    if(!f.open(QFile::ReadOnly))
+        return;
+    QJsonObject obj = QJsonDocument::fromJson(f.readAll()).object();
+    m_lockerETag = obj.value("etag").toString().toLatin1();
+    m_lockerFetched = QDateTime::fromString(obj.value("fetched").toString(),Qt::ISODate);
+    QJsonArray arr = obj.value("applications").toArray();
+    for(int i=0;i<arr.size();i++) {
+        QJsonObject el(arr.at(i).toObject());
+        m_locker.insert(QUuid(el.value("uuid").toString()),el);
+    }
+    QJsonObject sandbox = obj.value("sandbox").toObject();
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    for(QJsonObject::const_iterator it=sandbox.begin();it!=sandbox.end();it++) {
+        QJsonObject el(it.value().toObject());
+        QDateTime fetched = QDateTime::fromString(el.value("fetched").toString(),Qt::ISODate);
+        if(fetched.isValid() && fetched.secsTo(now) < s_lockerTTL)
+            m_sandboxTokens.insert(QUuid(it.key()),qMakePair(el.value("token").toString(),fetched));
+    }
+    qDebug() << "Loaded" << m_locker.count() << "locker apps cached at" << m_lockerFetched.toString(Qt::ISODate);
+}
+
+void TimelineSync::saveLockerCache() const
+{
+    QJsonArray arr;
+    foreach(const QJsonObject &el,m_locker)
+        arr.append(el);
+    QJsonObject sandbox;
+    for(QHash<QUuid,QPair<QString,QDateTime>>::const_iterator it=m_sandboxTokens.begin();it!=m_sandboxTokens.end();it++) {
+        QJsonObject el;
+        el.insert("token",it.value().first);
+        el.insert("fetched",it.value().second.toString(Qt::ISODate));
+        sandbox.insert(it.key().toString(),el);
+    }
+    QJsonObject obj;
+    obj.insert("etag",QString::fromLatin1(m_lockerETag));
+    obj.insert("fetched",m_lockerFetched.toString(Qt::ISODate));
+    obj.insert("applications",arr);
+    obj.insert("sandbox",sandbox);
+
+    QSaveFile f(m_timelineStoragePath + "/locker.json");
+    if(!f.open(QFile::WriteOnly)) {
+        qWarning() << "Cannot save locker cache" << f.fileName() << f.errorString();
+        return;
+    }
+    f.write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+    f.commit();
+}
+
+void TimelineSync::clearLockerCache()
+{
+    m_locker.clear();
+    m_sandboxTokens.clear();
+    m_lockerETag.clear();
+    m_lockerFetched = QDateTime();
+    QFile::remove(m_timelineStoragePath + "/locker.json");
+}
+
+void TimelineSync::requestTimelineToken(const QUuid &app_uuid, TokenCallback ack, TokenCallback nak) const
+{
+    // Answer from cache right away, stale locker is revalidated in background
+    if(m_locker.contains(app_uuid)) {
+        ack(m_locker.value(app_uuid).value("user_token").toString());
+        fetchLocker();
+        return;
+    }
+    if(m_sandboxTokens.contains(app_uuid)) {
+        const QPair<QString,QDateTime> &sandbox = m_sandboxTokens[app_uuid];
+        if(sandbox.second.secsTo(QDateTime::currentDateTimeUtc()) < s_lockerTTL) {
+            ack(sandbox.first);
+            return;
+        }
+        // Expired - look it up again, it may have been rotated or revoked
+        m_sandboxTokens.remove(app_uuid);
+        saveLockerCache();
+    }
+    // Somebody is already looking this app up, just wait for the result
+    bool inFlight = m_tokenWaiters.contains(app_uuid);
+    m_tokenWaiters[app_uuid].append(qMakePair(ack,nak));
+    if(inFlight)
+        return;
+
+    struct ctx {
+        QUuid id;
+        const TimelineSync *me;
+    } * context = new ctx({app_uuid,this});
+    fetchLocker(false,[](void*p){
+        struct ctx *c=(struct ctx*)p;
+        if(c->me->m_locker.contains(c->id)) {
+            c->me->resolveTimelineToken(c->id,c->me->m_locker.value(c->id).value("user_token").toString(),QString());
+            delete c;
+        } else {
+            // Check for sandbox token
+            c->me->timelineApiQuery("GET",sandboxTokens()+"/"+c->id.toString(),p,[](void*pc,const QJsonObject &obj){
+                struct ctx *c=(struct ctx*)pc;
+                if(obj.contains("token")) {
+                    c->me->m_sandboxTokens.insert(c->id,qMakePair(obj.value("token").toString(),QDateTime::currentDateTimeUtc()));
+                    c->me->saveLockerCache();
+                    c->me->resolveTimelineToken(c->id,obj.value("token").toString(),QString());
+                } else {
+                    c->me->resolveTimelineToken(c->id,QString(),"Neither production nor sandbox token found");
+                }
+                delete c;
+            },[](void*pc,const QString &err){
+                struct ctx *c=(struct ctx*)pc;
+                c->me->resolveTimelineToken(c->id,QString(),err);
+                delete c;
+            });
+        }
+    },context);
+}
+
+void TimelineSync::dropSandboxToken(const QString &token) const
+{
+    for(QHash<QUuid,QPair<QString,QDateTime>>::iterator it=m_sandboxTokens.begin();it!=m_sandboxTokens.end();it++) {
+        if(it.value().first == token) {
+            qDebug() << "Sandbox token for" << it.key().toString() << "was rejected, dropping it";
+            m_sandboxTokens.erase(it);
+            saveLockerCache();
+            return;
+        }
+    }
+}
+
+void TimelineSync::resolveTimelineToken(const QUuid &app_uuid, const QString &token, const QString &err) const
+{
+    QList<QPair<TokenCallback,TokenCallback>> waiters = m_tokenWaiters.take(app_uuid);
+    for(int i=0;i<waiters.size();i++) {
+        if(err.isEmpty())
+            waiters.at(i).first(token);
+        else
+            waiters.at(i).second(err);
+    }
+}
+
 void TimelineSync::resyncLocker(bool force)
 {
     QList<QUuid> toRemove;
@@ -347,6 +603,7 @@ void TimelineSync::resyncLocker(bool force)
                     QJsonObject el(obj.value("application").toObject());
                     el.remove("hardware_platforms");
                     m_locker.insert(QUuid(el.value("uuid").toString()),el);
+                    saveLockerCache();
                     qDebug() << "Registered" << el.value("uuid").toString() << el.value("title").toString() << "to the locker";
                 } else {
                     qWarning() << "Error adding application to locker - empty reply:" << QJsonDocument(obj).toJson();
@@ -358,11 +615,12 @@ void TimelineSync::resyncLocker(bool force)
     foreach(const QUuid &id, toRemove) {
         qDebug() << "Removing" << id << m_locker.value(id).value("title").toString() << "from locker";
         QNetworkReply *rpl = m_nam->deleteResource(authedRequest(s_lockerUrl + id.toString().mid(1,36)));
-        connect(rpl,&QNetworkReply::finished,[this,&id,rpl](){
+        connect(rpl,&QNetworkReply::finished,[this,id,rpl](){
             rpl->deleteLater();
-            if(rpl->error()==QNetworkReply::NoError)
+            if(rpl->error()==QNetworkReply::NoError) {
                 m_locker.remove(id);
-            else
+                saveLockerCache();
+            } else
                 qWarning() << "Error deleting" << id << rpl->errorString();
         });
     }
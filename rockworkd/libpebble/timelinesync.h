@@ -2,12 +2,15 @@
 #define TIMELINESYNC_H
 
 #include <QObject>
+#include <QDateTime>
+#include <functional>
 #include <QUuid>
 #include <QHash>
 #include <QVariant>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QPointer>
+#include <QJsonArray>
 
 QT_FORWARD_DECLARE_CLASS(Pebble)
 QT_FORWARD_DECLARE_CLASS(TimelineManager)
@@ -15,6 +18,7 @@ QT_FORWARD_DECLARE_CLASS(QNetworkAccessManager)
 QT_FORWARD_DECLARE_CLASS(QNetworkRequest)
 QT_FORWARD_DECLARE_CLASS(QNetworkReply)
 QT_FORWARD_DECLARE_CLASS(QSettings)
+QT_FORWARD_DECLARE_CLASS(QTimer)
 
 class TimelineSync : public QObject
 {
@@ -38,7 +42,7 @@ public:
 signals:
     void oauthTokenChanged(const QString &token);
     void syncUrlChanged(const QString &url);
-    void timelineOp(const QJsonObject &op);
+    void timelineOps(const QJsonArray &ops);
     void wipePinKind(const QString &kind);
 
 public slots:
@@ -47,13 +51,19 @@ public slots:
 
 private slots:
     void doWebsync();
-    void webOpHandler(const QJsonObject &op);
+    void webOpsHandler(const QJsonArray &ops);
     void resyncLocker(bool force=false);
-
-protected:
-    void timerEvent(QTimerEvent *event) override;
+    void onPebbleConnected();
+    void onPebbleDisconnected();
 
 private:
+    void webOpHandler(const QJsonObject &op);
+    void storeValidators();
+    // Polling cadence: back to min after updates, doubles up to max while idle or failing
+    static const int s_minSyncInterval = 10000;
+    static const int s_maxSyncInterval = 30 * 60 * 1000;
+    void scheduleWebsync(bool activity);
+
     // https://timeline-api.getpebble.com/docs
     static const QString s_internalApi;
     static const QString s_accInfoUrl;
@@ -62,6 +72,7 @@ private:
     static const QString s_lockerUrl;
 
     QString syncUrl() { return m_syncUrl.isEmpty() ? initialSyncUrl():m_syncUrl;}
+    void setSyncUrl(const QString &url);
     QString m_syncUrl;
 
     QString m_oauthToken;
@@ -69,6 +80,19 @@ private:
     bool m_syncFromCloud = false;
     void fetchLocker(bool force = false, void (*next)(void*) = 0, void *ctx = 0) const;
     mutable QHash<QUuid,QJsonObject> m_locker;
+    // Locker cache persisted to timeline/locker.json, revalidated by ETag once older than TTL
+    static const int s_lockerTTL = 24 * 3600;
+    void loadLockerCache();
+    void saveLockerCache() const;
+    void clearLockerCache();
+    bool lockerFresh() const;
+    mutable QByteArray m_lockerETag;
+    mutable QDateTime m_lockerFetched;
+    mutable bool m_lockerFetching = false;
+    mutable QList<QPair<void(*)(void*),void*>> m_lockerWaiters;
+    // Sandbox tokens with the time they were fetched, kept no longer than the locker
+    mutable QHash<QUuid,QPair<QString,QDateTime>> m_sandboxTokens;
+    void dropSandboxToken(const QString &token) const;
 
     // to use with templated callbacks hiding internal logic
     void timelineApiQuery(const QByteArray &verb, const QString &url, void *ctx, void(*ack)(void*,const QJsonObject&), void(*nack)(void*,const QString&) = 0, const QString &token = QString()) const;
@@ -77,12 +101,25 @@ private:
     //QJsonObject processJsonReply(QNetworkReply *rpl, QString &err) const;
 
     QPointer<QNetworkReply> m_pendingReply;
-    int m_tmr_websync = 0;
+    QTimer *m_syncTimer;
+    int m_syncInterval;
+    // Validators of the last reply for syncUrl, used for conditional requests
+    QByteArray m_syncETag;
+    QByteArray m_syncModified;
+    // Validators of a reply whose ops are still queued for webOpsHandler
+    QByteArray m_pendingETag;
+    QByteArray m_pendingModified;
+    bool m_validatorsPending = false;
     QString m_timelineStoragePath;
     QNetworkAccessManager *m_nam;
     QSettings *m_ini;
     Pebble *m_pebble;
     TimelineManager *m_manager;
+    typedef std::function<void(const QString&)> TokenCallback;
+    // Callbacks of token requests waiting for the same app lookup
+    mutable QHash<QUuid,QList<QPair<TokenCallback,TokenCallback>>> m_tokenWaiters;
+    void requestTimelineToken(const QUuid &app_uuid, TokenCallback ack, TokenCallback nak) const;
+    void resolveTimelineToken(const QUuid &app_uuid, const QString &token, const QString &err) const;
 public:
     // JSKit Utilities - asynchronous calls with callback interface
     ////
@@ -90,31 +127,7 @@ public:
     // token from sandbox when application is not available in the locker
     template<typename Ack, typename Nak>
     void getTimelineToken(const QUuid &app_uuid, Ack ack, Nak nak) const {
-        struct ctx {
-            const QUuid &id;
-            const TimelineSync *me;
-            Ack ack;
-            Nak nak;
-        } * context = new ctx({app_uuid,this,ack,nak});
-        fetchLocker(false,[](void*p){
-            struct ctx *c=(struct ctx*)p;
-            if(c->me->m_locker.contains(c->id)) {
-                c->ack(c->me->m_locker.value(c->id).value("user_token").toString());
-                delete c;
-            } else {
-                // Check for sandbox token
-                c->me->timelineApiQuery("GET",sandboxTokens()+"/"+c->id.toString(),p,[](void*pc,const QJsonObject &obj){
-                    if(obj.contains("token"))
-                        ((struct ctx*)pc)->ack(obj.value("token").toString());
-                    else
-                        ((struct ctx*)pc)->nak("Neither production nor sandbox token found");
-                    delete ((struct ctx*)pc);
-                },[](void*pc,const QString &err){
-                    ((struct ctx*)pc)->nak(err);
-                    delete ((struct ctx*)pc);
-                });
-            }
-        },context);
+        requestTimelineToken(app_uuid,ack,nak);
     }
 
     // getSubscriptions return subscribed topics for given app represented by timeline token
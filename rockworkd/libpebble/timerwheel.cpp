@@ -0,0 +1,281 @@
+#include "timerwheel.h"
+
+#include <QTimerEvent>
+#include <QtAlgorithms>
+#include <QDebug>
+
+static const qint64 TICK_MSEC = 8;
+// Ids carry the entry index in the low bits and a generation above, so a stale id
+// never cancels the timer that reused its entry
+static const int INDEX_BITS = 20;
+static const int GENERATION_MASK = 0x3ff;
+static const quint64 NO_TICK = ~quint64(0);
+
+static inline quint64 rotateRight(quint64 v, int n)
+{
+    return n ? (v >> n) | (v << (64 - n)) : v;
+}
+
+TimerWheel::TimerWheel(QObject *parent):
+    QObject(parent),
+    m_heads(Firing + 1, -1),
+    m_tails(Firing + 1, -1)
+{
+    for (int level = 0; level < Levels; level++) {
+        m_occupied[level] = 0;
+    }
+    m_clock.start();
+}
+
+int TimerWheel::start(int msec, QObject *context, const Callback &callback, bool repeat)
+{
+    int index;
+    if (m_free.isEmpty()) {
+        index = m_entries.count();
+        if (index >= (1 << INDEX_BITS) - 1) {
+            qWarning() << "Too many timers, dropping one of" << msec << "ms";
+            return 0;
+        }
+        m_entries.append(Entry());
+    } else {
+        index = m_free.takeLast();
+    }
+
+    // Round up so nothing fires before the time it asked for
+    qint64 elapsed = m_clock.elapsed();
+    msec = qMax(msec, 0);
+    Entry &e = m_entries[index];
+    e.deadline = (elapsed + msec + TICK_MSEC - 1) / TICK_MSEC;
+    e.interval = repeat ? qMax<quint64>((msec + TICK_MSEC - 1) / TICK_MSEC, 1) : 0;
+    e.callback = callback;
+    e.context = context;
+    e.hasContext = context != nullptr;
+    schedule(index, elapsed / TICK_MSEC);
+    updateTimer();
+
+    return ((e.generation & GENERATION_MASK) << INDEX_BITS) | (index + 1);
+}
+
+void TimerWheel::stop(int id, const QObject *context)
+{
+    int index = indexOf(id);
+    if (index < 0 || m_entries.at(index).context != context) {
+        return;
+    }
+    unlink(index);
+    release(index);
+    // The system timer stays armed, a wakeup for nothing is cheaper than finding the next one
+}
+
+void TimerWheel::stopAll(const QObject *context)
+{
+    for (int index = 0; index < m_entries.count(); index++) {
+        if (m_entries.at(index).list >= 0 && m_entries.at(index).context == context) {
+            unlink(index);
+            release(index);
+        }
+    }
+}
+
+bool TimerWheel::isActive(int id) const
+{
+    return indexOf(id) >= 0;
+}
+
+void TimerWheel::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != m_timer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+    m_timer.stop();
+    process();
+    updateTimer();
+}
+
+quint64 TimerWheel::currentTick() const
+{
+    return m_clock.elapsed() / TICK_MSEC;
+}
+
+void TimerWheel::schedule(int index, quint64 now)
+{
+    // Defer by up to 1/16th of the delay onto the coarsest boundary in reach, so timers
+    // of similar length end up in the same slot
+    Entry &e = m_entries[index];
+    quint64 slack = e.deadline > now ? (e.deadline - now) >> 4 : 0;
+    quint64 align = 1;
+    while (align * 2 <= slack) {
+        align *= 2;
+    }
+    e.expires = (e.deadline + align - 1) & ~(align - 1);
+    place(index);
+}
+
+void TimerWheel::place(int index)
+{
+    Entry &e = m_entries[index];
+    quint64 expires = qMax(e.expires, m_next);
+    quint64 delta = expires - m_next;
+
+    int level = 0;
+    while (level < Levels - 1 && delta >= (quint64(1) << (SlotBits * (level + 1)))) {
+        level++;
+    }
+    if (delta >= (quint64(1) << (SlotBits * Levels))) {
+        // Out of range, park it in the last slot to come round and place it again from there
+        expires = m_next + (quint64(1) << (SlotBits * Levels)) - 1;
+    }
+    link(index, level * Slots + ((expires >> (SlotBits * level)) & (Slots - 1)));
+}
+
+void TimerWheel::link(int index, int list)
+{
+    Entry &e = m_entries[index];
+    e.list = list;
+    e.next = -1;
+    e.prev = m_tails[list];
+    if (e.prev >= 0) {
+        m_entries[e.prev].next = index;
+    } else {
+        m_heads[list] = index;
+    }
+    m_tails[list] = index;
+    if (list < Firing) {
+        m_occupied[list / Slots] |= quint64(1) << (list % Slots);
+    }
+}
+
+void TimerWheel::unlink(int index)
+{
+    Entry &e = m_entries[index];
+    if (e.prev >= 0) {
+        m_entries[e.prev].next = e.next;
+    } else {
+        m_heads[e.list] = e.next;
+    }
+    if (e.next >= 0) {
+        m_entries[e.next].prev = e.prev;
+    } else {
+        m_tails[e.list] = e.prev;
+    }
+    if (e.list < Firing && m_heads[e.list] < 0) {
+        m_occupied[e.list / Slots] &= ~(quint64(1) << (e.list % Slots));
+    }
+    e.list = -1;
+    e.prev = e.next = -1;
+}
+
+void TimerWheel::release(int index)
+{
+    Entry &e = m_entries[index];
+    e.callback = Callback();
+    e.context.clear();
+    e.generation++;
+    m_free.append(index);
+}
+
+void TimerWheel::cascade(int level, int slot)
+{
+    int list = level * Slots + slot;
+    int index = m_heads[list];
+    while (index >= 0) {
+        int next = m_entries[index].next;
+        unlink(index);
+        place(index);
+        index = next;
+    }
+}
+
+quint64 TimerWheel::nextEventTick() const
+{
+    quint64 next = NO_TICK;
+    if (m_occupied[0]) {
+        next = m_next + qCountTrailingZeroBits(rotateRight(m_occupied[0], m_next & (Slots - 1)));
+    }
+    // Higher levels need attention when their slot is due to be cascaded
+    for (int level = 1; level < Levels; level++) {
+        if (!m_occupied[level]) {
+            continue;
+        }
+        quint64 unit = quint64(1) << (SlotBits * level);
+        quint64 boundary = (m_next + unit - 1) & ~(unit - 1);
+        int slot = (boundary >> (SlotBits * level)) & (Slots - 1);
+        next = qMin(next, boundary + qCountTrailingZeroBits(rotateRight(m_occupied[level], slot)) * unit);
+    }
+    return next;
+}
+
+void TimerWheel::process()
+{
+    quint64 now = currentTick();
+    forever {
+        quint64 tick = nextEventTick();
+        if (tick > now) {
+            break;
+        }
+        m_next = tick;
+        for (int level = 1; level < Levels; level++) {
+            if (m_next & ((quint64(1) << (SlotBits * level)) - 1)) {
+                break;
+            }
+            cascade(level, (m_next >> (SlotBits * level)) & (Slots - 1));
+        }
+
+        // Move the slot aside so callbacks may stop any of its entries
+        int list = m_next & (Slots - 1);
+        while (m_heads[list] >= 0) {
+            int index = m_heads[list];
+            unlink(index);
+            link(index, Firing);
+        }
+        m_next++;
+
+        while (m_heads[Firing] >= 0) {
+            int index = m_heads[Firing];
+            unlink(index);
+            Entry &e = m_entries[index];
+            if (e.hasContext && !e.context) {
+                release(index);
+                continue;
+            }
+            // Copy, the entry may be reused by a timer started from the callback
+            Callback callback = e.callback;
+            if (e.interval) {
+                e.deadline = qMax(e.deadline + e.interval, now + 1);
+                schedule(index, now);
+            } else {
+                release(index);
+            }
+            callback();
+        }
+    }
+    m_next = qMax(m_next, now + 1);
+}
+
+void TimerWheel::updateTimer()
+{
+    quint64 next = nextEventTick();
+    if (next == NO_TICK) {
+        m_timer.stop();
+        return;
+    }
+    if (m_timer.isActive() && m_armed <= next) {
+        return;
+    }
+    m_armed = next;
+    m_timer.start(int(qMax<qint64>(qint64(next) * TICK_MSEC - m_clock.elapsed(), 0)), Qt::CoarseTimer, this);
+}
+
+int TimerWheel::indexOf(int id) const
+{
+    int index = (id & ((1 << INDEX_BITS) - 1)) - 1;
+    if (index < 0 || index >= m_entries.count()) {
+        return -1;
+    }
+    const Entry &e = m_entries.at(index);
+    if (e.list < 0 || (e.generation & GENERATION_MASK) != (id >> INDEX_BITS)) {
+        return -1;
+    }
+    return index;
+}
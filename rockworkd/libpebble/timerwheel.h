@@ -0,0 +1,82 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QVector>
+
+#include <functional>
+
+/**
+ * @brief The TimerWheel class multiplexes the timers of a watch thread onto a single
+ * system timer. Timers are kept in a hierarchical wheel of 4 levels of 64 slots with
+ * a tick of 8ms, so arming and cancelling is O(1) whatever the number of timers.
+ * Deadlines are deferred by up to 1/16th of the delay to line them up with their
+ * neighbours, which lets timers of similar length fire in the same wakeup.
+ * Callbacks are never invoked early, and never once their context object is gone.
+ */
+class TimerWheel : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<void()> Callback;
+
+    explicit TimerWheel(QObject *parent);
+
+    // Returns a positive id, valid until the timer is stopped or a single shot fired
+    int start(int msec, QObject *context, const Callback &callback, bool repeat = false);
+    // Ids are shared by everybody on the thread, so only the owning context can stop a timer
+    void stop(int id, const QObject *context);
+    void stopAll(const QObject *context);
+    bool isActive(int id) const;
+
+protected:
+    void timerEvent(QTimerEvent *event) override;
+
+private:
+    enum {
+        Levels = 4,
+        SlotBits = 6,
+        Slots = 1 << SlotBits,
+        Firing = Levels * Slots // List of the entries being fired
+    };
+
+    struct Entry {
+        quint64 deadline = 0; // Tick requested by the caller
+        quint64 expires = 0;  // Tick the entry is scheduled for, after slack
+        quint64 interval = 0; // In ticks, 0 for single shots
+        Callback callback;
+        QPointer<QObject> context;
+        bool hasContext = false;
+        int prev = -1;
+        int next = -1;
+        int list = -1;
+        int generation = 0;
+    };
+
+    quint64 currentTick() const;
+    void schedule(int index, quint64 now);
+    void place(int index);
+    void link(int index, int list);
+    void unlink(int index);
+    void release(int index);
+    void cascade(int level, int slot);
+    quint64 nextEventTick() const;
+    void process();
+    void updateTimer();
+    int indexOf(int id) const;
+
+    QVector<Entry> m_entries;
+    QVector<int> m_free;
+    QVector<int> m_heads;
+    QVector<int> m_tails;
+    quint64 m_occupied[Levels]; // Bitmap of the non empty slots per level
+    quint64 m_next = 0; // First tick not processed yet
+    quint64 m_armed = 0;
+    QElapsedTimer m_clock;
+    QBasicTimer m_timer;
+};
+
+#endif // TIMERWHEEL_H
@@ -0,0 +1,196 @@
+#include "tracerecorder.h"
+#include "pebble.h"
+#include "metrics.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QVariantList>
+#include <QtEndian>
+#include <QDebug>
+
+TraceRecorder::TraceRecorder(Pebble *pebble, WatchConnection *connection):
+    QObject(pebble),
+    m_wallBase(QDateTime::currentMSecsSinceEpoch() * 1000 - Metrics::now())
+{
+    connect(connection, &WatchConnection::rawIncomingMsg, this, &TraceRecorder::onRawIncomingMsg);
+    connect(connection, &WatchConnection::rawOutgoingMsg, this, &TraceRecorder::onRawOutgoingMsg);
+}
+
+void TraceRecorder::setCapacity(int bytes)
+{
+    m_capacity = bytes;
+    while (m_bytes > m_capacity && !m_frames.isEmpty())
+        m_bytes -= m_frames.dequeue().data.size();
+}
+
+void TraceRecorder::onRawIncomingMsg(const QByteArray &msg)
+{
+    append(DirectionIncoming, msg);
+}
+
+void TraceRecorder::onRawOutgoingMsg(const QByteArray &msg)
+{
+    append(DirectionOutgoing, msg);
+}
+
+void TraceRecorder::append(Direction dir, const QByteArray &msg)
+{
+    if (m_capacity <= 0)
+        return;
+    Frame f;
+    f.ts = Metrics::now();
+    f.dir = dir;
+    f.data = msg; // implicitly shared, no copy
+    m_frames.enqueue(f);
+    m_bytes += msg.size();
+    while (m_bytes > m_capacity && m_frames.size() > 1)
+        m_bytes -= m_frames.dequeue().data.size();
+}
+
+bool TraceRecorder::dump(const QString &fileName) const
+{
+    QFile f(fileName);
+    if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
+        qWarning() << "Cannot open trace capture file" << fileName << f.errorString();
+        return false;
+    }
+    QDataStream out(&f);
+    out.setByteOrder(QDataStream::LittleEndian);
+    // pcap global header
+    out << PcapMagic << quint16(2) << quint16(4) << qint32(0) << quint32(0) << PcapSnapLen << PcapLinkType;
+    foreach (const Frame &frame, m_frames) {
+        qint64 wall = m_wallBase + frame.ts;
+        out << quint32(wall / 1000000) << quint32(wall % 1000000);
+        out << quint32(frame.data.size() + 1) << quint32(frame.data.size() + 1);
+        out << quint8(frame.dir);
+        out.writeRawData(frame.data.constData(), frame.data.size());
+    }
+    qDebug() << "Dumped" << m_frames.count() << "frames," << m_bytes << "bytes to" << fileName;
+    return out.status() == QDataStream::Ok;
+}
+
+/**
+ * @brief TraceRecorder::analyze
+ * @param fileName - capture produced by TraceRecorder::dump
+ * @param stallUsecs - request/response round trips and traffic gaps longer than that are reported as stalls
+ * @return {"frames", "duration", "endpoints": {id: {tx/rx frames and bytes, bandwidth, rtt}}, "stalls": [], "gaps": []}, "truncated" when a bad record ended the parse
+ *
+ * Round trip is measured per endpoint from the first outgoing frame to the next
+ * incoming frame on the same endpoint, which matches BlobDB, PutBytes and AppMessage flows.
+ */
+QVariantMap TraceRecorder::analyze(const QString &fileName, qint64 stallUsecs)
+{
+    QVariantMap ret;
+    QFile f(fileName);
+    if (!f.open(QFile::ReadOnly)) {
+        ret.insert("error", f.errorString());
+        return ret;
+    }
+    QDataStream in(&f);
+    in.setByteOrder(QDataStream::LittleEndian);
+    quint32 magic, zone, sigfigs, snaplen, link;
+    quint16 major, minor;
+    in >> magic;
+    if (magic != PcapMagic) {
+        in.setByteOrder(QDataStream::BigEndian);
+        if (qbswap(magic) != PcapMagic) {
+            ret.insert("error", QString("Not a pcap file"));
+            return ret;
+        }
+    }
+    in >> major >> minor >> zone >> sigfigs >> snaplen >> link;
+    if (link != PcapLinkType) {
+        ret.insert("error", QString("Unexpected link type %1").arg(link));
+        return ret;
+    }
+
+    struct Stats {
+        quint64 txFrames = 0, rxFrames = 0, txBytes = 0, rxBytes = 0;
+        qint64 first = -1, last = -1, pending = -1;
+        Histogram rtt;
+    };
+    QMap<quint16,Stats> endpoints;
+    QVariantList stalls, gaps;
+    qint64 first = -1, prev = -1;
+    quint64 frames = 0;
+
+    while (!in.atEnd()) {
+        quint32 sec, usec, incl, orig;
+        in >> sec >> usec >> incl >> orig;
+        if (in.status() != QDataStream::Ok || incl < 5)
+            break;
+        // dump() never writes more than the snaplen, anything larger is a damaged or foreign file
+        if (incl > PcapSnapLen || incl > f.bytesAvailable()) {
+            qWarning() << "Bad record length" << incl << "in" << fileName << "after" << frames << "frames";
+            ret.insert("truncated", true);
+            break;
+        }
+        QByteArray pkt(incl, Qt::Uninitialized);
+        if (in.readRawData(pkt.data(), incl) != (int)incl)
+            break;
+        qint64 ts = qint64(sec) * 1000000 + usec;
+        bool outgoing = pkt.at(0) == DirectionOutgoing;
+        quint16 endpoint = qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(pkt.constData()) + 3);
+        frames++;
+
+        if (first < 0)
+            first = ts;
+        if (prev >= 0 && ts - prev > stallUsecs) {
+            QVariantMap gap;
+            gap.insert("at", double(prev - first) / 1000000);
+            gap.insert("duration", double(ts - prev) / 1000000);
+            gap.insert("before", endpoint);
+            gaps.append(gap);
+        }
+        prev = ts;
+
+        Stats &s = endpoints[endpoint];
+        if (s.first < 0)
+            s.first = ts;
+        s.last = ts;
+        if (outgoing) {
+            s.txFrames++;
+            s.txBytes += incl - 1;
+            if (s.pending < 0)
+                s.pending = ts;
+        } else {
+            s.rxFrames++;
+            s.rxBytes += incl - 1;
+            if (s.pending >= 0) {
+                s.rtt.record(ts - s.pending);
+                if (ts - s.pending > stallUsecs) {
+                    QVariantMap stall;
+                    stall.insert("endpoint", endpoint);
+                    stall.insert("at", double(s.pending - first) / 1000000);
+                    stall.insert("duration", double(ts - s.pending) / 1000000);
+                    stalls.append(stall);
+                }
+                s.pending = -1;
+            }
+        }
+    }
+
+    QVariantMap eps;
+    for (QMap<quint16,Stats>::const_iterator it = endpoints.begin(); it != endpoints.end(); ++it) {
+        const Stats &s = it.value();
+        double span = qMax<double>(double(s.last - s.first) / 1000000, 0.001);
+        QVariantMap ep;
+        ep.insert("txFrames", s.txFrames);
+        ep.insert("rxFrames", s.rxFrames);
+        ep.insert("txBytes", s.txBytes);
+        ep.insert("rxBytes", s.rxBytes);
+        ep.insert("txBandwidth", s.txBytes / span);
+        ep.insert("rxBandwidth", s.rxBytes / span);
+        ep.insert("rtt", s.rtt.toVariantMap());
+        if (s.pending >= 0)
+            ep.insert("unanswered", double(prev - s.pending) / 1000000);
+        eps.insert(QString::number(it.key()), ep);
+    }
+    ret.insert("frames", frames);
+    ret.insert("duration", first < 0 ? 0.0 : double(prev - first) / 1000000);
+    ret.insert("endpoints", eps);
+    ret.insert("stalls", stalls);
+    ret.insert("gaps", gaps);
+    return ret;
+}
@@ -0,0 +1,54 @@
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <QObject>
+#include <QQueue>
+#include <QVariantMap>
+
+#include "watchconnection.h"
+
+class Pebble;
+
+// Bounded in-memory capture of all frames on the watch connection. Can be dumped
+// to a pcap file (DLT_USER0, each packet is a direction byte followed by the raw
+// frame with its 4 byte header) and analyzed offline, eg. rockpoold --analyze-trace
+class TraceRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    enum Direction {
+        DirectionIncoming = 0,
+        DirectionOutgoing = 1
+    };
+
+    explicit TraceRecorder(Pebble *pebble, WatchConnection *connection);
+
+    void setCapacity(int bytes);
+    int capacity() const {return m_capacity;}
+
+    bool dump(const QString &fileName) const;
+    static QVariantMap analyze(const QString &fileName, qint64 stallUsecs = 1000000);
+
+private slots:
+    void onRawIncomingMsg(const QByteArray &msg);
+    void onRawOutgoingMsg(const QByteArray &msg);
+
+private:
+    struct Frame {
+        qint64 ts;
+        Direction dir;
+        QByteArray data;
+    };
+    void append(Direction dir, const QByteArray &msg);
+
+    static const quint32 PcapMagic = 0xa1b2c3d4;
+    static const quint32 PcapLinkType = 147; // DLT_USER0
+    static const quint32 PcapSnapLen = 0x10005; // direction byte and the largest frame
+
+    QQueue<Frame> m_frames;
+    int m_bytes = 0;
+    int m_capacity = 1024 * 1024;
+    qint64 m_wallBase;
+};
+
+#endif // TRACERECORDER_H
@@ -1,6 +1,7 @@
 #include "uploadmanager.h"
 #include "watchdatareader.h"
 #include "watchdatawriter.h"
+#include "metrics.h"
 
 static const int CHUNK_SIZE = 2000;
 
@@ -14,13 +15,6 @@ UploadManager::UploadManager(WatchConnection *connection, QObject *parent) :
 uint UploadManager::upload(WatchConnection::UploadType type, int index, quint32 appInstallId, const QString &filename, int size, quint32 crc,
                            SuccessCallback successCallback, ErrorCallback errorCallback, ProgressCallback progressCallback)
 {
-    qDebug() << "Should enqueue uplodad:" << filename;
-    PendingUpload upload;
-    upload.id = ++_lastUploadId;
-    upload.type = type;
-    upload.index = index;
-    upload.filename = filename;
-    upload.appInstallId = appInstallId;
     QFile *f = new QFile(filename);
     if (!f->open(QFile::ReadOnly)) {
         qWarning() << "Error opening file" << filename << "for reading. Cannot upload file";
@@ -28,9 +22,22 @@ uint UploadManager::upload(WatchConnection::UploadType type, int index, quint32
             errorCallback(-1);
         }
     }
-    upload.device = f;
+    return upload(type, index, appInstallId, f, filename, size, crc, successCallback, errorCallback, progressCallback);
+}
+
+uint UploadManager::upload(WatchConnection::UploadType type, int index, quint32 appInstallId, QIODevice *device, const QString &filename, int size, quint32 crc,
+                           SuccessCallback successCallback, ErrorCallback errorCallback, ProgressCallback progressCallback)
+{
+    qDebug() << "Should enqueue uplodad:" << filename;
+    PendingUpload upload;
+    upload.id = ++_lastUploadId;
+    upload.type = type;
+    upload.index = index;
+    upload.filename = filename;
+    upload.appInstallId = appInstallId;
+    upload.device = device;
     if (size < 0) {
-        upload.size = f->size();
+        upload.size = device->size();
     } else {
         upload.size = size;
     }
@@ -82,6 +89,16 @@ uint UploadManager::uploadFirmwareResources(const QString &filename, quint32 crc
     return upload(WatchConnection::UploadTypeSystemResources, 0, 0, filename, -1, crc, successCallback, errorCallback, progressCallback);
 }
 
+uint UploadManager::uploadFirmwareBinary(bool recovery, QIODevice *device, const QString &filename, quint32 crc, SuccessCallback successCallback, ErrorCallback errorCallback, ProgressCallback progressCallback)
+{
+    return upload(recovery ? WatchConnection::UploadTypeRecovery: WatchConnection::UploadTypeFirmware, 0, 0, device, filename, -1, crc, successCallback, errorCallback, progressCallback);
+}
+
+uint UploadManager::uploadFirmwareResources(QIODevice *device, const QString &filename, quint32 crc, SuccessCallback successCallback, ErrorCallback errorCallback, ProgressCallback progressCallback)
+{
+    return upload(WatchConnection::UploadTypeSystemResources, 0, 0, device, filename, -1, crc, successCallback, errorCallback, progressCallback);
+}
+
 uint UploadManager::uploadAppWorker(quint32 appInstallId, const QString &filename, quint32 crc, UploadManager::SuccessCallback successCallback, UploadManager::ErrorCallback errorCallback, UploadManager::ProgressCallback progressCallback)
 {
     return upload(WatchConnection::UploadTypeWorker, -1, appInstallId, filename, -1, crc, successCallback, errorCallback, progressCallback);
@@ -167,6 +184,7 @@ void UploadManager::startNextUpload()
     qDebug() << msg.toHex();
 
     _state = StateWaitForToken;
+    upload.started = Metrics::now();
     m_connection->writeToPebble(WatchConnection::EndpointPutBytes, msg);
 }
 
@@ -316,6 +334,7 @@ void UploadManager::handlePutBytesMessage(const QByteArray &data)
         break;
     case StateComplete:
         qDebug() << "upload" << upload.id << "succesful, invoking callback";
+        emit uploadFinished(upload.type, upload.size, Metrics::now() - upload.started);
         if (upload.successCallback) {
             upload.successCallback();
         }
@@ -4,8 +4,8 @@
 #include "watchdatawriter.h"
 #include "watchdatareader.h"
 #include "watchconnection.h"
+#include "timerwheel.h"
 
-#include <QTimerEvent>
 #include <QDebug>
 
 VoiceEndpoint::VoiceEndpoint(Pebble *pebble, WatchConnection *connection):
@@ -100,7 +100,7 @@ void VoiceEndpoint::handleMessage(const QByteArray &data)
                         qDebug() << "Session Setup Request" << ((flags&FlagAppInitiated)?list.attByType(AttAppUuid).uuid.toString():"");
                         emit sessionSetupRequest(m_appUuid,m_codec);
                         m_sesPhase = PhSetupRequest;
-                        m_sesTimer = startTimer(4000);
+                        m_sesTimer = m_pebble->timers()->start(4000, this, [this]() { sessionTimeout(); });
                     } else {
                         qWarning() << "Invalid attribute set for dictation request" << list.count;
                     }
@@ -137,8 +137,8 @@ void VoiceEndpoint::sessionSetupResponse(Result result, const QUuid &appUuid)
             sessionDestroy();
         } else {
             if(m_sesTimer)
-                killTimer(m_sesTimer);
-            m_sesTimer = startTimer(6000);
+                m_pebble->timers()->stop(m_sesTimer, this);
+            m_sesTimer = m_pebble->timers()->start(6000, this, [this]() { sessionTimeout(); });
         }
     }
 }
@@ -175,11 +175,11 @@ void VoiceEndpoint::handleFrame(const QByteArray &data)
         if(sid != m_sessId)
             return;
         if(m_sesTimer)
-            killTimer(m_sesTimer);
+            m_pebble->timers()->stop(m_sesTimer, this);
         qDebug() << "Pebble finished sending audio at session" << m_sessId;
         emit audioFrame(m_sessId,AudioStream());
         m_sesPhase = PhAudioStopped;
-        m_sesTimer = startTimer(1500);
+        m_sesTimer = m_pebble->timers()->start(1500, this, [this]() { sessionTimeout(); });
     } else {
         qWarning() << "Unknown audio frame type" << data.toHex();
     }
@@ -210,9 +210,9 @@ void VoiceEndpoint::transcriptionResponse(Result result, const QList<Sentence> &
                     m_sesResult.append(data);
                     if(m_sesPhase==PhAudioStopped) {
                         if(m_sesTimer)
-                            killTimer(m_sesTimer);
+                            m_pebble->timers()->stop(m_sesTimer, this);
                         m_sesPhase = PhResultReceived;
-                        m_sesTimer = startTimer(500);
+                        m_sesTimer = m_pebble->timers()->start(500, this, [this]() { sessionTimeout(); });
                     }
                 }
             }
@@ -227,7 +227,7 @@ void VoiceEndpoint::sendDictationResults()
 {
     if(m_sessId>0) {
         if(m_sesTimer) {
-            killTimer(m_sesTimer);
+            m_pebble->timers()->stop(m_sesTimer, this);
             m_sesTimer = 0;
             m_sesPhase = PhResultSent;
         }
@@ -254,7 +254,7 @@ void VoiceEndpoint::sendDictationResults()
 void VoiceEndpoint::sessionDestroy()
 {
     if(m_sesTimer) {
-        killTimer(m_sesTimer);
+        m_pebble->timers()->stop(m_sesTimer, this);
         m_sesTimer = 0;
     }
     m_sesResult.sentences.clear();
@@ -265,36 +265,33 @@ void VoiceEndpoint::sessionDestroy()
     qDebug() << "Session closed, state reset to initial";
 }
 
-void VoiceEndpoint::timerEvent(QTimerEvent *event)
+void VoiceEndpoint::sessionTimeout()
 {
-    if(m_sesTimer > 0 && event && event->timerId() == m_sesTimer) {
-        killTimer(m_sesTimer);
-        m_sesTimer = 0;
-        switch (m_sesPhase) {
-        case PhSetupRequest:
-            sessionSetupResponse(ResTimeout,QUuid());
-            break;
-        case PhSetupComplete:
-            sessionSetupResponse(ResInvalidMessage,QUuid());
-            break;
-        case PhAudioStarted:
-            stopAudioStream(m_sessId);
-            break;
-        case PhAudioStopped:
-            //transcriptionResponse(ResTimeout,QList<Sentence>(),QUuid()); // We should actualy reply like this but lets do...
-            transcriptionResponse(ResSuccess,
-                            QList<Sentence>({
-                                Sentence({8,QList<Word>({{1,2,"No"},{1,3,"one"},{1,5,"dared"},{1,2,"to"},{1,5,"reply"},{1,1,"."},{1,7,"Service"},{1,7,"Timeout"}})})
-                            }),
-                            m_appUuid); // Example transcription - for the reference
-            break;
-        case PhResultReceived:
-            sendDictationResults();
-            sessionDestroy();
-            break;
-        default:
-            qDebug() << "Unhandled timer event for phase" << m_sesPhase;
-        }
+    m_sesTimer = 0;
+    switch (m_sesPhase) {
+    case PhSetupRequest:
+        sessionSetupResponse(ResTimeout,QUuid());
+        break;
+    case PhSetupComplete:
+        sessionSetupResponse(ResInvalidMessage,QUuid());
+        break;
+    case PhAudioStarted:
+        stopAudioStream(m_sessId);
+        break;
+    case PhAudioStopped:
+        //transcriptionResponse(ResTimeout,QList<Sentence>(),QUuid()); // We should actualy reply like this but lets do...
+        transcriptionResponse(ResSuccess,
+                        QList<Sentence>({
+                            Sentence({8,QList<Word>({{1,2,"No"},{1,3,"one"},{1,5,"dared"},{1,2,"to"},{1,5,"reply"},{1,1,"."},{1,7,"Service"},{1,7,"Timeout"}})})
+                        }),
+                        m_appUuid); // Example transcription - for the reference
+        break;
+    case PhResultReceived:
+        sendDictationResults();
+        sessionDestroy();
+        break;
+    default:
+        qDebug() << "Unhandled timer event for phase" << m_sesPhase;
     }
 }
 
@@ -158,9 +158,6 @@ public slots:
     void handleMessage(const QByteArray &data);
     void handleFrame(const QByteArray &data);
 
-protected:
-    void timerEvent(QTimerEvent *event) override;
-
 public slots:
     void sessionSetupResponse(Result result, const QUuid &appUuid);
     void transcriptionResponse(Result result, const QList<Sentence> &data, const QUuid &appUuid);
@@ -170,6 +167,7 @@ public slots:
     void sessionDestroy();
 
 private:
+    void sessionTimeout();
     static inline AttributeList readAttributes(WatchDataReader &reader);
 
     enum SessionPhase {
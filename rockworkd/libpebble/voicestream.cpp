@@ -0,0 +1,157 @@
+#include "voicestream.h"
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QStandardPaths>
+#include <QDebug>
+
+#include <speex/speex.h>
+
+SpeexDecoder::SpeexDecoder(const SpeexInfo &codec)
+{
+    int mode = SPEEX_MODEID_NB;
+    if(codec.sampleRate >= 32000)
+        mode = SPEEX_MODEID_UWB;
+    else if(codec.sampleRate >= 16000)
+        mode = SPEEX_MODEID_WB;
+    m_state = speex_decoder_init(speex_lib_get_mode(mode));
+    int enhance = 1;
+    speex_decoder_ctl(m_state, SPEEX_SET_ENH, &enhance);
+    speex_decoder_ctl(m_state, SPEEX_GET_FRAME_SIZE, &m_frameSize);
+    SpeexBits *bits = new SpeexBits;
+    speex_bits_init(bits);
+    m_bits = bits;
+}
+
+SpeexDecoder::~SpeexDecoder()
+{
+    SpeexBits *bits = static_cast<SpeexBits*>(m_bits);
+    speex_bits_destroy(bits);
+    delete bits;
+    speex_decoder_destroy(m_state);
+}
+
+int SpeexDecoder::frameSize() const
+{
+    return m_frameSize;
+}
+
+void SpeexDecoder::decode(const QList<QByteArray> &packets)
+{
+    SpeexBits *bits = static_cast<SpeexBits*>(m_bits);
+    QByteArray pcm(packets.count() * m_frameSize * sizeof(spx_int16_t), Qt::Uninitialized);
+    spx_int16_t *out = reinterpret_cast<spx_int16_t*>(pcm.data());
+    int decoded = 0;
+    foreach(const QByteArray &packet, packets) {
+        speex_bits_read_from(bits, const_cast<char*>(packet.constData()), packet.size());
+        int res = speex_decode_int(m_state, bits, out + decoded * m_frameSize);
+        if(res != 0) {
+            // Lost or corrupt packet, let the decoder conceal it rather than leave a gap
+            qWarning() << "Cannot decode speex packet of" << packet.size() << "bytes:" << res;
+            speex_decode_int(m_state, nullptr, out + decoded * m_frameSize);
+        }
+        decoded++;
+    }
+    pcm.resize(decoded * m_frameSize * sizeof(spx_int16_t));
+    emit pcmReady(pcm);
+}
+
+void SpeexDecoder::flush()
+{
+    // Queued after every decode() of the session, so all audio is out by now
+    emit flushed();
+}
+
+VoiceStream::VoiceStream(const SpeexInfo &codec, const QString &name, QObject *parent):
+    QObject(parent),
+    m_decoder(new SpeexDecoder(codec)),
+    m_server(new QLocalServer(this)),
+    m_sampleRate(codec.sampleRate)
+{
+    qRegisterMetaType<QList<QByteArray> >("QList<QByteArray>");
+
+    m_decoder->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_decoder, &QObject::deleteLater);
+    connect(this, &VoiceStream::decode, m_decoder, &SpeexDecoder::decode);
+    connect(this, &VoiceStream::flush, m_decoder, &SpeexDecoder::flush);
+    connect(m_decoder, &SpeexDecoder::pcmReady, this, &VoiceStream::pcmReady);
+    connect(m_decoder, &SpeexDecoder::flushed, this, &VoiceStream::flushed);
+    m_thread.setObjectName("VoiceStream");
+    m_thread.start();
+
+    QString path = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + "/rockpool-voice-" + name;
+    QLocalServer::removeServer(path);
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(m_server, &QLocalServer::newConnection, this, &VoiceStream::newConnection);
+    if(!m_server->listen(path))
+        qWarning() << "Cannot listen for voice stream clients on" << path << m_server->errorString();
+}
+
+VoiceStream::~VoiceStream()
+{
+    m_server->close();
+    m_thread.quit();
+    m_thread.wait();
+}
+
+bool VoiceStream::isListening() const
+{
+    return m_server->isListening();
+}
+
+QString VoiceStream::socketPath() const
+{
+    return m_server->fullServerName();
+}
+
+QString VoiceStream::contentType() const
+{
+    return QString("audio/x-raw; format=S16LE; rate=%1; channels=1").arg(m_sampleRate);
+}
+
+void VoiceStream::addFrames(const AudioStream &frames)
+{
+    QList<QByteArray> packets;
+    foreach(const Frame &frame, frames.frames)
+        packets.append(frame.data);
+    if(!packets.isEmpty())
+        emit decode(packets);
+}
+
+void VoiceStream::finish()
+{
+    emit flush();
+}
+
+void VoiceStream::pcmReady(const QByteArray &pcm)
+{
+    m_pcm.append(pcm);
+    foreach(QLocalSocket *client, m_clients)
+        client->write(pcm);
+}
+
+void VoiceStream::flushed()
+{
+    qDebug() << "Voice stream complete," << m_pcm.size() << "bytes of PCM sent to" << m_clients.count() << "clients";
+    m_finished = true;
+    foreach(QLocalSocket *client, m_clients)
+        client->disconnectFromServer();
+}
+
+void VoiceStream::newConnection()
+{
+    while(m_server->hasPendingConnections()) {
+        QLocalSocket *client = m_server->nextPendingConnection();
+        // Late joiners catch up with what has been said so far
+        client->write(m_pcm);
+        if(m_finished) {
+            client->disconnectFromServer();
+            continue;
+        }
+        m_clients.append(client);
+        connect(client, &QLocalSocket::disconnected, this, [this,client](){
+            m_clients.removeAll(client);
+            client->deleteLater();
+        });
+    }
+}
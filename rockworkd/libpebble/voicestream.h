@@ -0,0 +1,77 @@
+#ifndef VOICESTREAM_H
+#define VOICESTREAM_H
+
+#include "voiceendpoint.h"
+
+#include <QObject>
+#include <QThread>
+#include <QList>
+
+QT_FORWARD_DECLARE_CLASS(QLocalServer)
+QT_FORWARD_DECLARE_CLASS(QLocalSocket)
+
+// Lives on the VoiceStream worker thread, turns Speex packets into 16bit PCM
+class SpeexDecoder : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SpeexDecoder(const SpeexInfo &codec);
+    ~SpeexDecoder();
+
+    int frameSize() const;
+
+public slots:
+    void decode(const QList<QByteArray> &packets);
+    void flush();
+
+signals:
+    void pcmReady(const QByteArray &pcm);
+    void flushed();
+
+private:
+    void *m_state = nullptr;
+    void *m_bits = nullptr;
+    int m_frameSize = 0;
+};
+
+/**
+ * @brief The VoiceStream class decodes the audio of a voice session while it is being
+ * recorded and serves it as raw S16LE mono PCM on a unix socket. Every client gets the
+ * whole session from the beginning and then follows it live; the socket is closed at
+ * end of speech so EOF marks the end of the utterance.
+ */
+class VoiceStream : public QObject
+{
+    Q_OBJECT
+public:
+    VoiceStream(const SpeexInfo &codec, const QString &name, QObject *parent);
+    ~VoiceStream();
+
+    bool isListening() const;
+    QString socketPath() const;
+    QString contentType() const;
+
+public slots:
+    void addFrames(const AudioStream &frames);
+    void finish();
+
+signals:
+    void decode(const QList<QByteArray> &packets);
+    void flush();
+
+private slots:
+    void pcmReady(const QByteArray &pcm);
+    void flushed();
+    void newConnection();
+
+private:
+    QThread m_thread;
+    SpeexDecoder *m_decoder;
+    QLocalServer *m_server;
+    QList<QLocalSocket*> m_clients;
+    QByteArray m_pcm;
+    quint32 m_sampleRate;
+    bool m_finished = false;
+};
+
+#endif // VOICESTREAM_H
@@ -2,6 +2,7 @@
 #include "watchdatareader.h"
 #include "watchdatawriter.h"
 #include "uploadmanager.h"
+#include "metrics.h"
 
 #include <QDBusConnection>
 #include <QDBusReply>
@@ -12,9 +13,14 @@
 #include <QtEndian>
 #include <QDateTime>
 
+// Bytes the socket may hold before the next frame is handed over. The kernel keeps the
+// link busy in the meantime, this only bounds what a call control frame has to wait for.
+static const qint64 WRITE_WINDOW = 1024;
+
 WatchConnection::WatchConnection(QObject *parent) :
     QObject(parent),
-    m_socket(nullptr)
+    m_socket(nullptr),
+    m_reconnectTimer(this) // parented so it follows moveToThread()
 {
     m_reconnectTimer.setSingleShot(true);
     QObject::connect(&m_reconnectTimer, &QTimer::timeout, this, &WatchConnection::reconnect);
@@ -74,7 +80,8 @@ void WatchConnection::reconnect()
     connect(m_socket, &QBluetoothSocket::readyRead, this, &WatchConnection::readyRead);
     connect(m_socket, SIGNAL(error(QBluetoothSocket::SocketError)), this, SLOT(socketError(QBluetoothSocket::SocketError)));
     connect(m_socket, &QBluetoothSocket::disconnected, this, &WatchConnection::pebbleDisconnected);
-    //connect(socket, SIGNAL(bytesWritten(qint64)), SLOT(onBytesWritten(qint64)));
+    connect(m_socket, &QBluetoothSocket::bytesWritten, this, &WatchConnection::bytesWritten);
+    dropWrites();
 
     m_connectionAttempts++;
 
@@ -118,7 +125,92 @@ void WatchConnection::writeToPebble(Endpoint endpoint, const QByteArray &data)
 void WatchConnection::writeRawData(const QByteArray &msg)
 {
     //qDebug() << "Writing:" << msg.toHex();
-    m_socket->write(msg);
+    Lane lane = LaneNormal;
+    if (msg.size() >= 4) {
+        switch (qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(msg.constData()) + 2)) {
+        case EndpointPhoneControl:
+            lane = LaneFast;
+            break;
+        case EndpointPutBytes:
+        case EndpointBlobDB:
+            lane = LaneBulk;
+            break;
+        default:
+            break;
+        }
+    }
+    QueuedFrame frame;
+    frame.data = msg;
+    frame.queued = Metrics::now();
+    m_lanes[lane].enqueue(frame);
+    flushWrites();
+}
+
+void WatchConnection::setBulkPaused(bool paused)
+{
+    if (m_bulkPaused == paused) {
+        return;
+    }
+    qDebug() << (paused ? "Pausing" : "Resuming") << "bulk transfers," << m_lanes[LaneBulk].count() << "frames queued";
+    m_bulkPaused = paused;
+    flushWrites();
+}
+
+bool WatchConnection::bulkPaused() const
+{
+    return m_bulkPaused;
+}
+
+void WatchConnection::flushWrites()
+{
+    if (!m_socket || m_socket->state() != QBluetoothSocket::ConnectedState) {
+        return;
+    }
+    while (m_socket->bytesToWrite() < WRITE_WINDOW) {
+        QQueue<QueuedFrame> *queue = nullptr;
+        if (!m_lanes[LaneFast].isEmpty()) {
+            queue = &m_lanes[LaneFast];
+        } else if (!m_lanes[LaneNormal].isEmpty()) {
+            queue = &m_lanes[LaneNormal];
+        } else if (!m_bulkPaused && !m_lanes[LaneBulk].isEmpty()) {
+            queue = &m_lanes[LaneBulk];
+        } else {
+            return;
+        }
+
+        QueuedFrame frame = queue->dequeue();
+        if (frame.data.size() >= 4) {
+            PendingWrite w;
+            w.endpoint = (Endpoint)qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(frame.data.constData()) + 2);
+            w.queued = frame.queued;
+            w.remaining = frame.data.size();
+            m_pendingWrites.enqueue(w);
+        }
+        m_socket->write(frame.data);
+    }
+}
+
+void WatchConnection::dropWrites()
+{
+    for (int lane = 0; lane < LaneCount; lane++) {
+        m_lanes[lane].clear();
+    }
+    m_pendingWrites.clear();
+}
+
+void WatchConnection::bytesWritten(qint64 bytes)
+{
+    while (bytes > 0 && !m_pendingWrites.isEmpty()) {
+        PendingWrite &w = m_pendingWrites.head();
+        qint64 chunk = qMin(bytes, w.remaining);
+        w.remaining -= chunk;
+        bytes -= chunk;
+        if (w.remaining == 0) {
+            emit frameWritten(w.endpoint, Metrics::now() - w.queued);
+            m_pendingWrites.dequeue();
+        }
+    }
+    flushWrites();
 }
 
 void WatchConnection::systemMessage(WatchConnection::SystemMessage msg)
@@ -151,6 +243,7 @@ void WatchConnection::pebbleConnected()
 void WatchConnection::pebbleDisconnected()
 {
     qDebug() << "Disconnected";
+    dropWrites();
     emit watchDisconnected();
     if (!m_reconnectTimer.isActive()) {
         scheduleReconnect();
@@ -199,7 +292,9 @@ void WatchConnection::readyRead()
     if (m_endpointHandlers.contains(endpoint)) {
         if (m_endpointHandlers.contains(endpoint)) {
             Callback cb = m_endpointHandlers.value(endpoint);
+            qint64 start = Metrics::now();
             QMetaObject::invokeMethod(cb.obj.data(), cb.method.toLatin1(), Q_ARG(QByteArray, data));
+            emit frameDispatched(endpoint, Metrics::now() - start);
         }
     } else {
         qWarning() << "Have message for unhandled endpoint" << endpoint << data.toHex();
@@ -7,6 +7,7 @@
 #include <QBluetoothLocalDevice>
 #include <QtEndian>
 #include <QPointer>
+#include <QQueue>
 #include <QTimer>
 #include <QFile>
 
@@ -120,6 +121,9 @@ public:
 
     void writeRawData(const QByteArray &data);
     void writeToPebble(Endpoint endpoint, const QByteArray &data);
+    // Holds back PutBytes and BlobDB frames, everything else keeps flowing
+    void setBulkPaused(bool paused);
+    bool bulkPaused() const;
     void systemMessage(SystemMessage msg);
 
     bool registerEndpointHandler(Endpoint endpoint, QObject *handler, const QString &method);
@@ -132,9 +136,16 @@ signals:
     void rawOutgoingMsg(QByteArray &msg);
     void rawIncomingMsg(QByteArray &msg);
 
+    // Timings in usecs: handler run time for incoming frames, time from queueing until the
+    // socket took it for outgoing
+    void frameDispatched(Endpoint endpoint, qint64 usecs);
+    void frameWritten(Endpoint endpoint, qint64 usecs);
+
 private:
     void scheduleReconnect();
     void reconnect();
+    void flushWrites();
+    void dropWrites();
 
 private slots:
     void hostModeStateChanged(QBluetoothLocalDevice::HostMode state);
@@ -142,6 +153,7 @@ private slots:
     void pebbleDisconnected();
     void socketError(QBluetoothSocket::SocketError error);
     void readyRead();
+    void bytesWritten(qint64 bytes);
 //    void logData(const QByteArray &data);
 
 
@@ -154,6 +166,28 @@ private:
 
     UploadManager *m_uploadManager;
     QHash<Endpoint, Callback> m_endpointHandlers;
+
+    // Frames wait here until the socket buffer drains, so call control can overtake
+    // bulk transfers which would otherwise sit in front of it
+    enum Lane {
+        LaneFast,
+        LaneNormal,
+        LaneBulk,
+        LaneCount
+    };
+    struct QueuedFrame {
+        QByteArray data;
+        qint64 queued;
+    };
+    QQueue<QueuedFrame> m_lanes[LaneCount];
+    bool m_bulkPaused = false;
+
+    struct PendingWrite {
+        Endpoint endpoint;
+        qint64 queued;
+        qint64 remaining;
+    };
+    QQueue<PendingWrite> m_pendingWrites;
 };
 
 #endif // WATCHCONNECTION_H
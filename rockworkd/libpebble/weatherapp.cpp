@@ -1,6 +1,7 @@
 #include "weatherapp.h"
 
 #include "blobdb.h"
+#include "metrics.h"
 #include "watchdatawriter.h"
 #include "platforminterface.h"
 
@@ -167,7 +168,7 @@ bool WeatherApp::Observation::operator==(const WeatherApp::Observation &that) co
 {
     if(temp_now!=that.temp_now) return false;
     if(today.condition != that.today.condition || today.temp_hi != that.today.temp_hi || today.temp_low != that.today.temp_low) return false;
-    if(tomorrow.condition != that.tomorrow.condition || tomorrow.temp_hi != that.tomorrow.temp_hi || tomorrow.temp_low != tomorrow.temp_low) return false;
+    if(tomorrow.condition != that.tomorrow.condition || tomorrow.temp_hi != that.tomorrow.temp_hi || tomorrow.temp_low != that.tomorrow.temp_low) return false;
     if(text != that.text) return false;
     return true;
 }
@@ -215,9 +216,15 @@ void WeatherApp::Forecast::reorder(const QStringList &newOrder)
     m_locOrder = newOrder;
 }
 
+/**
+ * @brief WeatherApp::Forecast::equal compares forecasts as far as the produced pins are concerned
+ * @param daypart 0 for the day (sunrise) pin, positive for the night (sunset) pin, negative for both
+ */
 bool WeatherApp::Forecast::equal(const Forecast &that, int daypart) const
 {
-    if(sunrise != that.sunrise || sunset != that.sunset) return false;
+    if(daypart <= 0 && sunrise != that.sunrise) return false;
+    if(daypart != 0 && sunset != that.sunset) return false;
+    if(locationName != that.locationName) return false;
     if(m_here.min_temp != that.m_here.min_temp || m_here.max_temp != that.m_here.max_temp) return false;
     if(m_cities.size() != that.m_cities.size()) return false;
     if(m_locOrder != that.m_locOrder) return false;
@@ -225,14 +232,14 @@ bool WeatherApp::Forecast::equal(const Forecast &that, int daypart) const
         if(!that.m_cities.contains(key)) return false;
         if(m_cities.value(key).min_temp != that.m_cities.value(key).min_temp) return false;
         if(m_cities.value(key).max_temp != that.m_cities.value(key).max_temp) return false;
-        if((daypart < 0 || daypart == 0) && m_cities.value(key).day_text != that.m_cities.value(key).day_text) return false;
-        if((daypart < 0 || daypart < 0) && m_cities.value(key).night_text != that.m_cities.value(key).night_text) return false;
+        if(daypart <= 0 && m_cities.value(key).day_text != that.m_cities.value(key).day_text) return false;
+        if(daypart != 0 && m_cities.value(key).night_text != that.m_cities.value(key).night_text) return false;
     }
-    if(daypart < 0 || daypart == 0) {
+    if(daypart <= 0) {
         if(day_icon != that.day_icon) return false;
         if(m_here.day_text != that.m_here.day_text) return false;
     }
-    if(daypart < 0 || daypart > 0) {
+    if(daypart != 0) {
         if(night_icon != that.night_icon) return false;
         if(m_here.night_text != that.m_here.night_text) return false;
     }
@@ -328,26 +335,36 @@ void WeatherApp::setProvider(WeatherProvider *provider)
 /**
  * @brief WeatherApp::updateForecasts repopulates forecasts into Timeline.
  * @param fcstBuf list of forecasts, should be presented in correct order of days, from
- * today to WeatherApp::m_fcstDays days after today. Pin is repopulated only if it
- * does not equal to the one already cached in memory (eg. forecast changed).
+ * today to WeatherApp::m_fcstDays days after today. Day and night pins are compared
+ * separately against the ones already pushed and only the changed ones are repopulated.
  * @param provider optional string which should reflect Weather Provider name
  * (eg. "The Weather Channel")
  */
 void WeatherApp::updateForecasts(const QList<Forecast> &fcstBuf, const QString &provider)
 {
+    int pushed = 0;
+    bool providerChanged = (provider != m_providerName);
+    m_providerName = provider;
     for(int i=0;i<fcstBuf.size();i++) {
-        if(m_forecasts.size()>i && fcstBuf.at(i).equal(m_forecasts.at(i))) {
-            continue;
+        const Forecast &fcst = fcstBuf.at(i);
+        bool known = !providerChanged && m_forecasts.size()>i;
+        if((i>0 || fcst.isValid()) && !(known && fcst.equal(m_forecasts.at(i),0))) {
+            m_pebble->insertPin(fcst.getPin(i,false,provider));
+            pushed++;
+        }
+        if(!(known && fcst.equal(m_forecasts.at(i),1))) {
+            m_pebble->insertPin(fcst.getPin(i,true,provider));
+            pushed++;
         }
-        if(i>0 || fcstBuf.at(0).isValid())
-            m_pebble->insertPin(fcstBuf.at(i).getPin(i,false,provider));
-        m_pebble->insertPin(fcstBuf.at(i).getPin(i,true,provider));
         if(m_forecasts.size()<=i) {
             m_forecasts.append(fcstBuf.at(i));
         } else {
             m_forecasts.replace(i,fcstBuf.at(i));
         }
     }
+    qDebug() << "Pushed" << pushed << "of" << fcstBuf.size()*2 << "forecast pins";
+    m_pebble->metrics()->count("weather.pins.pushed",pushed);
+    m_pebble->metrics()->count("weather.pins.skipped",fcstBuf.size()*2-pushed);
 }
 
 QVariantList WeatherApp::getLocations() const
@@ -403,12 +420,13 @@ void WeatherApp::setLocations(const QVariantList &locs, bool push)
             else
                 m_provider->refreshWeather();
         } else if(push) {
-            // Mere reorder, keep the data as is
+            // Mere reorder, keep the data as is. Pins list cities in order so all of them change
             for(int i=0;i<m_forecasts.size();i++) {
                 Forecast &f = m_forecasts[i];
                 f.reorder(locOrder);
-                if(f.isValid(i/2==1))
-                    m_pebble->insertPin(f.getPin(i/2,i%2==1));
+                if(i>0 || f.isValid())
+                    m_pebble->insertPin(f.getPin(i,false,m_providerName));
+                m_pebble->insertPin(f.getPin(i,true,m_providerName));
             }
             m_locUpdated = true; // to allow update
             updateConfig();
@@ -442,8 +460,11 @@ void WeatherApp::injectObservation(const QString &l, const Observation &obs, boo
         qDebug() << "Updating observation data for" << l << wo.serialize().toHex();
         m_pebble->blobdb()->insert(BlobDB::BlobDBIdWeatherData,wo);
         m_obss.insert(loc.uuid,obs);
-    } else
+        m_pebble->metrics()->count("weather.observations.pushed");
+    } else {
         qDebug() << "Ignoring observation data for" << l;
+        m_pebble->metrics()->count("weather.observations.skipped");
+    }
 }
 
 void WeatherApp::blobdbAckHandler(quint8 db, quint8 cmd, const QByteArray &key, quint8 ack)
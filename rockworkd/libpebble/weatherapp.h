@@ -131,6 +131,7 @@ private:
     int m_fcstDays = 5;
     QHash<QUuid,Observation> m_obss;
     QList<Forecast> m_forecasts;
+    QString m_providerName;
     Pebble *m_pebble;
     WeatherProvider *m_provider;
 };
@@ -1,19 +1,17 @@
 #include "webweatherprovider.h"
 
 #include "pebble.h"
-
-#include <QTimerEvent>
-
-#include <QGeoPositionInfoSource>
-#include <QGeoPositionInfo>
+#include "metrics.h"
+#include "timerwheel.h"
+#include "positionservice.h"
 
 #include <QNetworkRequest>
 #include <QNetworkReply>
+#include <QLocale>
 
 WebWeatherProvider::WebWeatherProvider(Pebble *pebble, WatchConnection *connection, WeatherApp *weatherApp) :
     QObject(pebble),
     m_nam(pebble->nam()),
-    m_gps(nullptr),
     m_pebble(pebble),
     m_connection(connection),
     m_weatherApp(weatherApp)
@@ -22,15 +20,15 @@ WebWeatherProvider::WebWeatherProvider(Pebble *pebble, WatchConnection *connecti
 }
 WebWeatherProvider::~WebWeatherProvider()
 {
-    if(m_gps) delete m_gps;
 }
 
 void WebWeatherProvider::setApiKey(const QString &key)
 {
     m_apiKey = key;
     if(!m_apiKey.isEmpty()) {
-        startTimer(refreshInterval);
-        timerEvent(0);
+        if(!m_refreshTimer)
+            m_refreshTimer = m_pebble->timers()->start(refreshInterval, this, [this]() { updateWeather(); }, true);
+        updateWeather();
     }
 }
 
@@ -38,7 +36,7 @@ void WebWeatherProvider::setLanguage(const QString &lang)
 {
     if(!lang.isEmpty()) {
         m_language = lang;
-        timerEvent(0);
+        updateWeather();
     }
 }
 
@@ -58,33 +56,24 @@ void WebWeatherProvider::setUnits(const QChar &u)
 
 void WebWeatherProvider::refreshWeather()
 {
-    timerEvent(0);
-}
-
-void WebWeatherProvider::initGPS()
-{
-    if (!m_gps) {
-        m_gps = QGeoPositionInfoSource::createDefaultSource(this);
-
-        connect(m_gps, static_cast<void (QGeoPositionInfoSource::*)(QGeoPositionInfoSource::Error)>(&QGeoPositionInfoSource::error), this, &WebWeatherProvider::gpsError);
-        connect(m_gps, &QGeoPositionInfoSource::positionUpdated, this, &WebWeatherProvider::gotPosition);
-        connect(m_gps, &QGeoPositionInfoSource::updateTimeout, this, &WebWeatherProvider::gpsTimeout);
-    }
+    updateWeather();
 }
 
 void WebWeatherProvider::watchConnected()
 {
     if(m_updateMissed) {
         m_updateMissed = false;
-        timerEvent(0);
+        updateWeather();
     }
 }
 
-void WebWeatherProvider::timerEvent(QTimerEvent *e)
+void WebWeatherProvider::updateWeather()
 {
     if(m_apiKey.isEmpty() || m_weatherApp->locOrder().isEmpty()) {
-        if(m_apiKey.isEmpty() && e)
-            killTimer(e->timerId());
+        if(m_apiKey.isEmpty() && m_refreshTimer) {
+            m_pebble->timers()->stop(m_refreshTimer, this);
+            m_refreshTimer = 0;
+        }
         qDebug() << "API Key" << m_apiKey << "or Locations" << m_weatherApp->locOrder() << "are empty, ignoring update";
         return;
     }
@@ -96,13 +85,12 @@ void WebWeatherProvider::timerEvent(QTimerEvent *e)
     // This could be called more frequently, suppress fast updates, meteo stations are slow
     if(m_lastUpdated.isValid() && m_lastUpdated.addSecs(300) > QDateTime::currentDateTime())
         return;
-    initGPS();
-    QGeoPositionInfo gpi = m_gps->lastKnownPosition();
-    if(gpi.isValid() && gpi.timestamp().addSecs(300)>QDateTime::currentDateTimeUtc()) {
-        gotPosition(gpi);
-    } else {
-        m_gps->requestUpdate();
-    }
+    m_pebble->positions()->requestPosition(300000, -1, false, this, [this](const QGeoPositionInfo &gpi, PositionService::Error error) {
+        if(error == PositionService::NoError)
+            gotPosition(gpi);
+        else
+            qWarning() << "Error getting location data" << error;
+    });
 }
 void WebWeatherProvider::gotPosition(const QGeoPositionInfo &gpi)
 {
@@ -114,42 +102,108 @@ void WebWeatherProvider::gotPosition(const QGeoPositionInfo &gpi)
         updateForecast();
 }
 
-void WebWeatherProvider::gpsError(int err)
-{
-    qWarning() << "Error getting location data" << err;
-}
-
-void WebWeatherProvider::gpsTimeout()
+void WebWeatherProvider::updateForecast()
 {
-    qWarning() << "Timeout getting location data";
+    if(urlTemplate().isEmpty()) {
+        qWarning() << "Cannot get forecasts from empty URL template";
+        return;
+    }
+    // Forget replies for locations which are gone
+    foreach(const QString &l, m_replyCache.keys()) {
+        if(!m_weatherApp->locOrder().contains(l))
+            m_replyCache.remove(l);
+    }
+    // Requests still in flight from the previous round only free their slot, results are ignored
+    m_fetchRound++;
+    m_fetchQueue = m_weatherApp->locOrder();
+    fetchNext();
 }
 
-void WebWeatherProvider::updateForecast()
+void WebWeatherProvider::fetchNext()
 {
     QString urlTemp = urlTemplate();
     if(urlTemp.isEmpty()) {
-        qWarning() << "Cannot get forecasts from empty URL template" << urlTemp;
+        m_fetchQueue.clear();
         return;
     }
-    foreach(const QString &l, m_weatherApp->locOrder()) {
+    while(m_fetchesInFlight < maxConcurrentFetches && !m_fetchQueue.isEmpty()) {
+        QString l = m_fetchQueue.takeFirst();
         WeatherApp::Location loc = m_weatherApp->getLocation(l);
         QUrl url(urlTemp.arg(loc.lat,loc.lng));
+        // Providers aggregate all locations into one forecast, so fresh data is replayed rather than skipped
+        CachedReply cached = m_replyCache.value(l);
+        if(cached.url == url && cached.expires > QDateTime::currentDateTimeUtc()) {
+            qDebug() << "Weather data for" << l << "is fresh until" << cached.expires;
+            m_pebble->metrics()->count("weather.fetch.cached");
+            processLocation(l,cached.data);
+            continue;
+        }
         QNetworkRequest req(url);
         QNetworkReply *rpl = m_nam->get(req);
+        m_fetchesInFlight++;
+        m_pebble->metrics()->count("weather.fetch");
         qDebug() << "Fetching weather data for" << l << "from" << url;
-        connect(rpl,&QNetworkReply::finished, [this,l,rpl](){
+        quint32 round = m_fetchRound;
+        connect(rpl,&QNetworkReply::finished, [this,l,url,rpl,round](){
             rpl->deleteLater();
+            m_fetchesInFlight--;
             QByteArray reply = rpl->readAll();
             //qDebug() << reply;
-            if(rpl->error() == QNetworkReply::NoError) {
+            if(round != m_fetchRound) {
+                qDebug() << "Dropping weather data for" << l << "from superseded update";
+            } else if(rpl->error() == QNetworkReply::NoError) {
+                CachedReply c;
+                c.url = url;
+                c.data = reply;
+                c.expires = replyExpiry(rpl);
+                m_replyCache.insert(l,c);
                 processLocation(l,reply);
                 m_lastUpdated = QDateTime::currentDateTime();
             } else if(rpl->error() == QNetworkReply::AuthenticationRequiredError) {
                 m_apiKey.clear();
+                m_fetchQueue.clear();
                 qWarning() << "Wrong Authorisation or API key" << rpl->errorString();
             } else {
                 qWarning() << "Error fetching Weather data" << rpl->errorString();
             }
+            fetchNext();
         });
     }
 }
+
+static QDateTime parseHttpDate(const QByteArray &value)
+{
+    // RFC 7231 IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+    QDateTime ret = QLocale::c().toDateTime(QString::fromLatin1(value).simplified().remove(" GMT"), "ddd, dd MMM yyyy hh:mm:ss");
+    ret.setTimeSpec(Qt::UTC);
+    return ret;
+}
+
+/**
+ * @brief WebWeatherProvider::replyExpiry works out how long the provider allows its reply to be reused.
+ * @return expiry time in UTC, invalid if the reply must not be cached
+ */
+QDateTime WebWeatherProvider::replyExpiry(QNetworkReply *rpl)
+{
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    QByteArray cacheControl = rpl->rawHeader("Cache-Control").toLower();
+    if(cacheControl.contains("no-store") || cacheControl.contains("no-cache"))
+        return QDateTime();
+    foreach(QByteArray directive, cacheControl.split(',')) {
+        directive = directive.trimmed();
+        if(directive.startsWith("max-age=")) {
+            qint64 maxAge = directive.mid(8).toLongLong() - rpl->rawHeader("Age").toLongLong();
+            return maxAge > 0 ? now.addSecs(maxAge) : QDateTime();
+        }
+    }
+    if(rpl->hasRawHeader("Expires")) {
+        QDateTime expires = parseHttpDate(rpl->rawHeader("Expires"));
+        if(!expires.isValid())
+            return QDateTime();
+        // Expires is in server time, measure it against the server's Date to stay clock-skew proof
+        QDateTime date = parseHttpDate(rpl->rawHeader("Date"));
+        qint64 ttl = date.isValid() ? date.secsTo(expires) : now.secsTo(expires);
+        return ttl > 0 ? now.addSecs(ttl) : QDateTime();
+    }
+    return QDateTime();
+}
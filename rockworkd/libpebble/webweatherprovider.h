@@ -3,10 +3,12 @@
 
 #include "weatherapp.h"
 
+#include <QUrl>
+
 class WatchConnection;
 
 class QNetworkAccessManager;
-class QGeoPositionInfoSource;
+class QNetworkReply;
 class QGeoPositionInfo;
 
 class WebWeatherProvider : public QObject, public WeatherProvider
@@ -14,6 +16,7 @@ class WebWeatherProvider : public QObject, public WeatherProvider
     Q_OBJECT
 public:
     static const quint32 refreshInterval = 60 * 60 * 1000;
+    static const int maxConcurrentFetches = 3;
 
     WebWeatherProvider(Pebble *pebble, WatchConnection *conneciton, WeatherApp *weatherApp);
     virtual ~WebWeatherProvider() override;
@@ -30,20 +33,33 @@ public slots:
     void refreshWeather();
 
 protected slots:
-    void timerEvent(QTimerEvent *) override;
+    void updateWeather();
 
-    void initGPS();
-    void gpsError(int);
-    void gpsTimeout();
     void gotPosition(const QGeoPositionInfo &gpi);
     void updateForecast();
+    void fetchNext();
     void watchConnected();
 
     virtual QString urlTemplate() const = 0;
     virtual void processLocation(const QString &locationName, const QByteArray &replyData) = 0;
 
 protected:
+    // Last reply per location, replayed while the provider says it is still fresh
+    struct CachedReply {
+        QUrl url;
+        QByteArray data;
+        QDateTime expires;
+    };
+    static QDateTime replyExpiry(QNetworkReply *rpl);
+
+    QStringList m_fetchQueue;
+    int m_fetchesInFlight = 0;
+    // Bumped by every updateForecast, replies from earlier rounds are dropped
+    quint32 m_fetchRound = 0;
+    QHash<QString,CachedReply> m_replyCache;
+
     QDateTime m_lastUpdated;
+    int m_refreshTimer = 0;
     bool m_updateMissed = false;
     int m_fcstDays = 5;
     QString m_language = "en-US";
@@ -51,7 +67,6 @@ protected:
 
     QString m_apiKey;
     QNetworkAccessManager *m_nam;
-    QGeoPositionInfoSource *m_gps;
     Pebble *m_pebble;
     WatchConnection *m_connection;
     WeatherApp *m_weatherApp;
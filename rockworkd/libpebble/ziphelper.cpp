@@ -42,7 +42,14 @@ bool ZipHelper::unpackArchive(const QString &archiveFilename, const QString &tar
             f.close();
             return false;
         }
-        of.write(f.readAll());
+        while (!f.atEnd()) {
+            QByteArray chunk = f.read(64 * 1024);
+            if (chunk.isEmpty() || of.write(chunk) != chunk.size()) {
+                qWarning() << "Error inflating" << fi.name << f.errorString() << of.errorString();
+                f.close();
+                return false;
+            }
+        }
         f.close();
         of.close();
     }
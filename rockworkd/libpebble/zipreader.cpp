@@ -0,0 +1,169 @@
+#include "zipreader.h"
+
+#include <climits>
+
+#include <QtEndian>
+#include <QDebug>
+
+#include <zlib.h>
+
+static const quint32 LocalHeaderSignature = 0x04034b50;
+static const quint32 CentralHeaderSignature = 0x02014b50;
+static const quint32 EndOfCentralDirSignature = 0x06054b50;
+static const int EndOfCentralDirSize = 22;
+
+static const quint16 MethodStored = 0;
+static const quint16 MethodDeflated = 8;
+
+ZipReader::ZipReader(const QString &fileName):
+    m_file(fileName)
+{
+    if (!m_file.open(QFile::ReadOnly)) {
+        qWarning() << "Cannot open zip file" << fileName << m_file.errorString();
+        return;
+    }
+    m_size = m_file.size();
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        qWarning() << "Cannot map zip file" << fileName << m_file.errorString();
+        return;
+    }
+    if (!indexCentralDirectory()) {
+        qWarning() << "Invalid zip file" << fileName;
+        m_entries.clear();
+    }
+}
+
+ZipReader::~ZipReader()
+{
+    if (m_data)
+        m_file.unmap(const_cast<uchar*>(m_data));
+}
+
+bool ZipReader::isValid() const
+{
+    return !m_entries.isEmpty();
+}
+
+QString ZipReader::fileName() const
+{
+    return m_file.fileName();
+}
+
+QStringList ZipReader::entries() const
+{
+    return m_entries.keys();
+}
+
+bool ZipReader::contains(const QString &name) const
+{
+    return m_entries.contains(name);
+}
+
+int ZipReader::size(const QString &name) const
+{
+    return m_entries.contains(name) ? m_entries.value(name).size : -1;
+}
+
+bool ZipReader::indexCentralDirectory()
+{
+    // End of central directory record is last, possibly followed by a comment of up to 64k
+    qint64 eocd = -1;
+    for (qint64 pos = m_size - EndOfCentralDirSize; pos >= 0 && pos >= m_size - EndOfCentralDirSize - 0xffff; pos--) {
+        if (qFromLittleEndian<quint32>(m_data + pos) == EndOfCentralDirSignature) {
+            eocd = pos;
+            break;
+        }
+    }
+    if (eocd < 0)
+        return false;
+
+    int count = qFromLittleEndian<quint16>(m_data + eocd + 10);
+    qint64 pos = qFromLittleEndian<quint32>(m_data + eocd + 16);
+    for (int i = 0; i < count; i++) {
+        if (pos + 46 > eocd || qFromLittleEndian<quint32>(m_data + pos) != CentralHeaderSignature)
+            return false;
+        const uchar *h = m_data + pos;
+        Entry e;
+        e.method = qFromLittleEndian<quint16>(h + 10);
+        e.crc = qFromLittleEndian<quint32>(h + 16);
+        e.compressedSize = qFromLittleEndian<quint32>(h + 20);
+        e.size = qFromLittleEndian<quint32>(h + 24);
+        int nameLength = qFromLittleEndian<quint16>(h + 28);
+        int extraLength = qFromLittleEndian<quint16>(h + 30);
+        int commentLength = qFromLittleEndian<quint16>(h + 32);
+        e.localHeader = qFromLittleEndian<quint32>(h + 42);
+        if (pos + 46 + nameLength > eocd)
+            return false;
+        QString name = QString::fromUtf8(reinterpret_cast<const char*>(h + 46), nameLength);
+        if (!name.endsWith('/'))
+            m_entries.insert(name, e);
+        pos += 46 + nameLength + extraLength + commentLength;
+    }
+    return true;
+}
+
+QByteArray ZipReader::read(const QString &name) const
+{
+    if (!m_entries.contains(name)) {
+        qWarning() << "No" << name << "in" << m_file.fileName();
+        return QByteArray();
+    }
+    const Entry &e = m_entries[name];
+
+    // Local header may carry a different extra field than the central one
+    qint64 pos = e.localHeader;
+    if (pos + 30 > m_size || qFromLittleEndian<quint32>(m_data + pos) != LocalHeaderSignature) {
+        qWarning() << "Corrupt local header for" << name;
+        return QByteArray();
+    }
+    pos += 30 + qFromLittleEndian<quint16>(m_data + pos + 26) + qFromLittleEndian<quint16>(m_data + pos + 28);
+    // A stored member is returned as is, so its size has to agree with the data we bound-check
+    if (e.method == MethodStored && e.size != e.compressedSize) {
+        qWarning() << "Size mismatch for stored zip member" << name;
+        return QByteArray();
+    }
+    if (pos + e.compressedSize > m_size) {
+        qWarning() << "Truncated zip member" << name;
+        return QByteArray();
+    }
+    const char *src = reinterpret_cast<const char*>(m_data + pos);
+
+    QByteArray ret;
+    if (e.method == MethodStored) {
+        // Copied, callers keep the data past the lifetime of the mapping
+        ret = QByteArray(src, e.size);
+    } else if (e.method == MethodDeflated) {
+        // Deflate cannot expand by more than about 1032:1, a larger size is a lie
+        if (e.size > INT_MAX || quint64(e.size) > quint64(e.compressedSize) * 1032 + 64) {
+            qWarning() << "Implausible size" << e.size << "for zip member" << name << "of" << e.compressedSize << "bytes";
+            return QByteArray();
+        }
+        ret = QByteArray(e.size, Qt::Uninitialized);
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(src));
+        zs.avail_in = e.compressedSize;
+        zs.next_out = reinterpret_cast<Bytef*>(ret.data());
+        zs.avail_out = e.size;
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+            qWarning() << "inflateInit failed for" << name;
+            return QByteArray();
+        }
+        int res = inflate(&zs, Z_FINISH);
+        inflateEnd(&zs);
+        if (res != Z_STREAM_END || zs.total_out != e.size) {
+            qWarning() << "Error inflating" << name << res;
+            return QByteArray();
+        }
+    } else {
+        qWarning() << "Unsupported compression method" << e.method << "for" << name;
+        return QByteArray();
+    }
+
+    if (crc32(0, reinterpret_cast<const Bytef*>(ret.constData()), ret.size()) != e.crc) {
+        qWarning() << "CRC mismatch for" << name << "in" << m_file.fileName();
+        return QByteArray();
+    }
+    return ret;
+}
@@ -0,0 +1,43 @@
+#ifndef ZIPREADER_H
+#define ZIPREADER_H
+
+#include <QFile>
+#include <QHash>
+#include <QStringList>
+
+// Read-only access to a zip archive (pbw, pbz) without extracting it. The file is
+// memory mapped and the central directory indexed once on construction.
+class ZipReader
+{
+public:
+    explicit ZipReader(const QString &fileName);
+    ~ZipReader();
+
+    bool isValid() const;
+    QString fileName() const;
+    QStringList entries() const;
+    bool contains(const QString &name) const;
+    int size(const QString &name) const;
+
+    // Returns a copy that outlives the reader. Deflated members are inflated.
+    QByteArray read(const QString &name) const;
+
+private:
+    Q_DISABLE_COPY(ZipReader)
+
+    struct Entry {
+        quint16 method;
+        quint32 crc;
+        quint32 compressedSize;
+        quint32 size;
+        quint32 localHeader;
+    };
+    bool indexCentralDirectory();
+
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    QHash<QString, Entry> m_entries;
+};
+
+#endif // ZIPREADER_H
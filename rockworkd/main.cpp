@@ -1,5 +1,10 @@
 #include <QCoreApplication>
 #include "core.h"
+#include "libpebble/tracerecorder.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
 
 #ifdef ENABLE_TESTING
 #include <QGuiApplication>
@@ -14,6 +19,13 @@ Q_DECL_EXPORT int main(int argc, char *argv[])
     QCoreApplication a(argc, argv);
 #endif
 
+    // Offline analysis of a capture from DBusPebble::DumpTrace, eg. pulled from a user device
+    if (a.arguments().count() > 2 && a.arguments().at(1) == "--analyze-trace") {
+        QVariantMap report = TraceRecorder::analyze(a.arguments().at(2));
+        QTextStream(stdout) << QJsonDocument(QJsonObject::fromVariantMap(report)).toJson();
+        return report.contains("error") ? 1 : 0;
+    }
+
     Core::instance()->init();
 
     return a.exec();
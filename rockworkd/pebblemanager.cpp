@@ -3,8 +3,10 @@
 #include "core.h"
 
 #include "libpebble/platforminterface.h"
+#include "libpebble/threadcall.h"
 
 #include <QHash>
+#include <QThread>
 
 #ifdef ENABLE_TESTING
 #include <QQuickView>
@@ -14,11 +16,25 @@
 
 PebbleManager::PebbleManager(QObject *parent) : QObject(parent)
 {
+    // Types crossing from the watch threads to D-Bus and the platform integration
+    qRegisterMetaType<MusicMetaData>();
+    qRegisterMetaType<MusicPlayState>();
+    qRegisterMetaType<MusicControlButton>();
+    qRegisterMetaType<Pebble::NotificationFilter>();
+    qRegisterMetaType<NotificationPin>();
+
     m_bluezClient = new BluezClient(this);
     connect(m_bluezClient, &BluezClient::devicesChanged, this, &PebbleManager::loadPebbles);
     loadPebbles();
 }
 
+PebbleManager::~PebbleManager()
+{
+    while (!m_pebbles.isEmpty()) {
+        destroyPebble(m_pebbles.takeFirst());
+    }
+}
+
 QList<Pebble *> PebbleManager::pebbles() const
 {
     return m_pebbles;
@@ -32,16 +48,25 @@ void PebbleManager::loadPebbles()
         Pebble *pebble = get(device.address);
         if (!pebble) {
             qDebug() << "creating new pebble";
-            pebble = new Pebble(device.address, this);
+            pebble = new Pebble(device.address);
             pebble->setName(device.name);
+            // Each watch gets its own event loop so a busy one doesn't stall the others
+            QThread *thread = new QThread(this);
+            thread->setObjectName("Pebble " + device.address.toString());
+            pebble->moveToThread(thread);
+            connect(pebble, &QObject::destroyed, thread, &QThread::quit, Qt::DirectConnection);
+            connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+            thread->start();
             setupPebble(pebble);
             m_pebbles.append(pebble);
             qDebug() << "have pebbles:" << m_pebbles.count() << this;
             emit pebbleAdded(pebble);
         }
-        if (!pebble->connected()) {
-            pebble->connect();
-        }
+        callOn(pebble, [pebble]() {
+            if (!pebble->connected()) {
+                pebble->connect();
+            }
+        });
     }
     QList<Pebble*> pebblesToRemove;
     foreach (Pebble *pebble, m_pebbles) {
@@ -66,6 +91,14 @@ void PebbleManager::loadPebbles()
     }
 }
 
+void PebbleManager::destroyPebble(Pebble *pebble)
+{
+    QThread *thread = pebble->thread();
+    // Tear the stack down on its own thread, destroyed() then stops the thread
+    invokeOn(pebble, [pebble]() { delete pebble; });
+    thread->wait();
+}
+
 void PebbleManager::pebbleConnected()
 {
 }
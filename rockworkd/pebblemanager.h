@@ -11,6 +11,7 @@ class PebbleManager : public QObject
     Q_OBJECT
 public:
     explicit PebbleManager(QObject *parent = 0);
+    ~PebbleManager();
 
     QList<Pebble*> pebbles() const;
     Pebble* get(const QBluetoothAddress &address);
@@ -26,6 +27,7 @@ private slots:
 
 private:
     void setupPebble(Pebble *pebble);
+    void destroyPebble(Pebble *pebble);
 
     BluezClient *m_bluezClient;
 
@@ -0,0 +1,243 @@
+#include "notificationclassifier.h"
+#include "notifications.h"
+
+#include "libpebble/platforminterface.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+#include <QDebug>
+
+static const char *RULES_FILE = "notificationrules.json";
+
+NotificationClassifier::NotificationClassifier(QObject *parent):
+    QObject(parent),
+    m_userFile(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/" + RULES_FILE),
+    m_watcher(new QFileSystemWatcher(this))
+{
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &NotificationClassifier::reload);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, [this]() {
+        // Only interested in the rules file showing up or going away
+        if (QFile::exists(m_userFile) != m_watcher->files().contains(m_userFile)) {
+            reload();
+        }
+    });
+    reload();
+}
+
+NotificationClassifier::~NotificationClassifier()
+{
+    logHits();
+}
+
+AppID NotificationClassifier::classify(watchfish::Notification *notification)
+{
+    QString values[FieldCount];
+    values[FieldOwner] = notification->owner();
+    values[FieldPackage] = notification->originPackage();
+    values[FieldCategory] = notification->category();
+
+    int best = m_rules.count();
+    for (int field = 0; field < FieldCount; field++) {
+        if (values[field].isEmpty()) {
+            continue;
+        }
+        QHash<QString, QVector<int>>::const_iterator it = m_exact[field].constFind(values[field]);
+        if (it == m_exact[field].constEnd()) {
+            continue;
+        }
+        foreach (int index, it.value()) {
+            if (index >= best) {
+                break;
+            }
+            if (matches(m_rules.at(index), values, notification)) {
+                best = index;
+                break;
+            }
+        }
+    }
+    foreach (int index, m_patterns) {
+        if (index >= best) {
+            break;
+        }
+        if (matches(m_rules.at(index), values, notification)) {
+            best = index;
+            break;
+        }
+    }
+
+    QString app = values[FieldPackage].isEmpty() ? values[FieldOwner] : values[FieldPackage];
+    if (app.isEmpty()) app = notification->sender();
+    AppID ret;
+    if (best == m_rules.count()) {
+        // No catch-all in the rules, or no rules at all
+        ret.type = "generic";
+        ret.sender = notification->sender();
+        ret.srcId = app;
+        ret.res = PlatformInterface::AppResMap.value("generic");
+        return ret;
+    }
+
+    m_hits[best]++;
+    const Rule &rule = m_rules.at(best);
+    QHash<QString,QString> vars;
+    vars.insert("${owner}", values[FieldOwner]);
+    vars.insert("${package}", values[FieldPackage]);
+    vars.insert("${category}", values[FieldCategory]);
+    vars.insert("${sender}", notification->sender());
+    vars.insert("${app}", app);
+    ret.type = rule.type;
+    ret.sender = rule.sender;
+    ret.srcId = rule.source;
+    for (QHash<QString,QString>::const_iterator it = vars.constBegin(); it != vars.constEnd(); ++it) {
+        ret.sender.replace(it.key(), it.value());
+        ret.srcId.replace(it.key(), it.value());
+    }
+    ret.res = rule.res;
+    return ret;
+}
+
+void NotificationClassifier::reload()
+{
+    if (!m_rules.isEmpty()) {
+        logHits();
+    }
+    m_rules.clear();
+    for (int field = 0; field < FieldCount; field++) {
+        m_exact[field].clear();
+    }
+    m_patterns.clear();
+
+    loadRules(m_userFile);
+    loadRules(QString(SHARED_DATA_PATH) + "/" + RULES_FILE);
+    m_hits.fill(0, m_rules.count());
+    qDebug() << "Loaded" << m_rules.count() << "notification rules," << m_patterns.count() << "of them patterns";
+
+    // Editors tend to replace the file, which drops it from the watcher
+    if (!m_watcher->files().isEmpty()) {
+        m_watcher->removePaths(m_watcher->files());
+    }
+    if (QFile::exists(m_userFile)) {
+        m_watcher->addPath(m_userFile);
+    }
+    QString dir = QFileInfo(m_userFile).absolutePath();
+    if (QDir(dir).exists() && !m_watcher->directories().contains(dir)) {
+        m_watcher->addPath(dir);
+    }
+}
+
+void NotificationClassifier::loadRules(const QString &fileName)
+{
+    QFile f(fileName);
+    if (!f.exists()) {
+        return;
+    }
+    if (!f.open(QFile::ReadOnly)) {
+        qWarning() << "Cannot open notification rules" << fileName << f.errorString();
+        return;
+    }
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(f.readAll(), &error);
+    if (error.error != QJsonParseError::NoError) {
+        qWarning() << "Cannot parse notification rules" << fileName << error.errorString();
+        return;
+    }
+
+    static const char *fields[FieldCount] = {"owner", "package", "category"};
+    foreach (const QJsonValue &value, doc.object().value("rules").toArray()) {
+        QJsonObject obj = value.toObject();
+        Rule rule;
+        rule.origin = fileName;
+        for (int field = 0; field < FieldCount; field++) {
+            if (!obj.contains(fields[field])) {
+                continue;
+            }
+            QString key = obj.value(fields[field]).toString();
+            rule.field = Field(field);
+            bool prefix = key.endsWith('*');
+            bool suffix = key.startsWith('*');
+            key.remove('*');
+            if (prefix && suffix) {
+                rule.match = MatchContains;
+            } else if (prefix) {
+                rule.match = MatchPrefix;
+            } else if (suffix) {
+                rule.match = MatchSuffix;
+            } else {
+                rule.match = MatchExact;
+            }
+            rule.key = rule.match == MatchExact ? key : key.toLower();
+            break;
+        }
+        QJsonObject when = obj.value("when").toObject();
+        rule.whenSender = when.value("sender").toString().toLower();
+        rule.whenAction = when.value("action").toString().toLower();
+        rule.type = obj.value("type").toString("generic");
+        rule.sender = obj.value("sender").toString();
+        rule.source = obj.value("source").toString("${app}");
+
+        // Resolved now so classifying never goes through the map by name
+        rule.res = PlatformInterface::AppResMap.contains(rule.type) ? PlatformInterface::AppResMap.value(rule.type) : PlatformInterface::AppResMap.value("unknown");
+        static const char *resKeys[] = {"icon", "color", "name"};
+        for (int i = 0; i < 3; i++) {
+            if (!obj.contains(resKeys[i])) {
+                continue;
+            }
+            while (rule.res.count() <= i) {
+                rule.res.append(QString());
+            }
+            rule.res[i] = obj.value(resKeys[i]).toString();
+        }
+
+        int index = m_rules.count();
+        m_rules.append(rule);
+        if (rule.match == MatchExact) {
+            m_exact[rule.field][rule.key].append(index);
+        } else {
+            m_patterns.append(index);
+        }
+    }
+}
+
+bool NotificationClassifier::matches(const Rule &rule, const QString *values, watchfish::Notification *notification) const
+{
+    switch (rule.match) {
+    case MatchAny:
+    case MatchExact:
+        break;
+    case MatchPrefix:
+        if (!values[rule.field].toLower().startsWith(rule.key)) return false;
+        break;
+    case MatchSuffix:
+        if (!values[rule.field].toLower().endsWith(rule.key)) return false;
+        break;
+    case MatchContains:
+        if (!values[rule.field].toLower().contains(rule.key)) return false;
+        break;
+    }
+    if (!rule.whenSender.isEmpty() && !notification->sender().toLower().contains(rule.whenSender)) {
+        return false;
+    }
+    if (!rule.whenAction.isEmpty()) {
+        QVariantList args = notification->actions().contains("default") ? notification->actionArgs("default") : QVariantList();
+        if (args.isEmpty() || !args.first().toString().toLower().contains(rule.whenAction)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void NotificationClassifier::logHits() const
+{
+    for (int i = 0; i < m_rules.count(); i++) {
+        if (m_hits.value(i)) {
+            const Rule &rule = m_rules.at(i);
+            qDebug() << "Notification rule" << i << rule.key << rule.type << "from" << rule.origin << "matched" << m_hits.at(i) << "times";
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef NOTIFICATIONCLASSIFIER_H
+#define NOTIFICATIONCLASSIFIER_H
+
+#include <QObject>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+class QFileSystemWatcher;
+
+namespace watchfish
+{
+class Notification;
+}
+
+struct AppID {
+    QString type;
+    QString sender;
+    QString srcId;
+    QStringList res; // {icon, color, [name]} as in PlatformInterface::AppResMap
+};
+
+/**
+ * @brief The NotificationClassifier class maps notifications to the app they are shown as.
+ * Rules come from notificationrules.json, the user's copy in the data directory first and
+ * then the packaged one, and the first matching rule in that order wins. Rules keyed by an
+ * exact owner, category or package go into hash tables, so adding apps does not slow down
+ * classification; keys with a * wildcard and keyless catch-alls are tried one by one.
+ */
+class NotificationClassifier : public QObject
+{
+    Q_OBJECT
+public:
+    explicit NotificationClassifier(QObject *parent = 0);
+    ~NotificationClassifier();
+
+    AppID classify(watchfish::Notification *notification);
+
+public slots:
+    void reload();
+
+private:
+    enum Field {
+        FieldOwner,
+        FieldPackage,
+        FieldCategory,
+        FieldCount
+    };
+    enum Match {
+        MatchAny,
+        MatchExact,
+        MatchPrefix,
+        MatchSuffix,
+        MatchContains
+    };
+    struct Rule {
+        Field field = FieldOwner;
+        Match match = MatchAny;
+        QString key;
+        // Extra conditions, case insensitive substrings
+        QString whenSender;
+        QString whenAction;
+        QString type;
+        QString sender;
+        QString source;
+        QStringList res;
+        QString origin;
+    };
+
+    void loadRules(const QString &fileName);
+    bool matches(const Rule &rule, const QString *values, watchfish::Notification *notification) const;
+    void logHits() const;
+
+    QVector<Rule> m_rules;
+    QVector<quint64> m_hits;
+    QHash<QString, QVector<int>> m_exact[FieldCount]; // Rule indexes in ascending order
+    QVector<int> m_patterns;
+    QString m_userFile;
+    QFileSystemWatcher *m_watcher;
+};
+
+#endif // NOTIFICATIONCLASSIFIER_H
@@ -0,0 +1,287 @@
+#include "notificationindex.h"
+#include "notifications.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QDebug>
+
+static const quint32 INDEX_MAGIC = 0x524e4958; // RNIX
+static const quint8 INDEX_VERSION = 1;
+// Well past the timeline's window for notifications
+static const qint64 ENTRY_LIFETIME = 3 * 24 * 3600;
+static const int SYNC_DELAY = 2000;
+
+NotificationIndexWriter::NotificationIndexWriter(const QString &fileName):
+    m_fileName(fileName)
+{
+}
+
+void NotificationIndexWriter::write(const QByteArray &data)
+{
+    QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+    QSaveFile f(m_fileName);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write notification index" << m_fileName << f.errorString();
+        emit failed();
+        return;
+    }
+    f.write(data);
+    if (!f.commit()) {
+        qWarning() << "Cannot write notification index" << m_fileName << f.errorString();
+        emit failed();
+    }
+}
+
+NotificationIndex::NotificationIndex(QObject *parent):
+    QObject(parent),
+    m_fileName(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/notifications.idx"),
+    m_writer(new NotificationIndexWriter(m_fileName)),
+    m_syncTimer(this)
+{
+    m_writer->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_writer, &QObject::deleteLater);
+    connect(this, &NotificationIndex::writeIndex, m_writer, &NotificationIndexWriter::write);
+    connect(m_writer, &NotificationIndexWriter::failed, this, &NotificationIndex::scheduleSync);
+    m_thread.setObjectName("NotificationIndex");
+    m_thread.start(QThread::LowPriority);
+
+    m_syncTimer.setSingleShot(true);
+    m_syncTimer.setInterval(SYNC_DELAY);
+    connect(&m_syncTimer, &QTimer::timeout, this, &NotificationIndex::sync);
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &NotificationIndex::flush);
+
+    load();
+    expire();
+}
+
+NotificationIndex::~NotificationIndex()
+{
+    flush();
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void NotificationIndex::insert(watchfish::Notification *notification, const QUuid &guid)
+{
+    expire();
+    remove(guid);
+
+    Entry entry;
+    entry.id = notification->id();
+    entry.expires = QDateTime::currentDateTimeUtc().toTime_t() + ENTRY_LIFETIME;
+    foreach (const QString &token, notification->actions()) {
+        QStringList target = notification->actionTarget(token);
+        Action &action = entry.actions[token];
+        action.service = target.value(0);
+        action.path = target.value(1);
+        action.iface = target.value(2);
+        action.method = target.value(3);
+        action.args = notification->actionArgs(token);
+    }
+    // A replacing notification takes over the id, the pin it replaced keeps its actions
+    m_ids.insert(entry.id, guid);
+    m_expiry.insert(entry.expires, guid);
+    m_entries.insert(guid, entry);
+    scheduleSync();
+}
+
+void NotificationIndex::remove(const QUuid &guid)
+{
+    QHash<QUuid, Entry>::iterator it = m_entries.find(guid);
+    if (it == m_entries.end()) {
+        return;
+    }
+    if (m_ids.value(it->id) == guid) {
+        m_ids.remove(it->id);
+    }
+    m_expiry.remove(it->expires, guid);
+    m_entries.erase(it);
+    scheduleSync();
+}
+
+bool NotificationIndex::contains(const QUuid &guid) const
+{
+    return m_entries.contains(guid);
+}
+
+QUuid NotificationIndex::guid(uint id) const
+{
+    return m_ids.value(id);
+}
+
+uint NotificationIndex::id(const QUuid &guid) const
+{
+    return m_entries.value(guid).id;
+}
+
+QVariantList NotificationIndex::actionArgs(const QUuid &guid, const QString &action) const
+{
+    return m_entries.value(guid).actions.value(action).args;
+}
+
+bool NotificationIndex::invokeAction(const QUuid &guid, const QString &action) const
+{
+    QHash<QUuid, Entry>::const_iterator it = m_entries.constFind(guid);
+    if (it == m_entries.constEnd() || !it->actions.contains(action)) {
+        return false;
+    }
+    const Action &a = it->actions[action];
+    if (a.service.isEmpty()) {
+        return false;
+    }
+    QDBusMessage msg = QDBusMessage::createMethodCall(a.service, a.path, a.iface, a.method);
+    msg.setArguments(a.args);
+    qDebug() << "Invoking action" << action << "of notification" << it->id << a.service << a.path << a.iface << a.method;
+    QDBusConnection::sessionBus().asyncCall(msg);
+    return true;
+}
+
+bool NotificationIndex::close(const QUuid &guid) const
+{
+    QHash<QUuid, Entry>::const_iterator it = m_entries.constFind(guid);
+    if (it == m_entries.constEnd()) {
+        return false;
+    }
+    QDBusMessage msg = QDBusMessage::createMethodCall("org.freedesktop.Notifications",
+                                                      "/org/freedesktop/Notifications",
+                                                      "org.freedesktop.Notifications",
+                                                      "CloseNotification");
+    msg << quint32(it->id);
+    QDBusConnection::sessionBus().asyncCall(msg);
+    return true;
+}
+
+void NotificationIndex::sync()
+{
+    m_syncTimer.stop();
+    if (!m_dirty) {
+        return;
+    }
+    emit writeIndex(snapshot());
+}
+
+void NotificationIndex::flush()
+{
+    m_syncTimer.stop();
+    if (!m_dirty) {
+        return;
+    }
+    // Queued behind any write still pending, so the last snapshot is the one which stays
+    QMetaObject::invokeMethod(m_writer, "write", Qt::BlockingQueuedConnection, Q_ARG(QByteArray, snapshot()));
+}
+
+QByteArray NotificationIndex::snapshot()
+{
+    m_dirty = false;
+
+    // D-Bus names repeat across nearly every entry, so they go into a string table
+    QStringList strings;
+    QHash<QString, quint16> stringIds;
+    auto intern = [&strings, &stringIds](const QString &s) -> quint16 {
+        QHash<QString, quint16>::const_iterator it = stringIds.constFind(s);
+        if (it != stringIds.constEnd()) {
+            return it.value();
+        }
+        quint16 id = strings.count();
+        strings.append(s);
+        stringIds.insert(s, id);
+        return id;
+    };
+    QByteArray entries;
+    QDataStream es(&entries, QIODevice::WriteOnly);
+    es.setVersion(QDataStream::Qt_5_0);
+    es << quint32(m_entries.count());
+    for (QHash<QUuid, Entry>::const_iterator it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        es << quint32(it->id) << it.key() << it->expires << quint16(it->actions.count());
+        for (QHash<QString, Action>::const_iterator a = it->actions.constBegin(); a != it->actions.constEnd(); ++a) {
+            es << intern(a.key()) << intern(a->service) << intern(a->path) << intern(a->iface) << intern(a->method) << a->args;
+        }
+    }
+
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds.setVersion(QDataStream::Qt_5_0);
+    ds << INDEX_MAGIC << INDEX_VERSION << strings;
+    ds.writeRawData(entries.constData(), entries.size());
+    return data;
+}
+
+void NotificationIndex::load()
+{
+    QFile f(m_fileName);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    QDataStream ds(&f);
+    ds.setVersion(QDataStream::Qt_5_0);
+    quint32 magic;
+    quint8 version;
+    QStringList strings;
+    ds >> magic >> version;
+    if (magic != INDEX_MAGIC || version != INDEX_VERSION) {
+        qWarning() << "Ignoring notification index" << m_fileName << "of unknown format";
+        return;
+    }
+    ds >> strings;
+
+    quint32 count;
+    ds >> count;
+    for (quint32 i = 0; i < count && ds.status() == QDataStream::Ok; i++) {
+        Entry entry;
+        quint32 id;
+        QUuid guid;
+        quint16 actions;
+        ds >> id >> guid >> entry.expires >> actions;
+        entry.id = id;
+        for (quint16 j = 0; j < actions && ds.status() == QDataStream::Ok; j++) {
+            quint16 token, service, path, iface, method;
+            ds >> token >> service >> path >> iface >> method;
+            Action &a = entry.actions[strings.value(token)];
+            a.service = strings.value(service);
+            a.path = strings.value(path);
+            a.iface = strings.value(iface);
+            a.method = strings.value(method);
+            ds >> a.args;
+        }
+        if (ds.status() != QDataStream::Ok) {
+            break;
+        }
+        m_entries.insert(guid, entry);
+        m_expiry.insert(entry.expires, guid);
+        // The id belongs to the latest of the notifications which had it
+        QUuid current = m_ids.value(entry.id);
+        if (current.isNull() || m_entries.value(current).expires <= entry.expires) {
+            m_ids.insert(entry.id, guid);
+        }
+    }
+    if (ds.status() != QDataStream::Ok) {
+        qWarning() << "Notification index" << m_fileName << "is truncated, kept" << m_entries.count() << "entries";
+    }
+    qDebug() << "Loaded" << m_entries.count() << "notifications from the index";
+}
+
+void NotificationIndex::expire()
+{
+    qint64 now = QDateTime::currentDateTimeUtc().toTime_t();
+    while (!m_expiry.isEmpty() && m_expiry.firstKey() <= now) {
+        if (m_entries.contains(m_expiry.first())) {
+            remove(m_expiry.first());
+        } else {
+            m_expiry.erase(m_expiry.begin());
+        }
+    }
+}
+
+void NotificationIndex::scheduleSync()
+{
+    m_dirty = true;
+    m_syncTimer.start();
+}
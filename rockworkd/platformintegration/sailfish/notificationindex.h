@@ -0,0 +1,99 @@
+#ifndef NOTIFICATIONINDEX_H
+#define NOTIFICATIONINDEX_H
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QThread>
+#include <QTimer>
+#include <QUuid>
+#include <QVariantList>
+
+namespace watchfish
+{
+class Notification;
+}
+
+// Lives on the NotificationIndex writer thread, puts serialized snapshots on disk
+class NotificationIndexWriter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit NotificationIndexWriter(const QString &fileName);
+
+public slots:
+    void write(const QByteArray &data);
+
+signals:
+    void failed();
+
+private:
+    QString m_fileName;
+};
+
+/**
+ * @brief The NotificationIndex class remembers the phone notifications forwarded to the
+ * watch: platform id and pin guid in both directions, plus the D-Bus calls behind their
+ * actions. It is kept on disk, so dismissals and actions coming back from the watch can
+ * still be routed after a daemon restart, when the watchfish::Notification objects are
+ * long gone. Entries expire after a few days. Changes are written out a moment later by
+ * a worker thread, from a snapshot taken on the owning thread.
+ */
+class NotificationIndex : public QObject
+{
+    Q_OBJECT
+public:
+    explicit NotificationIndex(QObject *parent = 0);
+    ~NotificationIndex();
+
+    void insert(watchfish::Notification *notification, const QUuid &guid);
+    void remove(const QUuid &guid);
+
+    bool contains(const QUuid &guid) const;
+    // Null if unknown
+    QUuid guid(uint id) const;
+    // 0 if unknown
+    uint id(const QUuid &guid) const;
+    QVariantList actionArgs(const QUuid &guid, const QString &action) const;
+
+    bool invokeAction(const QUuid &guid, const QString &action) const;
+    bool close(const QUuid &guid) const;
+
+public slots:
+    void sync();
+
+signals:
+    void writeIndex(const QByteArray &data);
+
+private:
+    struct Action {
+        QString service;
+        QString path;
+        QString iface;
+        QString method;
+        QVariantList args;
+    };
+    struct Entry {
+        uint id = 0;
+        qint64 expires = 0; // Secs since epoch
+        QHash<QString, Action> actions;
+    };
+
+    void load();
+    void expire();
+    void scheduleSync();
+    // Waits for the writer, for shutdown
+    void flush();
+    QByteArray snapshot();
+
+    QString m_fileName;
+    QThread m_thread;
+    NotificationIndexWriter *m_writer;
+    QHash<QUuid, Entry> m_entries;
+    QHash<uint, QUuid> m_ids;
+    QMultiMap<qint64, QUuid> m_expiry;
+    QTimer m_syncTimer;
+    bool m_dirty = false;
+};
+
+#endif // NOTIFICATIONINDEX_H
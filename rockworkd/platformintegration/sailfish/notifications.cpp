@@ -313,6 +313,13 @@ QVariantList Notification::actionArgs(const QString &action) const
     return d->actions.value(action).args;
 }
 
+QStringList Notification::actionTarget(const QString &action) const
+{
+    Q_D(const Notification);
+	const Action a = d->actions.value(action);
+	return QStringList() << a.service << a.path << a.iface << a.method;
+}
+
 void Notification::invokeAction(const QString &action)
 {
     Q_D(Notification);
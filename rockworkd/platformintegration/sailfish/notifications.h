@@ -116,6 +116,8 @@ public:
 	QStringList actions() const;
 	void addDBusAction(const QString &action, const QString &service, const QString &path, const QString &iface, const QString &method, const QStringList &args = QStringList());
 	QVariantList actionArgs(const QString &action) const;
+	/** D-Bus service, path, interface and method the action calls */
+	QStringList actionTarget(const QString &action) const;
 
 public slots:
 	void invokeAction(const QString &action);
@@ -6,6 +6,8 @@
 #include "musiccontroller.h"
 #include "notificationmonitor.h"
 #include "walltimemonitor.h"
+#include "notificationclassifier.h"
+#include "notificationindex.h"
 
 #include <QDBusConnection>
 #include <QDebug>
@@ -26,6 +28,8 @@ SailfishPlatform::SailfishPlatform(QObject *parent):
     connect(m_wallTimeMonitor, &watchfish::WallTimeMonitor::timeChanged, this, &SailfishPlatform::onTimeChanged);
 
     // Notifications
+    m_classifier = new NotificationClassifier(this);
+    m_notificationIndex = new NotificationIndex(this);
     m_notificationMonitor = new watchfish::NotificationMonitor(this);
     connect(m_notificationMonitor, &watchfish::NotificationMonitor::notification, this, &SailfishPlatform::newNotificationPin);
     connect(m_notificationMonitor, &watchfish::NotificationMonitor::notificationClosed, this, &SailfishPlatform::handleClosedNotification);
@@ -48,6 +52,7 @@ SailfishPlatform::SailfishPlatform(QObject *parent):
 
     // Device - MCE
     m_nokiaMCE = new ModeControlEntity(this);
+    connect(m_nokiaMCE, &ModeControlEntity::activeStateChanged, this, &PlatformInterface::deviceActiveChanged);
 }
 SailfishPlatform::~SailfishPlatform()
 {
@@ -116,73 +121,14 @@ void SailfishPlatform::onActiveVoiceCallStatusChanged()
 void SailfishPlatform::onTimeChanged() {
     emit timeChanged();
 }
-struct AppID {
-    QString type;
-    QString sender;
-    QString srcId;
-};
-
-AppID getAppID(watchfish::Notification *notification)
-{
-    QString owner = notification->originPackage().isEmpty()?notification->owner():notification->originPackage();
-    if (owner.isEmpty()) owner = notification->sender();
-    AppID ret;
-    if (notification->owner() == "twitter-notifications-client") {
-        ret.type="twitter";
-        ret.srcId=notification->owner();
-        ret.sender="Twitter";
-    } else if (notification->category() == "x-nemo.email") {
-        if (notification->sender().toLower().contains("gmail")) {
-            ret.type="gmail";
-            ret.sender="GMail";
-            ret.srcId=notification->category()+"%3Agmail";
-        } else {
-            ret.type="email";
-            ret.sender=notification->sender();
-            ret.srcId=QString("mailto%3A")+notification->sender();
-        }
-    } else if (notification->owner() == "facebook-notifications-client") {
-        ret.type="facebook";
-        ret.srcId=notification->owner();
-    } else if (notification->category() == "x-nemo.messaging.sms") {
-        ret.type="sms";
-        ret.sender="SMS";
-        ret.srcId=notification->category();
-    } else if (notification->originPackage() == "com.google.android.apps.babel" || notification->owner() == "harbour-hangish") {
-        ret.type="hangouts";
-        ret.srcId=owner;
-    } else if (notification->category() == "x-nemo.messaging.im") {
-        if(notification->actions().contains("default") && notification->actionArgs("default").at(0).toString().contains("gabble/jabber/google")) {
-            ret.type="hangouts";
-        } else {
-            ret.type="sms";
-        }
-        ret.sender=notification->sender();
-        ret.srcId=notification->category();
-    } else if (notification->category() == "x-nemo.call.missed") {
-        ret.type = "calls";
-        ret.sender = notification->sender();
-        ret.srcId = notification->category();
-    } else if (notification->originPackage() == "org.telegram.messenger" || notification->category().startsWith("harbour.sailorgram")) {
-        ret.type="telegram";
-        ret.srcId=owner;
-    } else if (notification->originPackage() == "com.whatsapp" || notification->owner().toLower().contains("whatsup")) {
-        ret.type="whatsapp";
-        ret.srcId=owner;
-    } else {
-        ret.type="generic";
-        ret.sender=notification->sender();
-        ret.srcId=owner;
-    }
-    return ret;
-}
-
-const QHash<QString,QStringList>& SailfishPlatform::cannedResponses() const
+QHash<QString,QStringList> SailfishPlatform::cannedResponses() const
 {
+    QMutexLocker l(&m_cansLock);
     return m_cans;
 }
 void SailfishPlatform::setCannedResponses(const QHash<QString, QStringList> &cans)
 {
+    QMutexLocker l(&m_cansLock);
     // Accept only what we can handle, don't inject more than we have
     foreach(const QString &key, m_cans.keys()) {
         if(cans.contains(key))
@@ -198,64 +144,49 @@ void SailfishPlatform::newNotificationPin(watchfish::Notification *notification)
         qDebug() << "Skipping group notification.";
         return;
     }
-    QJsonObject pin;
-    QJsonObject layout;
-    QJsonArray actions;
-
-    AppID a = getAppID(notification);
-    QStringList res = PlatformInterface::AppResMap.contains(a.type) ? PlatformInterface::AppResMap.value(a.type) : PlatformInterface::AppResMap.value("unknown");
-
-    pin.insert("id",QString("%1.%2.%3").arg(a.sender).arg(notification->timestamp().toTime_t()).arg(notification->id()));
-    QUuid guid = PlatformInterface::idToGuid(pin.value("id").toString());
-    pin.insert("createTime", notification->timestamp().toUTC().toString(Qt::ISODate));
-    pin.insert("guid",guid.toString().mid(1,36));
-    pin.insert("type",QString("notification"));
-    pin.insert("dataSource",QString("%1:%2").arg(a.srcId).arg(PlatformInterface::SysID));
-    pin.insert("source",a.sender);
+    NotificationPin pin;
+
+    AppID a = m_classifier->classify(notification);
+    const QStringList &res = a.res;
+
+    pin.id = QString("%1.%2.%3").arg(a.sender).arg(notification->timestamp().toTime_t()).arg(notification->id());
+    pin.guid = PlatformInterface::idToGuid(pin.id);
+    pin.createTime = notification->timestamp().toUTC();
+    pin.sourceId = a.srcId;
+    pin.parent = PlatformInterface::UUID;
+    pin.source = a.sender;
     if (!notification->icon().startsWith("/opt/alien/data/notificationIcon/")) //these are temporary, don't store them
-        pin.insert("sourceIcon",notification->icon());
+        pin.sourceIcon = notification->icon();
     if(res.count()>2 && !res.at(2).isEmpty()) {
-        pin.insert("sourceName",res.at(2));
+        pin.sourceName = res.at(2);
     }
 
-    // Dismiss action is added implicitly by TimelinePin class
-    if(m_cans.contains(a.srcId) && !m_cans.value(a.srcId).isEmpty()) {
+    // Dismiss action is added implicitly by TimelineManager
+    QStringList cans = cannedResponses().value(a.srcId);
+    if(!cans.isEmpty()) {
         // We should have responses only for something we could do
-        QJsonObject response;
-        response.insert("type",QString("response"));
-        response.insert("title",QString("Response"));
-        response.insert("cannedResponse",QJsonArray::fromStringList(m_cans.value(a.srcId)));
-        actions.append(response);
+        pin.actions.append({QString("response"), QString("Response"), cans});
     }
     // Explicit open* will override implicit one
     foreach (const QString &actToken, notification->actions()) {
         if (actToken == "default") {
             qDebug() << "found action" << actToken;
-            QJsonObject action;
-            action.insert("type",QString("open:%1").arg(actToken));
-            action.insert("title",QString("Open on Phone"));
-            actions.append(action);
+            pin.actions.append({QString("open:%1").arg(actToken), QString("Open on Phone"), QStringList()});
             // Sender is sent back as part of canned message response
-            layout.insert("sender",actToken);
+            pin.sender = actToken;
             break;
         }
     }
-    pin.insert("actions",actions);
-
-    layout.insert("type",QString("commNotification"));
-    layout.insert("title",a.sender);
-    layout.insert("subtitle",notification->summary());
-    layout.insert("body",notification->body());
-
-    layout.insert("tinyIcon",res.at(0));
-    layout.insert("backgroundColor",res.at(1));
 
-    pin.insert("layout",layout);
+    pin.title = a.sender;
+    pin.subtitle = notification->summary();
+    pin.body = notification->body();
+    pin.tinyIcon = res.at(0);
+    pin.backgroundColor = res.at(1);
 
-    m_notifs.insert(guid, notification); // keep for the action. TimelineManager will take care cleaning it up
-    m_notifs_by_id.insert(notification->id(), guid);
-    qDebug() << "Emitting new pin" << pin.value("id").toString() << pin.value("dataSource").toString() << pin.value("guid").toString();
-    emit newTimelinePin(pin);
+    m_notificationIndex->insert(notification, pin.guid); // keep for the action. TimelineManager will take care cleaning it up
+    qDebug() << "Emitting new notification" << pin.id << a.srcId << pin.guid;
+    emit newNotification(pin);
 }
 
 void SailfishPlatform::syncOrganizer(qint32 end) const
@@ -301,20 +232,20 @@ void SailfishPlatform::telepathyResponse(const QString &account, const QString &
 void SailfishPlatform::actionTriggered(const QUuid &uuid, const QString &actToken, const QJsonObject &param) const
 {
     qDebug() << "Triggering notification" << uuid << "action" << actToken << QJsonDocument(param).toJson();
-    watchfish::Notification *notif = m_notifs.value(uuid);
-    if (notif) {
+    if (m_notificationIndex->contains(uuid)) {
         if(actToken.split(":").first()=="open") {
-            notif->invokeAction(actToken.split(":").last());
+            m_notificationIndex->invokeAction(uuid, actToken.split(":").last());
         } else if(actToken == "response") {
-            if(param.contains("sender") && !notif->actionArgs(param.value("sender").toString()).isEmpty()
-                    && notif->actionArgs(param.value("sender").toString()).at(0).toString().startsWith("/org/freedesktop/Telepathy/Account"))
+            QVariantList args = m_notificationIndex->actionArgs(uuid, param.value("sender").toString());
+            if(param.contains("sender") && args.count() > 1
+                    && args.at(0).toString().startsWith("/org/freedesktop/Telepathy/Account"))
                 telepathyResponse(
-                            notif->actionArgs(param.value("sender").toString()).at(0).toString(), // account dbus path
-                            notif->actionArgs(param.value("sender").toString()).at(1).toString(), // destination contact
+                            args.at(0).toString(), // account dbus path
+                            args.at(1).toString(), // destination contact
                             param.value("title").toString() // message text
                             );
             else
-                qDebug() << "Don't know how to respond to" << notif->category() << notif->actionArgs(actToken);
+                qDebug() << "Don't know how to respond to" << uuid << args;
         }
     } else
         qDebug() << "Not found";
@@ -323,11 +254,8 @@ void SailfishPlatform::actionTriggered(const QUuid &uuid, const QString &actToke
 void SailfishPlatform::removeNotification(const QUuid &uuid) const
 {
     qDebug() << "Removing notification " << uuid;
-    watchfish::Notification *notif = m_notifs.value(uuid);
-    if (notif) {
-        notif->close();
-        m_notifs.remove(uuid);
-        m_notifs_by_id.remove(notif->id());
+    if (m_notificationIndex->close(uuid)) {
+        m_notificationIndex->remove(uuid);
     }
     else
         qDebug() << "Not found";
@@ -336,12 +264,11 @@ void SailfishPlatform::removeNotification(const QUuid &uuid) const
 void SailfishPlatform::handleClosedNotification(uint nid, watchfish::Notification::CloseReason reason) {
     qDebug() << "Notification closed:" << nid << "Reason: " << reason;
 
-    if (m_notifs_by_id.contains(nid)) {
-        QUuid uuid = m_notifs_by_id.value(nid);
-        m_notifs_by_id.remove(nid);
+    QUuid uuid = m_notificationIndex->guid(nid);
+    if (!uuid.isNull()) {
         qDebug() << "Removing notification " << uuid;
         emit delTimelinePin(uuid.toString()); // Not sure we want it, but why not?
-        m_notifs.remove(uuid);
+        m_notificationIndex->remove(uuid);
     }
     else
         qDebug() << "Notification not found";
@@ -12,10 +12,13 @@
 
 #include <QDBusInterface>
 #include <QDBusContext>
+#include <QMutex>
 
 class QDBusPendingCallWatcher;
 class VoiceCallManager;
 class OrganizerAdapter;
+class NotificationClassifier;
+class NotificationIndex;
 
 class SailfishPlatform : public PlatformInterface, public QDBusContext
 {
@@ -41,7 +44,7 @@ public:
     bool deviceIsActive() const override;
     void setProfile(const QString &profile) const override;
 
-    const QHash<QString,QStringList>& cannedResponses() const override;
+    QHash<QString,QStringList> cannedResponses() const override;
     void setCannedResponses(const QHash<QString, QStringList> &cans) override;
     void sendTextMessage(const QString &account, const QString &contact, const QString &text) const override;
 
@@ -65,12 +68,13 @@ private:
     VoiceCallManager *m_voiceCallManager;
     OrganizerAdapter *m_organizerAdapter;
     ModeControlEntity *m_nokiaMCE;
-    mutable QMap<QUuid, watchfish::Notification*> m_notifs;
-    mutable QMap<uint, QUuid> m_notifs_by_id;
     watchfish::MusicController *m_musicController;
     watchfish::NotificationMonitor *m_notificationMonitor;
+    NotificationClassifier *m_classifier;
+    NotificationIndex *m_notificationIndex;
     watchfish::WallTimeMonitor *m_wallTimeMonitor;
     QHash<QString,QStringList> m_cans;
+    mutable QMutex m_cansLock;
 };
 
 #endif // SAILFISHPLATFORM_H
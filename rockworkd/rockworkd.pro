@@ -10,9 +10,9 @@ CONFIG += console
 CONFIG += link_pkgconfig
 
 INCLUDEPATH += $$[QT_HOST_PREFIX]/include/quazip/
-LIBS += -lquazip
+LIBS += -lquazip -lz
 
-PKGCONFIG += qt5-boostable libmkcal-qt5 libkcalcoren-qt5 dbus-1 mpris-qt5 timed-qt5 Qt5WebSockets
+PKGCONFIG += qt5-boostable libmkcal-qt5 libkcalcoren-qt5 dbus-1 mpris-qt5 timed-qt5 Qt5WebSockets speex
 INCLUDEPATH += /usr/include/mkcal-qt5 /usr/include/kcalcoren-qt5
 
 SOURCES += main.cpp \
@@ -21,6 +21,7 @@ SOURCES += main.cpp \
     libpebble/watchdatareader.cpp \
     libpebble/watchdatawriter.cpp \
     libpebble/devconnection.cpp \
+    libpebble/logbuffer.cpp \
     libpebble/musicendpoint.cpp \
     libpebble/phonecallendpoint.cpp \
     libpebble/musicmetadata.cpp \
@@ -30,14 +31,17 @@ SOURCES += main.cpp \
     libpebble/timelinesync.cpp \
     libpebble/appmetadata.cpp \
     libpebble/appdownloader.cpp \
+    libpebble/filedownload.cpp \
     libpebble/screenshotendpoint.cpp \
     libpebble/firmwaredownloader.cpp \
     libpebble/bundle.cpp \
     libpebble/watchlogendpoint.cpp \
     libpebble/ziphelper.cpp \
+    libpebble/zipreader.cpp \
     libpebble/healthparams.cpp \
     libpebble/dataloggingendpoint.cpp \
     libpebble/voiceendpoint.cpp \
+    libpebble/voicestream.cpp \
     libpebble/jskit/jskitmanager.cpp \
     libpebble/jskit/jskitconsole.cpp \
     libpebble/jskit/jskitgeolocation.cpp \
@@ -52,6 +56,11 @@ SOURCES += main.cpp \
     libpebble/appmanager.cpp \
     libpebble/appmsgmanager.cpp \
     libpebble/uploadmanager.cpp \
+    libpebble/metrics.cpp \
+    libpebble/settingsstore.cpp \
+    libpebble/timerwheel.cpp \
+    libpebble/positionservice.cpp \
+    libpebble/tracerecorder.cpp \
     libpebble/weatherapp.cpp \
     libpebble/webweatherprovider.cpp \
     libpebble/weatherprovidertwc.cpp \
@@ -75,7 +84,9 @@ SOURCES += main.cpp \
     platformintegration/sailfish/notificationmonitor.cpp \
     platformintegration/sailfish/notifications.cpp \
     platformintegration/sailfish/modecontrolentity.cpp \
-    platformintegration/sailfish/walltimemonitor.cpp
+    platformintegration/sailfish/walltimemonitor.cpp \
+    platformintegration/sailfish/notificationclassifier.cpp \
+    platformintegration/sailfish/notificationindex.cpp
 
 HEADERS += \
     libpebble/watchconnection.h \
@@ -83,6 +94,7 @@ HEADERS += \
     libpebble/watchdatareader.h \
     libpebble/watchdatawriter.h \
     libpebble/devconnection.h \
+    libpebble/logbuffer.h \
     libpebble/musicendpoint.h \
     libpebble/musicmetadata.h \
     libpebble/phonecallendpoint.h \
@@ -93,15 +105,19 @@ HEADERS += \
     libpebble/timelinemanager.h \
     libpebble/appmetadata.h \
     libpebble/appdownloader.h \
+    libpebble/filedownload.h \
     libpebble/enums.h \
     libpebble/screenshotendpoint.h \
     libpebble/firmwaredownloader.h \
     libpebble/bundle.h \
     libpebble/watchlogendpoint.h \
     libpebble/ziphelper.h \
+    libpebble/zipreader.h \
     libpebble/healthparams.h \
     libpebble/dataloggingendpoint.h \
     libpebble/voiceendpoint.h \
+    libpebble/voicestream.h \
+    libpebble/threadcall.h \
     libpebble/jskit/jskitmanager.h \
     libpebble/jskit/jskitconsole.h \
     libpebble/jskit/jskitgeolocation.h \
@@ -116,6 +132,11 @@ HEADERS += \
     libpebble/appmanager.h \
     libpebble/appmsgmanager.h \
     libpebble/uploadmanager.h \
+    libpebble/metrics.h \
+    libpebble/settingsstore.h \
+    libpebble/timerwheel.h \
+    libpebble/positionservice.h \
+    libpebble/tracerecorder.h \
     libpebble/weatherapp.h \
     libpebble/webweatherprovider.h \
     libpebble/weatherprovidertwc.h \
@@ -141,7 +162,9 @@ HEADERS += \
     platformintegration/sailfish/modecontrolentity.h \
     platformintegration/sailfish/nokia-mce-dbus-names.h \
     platformintegration/sailfish/walltimemonitor.h \
-    platformintegration/sailfish/notificationmonitor_p.h
+    platformintegration/sailfish/notificationmonitor_p.h \
+    platformintegration/sailfish/notificationclassifier.h \
+    platformintegration/sailfish/notificationindex.h
 
 testing: {
     SOURCES += platformintegration/testing/testingplatform.cpp
@@ -162,7 +185,7 @@ privilege.path = /usr/share/mapplauncherd/privileges.d/
 SHARED_DATA_PATH = /usr/share/$$replace(TARGET,d,)
 #fetch from https://github.com/pebble/pypkjs/blob/master/pypkjs/timeline/layouts.json
 # or better extract from latest firmware blob (pbz)
-JSON_FILES = libpebble/layouts.json
+JSON_FILES = libpebble/layouts.json platformintegration/sailfish/notificationrules.json
 layout.files = $${JSON_FILES}
 layout.path = $${SHARED_DATA_PATH}
 
@@ -15,6 +15,7 @@ Requires:   systemd-user-session-targets
 Requires:   nemo-qml-plugin-dbus-qt5
 Requires:   qt5-qtwebsockets
 Requires:   quazip
+Requires:   speex
 BuildRequires:  pkgconfig(Qt5DBus)
 BuildRequires:  pkgconfig(Qt5Bluetooth)
 BuildRequires:  pkgconfig(Qt5Contacts)
@@ -32,6 +33,7 @@ BuildRequires:  pkgconfig(mlite5)
 BuildRequires:  pkgconfig(sailfishapp) >= 0.0.10
 BuildRequires:  pkgconfig(icu-i18n)
 BuildRequires:  pkgconfig(zlib)
+BuildRequires:  pkgconfig(speex)
 BuildRequires:  pkgconfig(libmkcal-qt5)
 BuildRequires:  pkgconfig(libkcalcoren-qt5)
 BuildRequires:  quazip-devel
@@ -75,6 +77,7 @@ update-desktop-database
 %{_bindir}/rockpoold
 %{_datadir}/%{name}/qml
 %{_datadir}/%{name}/layouts.json
+%{_datadir}/%{name}/notificationrules.json
 %{_datadir}/%{name}/translations
 %{_datadir}/applications/%{name}.desktop
 %{_datadir}/icons/hicolor/86x86/apps/%{name}.png